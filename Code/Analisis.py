@@ -3,6 +3,7 @@ import copy
 import os
 
 from Code import AnalisisIndexes
+from Code import AnalisisScheduler
 from Code import BMT
 from Code import Jugada
 from Code import Partida
@@ -24,7 +25,6 @@ class AnalizaPartida:
         conf_engine = copy.deepcopy(self.configuracion.buscaMotor(alm.motor))
         if alm.multiPV:
             conf_engine.actMultiPV(alm.multiPV)
-        self.xgestor = procesador.creaGestorMotor(conf_engine, alm.tiempo, alm.depth, True, priority=alm.priority)
         self.tiempo = alm.tiempo
         self.depth = alm.depth
         self.siVariantes = (not is_massiv) and alm.masvariantes
@@ -34,6 +34,15 @@ class AnalizaPartida:
         self.st_depths = alm.st_depths
         self.st_timelimit = alm.st_timelimit
 
+        # Las jugadas se reparten entre alm.engines motores
+        self.scheduler = AnalisisScheduler.AnalisisScheduler(procesador, conf_engine, alm.engines, alm.hash_engine,
+                                                             alm.threads_engine, alm.tiempo, alm.depth, alm.priority,
+                                                             brDepth=alm.dpbrilliancies, brPuntos=alm.ptbrilliancies,
+                                                             stability=alm.stability,
+                                                             st_centipawns=alm.st_centipawns,
+                                                             st_depths=alm.st_depths,
+                                                             st_timelimit=alm.st_timelimit)
+
         # Asignacion de variables para blunders:
         # kblunders: puntos de perdida para considerar un blunder
         # tacticblunders: folder donde guardar tactic
@@ -121,7 +130,7 @@ class AnalizaPartida:
         Proceso final, para cerrar el motor que hemos usado
         @param siBMT: si hay que grabar el registro de BMT
         """
-        self.xgestor.terminar()
+        self.scheduler.terminar()
         if siBMT:
             self.terminarBMT(self.bmt_listaBlunders, self.bmtblunders)
             self.terminarBMT(self.bmt_listaBrilliancies, self.bmtbrilliancies)
@@ -319,12 +328,6 @@ FILESW=%s:100
         siBP2 = hasattr(tmpBP, "bp2")   # Para diferenciar el analisis de una partida que usa una progressbar unica del
                                         # analisis de muchas, que usa doble
 
-        def guiDispatch(rm):
-            return not tmpBP.siCancelado()
-
-        self.xgestor.ponGuiDispatch(guiDispatch)    # Dispatch del motor, si esta puesto a 4 minutos por ejemplo que
-                                                    # compruebe si se ha indicado que se cancele.
-
         siBlunders = self.kblunders > 0
         siBrilliancies = self.fnsbrilliancies or self.pgnbrilliancies or self.bmtbrilliancies
 
@@ -385,7 +388,6 @@ FILESW=%s:100
             for pos, njg in enumerate(liJugadas):
 
                 if tmpBP.siCancelado():
-                    self.xgestor.quitaGuiDispatch()
                     return
 
                 # # Si esta en el libro
@@ -409,10 +411,19 @@ FILESW=%s:100
         else:
             tmpBP.ponTotal(nJugadas)
 
+        # Las jugadas que necesitan el motor, se analizan en paralelo y los resultados llegan en este mismo orden
+        liAnalizar = []
+        for njg in liJugadas:
+            jg = partida.jugada(njg)
+            if not (xblancas if jg.posicionBase.siBlancas else xnegras):
+                continue
+            if self.siBorrarPrevio or jg.analisis is None:
+                liAnalizar.append(njg)
+        resultados = self.scheduler.analiza(partida, liAnalizar, tmpBP.siCancelado)
+
         for npos, njg in enumerate(liJugadas):
 
             if tmpBP.siCancelado():
-                self.xgestor.quitaGuiDispatch()
                 return
 
             jg = partida.jugada(njg)
@@ -425,7 +436,6 @@ FILESW=%s:100
                 self.rutDispatchBP(npos, nJugadas, njg)
 
             if tmpBP.siCancelado():
-                self.xgestor.quitaGuiDispatch()
                 return
 
                 # # Fin de partida
@@ -447,14 +457,8 @@ FILESW=%s:100
 
             # -# Procesamos
             if jg.analisis is None:
-                resp = self.xgestor.analizaJugadaPartida(partida, njg, self.tiempo, depth=self.depth,
-                                                         brDepth=self.dpbrilliancies, brPuntos=self.ptbrilliancies,
-                                                         stability=self.stability,
-                                                         st_centipawns=self.st_centipawns,
-                                                         st_depths=self.st_depths,
-                                                         st_timelimit=self.st_timelimit)
+                njg_resp, resp = next(resultados, (None, None))
                 if not resp:
-                    self.xgestor.quitaGuiDispatch()
                     return
 
                 jg.analisis = resp
@@ -520,8 +524,6 @@ FILESW=%s:100
             f.write("\n%s\n\n" % textoOriginal)
             f.close()
 
-        self.xgestor.quitaGuiDispatch()
-
 
 class UnaMuestra:
     def __init__(self, mAnalisis, mrm, posElegida, numero, xmotor):
@@ -0,0 +1,101 @@
+import LCEngine4 as LCEngine
+
+from Code import VarGen
+from Code import XMotorRespuesta
+
+
+class AnalisisCache:
+    """
+    Analisis guardados en disco entre sesiones, por clave polyglot de la posicion y motor (con su multipv y opciones),
+    se reutilizan si llegaron al menos a la misma profundidad, o al mismo tiempo si se analiza por tiempo.
+    Se guardan las lineas finales de cada multipv y, con multipv 0, las lineas previas de la mejor jugada
+    (una por profundidad) que necesita miraBrilliancies.
+    """
+    def __init__(self, fichero):
+        self.fichero = fichero
+        self.cache = None
+        self.siError = False
+
+    def abre(self):
+        if self.cache is None and not self.siError:
+            try:
+                self.cache = LCEngine.AnalysisCache(self.fichero)
+            except IOError:
+                self.siError = True
+        return self.cache
+
+    def cerrar(self):
+        if self.cache is not None:
+            self.cache.close()
+            self.cache = None
+
+    def motor(self, confMotor, nMultiPV):
+        # Hash y Threads no cambian el analisis lo suficiente como para no aprovecharlo
+        li = ["%s=%s" % (comando, valor) for comando, valor in confMotor.liUCI
+              if comando not in ("Hash", "Threads", "MultiPV")]
+        return LCEngine.engineId("%s %s %d %s" % (confMotor.clave, confMotor.version, nMultiPV, " ".join(li)))
+
+    def busca(self, fen, motor, nombre, tiempo, depth):
+        cache = self.abre()
+        if cache is None:
+            return None
+        if depth:
+            li = cache.get(LCEngine.polyglotKey(fen), motor, depth, 0)
+        else:
+            li = cache.get(LCEngine.polyglotKey(fen), motor, 0, tiempo or 0)
+        if not li:
+            return None
+        mrm = XMotorRespuesta.MRespuestaMotor(nombre, " w " in fen)
+        for dClaves in li:
+            if dClaves.get("multipv") == "0":
+                mrm.lines.append("info depth %s score %s pv %s" % (dClaves["depth"], dClaves["score"], dClaves["pv"]))
+            else:
+                mrm.dispatch_info(dClaves)
+        mrm.ordena()
+        return mrm
+
+    def guarda(self, fen, motor, mrm, tiempo):
+        cache = self.abre()
+        if cache is None or not mrm.liMultiPV or mrm.liMultiPV[0].sinMovimientos:
+            return
+        li = []
+        for n, rm in enumerate(mrm.liMultiPV):
+            if not rm.pv or rm.pv == "a1a1":
+                continue
+            dClaves = {"multipv": str(n + 1), "depth": str(rm.depth),
+                       "score": "mate %d" % rm.mate if rm.mate else "cp %d" % rm.puntos,
+                       "time": str(max(rm.time, tiempo or 0)),  # con movetime la ultima info llega antes del tiempo pedido
+                       "pv": rm.pv}
+            if rm.seldepth:
+                dClaves["seldepth"] = str(rm.seldepth)
+            if rm.nodes:
+                dClaves["nodes"] = str(rm.nodes)
+            if rm.nps:
+                dClaves["nps"] = str(rm.nps)
+            li.append(dClaves)
+        if li and mrm.lines:
+            busca = "pv " + mrm.liMultiPV[0].movimiento() + " "
+            setDepths = set()
+            for linea in mrm.lines:
+                if len(li) >= 64:
+                    break
+                if busca in linea:
+                    dClaves = mrm.miraClaves(linea, XMotorRespuesta.st_uci_claves)
+                    if "depth" in dClaves and "score" in dClaves and dClaves["depth"] not in setDepths:
+                        setDepths.add(dClaves["depth"])
+                        li.append({"multipv": "0", "depth": dClaves["depth"], "score": dClaves["score"],
+                                   "pv": dClaves["pv"]})
+        if li:
+            cache.put(LCEngine.polyglotKey(fen), motor, li)
+
+
+def cache():
+    """
+    AnalisisCache del usuario actual
+    """
+    fichero = VarGen.configuracion.ficheroAnalysisCache
+    if VarGen.analisisCache is None or VarGen.analisisCache.fichero != fichero:
+        if VarGen.analisisCache:
+            VarGen.analisisCache.cerrar()
+        VarGen.analisisCache = AnalisisCache(fichero)
+    return VarGen.analisisCache
@@ -0,0 +1,182 @@
+import copy
+
+from PyQt4 import QtCore
+
+from Code import AnalisisCache
+from Code import XGestorMotor
+
+
+class CacheAnalisis:
+    """
+    Analisis ya hechos de cada posicion (fenM2), se reutilizan si llegaron al menos a la misma profundidad,
+    o al mismo tiempo si se analiza por tiempo.
+    Los que no estan en esta sesion se buscan en la cache de disco, donde se guardan todos.
+    """
+    def __init__(self, xgestor):
+        self.dic = {}
+        self.disco = AnalisisCache.cache()
+        self.motor = self.disco.motor(xgestor.confMotor, xgestor.nMultiPV)
+        self.nombre = xgestor.nombre
+
+    def clave(self, posicion):
+        return posicion.fenM2()
+
+    def busca(self, posicion, tiempo, depth):
+        reg = self.dic.get(self.clave(posicion))
+        if reg:
+            r_depth, r_time, mrm = reg
+            siVale = r_depth >= depth if depth else r_time >= tiempo
+            if siVale:
+                return copy.deepcopy(mrm)  # agregaRM y cambiaColor modifican el mrm
+        # la de disco puede ser mas profunda que la de esta sesion
+        return self.disco.busca(posicion.fen(), self.motor, self.nombre, tiempo, depth)
+
+    def guarda(self, posicion, mrm, tiempo):
+        depth = mrm.getdepth0()
+        tm = max(mrm.getTime(), tiempo)  # con movetime la ultima info llega antes del tiempo pedido
+        reg = self.dic.get(self.clave(posicion))
+        if reg and (reg[0] > depth or (reg[0] == depth and reg[1] >= tm)):
+            return
+        self.dic[self.clave(posicion)] = (depth, tm, copy.deepcopy(mrm))
+        self.disco.guarda(posicion.fen(), self.motor, mrm, tiempo)
+
+    def __len__(self):
+        return len(self.dic)
+
+
+class TrabajoJugada:
+    """
+    Analisis de una jugada de la partida: la posicion anterior a la jugada y, si la jugada no aparece entre las
+    que considera el motor, la posicion que se alcanza.
+    """
+    def __init__(self, partida, njg):
+        self.partida = partida
+        self.njg = njg
+        self.mrm = None
+        self.resp = None
+        self.terminado = False
+
+
+class AnalisisScheduler:
+    """
+    Reparte el analisis de las jugadas entre varios motores, cada uno con su hash y threads,
+    tomando los trabajos de una cola comun; los resultados se devuelven en el orden pedido.
+    Las posiciones ya analizadas a igual o mayor profundidad no se vuelven a analizar.
+    """
+    def __init__(self, procesador, conf_engine, num_engines, hash_mb, threads, tiempo, depth, priority,
+                 brDepth=5, brPuntos=50, stability=False, st_centipawns=0, st_depths=0, st_timelimit=0):
+        self.tiempo = tiempo
+        self.depth = depth
+        self.brDepth = brDepth
+        self.brPuntos = brPuntos
+        self.stability = (tiempo, depth, st_centipawns, st_depths, st_timelimit) if stability else None
+
+        conf_engine = copy.deepcopy(conf_engine)
+        if hash_mb:
+            conf_engine.removeUCI("Hash")
+            conf_engine.ordenUCI("Hash", str(hash_mb))
+        if threads:
+            conf_engine.removeUCI("Threads")
+            conf_engine.ordenUCI("Threads", str(threads))
+
+        self.liGestores = []
+        for x in range(max(num_engines, 1)):
+            xgestor = XGestorMotor.GestorMotor(procesador, copy.deepcopy(conf_engine))
+            xgestor.opciones(tiempo, depth, True)
+            xgestor.setPriority(priority)
+            self.liGestores.append(xgestor)
+
+        self.cache = CacheAnalisis(self.liGestores[0])
+
+    def analiza(self, partida, liJugadas, siCancelado):
+        """
+        Generador de (njg, (mrm, pos)) en el orden de liJugadas, termina antes si siCancelado()
+        """
+        cola = [TrabajoJugada(partida, njg) for njg in liJugadas]
+        pendientes = list(cola)
+        pendientes.reverse()
+        activos = {}  # xgestor -> trabajo
+        sig = 0
+
+        while sig < len(cola):
+            QtCore.QCoreApplication.processEvents(QtCore.QEventLoop.ExcludeUserInputEvents)
+            if siCancelado():
+                self.para(activos)
+                return
+
+            # Trabajos nuevos a los motores libres, los que estan en la cache no necesitan motor
+            for xgestor in self.liGestores:
+                while xgestor not in activos and pendientes:
+                    trabajo = pendientes.pop()
+                    if not self.desdeCache(xgestor, trabajo):
+                        self.inicia(xgestor, trabajo)
+                        activos[xgestor] = trabajo
+
+            # Los resultados en orden
+            while sig < len(cola) and cola[sig].terminado:
+                trabajo = cola[sig]
+                cola[sig] = None
+                sig += 1
+                yield trabajo.njg, trabajo.resp
+            if sig == len(cola):
+                break
+
+            siTerminado = False
+            for xgestor, trabajo in activos.items():
+                mrm = xgestor.motor.go_poll()
+                if mrm is not None:
+                    del activos[xgestor]
+                    siTerminado = True
+                    self.termina(xgestor, trabajo, mrm)
+                    if not trabajo.terminado:
+                        activos[xgestor] = trabajo
+            if activos and not siTerminado:
+                activos.keys()[0].motor.engine.wait(90)  # con el driver nativo espera a cualquiera de los motores
+
+    def desdeCache(self, xgestor, trabajo):
+        jg = trabajo.partida.jugada(trabajo.njg)
+        mrm = self.cache.busca(jg.posicionBase, self.tiempo, self.depth)
+        if mrm is None:
+            return False
+        trabajo.mrm = mrm
+        trabajo.resp = xgestor.miraJugadaPartida(trabajo.partida, trabajo.njg, mrm, self.brDepth, self.brPuntos)
+        if trabajo.resp is None:
+            mrm1 = self.cache.busca(jg.posicion, self.tiempo, self.depth)
+            if mrm1 is None:
+                return False
+            trabajo.resp = xgestor.agregaJugadaPartida(trabajo.partida, trabajo.njg, mrm, mrm1)
+        trabajo.terminado = True
+        return True
+
+    def inicia(self, xgestor, trabajo):
+        xgestor.testEngine()
+        if trabajo.mrm is None:
+            xgestor.motor.go_game_jg(trabajo.partida, trabajo.njg, self.tiempo, self.depth, True, self.stability)
+        else:
+            jg = trabajo.partida.jugada(trabajo.njg)
+            xgestor.motor.go_fen(jg.posicion.fen(), self.tiempo, self.depth)
+
+    def termina(self, xgestor, trabajo, mrm):
+        jg = trabajo.partida.jugada(trabajo.njg)
+        if trabajo.mrm is None:
+            self.cache.guarda(jg.posicionBase, mrm, self.tiempo)
+            trabajo.mrm = mrm
+            trabajo.resp = xgestor.miraJugadaPartida(trabajo.partida, trabajo.njg, mrm, self.brDepth, self.brPuntos)
+            if trabajo.resp is None:
+                mrm1 = self.cache.busca(jg.posicion, self.tiempo, self.depth)
+                if mrm1 is None:
+                    self.inicia(xgestor, trabajo)
+                    return
+                trabajo.resp = xgestor.agregaJugadaPartida(trabajo.partida, trabajo.njg, trabajo.mrm, mrm1)
+        else:
+            self.cache.guarda(jg.posicion, mrm, self.tiempo)
+            trabajo.resp = xgestor.agregaJugadaPartida(trabajo.partida, trabajo.njg, trabajo.mrm, mrm)
+        trabajo.terminado = True
+
+    def para(self, activos):
+        for xgestor in activos:
+            xgestor.motor.put_line("stop")
+
+    def terminar(self):
+        for xgestor in self.liGestores:
+            xgestor.terminar()
@@ -313,6 +313,7 @@ class Configuracion:
         self.ficheroEntAperturasPar = "%s/entaperturaspar.pkd" % self.carpeta
         self.ficheroPersAperturas = "%s/persaperturas.pkd" % self.carpeta
         self.ficheroAnalisis = "%s/paranalisis.pkd" % self.carpeta
+        self.ficheroAnalysisCache = "%s/analysis" % self.carpeta  # .dat + .idx
         self.ficheroDailyTest = "%s/nivel.pkd" % self.carpeta
         self.ficheroTemas = "%s/themes.pkd" % self.carpeta
         self.dirPersonalTraining = "%s/Personal Training" % self.carpeta
@@ -1,4 +1,5 @@
 import atexit
+import multiprocessing
 import os
 import sqlite3
 import time
@@ -15,7 +16,14 @@ posA1 = LCEngine.posA1
 a1Pos = LCEngine.a1Pos
 pv2xpv = LCEngine.pv2xpv
 xpv2pv = LCEngine.xpv2pv
+xpv2pvList = LCEngine.xpv2pvList
 xpv2pgn = LCEngine.xpv2pgn
+pv2mvx = LCEngine.pv2mvx
+mvx2pv = LCEngine.mvx2pv
+mvx2xpv = LCEngine.mvx2xpv
+mvx2pvList = LCEngine.mvx2pvList
+mvx2xpvList = LCEngine.mvx2xpvList
+xpv2mvxList = LCEngine.xpv2mvxList
 PGNreader = LCEngine.PGNreader
 setFen = LCEngine.setFen
 makeMove = LCEngine.makeMove
@@ -38,299 +46,111 @@ drots["PLIES"] = "PlyCount"
 
 
 class TreeSTAT:
+    # W/B/D/O of each (position, move) of the games, in memory (LCEngine.StatsMap), saved in a compact binary file.
+    # The positions are zobrist keys, the transpositions are added together.
+    # The changes of single games stay in memory, the file is rewritten at the end of a batch (commit) or when closing.
     def __init__(self, nomFichero, depth=None):
         self.nomFichero = nomFichero
         self.defaultDepth = 30
-        self.iniFen = ControlPosicion.FEN_INICIAL
-        self.hiniFen = self._fen2hash(self.iniFen)
-        self._conexion = sqlite3.connect(self.nomFichero)
-
-        self.depth, self.riniFen = self.checkTable(depth)
-
-        self.fsum = self._sum  # called method needed to massive append
-
-        atexit.register(self.close)
-
-    def checkTable(self, depth):
-        cursor = self._conexion.cursor()
-        cursor.execute("pragma table_info(STATS)")
-        if not cursor.fetchall():
-            cursor.execute("PRAGMA page_size = 4096")
-            cursor.execute("PRAGMA synchronous = NORMAL")
-            if depth is None:
-                depth = self.defaultDepth
-            sql = "CREATE TABLE STATS( HASHFEN INT, W INT, B INT, D INT, O INT, RFATHER INT, XMOVE INT );"
-            cursor.execute(sql)
-            sql = "CREATE INDEX HASHFEN ON STATS( HASHFEN );"
-            cursor.execute(sql)
-            sql = "INSERT INTO STATS( HASHFEN, W, B, D, O, RFATHER, XMOVE ) VALUES( ?, ?, ?, ?, ?, ?, ? );"
-            cursor.execute(sql, (self.hiniFen, 0, 0, 0, 0, 0, 0))
-            riniFen = cursor.lastrowid
-
-            sql = "CREATE TABLE CONFIG( KEY TEXT PRIMARY KEY, VALUE TEXT );"
-            cursor.execute(sql)
-            sql = "INSERT INTO CONFIG( KEY, VALUE ) VALUES( ?, ? );"
-            cursor.execute(sql, ("DEPTH", str(depth)))
-
-            self._conexion.commit()
-        else:
-            sql = "SELECT VALUE FROM CONFIG WHERE KEY= ?"
-            cursor.execute(sql, ("DEPTH",))
-            raw = cursor.fetchone()
-            depth = int(raw[0])
-            sql = "SELECT ROWID FROM STATS WHERE HASHFEN = ?"
-            cursor.execute(sql, (self.hiniFen,))
-            raw = cursor.fetchone()
-            riniFen = raw[0]
-
+        self.stats = LCEngine.StatsMap()
+        self.siDirty = False
+        self.depth = self.load(depth)
+
+    def load(self, depth):
+        if Util.existeFichero(self.nomFichero):
+            fdepth = self.stats.load(self.nomFichero)
+            if fdepth >= 0:
+                return fdepth
+            self.stats.clear()
+            with open(self.nomFichero, "rb") as f:
+                siSQLite = f.read(16) == "SQLite format 3\x00"
+            if siSQLite:
+                return self.convertSQLite()
+        if depth is None:
+            depth = self.defaultDepth
+        self.depth = depth
+        self.siDirty = True
+        self.commit()
+        return depth
+
+    def convertSQLite(self):
+        # Old format: a sqlite tree with a row for each (path, move), the moves are replayed from the parent
+        conexion = sqlite3.connect(self.nomFichero)
+        cursor = conexion.cursor()
+        cursor.execute("SELECT VALUE FROM CONFIG WHERE KEY= ?", ("DEPTH",))
+        raw = cursor.fetchone()
+        depth = int(raw[0]) if raw else self.defaultDepth
+        dicFens = {}
+        cursor.execute("SELECT ROWID, W, B, D, O, RFATHER, XMOVE FROM STATS ORDER BY ROWID")
+        for rowid, w, b, d, o, rfather, xmove in cursor:
+            if not rfather:
+                dicFens[rowid] = ControlPosicion.FEN_INICIAL
+                continue
+            fen = dicFens.get(rfather)
+            if fen is None:
+                continue
+            move = num2move(xmove)
+            self.stats.add_fen_move(fen, move, w, b, d, o)
+            setFen(fen)
+            if makeMove(move):
+                dicFens[rowid] = getFen()
         cursor.close()
-        return depth, riniFen
+        conexion.close()
+        self.depth = depth
+        self.siDirty = True
+        self.commit()
+        return depth
 
     def close(self):
-        if self._conexion:
-            self._conexion.close()
-            self._conexion = None
+        self.commit()
+        self.stats.clear()
 
     def reset(self, depth=None):
-        self.close()
         Util.borraFichero(self.nomFichero)
-        self._conexion = sqlite3.connect(self.nomFichero)
-        self.depth, self.riniFen = self.checkTable(depth)
-
-    def _readRow(self, hfen, rfather, xmove):
-        sql = "SELECT ROWID, W, B, D, O, RFATHER, XMOVE FROM STATS WHERE HASHFEN = ?"
-        cursor = self._conexion.cursor()
-        cursor.execute(sql, (hfen,))
-        liRows = cursor.fetchall()
-        if liRows:
-            for row in liRows:
-                RFATHER = row[5]
-                if rfather == RFATHER:
-                    alm = Util.Almacen()
-                    alm.ROWID = row[0]
-                    alm.W = row[1]
-                    alm.B = row[2]
-                    alm.D = row[3]
-                    alm.O = row[4]
-                    alm.RFATHER = RFATHER
-                    alm.XMOVE = row[6]
-                    return alm
-
-        alm = Util.Almacen()
-        alm.ROWID = None
-        alm.W = 0
-        alm.B = 0
-        alm.D = 0
-        alm.O = 0
-        alm.RFATHER = rfather
-        alm.XMOVE = xmove
-        return alm
-
-    def _readRowExt(self, rfather, hashFen, fen):
-        sql = "SELECT ROWID, W, B, D, O, RFATHER, XMOVE FROM STATS WHERE HASHFEN = ?"
-        cursor = self._conexion.cursor()
-        cursor.execute(sql, (hashFen,))
-        liRows = cursor.fetchall()
-        basefenM2 = fen2fenM2(fen)
-
-        def history(xmove, rfather):
-            li = [xmove,]
-            sql = "SELECT RFATHER, XMOVE FROM STATS WHERE ROWID = ?"
-            while rfather != self.riniFen:
-                cursor.execute(sql, (rfather,))
-                resp = cursor.fetchone()
-                if resp is None:
-                    break
-                rfather, xmove = resp
-                li.insert(0, xmove)
-            li = [num2move(x) for x in li]
-            pv = " ".join(li)
-            setFen(self.iniFen)
-            makePV(pv)
-            fenM2 = fen2fenM2(getFen())
-            return pv, fenM2
-
-        liAlms = []
-        alm_base = None
-        tW = tB = tD = tO = 0
-        if liRows:
-            li = []
-            for row in liRows:
-                alm = Util.Almacen()
-                alm.ROWID, alm.W, alm.B, alm.D, alm.O, alm.RFATHER, alm.XMOVE = row
-                alm.PV, alm.FENM2 = history(alm.XMOVE, alm.RFATHER)
-                if alm.RFATHER == rfather:
-                    alm_base = alm
-                li.append(alm)
-            for alm in li:
-                if alm.FENM2 == basefenM2:
-                    liAlms.append(alm)
-                    tW += alm.W
-                    tB += alm.B
-                    tD += alm.D
-                    tO += alm.O
-        alm = Util.Almacen()
-        alm.W = tW
-        alm.B = tB
-        alm.D = tD
-        alm.O = tO
-        alm.BASE = alm_base
-        alm.LIALMS = liAlms
-        cursor.close()
-        return alm
-
-    def _writeRow(self, hashFen, alm):
-        rowid = alm.ROWID
-        cursor = self._conexion.cursor()
-        if rowid is None:
-            sql = "INSERT INTO STATS( HASHFEN, W, B, D, O, RFATHER, XMOVE ) VALUES( ?, ?, ?, ?, ?, ?, ? )"
-            cursor.execute(sql, (hashFen, alm.W, alm.B, alm.D, alm.O, alm.RFATHER, alm.XMOVE))
-            rowid = cursor.lastrowid
-        else:
-            sql = "UPDATE STATS SET W=?, B=?, D=?, O=? WHERE ROWID=?"
-            cursor.execute(sql, (alm.W, alm.B, alm.D, alm.O, rowid))
-        cursor.close()
-        return rowid
+        self.stats.clear()
+        self.depth = self.defaultDepth if depth is None else depth
+        self.siDirty = True
+        self.commit()
 
     def commit(self):
-        self._conexion.commit()
-
-    def _fen2hash(self, fen):
-        return hash(fen2fenM2(fen))
-
-    def _sum(self, hfen, rfather, xmove, w, b, d, o, tdepth ):
-        alm = self._readRow(hfen, rfather, xmove)
-        if w:
-            alm.W += w
-        elif b:
-            alm.B += b
-        elif d:
-            alm.D += d
-        else:
-            alm.O += o
-        return self._writeRow(hfen, alm)
+        if self.siDirty:
+            self.stats.save(self.nomFichero, self.depth)
+            self.siDirty = False
 
     def append(self, pv, result, r=+1, siCommit=False):
-        w = b = d = o = 0
-        if result == "1-0":
-            w += r
-        elif result == "0-1":
-            b += r
-        elif result == "1/2-1/2":
-            d += r
-        else:
-            o += r
-
-        self.fsum(self.hiniFen, 0, 0, w, b, d, o, 0)
-        rfather = self.riniFen
-        setFen(self.iniFen)
-        liPV = pv.split(" ")
-        for depth, move in enumerate(liPV):
-            if depth >= self.depth:
-                break
-            if makeMove(move):
-                fen = getFen()
-                hfen = self._fen2hash(fen)
-                rfather = self.fsum(hfen, rfather, move2num(move), w, b, d, o, depth)
-
-    def append_fen(self, pv, result, liFens):
-        w = b = d = o = 0
-        if result == "1-0":
-            w += 1
-        elif result == "0-1":
-            b += 1
-        elif result == "1/2-1/2":
-            d += 1
-        else:
-            o += 1
+        self.stats.add_pv(pv, result, r, self.depth)
+        self.siDirty = True
+        if siCommit:
+            self.commit()
 
-        self.fsum(self.hiniFen, 0, 0, w, b, d, o, 0)
-        rfather = self.riniFen
-        liPV = pv.split(" ")
-        for depth, move in enumerate(liPV):
-            if depth >= self.depth:
-                break
-            hfen = hash(liFens[depth])
-            rfather = self.fsum(hfen, rfather, move2num(move), w, b, d, o, depth)
+    def merge(self, stats):
+        self.stats.merge(stats)
+        self.siDirty = True
 
-    def massive_append_set(self, start):
-        if start:
-            self.massive = {}
-            self.fsum = self.massive_sum
-        else:
-            self.fsum = self._sum
-            for (hfen, rfather), alm in self.massive.iteritems():
-                self._writeRow(hfen, alm)
-            self.massive = {}
-
-    def massive_sum(self, hfen, rfather, xmove, w, b, d, o, tdepth ):
-        if tdepth > 10:
-            return self._sum(hfen, rfather, xmove, w, b, d, o, tdepth )
-
-        alm = self.massive.get((hfen, rfather))
-        if not alm:
-            alm = self._readRow(hfen, rfather, xmove)
-        if w:
+    def root(self):
+        alm = Util.Almacen()
+        alm.W = alm.B = alm.D = alm.O = 0
+        for move, w, b, d, o in self.stats.children(""):
             alm.W += w
-        elif b:
             alm.B += b
-        elif d:
             alm.D += d
-        else:
             alm.O += o
-        if not alm.ROWID:
-            alm.ROWID = self._writeRow(hfen, alm)
-        self.massive[(hfen, rfather)] = alm
-        return alm.ROWID
-
-    def appendColor(self, pv, result, siWhite, r=+1):
-        w = b = d = o = 0
-        if result == "1-0":
-            w += r
-        elif result == "0-1":
-            b += r
-        elif result == "1/2-1/2":
-            d += r
-        else:
-            o += r
-
-        self.fsum(self.hiniFen, 0, 0, w, b, d, o, 0)
-        rfather = self.riniFen
-        setFen(self.iniFen)
-        liPV = pv.split(" ")
-        for depth, move in enumerate(liPV):
-            if depth >= self.depth:
-                break
-            if makeMove(move):
-                fen = getFen()
-                hfen = self._fen2hash(fen)
-                if (depth % 2 == 0 and siWhite) or (depth % 2 == 1 and not siWhite):
-                    rfather = self.fsum(hfen, rfather, move2num(move), w, b, d, o, depth)
-                else:
-                    rfather = self.fsum(hfen, rfather, move2num(move), 0, 0, 0, r, depth)
-
-    def root(self):
-        return self._readRow(self.hiniFen, 0, 0)
+        return alm
 
     def rootGames(self):
         alm = self.root()
         return alm.W + alm.B + alm.D + alm.O
 
     def children(self, pvBase, allmoves=True):
-        fen_base = makePV(pvBase)
-        li = getExMoves()
         liResp = []
-        rfather = self.riniFen
-        for n, mv in enumerate(li):
-            setFen(fen_base)
-            move = mv.movimiento()
-            makeMove(move)
-            fen = getFen()
-            hashFen = self._fen2hash(fen)
-            alm = self._readRowExt(rfather, hashFen, fen)
-            if not allmoves and (alm.W +alm.B+alm.D+alm.O) == 0:
+        for move, w, b, d, o in self.stats.children(pvBase):
+            if not allmoves and (w + b + d + o) == 0:
                 continue
+            alm = Util.Almacen()
+            alm.W, alm.B, alm.D, alm.O = w, b, d, o
             alm.move = move
+            alm.PV = (pvBase + " " + move).strip()
+            alm.LIALMS = [alm]
             liResp.append(alm)
         return liResp
 
@@ -558,6 +378,8 @@ class DBgames:
         self.maxcache = 4000
 
         self.controlInicial()
+        # las bases nuevas guardan las jugadas en mvx (1 caracter por jugada), las anteriores siguen en xpv
+        self.siMVX = self.recuperaConfig("XPV_FORMAT", "xpv") == "mvx"
 
         self.liOrden = []
 
@@ -568,6 +390,8 @@ class DBgames:
 
         self.liRowids = []
 
+        self.posIndex = None
+
         atexit.register(self.close)
 
         self.rowidReader = Util.RowidReader(self.nomFichero, self.tabla)
@@ -583,6 +407,25 @@ class DBgames:
         with Util.DicRaw(self.nomFichero, "config") as dbconf:
             return dbconf.get(clave, default)
 
+    def pv2clave(self, pv):
+        # la columna XPV esta en mvx o en xpv segun la base
+        return pv2mvx(pv) if self.siMVX else pv2xpv(pv)
+
+    def clave2pv(self, clave):
+        return mvx2pv(clave) if self.siMVX else xpv2pv(clave)
+
+    def clave2pvList(self, liClaves):
+        return mvx2pvList(liClaves) if self.siMVX else xpv2pvList(liClaves)
+
+    def clave2xpv(self, clave):
+        return mvx2xpv(clave) if self.siMVX else clave
+
+    def clave2xpvList(self, liClaves):
+        return mvx2xpvList(liClaves) if self.siMVX else liClaves
+
+    def xpv2claveList(self, lixpv):
+        return xpv2mvxList(lixpv) if self.siMVX else lixpv
+
     def guardaOrden(self):
         self.guardaConfig("LIORDEN", self.liOrden)
 
@@ -643,6 +486,7 @@ class DBgames:
         self._cursor.execute(sql % rowid, regOther)
         self._cursor.execute(sql % rowidOther, reg)
         self._conexion.commit()
+        self.borraPosIndex()
 
         self.addcache(rowid, regOther)
         self.addcache(rowidOther, reg)
@@ -671,12 +515,12 @@ class DBgames:
             if pv:
                 li = []
                 for unpv in pv:
-                    xpv = pv2xpv(unpv)
-                    li.append('XPV GLOB "%s*"' % xpv)
+                    clave = self.pv2clave(unpv)
+                    li.append('XPV GLOB "%s*"' % clave)
                 condicion = "(%s)" % (" OR ".join(li),)
         elif pv:
-            xpv = pv2xpv(pv)
-            condicion = 'XPV GLOB "%s*"' % xpv if xpv else ""
+            clave = self.pv2clave(pv)
+            condicion = 'XPV GLOB "%s*"' % clave if clave else ""
         if condicionAdicional:
             if condicion:
                 condicion += " AND (%s)" % condicionAdicional
@@ -687,6 +531,119 @@ class DBgames:
         self.liRowids = []
         self.rowidReader.run(self.liRowids, condicion, self.order)
 
+    def ficheroPosIndex(self):
+        return self.nomFichero + "_pix"
+
+    def abrePosIndex(self):
+        """
+        Indice de las partidas que llegan a cada posicion y material, se crea la primera vez que se necesita,
+        y se pone al dia con las partidas que se han ido grabando (rowids mayores que los del indice).
+        """
+        if self.posIndex is None:
+            try:
+                self.posIndex = LCEngine.PositionIndex(self.ficheroPosIndex())
+            except IOError:
+                pass
+        self._cursor.execute("SELECT MAX(ROWID) FROM %s" % self.tabla)
+        maxRowid = self._cursor.fetchone()[0] or 0
+        if self.posIndex is None or maxRowid > self.posIndex.maxrowid():
+            self.actualizaPosIndex(True)
+            try:
+                self.posIndex = LCEngine.PositionIndex(self.ficheroPosIndex())
+            except IOError:
+                return None
+        return self.posIndex
+
+    def cierraPosIndex(self):
+        if self.posIndex is not None:
+            self.posIndex.close()
+            self.posIndex = None
+
+    def actualizaPosIndex(self, siCrear=False):
+        fich = self.ficheroPosIndex()
+        if not siCrear and not Util.existeFichero(fich + ".idx"):
+            return
+        self.cierraPosIndex()
+        builder = LCEngine.PositionIndexBuilder(fich, self.recuperaConfig("POSINDEX_PLY", 40), True, self.siMVX)
+        cursor = self._conexion.cursor()
+        cursor.execute("SELECT ROWID, XPV FROM %s WHERE ROWID > %d" % (self.tabla, builder.maxrowid()))
+        while True:
+            li = cursor.fetchmany(5000)
+            if not li:
+                break
+            builder.addList(li)
+        cursor.close()
+        builder.finish()
+
+    def borraPosIndex(self):
+        # las partidas cambian de movimientos sin cambiar de rowid, hay que rehacerlo
+        self.cierraPosIndex()
+        Util.borraFichero(self.ficheroPosIndex() + ".idx")
+        Util.borraFichero(self.ficheroPosIndex() + ".dat")
+
+    def maxPlyPosIndex(self):
+        # las posiciones de mas medias jugadas no estan en el indice
+        return self.posIndex.maxply() if self.posIndex is not None else self.recuperaConfig("POSINDEX_PLY", 40)
+
+    def filterPosition(self, fen, siMaterial=False, condicionAdicional=None):
+        """
+        Partidas que pasan por la posicion de fen (transposiciones incluidas, hasta la jugada POSINDEX_PLY),
+        o por el material de fen en cualquier momento de la partida.
+        """
+        posIndex = self.abrePosIndex()
+        if posIndex is None:
+            return False
+        liRowids = posIndex.material(fen) if siMaterial else posIndex.positions(fen)
+        self.filterRowids(liRowids, condicionAdicional)
+        return True
+
+    def filterQuery(self, expr, minPlies=1, condicionAdicional=None, dispatch=None):
+        """
+        Partidas que llegan a una posicion donde se cumple expr (LCEngine.GameQuery, ValueError si no es valida),
+        durante minPlies medias jugadas seguidas. Se revisan en paralelo en LCEngine.
+        dispatch(hechas, total), si devuelve False se cancela y no se cambia el filtro.
+        """
+        query = LCEngine.GameQuery(expr, minPlies, self.siMVX)
+        nworkers = multiprocessing.cpu_count() - 1
+
+        self._cursor.execute("SELECT COUNT(*) FROM %s" % self.tabla)
+        total = self._cursor.fetchone()[0]
+        liRowids = []
+        hechas = 0
+        cursor = self._conexion.cursor()
+        cursor.execute("SELECT ROWID, XPV FROM %s" % self.tabla)
+        while True:
+            if dispatch and not dispatch(hechas, total):
+                cursor.close()
+                return False
+            li = cursor.fetchmany(20000)
+            if not li:
+                break
+            liPlies = query.run([XPV for ROWID, XPV in li], nworkers)
+            liRowids.extend(ROWID for (ROWID, XPV), ply in zip(li, liPlies) if ply >= 0)
+            hechas += len(li)
+        cursor.close()
+
+        self.filterRowids(liRowids, condicionAdicional)
+        return True
+
+    def filterRowids(self, liRowids, condicionAdicional=None):
+        # Los rowids se dejan en la tabla POSFILTER, para que el filtro sea una condicion SQL mas
+        self.rowidReader.stopnow()
+        self._cursor.execute("DROP TABLE IF EXISTS POSFILTER")
+        self._cursor.execute("CREATE TABLE POSFILTER (ID INTEGER PRIMARY KEY)")
+        self._cursor.executemany("INSERT INTO POSFILTER (ID) VALUES (?)", [(rowid,) for rowid in liRowids])
+        self._conexion.commit()
+
+        # las partidas borradas despues no pasan la subconsulta
+        condicion = "ROWID IN (SELECT ID FROM POSFILTER)"
+        if condicionAdicional:
+            condicion += " AND (%s)" % condicionAdicional
+        self.filter = condicion
+
+        self.liRowids = []
+        self.rowidReader.run(self.liRowids, condicion, self.order)
+
     def reccount(self):
         if not self.rowidReader:
             return 0
@@ -722,8 +679,10 @@ class DBgames:
             sql = sql[:-1] + " );"
             cursor.execute(sql)
             cursor.close()
+            self.guardaConfig("XPV_FORMAT", "mvx")
 
     def close(self):
+        self.cierraPosIndex()
         if self._conexion:
             self._cursor.close()
             self._conexion.close()
@@ -748,8 +707,10 @@ class DBgames:
         return self.dbSTAT.flistAllpvs(maxDepth, minGames, siWhite, siDraw, pvBase)
 
     def damePV(self, fila):
-        xpv = self.field(fila, "XPV")
-        return xpv2pv(xpv)
+        return self.clave2pv(self.field(fila, "XPV"))
+
+    def dameXPV(self, fila):
+        return self.clave2xpv(self.field(fila, "XPV"))
 
     def ponOrden(self, liOrden):
         li = []
@@ -768,6 +729,11 @@ class DBgames:
     def borrarLista(self, lista):
         cSQL = "DELETE FROM %s WHERE rowid = ?" % self.tabla
         lista.sort(reverse=True)
+        # sqlite vuelve a usar el rowid mayor si se borra, la partida nueva no entraria en el indice
+        self._cursor.execute("SELECT MAX(ROWID) FROM %s" % self.tabla)
+        maxRowid = self._cursor.fetchone()[0]
+        if maxRowid in [self.liRowids[recno] for recno in lista]:
+            self.borraPosIndex()
         for recno in lista:
             pv = self.damePV(recno)
             result = self.field(recno, "RESULT")
@@ -775,8 +741,6 @@ class DBgames:
                 self.dbSTAT.append(pv, result, -1)
             self._cursor.execute(cSQL,(self.liRowids[recno],))
             del self.liRowids[recno]
-        if self.with_dbSTAT:
-            self.dbSTAT.commit()
         self._conexion.commit()
 
     def getSummary(self, pvBase, dicAnalisis, siFigurinesPGN, allmoves=True):
@@ -793,13 +757,12 @@ class DBgames:
         if reccount:
             self._cursor.execute("SELECT XPV, RESULT FROM %s" % self.tabla)
             recno = 0
-            t = 0
             while dispatch(recno, reccount):
                 chunk = random.randint(1500, 3500)
                 li = self._cursor.fetchmany(chunk)
                 if li:
-                    for XPV, RESULT in li:
-                        pv = xpv2pv(XPV)
+                    lipv = self.clave2pvList([XPV for XPV, RESULT in li])
+                    for pv, (XPV, RESULT) in zip(lipv, li):
                         self.dbSTAT.append(pv, RESULT)
                     nli = len(li)
                     if nli < chunk:
@@ -807,19 +770,13 @@ class DBgames:
                     recno += nli
                 else:
                     break
-                t += 1
-                if t % 5 == 0:
-                    self.dbSTAT.commit()
             self.dbSTAT.commit()
 
     def leerPGNs(self, ficheros, dlTmp):
-        erroneos = duplicados = importados = n = 0
+        erroneos = duplicados = importados = 0
 
         t1 = time.time()-0.7  # para que empiece enseguida
 
-        if self.with_dbSTAT:
-            self.dbSTAT.massive_append_set(True)
-
         def write_logs(fich, pgn):
             with open(fich, "ab") as ferr:
                 ferr.write(pgn)
@@ -829,112 +786,120 @@ class DBgames:
         sicodec = codec not in ("utf-8", "ascii")
 
         liRegs = []
-        stRegs = set()
         nRegs = 0
 
         conexion = self._conexion
         cursor = self._cursor
 
+        # duplicates are detected in LCEngine, the set starts with the games already in the database
+        dups = LCEngine.XPVset()
+        cursorXPV = conexion.cursor()
+        cursorXPV.execute("SELECT XPV FROM games")
+        while True:
+            li = cursorXPV.fetchmany(20000)
+            if not li:
+                break
+            for xpv in self.clave2xpvList([str(XPV) for (XPV,) in li if XPV]):
+                dups.add(xpv)
+        cursorXPV.close()
+
         sql = "insert into games (XPV,EVENT,SITE,DATE,WHITE,BLACK,RESULT,ECO,WHITEELO,BLACKELO,PGN,PLIES) values (?,?,?,?,?,?,?,?,?,?,?,?);"
         liCabs = self.liCamposBase[:-1] # all except PLIES PGN, TAGS
         liCabs.append("PLYCOUNT")
 
-        for fichero in ficheros:
-            nomfichero = os.path.basename(fichero)
-            fich_erroneos = os.path.join(VarGen.configuracion.carpetaTemporal(), nomfichero[:-3] + "errors.pgn")
-            fich_duplicados = os.path.join(VarGen.configuracion.carpetaTemporal(), nomfichero[:-3] + "duplicates.pgn")
-            dlTmp.pon_titulo(nomfichero)
-            next_n = random.randint(100, 200)
-            with LCEngine.PGNreader(fichero, self.depthStat()) as fpgn:
-                for n, (pgn, pv, dCab, raw, liFens, dCablwr) in enumerate(fpgn, 1):
-                    if not pv:
+        # the files are parsed by native workers, the chunks of games arrive in file order
+        siSeguir = True
+        nfile = -1
+        # the stats of the games imported are built by the workers too, the duplicates are not counted
+        stats_depth = self.dbSTAT.depth if self.with_dbSTAT else 0
+        with LCEngine.PGNimport(ficheros, multiprocessing.cpu_count(), self.depthStat(), stats_depth) as imp:
+            while siSeguir:
+                liGames = imp.next(dups)
+                if not liGames:
+                    break
+                if imp.file() != nfile:
+                    nfile = imp.file()
+                    nomfichero = os.path.basename(ficheros[nfile])
+                    fich_erroneos = os.path.join(VarGen.configuracion.carpetaTemporal(), nomfichero[:-3] + "errors.pgn")
+                    fich_duplicados = os.path.join(VarGen.configuracion.carpetaTemporal(), nomfichero[:-3] + "duplicates.pgn")
+                    dlTmp.pon_titulo(nomfichero)
+                for status, pgn, pv, xpv, plies, dCab, raw, liFens, dCablwr in liGames:
+                    if status == LCEngine.PGN_ERROR:
                         erroneos += 1
                         write_logs(fich_erroneos, pgn)
+                    elif status == LCEngine.PGN_NOTINITIAL:
+                        erroneos += 1
+                    elif status == LCEngine.PGN_DUPLICATE:
+                        duplicados += 1
+                        write_logs(fich_duplicados, pgn)
                     else:
-                        fen = dCab.get("FEN", None)
-                        if fen and fen != ControlPosicion.FEN_INICIAL:
-                            erroneos += 1
-                        else:
-                            xpv = pv2xpv(pv)
-                            if xpv in stRegs:
-                                dup = True
+                        if sicodec:
+                            for k, v in dCab.iteritems():
+                                dCab[k] = unicode(v, encoding=codec, errors="ignore")
+                            if pgn:
+                                pgn = unicode(pgn, encoding=codec, errors="ignore")
+
+                        if raw: # si no tiene variantes ni comentarios, se graba solo las tags que faltan
+                            liRTags = [(dCablwr[k],v) for k, v in dCab.iteritems() if k not in liCabs] # k is always upper
+                            if liRTags:
+                                pgn = {}
+                                pgn["RTAGS"] = liRTags
                             else:
-                                cursor.execute("SELECT COUNT(*) FROM games WHERE XPV = ?", (xpv,))
-                                num = cursor.fetchone()[0]
-                                dup = num > 0
-                            if dup:
-                                duplicados += 1
-                                write_logs(fich_duplicados, pgn)
-                            else:
-                                stRegs.add(xpv)
-                                if sicodec:
-                                    for k, v in dCab.iteritems():
-                                        dCab[k] = unicode(v, encoding=codec, errors="ignore")
-                                    if pgn:
-                                        pgn = unicode(pgn, encoding=codec, errors="ignore")
-
-                                if raw: # si no tiene variantes ni comentarios, se graba solo las tags que faltan
-                                    liRTags = [(dCablwr[k],v) for k, v in dCab.iteritems() if k not in liCabs] # k is always upper
-                                    if liRTags:
-                                        pgn = {}
-                                        pgn["RTAGS"] = liRTags
-                                    else:
-                                        pgn = None
-
-                                event = dCab.get("EVENT", "")
-                                site = dCab.get("SITE", "")
-                                date = dCab.get("DATE", "")
-                                white = dCab.get("WHITE", "")
-                                black = dCab.get("BLACK", "")
-                                result = dCab.get("RESULT", "")
-                                eco = dCab.get("ECO", "")
-                                whiteelo = dCab.get("WHITEELO", "")
-                                blackelo = dCab.get("BLACKELO", "")
-                                plies = (pv.count(" ")+1) if pv else 0
-                                if pgn:
-                                    pgn = Util.var2blob(pgn)
-
-                                reg = (xpv, event, site, date, white, black, result, eco, whiteelo, blackelo, pgn, plies)
-                                if self.with_dbSTAT:
-                                    self.dbSTAT.append_fen(pv, result, liFens)
-                                liRegs.append(reg)
-                                nRegs += 1
-                                importados += 1
-                                if nRegs == 10000:
-                                    nRegs = 0
-                                    cursor.executemany(sql, liRegs)
-                                    liRegs = []
-                                    stRegs = set()
-                                    conexion.commit()
-                                    if self.with_dbSTAT:
-                                        self.dbSTAT.massive_append_set(False)
-                                        self.dbSTAT.commit()
-                                        self.dbSTAT.massive_append_set(True)
-                    if n == next_n:
-                        if time.time()-t1> 0.8:
-                            if not dlTmp.actualiza(erroneos+duplicados+importados, erroneos, duplicados, importados):
-                                break
-                            t1 = time.time()
-                        next_n = n + random.randint(100, 500)
+                                pgn = None
+
+                        event = dCab.get("EVENT", "")
+                        site = dCab.get("SITE", "")
+                        date = dCab.get("DATE", "")
+                        white = dCab.get("WHITE", "")
+                        black = dCab.get("BLACK", "")
+                        result = dCab.get("RESULT", "")
+                        eco = dCab.get("ECO", "")
+                        whiteelo = dCab.get("WHITEELO", "")
+                        blackelo = dCab.get("BLACKELO", "")
+                        if pgn:
+                            pgn = Util.var2blob(pgn)
+
+                        reg = (xpv, event, site, date, white, black, result, eco, whiteelo, blackelo, pgn, plies)
+                        liRegs.append(reg)
+                        nRegs += 1
+                        importados += 1
+
+                if nRegs >= 10000:
+                    nRegs = 0
+                    cursor.executemany(sql, self.regsClave(liRegs))
+                    liRegs = []
+                    conexion.commit()
+
+                if time.time()-t1 > 0.8:
+                    if not dlTmp.actualiza(erroneos+duplicados+importados, erroneos, duplicados, importados):
+                        siSeguir = False
+                    t1 = time.time()
+
+            if self.with_dbSTAT:
+                self.dbSTAT.merge(imp.stats())
 
         if liRegs:
-            cursor.executemany(sql, liRegs)
+            cursor.executemany(sql, self.regsClave(liRegs))
             conexion.commit()
         dlTmp.actualiza(erroneos+duplicados+importados, erroneos, duplicados, importados)
         dlTmp.ponSaving()
 
         if self.with_dbSTAT:
-            self.dbSTAT.massive_append_set(False)
             self.dbSTAT.commit()
         conexion.commit()
+        self.actualizaPosIndex()
         dlTmp.ponContinuar()
 
+    def regsClave(self, liRegs):
+        # los registros del import llegan con xpv, se pasan todos juntos a la clave de la base
+        if not self.siMVX:
+            return liRegs
+        liClaves = xpv2mvxList([reg[0] for reg in liRegs])
+        return [(clave,) + reg[1:] for clave, reg in zip(liClaves, liRegs)]
+
     def appendDB(self, db, liRecnos, dlTmp):
         duplicados = importados = 0
 
-        if self.with_dbSTAT:
-            self.dbSTAT.massive_append_set(True)
-
         t1 = time.time() - 0.7  # para que empiece enseguida
 
         next_n = random.randint(100, 200)
@@ -950,15 +915,16 @@ class DBgames:
         for pos, recno in enumerate(liRecnos):
             raw = db.leeAllRecno(recno)
 
-            xpv = raw["XPV"]
-            cursor.execute("SELECT COUNT(*) FROM games WHERE XPV = ?", (xpv,))
+            # las dos bases pueden tener la columna XPV en formatos distintos
+            pv = db.clave2pv(raw["XPV"])
+            clave = self.pv2clave(pv)
+            cursor.execute("SELECT COUNT(*) FROM games WHERE XPV = ?", (clave,))
             num = cursor.fetchone()[0]
             dup = num > 0
             if dup:
                 duplicados += 1
             else:
-                pv = xpv2pv(xpv)
-                reg = (xpv, raw["EVENT"], raw["SITE"], raw["DATE"], raw["WHITE"], raw["BLACK"], raw["RESULT"], raw["ECO"], raw["WHITEELO"],
+                reg = (clave, raw["EVENT"], raw["SITE"], raw["DATE"], raw["WHITE"], raw["BLACK"], raw["RESULT"], raw["ECO"], raw["WHITEELO"],
                        raw["BLACKELO"], raw["PGN"], raw["PLIES"])
                 if self.with_dbSTAT:
                     self.dbSTAT.append(pv, raw["RESULT"])
@@ -969,10 +935,6 @@ class DBgames:
                     cursor.executemany(sql, liRegs)
                     liRegs = []
                     conexion.commit()
-                    if self.with_dbSTAT:
-                        self.dbSTAT.massive_append_set(False)
-                        self.dbSTAT.commit()
-                        self.dbSTAT.massive_append_set(True)
 
             if pos == next_n:
                 if time.time() - t1 > 0.8:
@@ -989,9 +951,9 @@ class DBgames:
         dlTmp.ponSaving()
 
         if self.with_dbSTAT:
-            self.dbSTAT.massive_append_set(False)
             self.dbSTAT.commit()
         conexion.commit()
+        self.actualizaPosIndex()
 
         dlTmp.ponContinuar()
 
@@ -1077,7 +1039,7 @@ class DBgames:
                 p.restore(xpgn["FULLGAME"])
                 return p
 
-        p.leerPV(xpv2pv(raw["XPV"]))
+        p.leerPV(self.clave2pv(raw["XPV"]))
         rots = ["Event", "Site", "Date", "Round", "White", "Black", "Result",
                 "WhiteTitle", "BlackTitle", "WhiteElo", "BlackElo", "WhiteUSCF", "BlackUSCF", "WhiteNA", "BlackNA",
                 "WhiteType", "BlackType", "EventDate", "EventSponsor", "ECO", "UTCTime", "UTCDate", "TimeControl",
@@ -1112,7 +1074,7 @@ class DBgames:
                 p = Partida.PartidaCompleta()
                 p.restore(xpgn["FULLGAME"])
                 return p.pgn(), result
-        pgn = xpv2pgn(raw["XPV"])
+        pgn = xpv2pgn(self.clave2xpv(raw["XPV"]))
         litags = []
         st = set()
         for field in self.liCamposBase:
@@ -1163,14 +1125,14 @@ class DBgames:
             liData.append(xpgn)
 
         pvNue = partidaCompleta.pv()
-        xpv = pv2xpv(pvNue)
-        if xpv != reg_ant["XPV"]:
-            self._cursor.execute("SELECT COUNT(*) FROM games WHERE XPV = ?", (xpv,))
+        clave = self.pv2clave(pvNue)
+        if clave != reg_ant["XPV"]:
+            self._cursor.execute("SELECT COUNT(*) FROM games WHERE XPV = ?", (clave,))
             num = self._cursor.fetchone()[0]
             if num > 0:
                 return False
             liFields.append("XPV=?")
-            liData.append(xpv)
+            liData.append(clave)
 
         rowid = self.liRowids[recno]
         if len(liFields) == 0:
@@ -1179,12 +1141,13 @@ class DBgames:
         sql = "UPDATE games SET %s WHERE ROWID = %d" % (fields, rowid)
         self._cursor.execute(sql, liData)
         self._conexion.commit()
-        pvAnt = xpv2pv(reg_ant["XPV"])
+        if clave != reg_ant["XPV"]:
+            self.borraPosIndex()
+        pvAnt = self.clave2pv(reg_ant["XPV"])
         resNue = dTags.get("RESULT", "*")
         if self.with_dbSTAT:
             self.dbSTAT.append(pvAnt, resAnt, -1)
             self.dbSTAT.append(pvNue, resNue, +1)
-            self.dbSTAT.commit()
 
         del self.cache[rowid]
 
@@ -1192,8 +1155,8 @@ class DBgames:
 
     def inserta(self, partidaCompleta):
         pv = partidaCompleta.pv()
-        xpv = pv2xpv(pv)
-        self._cursor.execute("SELECT COUNT(*) FROM games WHERE XPV = ?", (xpv,))
+        clave = self.pv2clave(pv)
+        self._cursor.execute("SELECT COUNT(*) FROM games WHERE XPV = ?", (clave,))
         raw = self._cursor.fetchone()
         num = raw[0]
         if num > 0:
@@ -1208,7 +1171,7 @@ class DBgames:
             dTags[key.upper()] = value
         dTags["PLIES"] = partidaCompleta.numJugadas()
 
-        data = [xpv, ]
+        data = [clave, ]
         for field in self.liCamposBase:
             data.append(dTags.get(field, None))
         data.append(xpgn)
@@ -1218,7 +1181,6 @@ class DBgames:
         self._conexion.commit()
         if self.with_dbSTAT:
             self.dbSTAT.append(pv, dTags.get("RESULT", "*"), +1)
-            self.dbSTAT.commit()
 
         self.liRowids.append(self._cursor.lastrowid)
 
@@ -1287,8 +1249,9 @@ class DBgames:
 
     def pack(self):
         self._conexion.execute("VACUUM")
+        self.borraPosIndex()  # VACUUM puede renumerar los rowids
         if self.with_dbSTAT:
-            self.dbSTAT._conexion.execute("VACUUM")
+            self.dbSTAT.commit()
 
     def insert_pks(self, path_pks):
         f = open(path_pks, "rb")
@@ -4,10 +4,13 @@ import time
 
 import psutil
 
+import LCEngine4 as LCEngine
+
 from Code import VarGen
 from Code.Constantes import *
 
 DEBUG_ENGINE = False
+NATIVE_ENGINE = True  # pipes read by LCEngine, without a reader thread per engine
 
 
 def xpr(exe, line):
@@ -103,6 +106,16 @@ class Engine(object):
     def hay_datos(self):
         return len(self.liBuffer) > 0
 
+    def get_updates(self):
+        return []
+
+    def set_raw(self, raw):
+        pass
+
+    def wait(self, ms):
+        if not self.hay_datos():
+            time.sleep(ms / 1000.0)
+
     def reset(self):
         self.get_lines()
 
@@ -166,3 +179,65 @@ class Engine(object):
                 self.process.terminate()
 
             self.pid = None
+
+
+class NativeEngine(Engine):
+    """Same interface as Engine, the output is read by LCEngine.UCIEngine.
+    The info lines with score or pv arrive already parsed in get_updates(), unless set_raw(True),
+    all the other lines in get_lines().
+    """
+    def start(self):
+        if self.args[0] == os.path.basename(self.exe):
+            self.args[0] = self.exe
+        self.process = LCEngine.UCIEngine(self.args, os.path.abspath(self.direxe))
+
+        self.pid = self.process.pid()
+        if self.priority is not None:
+            p = psutil.Process(self.pid)
+            p.nice(priorities.value(self.priority))
+
+        self.starting = False
+
+    def put_line(self, line):
+        if self.working:
+            assert xpr(self.exe, "put>>> %s\n" % line)
+            if not self.process.put_line(line):
+                self.working = False
+
+    def get_lines(self):
+        li = self.process.lines()
+        assert xprli(li)
+        return li
+
+    def get_updates(self):
+        return self.process.updates()
+
+    def set_raw(self, raw):
+        self.process.set_raw(raw)
+
+    def hay_datos(self):
+        if self.process.read() < 0:
+            self.working = False
+        return self.process.pending()
+
+    def wait(self, ms):
+        if not self.hay_datos():
+            LCEngine.uciWait(ms)
+
+    def reset(self):
+        self.get_lines()
+        self.process.clear()
+
+    def close(self):
+        self.working = False
+        if self.pid:
+            self.process.put_line("stop")
+            self.process.put_line("quit")
+            self.process.close()
+            self.pid = None
+
+
+def new_engine(exe, priority, args):
+    if NATIVE_ENGINE:
+        return NativeEngine(exe, priority, args)
+    return Engine(exe, priority, args)
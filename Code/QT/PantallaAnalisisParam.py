@@ -25,6 +25,9 @@ def leeDicParametros(configuracion):
     alm.desdeelfinal = dic.get("DESDEELFINAL", False)
     alm.multiPV = dic.get("MULTIPV", "PD")
     alm.priority = dic.get("PRIORITY", EngineThread.priorities.normal)
+    alm.engines = dic.get("ENGINES", 1)
+    alm.hash_engine = dic.get("HASH_ENGINE", 0)  # 0 = engine configuration
+    alm.threads_engine = dic.get("THREADS_ENGINE", 0)
 
     alm.libro = dic.get("LIBRO", None)
 
@@ -107,6 +110,15 @@ def formBlundersBrilliancies(alm, configuracion):
     return liBlunders, liBrilliancies
 
 
+def formEngines(alm, liGen):
+    liGen.append(SEPARADOR)
+    liGen.append((FormLayout.Spinbox(_("Number of engines working at the same time"), 1, 64, 50), alm.engines))
+    liGen.append((FormLayout.Spinbox(_("Hash (MB) of each engine") + " (0=" + _("Default") + ")", 0, 65536, 70),
+                  alm.hash_engine))
+    liGen.append((FormLayout.Spinbox(_("Threads of each engine") + " (0=" + _("Default") + ")", 0, 256, 50),
+                  alm.threads_engine))
+
+
 def paramAnalisis(parent, configuracion, siModoAmpliado, siTodosMotores=False):
     alm = leeDicParametros(configuracion)
 
@@ -152,6 +164,8 @@ def paramAnalisis(parent, configuracion, siModoAmpliado, siTodosMotores=False):
 
     # Completo
     if siModoAmpliado:
+        formEngines(alm, liGen)
+
         liGen.append(SEPARADOR)
 
         liJ = [(_("White"), "BLANCAS"), (_("Black"), "NEGRAS"), (_("White & Black"), "AMBOS")]
@@ -284,15 +298,16 @@ def paramAnalisis(parent, configuracion, siModoAmpliado, siTodosMotores=False):
         alm.priority = liGen[5]
 
         if siModoAmpliado:
-            color = liGen[6]
+            alm.engines, alm.hash_engine, alm.threads_engine = liGen[6:9]
+            color = liGen[9]
             alm.blancas = color != "NEGRAS"
             alm.negras = color != "BLANCAS"
-            alm.jugadas = liGen[7]
-            alm.libroAperturas = liGen[8]
+            alm.jugadas = liGen[10]
+            alm.libroAperturas = liGen[11]
             alm.libro = alm.libroAperturas.nombre if alm.libroAperturas else None
-            alm.siBorrarPrevio = liGen[9]
-            alm.desdeelfinal = liGen[10]
-            alm.showGraphs = liGen[11]
+            alm.siBorrarPrevio = liGen[12]
+            alm.desdeelfinal = liGen[13]
+            alm.showGraphs = liGen[14]
 
             (alm.masvariantes, alm.limitemasvariantes, alm.mejorvariante, alm.infovariante,
                 alm.siPDT, alm.unmovevariante) = liVar
@@ -350,6 +365,8 @@ def paramAnalisisMasivo(parent, configuracion, siVariosSeleccionados, siDatabase
         li.append((str(x), str(x)))
     config = FormLayout.Combobox(_("Number of moves evaluated by engine(MultiPV)"), li)
     liGen.append((config, alm.multiPV))
+
+    formEngines(alm, liGen)
     liGen.append(SEPARADOR)
 
     liJ = [(_("White"), "BLANCAS"), (_("Black"), "NEGRAS"), (_("White & Black"), "AMBOS")]
@@ -436,8 +453,8 @@ def paramAnalisisMasivo(parent, configuracion, siVariosSeleccionados, siDatabase
 
         liGen, liBlunders, liBrilliancies = liResp
 
-        alm.motor, tiempo, alm.depth, alm.timedepth, alm.multiPV, color, cjug, alm.libroAperturas, \
-            alm.desdeelfinal, alm.siBorrarPrevio, alm.siVariosSeleccionados = liGen
+        alm.motor, tiempo, alm.depth, alm.timedepth, alm.multiPV, alm.engines, alm.hash_engine, alm.threads_engine, \
+            color, cjug, alm.libroAperturas, alm.desdeelfinal, alm.siBorrarPrevio, alm.siVariosSeleccionados = liGen
 
         alm.tiempo = int(tiempo * 1000)
         alm.blancas = color != "NEGRAS"
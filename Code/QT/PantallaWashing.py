@@ -276,6 +276,7 @@ class WWashing(QTVarios.WDialogo):
                     dbn = DBgames.DBgames(path)
                     for pc in other_pc():
                         dbn.inserta(pc)
+                    dbn.close()
                     me.final()
                     QTUtil2.mensaje(self, _X(_("Saved to %1"), path))
             else:
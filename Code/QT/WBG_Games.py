@@ -11,6 +11,7 @@ from Code import AperturasStd
 from Code.QT import Colocacion
 from Code.QT import Columnas
 from Code.QT import Controles
+from Code.QT import FormLayout
 from Code.QT import Grid
 from Code.QT import Iconos
 from Code.QT import PantallaBooks
@@ -47,6 +48,7 @@ class WGames(QtGui.QWidget):
         self.where = None
 
         self.last_opening = None
+        self.last_query = ("", 1)
 
         # Grid
         oColumnas = Columnas.ListaColumnas()
@@ -161,7 +163,7 @@ class WGames(QtGui.QWidget):
         elif clave == "rowid":
             return str(self.dbGames.getROWID(nfila))
         elif clave == "opening":
-            xpv = self.dbGames.field(nfila, "XPV")
+            xpv = self.dbGames.dameXPV(nfila)
             return self.ap.XPV(xpv)
         return self.dbGames.field(nfila, clave)
 
@@ -344,12 +346,62 @@ class WGames(QtGui.QWidget):
             self.where = None
             refresh()
 
+        pvPosicion = self.summaryActivo.get("pv") if self.summaryActivo else None
+
+        def position(siMaterial):
+            um = QTUtil2.unMomento(self)
+            fen = DBgames.makePV(pvPosicion)
+            self.dbGames.filterPosition(fen, siMaterial, self.where)
+            um.final()
+            refresh()
+
+        def query():
+            expr, minPlies = self.last_query
+            liGen = [FormLayout.separador]
+            liGen.append((FormLayout.Editbox(_("Condition"), 400), expr))
+            liGen.append((FormLayout.Spinbox(_("Plies"), 1, 99, 50), minPlies))
+            comment = "R == 1 and B == 0 and r == 0 and b == 1 and Q+q+N+n == 0\n" \
+                      "P+p == P@a-d+p@a-d or P+p == P@e-h+p@e-h\n" \
+                      "move <= 20 and Q == 0 and q == 1 and material < 0"
+            resultado = FormLayout.fedit(liGen, title=_("Condition"), comment=comment, parent=self,
+                                         icon=Iconos.Buscar())
+            if not resultado:
+                return
+            expr, minPlies = resultado[1]
+            self.last_query = (expr, minPlies)
+
+            bp = QTUtil2.BarraProgreso(self, _("Condition"), _("Working..."), 1).mostrar()
+
+            def dispatch(hechas, total):
+                if bp.total != total:
+                    bp.total = total
+                    bp.ponTotal(total)
+                bp.pon(hechas)
+                return not bp.siCancelado()
+
+            try:
+                siHecho = self.dbGames.filterQuery(expr, minPlies, self.where, dispatch)
+            except ValueError as e:
+                bp.cerrar()
+                QTUtil2.mensError(self, str(e))
+                return
+            bp.cerrar()
+            if siHecho:
+                refresh()
+
         menu = QTVarios.LCMenu(self)
         menu.opcion(standard, _("Standard"), Iconos.Filtrar())
         menu.separador()
         menu.opcion(raw_sql, _("Advanced"), Iconos.SQL_RAW())
         menu.separador()
         menu.opcion(opening, _("Opening"), Iconos.Apertura())
+        if pvPosicion:
+            menu.separador()
+            siFuera = len(pvPosicion.split(" ")) > self.dbGames.maxPlyPosIndex()
+            menu.opcion(lambda: position(False), _("Position"), Iconos.Transposition(), siDeshabilitado=siFuera)
+            menu.opcion(lambda: position(True), _("Material"), Iconos.Tablero())
+        menu.separador()
+        menu.opcion(query, _("Condition"), Iconos.Buscar())
         if self.dbGames.filter is not None and self.dbGames.filter:
             menu.separador()
             menu.opcion(remove, _("Remove filter"), Iconos.Cancelar())
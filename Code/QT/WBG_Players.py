@@ -400,9 +400,9 @@ class WPlayer(QtGui.QWidget):
                     result = resultb
                 else:
                     continue
-                xpv = alm.XPV
-                if not xpv:
+                if not alm.XPV:
                     continue
+                xpv = self.dbGames.clave2xpv(alm.XPV)
 
                 # openings
                 ap = self.ap.baseXPV(xpv)
@@ -31,3 +31,5 @@ XSEP = chr(183)
 
 listaGestoresMotor = None
 
+analisisCache = None  # AnalisisCache.cache()
+
@@ -2,6 +2,7 @@ import os
 
 import LCEngine4 as LCEngine
 
+from Code import AnalisisCache
 from Code import VarGen
 from Code import XMotor
 from Code import XMotorRespuesta
@@ -203,9 +204,26 @@ class GestorMotor:
             self.motor.run_ponder(partida, mrm)
         return mrm
 
+    def bestmove_fen(self, fen, tiempo, depth, is_savelines=False):
+        """
+        Analisis de fen, de la cache de analisis si ya lo hizo antes el mismo motor
+        """
+        if not (tiempo or depth):
+            return self.motor.bestmove_fen(fen, tiempo, depth)
+        cache = AnalisisCache.cache()
+        motor = cache.motor(self.confMotor, self.nMultiPV)
+        mrm = cache.busca(fen, motor, self.nombre, tiempo, depth)
+        if mrm is None:
+            if is_savelines:
+                mrm = self.motor.bestmove_fen(fen, tiempo, depth, is_savelines=True)
+            else:
+                mrm = self.motor.bestmove_fen(fen, tiempo, depth)
+            cache.guarda(fen, motor, mrm, tiempo)
+        return mrm
+
     def analiza(self, fen):
         self.testEngine()
-        return self.motor.bestmove_fen(fen, self.motorTiempoJugada, self.motorProfundidad)
+        return self.bestmove_fen(fen, self.motorTiempoJugada, self.motorProfundidad)
 
     def valora(self, posicion, desde, hasta, coronacion):
         self.testEngine()
@@ -225,7 +243,7 @@ class GestorMotor:
             self.coronacion = coronacion
             return rm
 
-        mrm = self.motor.bestmove_fen(fen, self.motorTiempoJugada, self.motorProfundidad)
+        mrm = self.bestmove_fen(fen, self.motorTiempoJugada, self.motorProfundidad)
         rm = mrm.mejorMov()
         rm.cambiaColor(posicion)
         mv = desde + hasta + (coronacion if coronacion else "")
@@ -238,7 +256,7 @@ class GestorMotor:
 
     def control(self, fen, profundidad):
         self.testEngine()
-        return self.motor.bestmove_fen(fen, 0, profundidad)
+        return self.bestmove_fen(fen, 0, profundidad)
 
     def terminar(self):
         if self.motor:
@@ -249,7 +267,7 @@ class GestorMotor:
     def analizaJugada(self, jg, tiempo, depth=0, brDepth=5, brPuntos=50):
         self.testEngine()
 
-        mrm = self.motor.bestmove_fen(jg.posicionBase.fen(), tiempo, depth, is_savelines=True)
+        mrm = self.bestmove_fen(jg.posicionBase.fen(), tiempo, depth, is_savelines=True)
         mv = jg.movimiento()
         if not mv:
             return mrm, 0
@@ -269,7 +287,7 @@ class GestorMotor:
         else:
             posicion = jg.posicion
 
-            mrm1 = self.motor.bestmove_fen(posicion.fen(), tiempo, depth)
+            mrm1 = self.bestmove_fen(posicion.fen(), tiempo, depth)
             if mrm1 and mrm1.liMultiPV:
                 rm = mrm1.liMultiPV[0]
                 rm.cambiaColor(posicion)
@@ -292,8 +310,32 @@ class GestorMotor:
         if stability:
             mrm = self.motor.analysis_stable(partida, njg, tiempo, depth, True, st_centipawns, st_depths, st_timelimit)
         else:
+            mrm = self.bestmove_game_jg(partida, njg, tiempo, depth)
+
+        resp = self.miraJugadaPartida(partida, njg, mrm, brDepth, brPuntos)
+        if resp is None:
+            # No esta considerado, obliga a hacer el analisis de nuevo desde posicion
+            jg = partida.jugada(njg)
+            mrm1 = self.bestmove_fen(jg.posicion.fen(), tiempo, depth)
+            resp = self.agregaJugadaPartida(partida, njg, mrm, mrm1)
+        return resp
+
+    def bestmove_game_jg(self, partida, njg, tiempo, depth):
+        # con la posicion de la partida, el motor tiene las jugadas previas (repeticiones, regla de 50)
+        cache = AnalisisCache.cache()
+        motor = cache.motor(self.confMotor, self.nMultiPV)
+        fen = partida.jugada(njg).posicionBase.fen()
+        mrm = cache.busca(fen, motor, self.nombre, tiempo, depth) if tiempo or depth else None
+        if mrm is None:
             mrm = self.motor.bestmove_game_jg(partida, njg, tiempo, depth, is_savelines=True)
+            if tiempo or depth:
+                cache.guarda(fen, motor, mrm, tiempo)
+        return mrm
 
+    def miraJugadaPartida(self, partida, njg, mrm, brDepth, brPuntos):
+        """
+        (mrm, posicion de la jugada en mrm), None si la jugada no esta en mrm y hay que analizar la posicion siguiente
+        """
         jg = partida.jugada(njg)
         mv = jg.movimiento()
         if not mv:
@@ -304,8 +346,17 @@ class GestorMotor:
                 mrm.miraBrilliancies(brDepth, brPuntos)
             return mrm, n
 
-        # No esta considerado, obliga a hacer el analisis de nuevo desde posicion
         if jg.siJaqueMate or jg.siTablas():
+            return self.agregaJugadaPartida(partida, njg, mrm, None)
+        return None
+
+    def agregaJugadaPartida(self, partida, njg, mrm, mrm1):
+        """
+        Agrega a mrm la jugada de la partida, con el analisis mrm1 de la posicion que se alcanza
+        """
+        jg = partida.jugada(njg)
+        mv = jg.movimiento()
+        if mrm1 is None:  # jaque mate o tablas
             rm = XMotorRespuesta.RespuestaMotor(self.nombre, jg.posicionBase.siBlancas)
             rm.desde = mv[:2]
             rm.hasta = mv[2:4]
@@ -314,7 +365,6 @@ class GestorMotor:
         else:
             posicion = jg.posicion
 
-            mrm1 = self.motor.bestmove_fen(posicion.fen(), tiempo, depth)
             if mrm1 and mrm1.liMultiPV:
                 rm = mrm1.liMultiPV[0]
                 rm.cambiaColor(posicion)
@@ -333,7 +383,7 @@ class GestorMotor:
     def analizaVariante(self, jg, tiempo, siBlancas):
         self.testEngine()
 
-        mrm = self.motor.bestmove_fen(jg.posicion.fen(), tiempo, None)
+        mrm = self.bestmove_fen(jg.posicion.fen(), tiempo, None)
         if mrm.liMultiPV:
             rm = mrm.liMultiPV[0]
             # if siBlancas != jg.posicion.siBlancas:
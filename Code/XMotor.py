@@ -34,11 +34,13 @@ class XMotor:
 
         self.uci_lines = []
 
+        self.go_limpio = False  # the last go_start finished with its bestmove, no output pending
+
         if not os.path.isfile(exe):
             QTUtil2.mensError(None, "%s:\n  %s" % (_("Engine not found"), exe))
             return
 
-        self.engine = EngineThread.Engine(exe, priority, args)
+        self.engine = EngineThread.new_engine(exe, priority, args)
         self.engine.start()
 
         self.lockAC = True
@@ -78,15 +80,30 @@ class XMotor:
     def log_open(self, fichero):
         self.log = open(fichero, "ab")
         self.log.write("%s %s\n\n" % (str(Util.hoy()), "-"*70))
+        self.engine.set_raw(True)  # the log needs all the lines as sent by the engine
 
     def log_close(self):
         if self.log:
             self.log.close()
             self.log = None
+            self.engine.set_raw(False)
 
     def log_write(self, line):
         self.log.write(line)
 
+    def lee(self, seektxt=None, seekdepth=None):
+        # parsed infos first, they were sent before the lines still pending (bestmove...)
+        found = False
+        for dClaves in self.engine.get_updates():
+            self.mrm.dispatch_info(dClaves)
+            if seekdepth and int(dClaves.get("depth", 0)) >= seekdepth:
+                found = True
+        for line in self.get_lines():
+            self.mrm.dispatch(line)
+            if seektxt and seektxt in line:
+                found = True
+        return found
+
     def get_lines(self):
         li = self.engine.get_lines()
         if self.log:
@@ -101,7 +118,9 @@ class XMotor:
 
     def reset(self):
         self.get_lines()
+        self.engine.reset()
         self.mrm = XMotorRespuesta.MRespuestaMotor(self.nombre, self.is_white)
+        self.engine.set_raw(self.log is not None)
 
     def dispatch(self):
         QtCore.QCoreApplication.processEvents(QtCore.QEventLoop.ExcludeUserInputEvents)
@@ -120,13 +139,12 @@ class XMotor:
     def wait_mrm(self, seektxt, msStop):
         iniTiempo = time.time()
         stop = False
+        seekdepth = int(seektxt.split()[1]) if seektxt.startswith(" depth ") else None
         while True:
             if self.engine.hay_datos():
-                for line in self.get_lines():
-                    self.mrm.dispatch(line)
-                    if seektxt in line:
-                        self.dispatch()
-                        return True
+                if self.lee(seektxt, seekdepth):
+                    self.dispatch()
+                    return True
 
             queda = msStop - int((time.time() - iniTiempo) * 1000)
             if queda <= 0:
@@ -139,7 +157,7 @@ class XMotor:
                 if not self.dispatch():
                     self.put_line("stop")
                     return False
-                time.sleep(0.090)
+                self.engine.wait(90)
 
     def wait_list(self, txt, msStop):
         iniTiempo = time.time()
@@ -164,7 +182,7 @@ class XMotor:
                 msStop += 2000
                 stop = True
             if not self.engine.hay_datos():
-                time.sleep(0.090)
+                self.engine.wait(90)
 
     def wait_txt(self, seektxt, msStop):
         iniTiempo = time.time()
@@ -178,7 +196,7 @@ class XMotor:
             if queda <= 0:
                 return False
             if not self.engine.hay_datos():
-                time.sleep(0.090)
+                self.engine.wait(90)
 
     def work_ok(self, orden):
         self.reset()
@@ -196,7 +214,7 @@ class XMotor:
         self.put_line("go infinite")
         self.wait_mrm(busca, msmax_time)
 
-    def seek_bestmove(self, max_time, max_depth, is_savelines):
+    def go_command(self, max_time, max_depth):
         env = "go"
         if max_depth:
             env += " depth %d" % max_depth
@@ -209,6 +227,11 @@ class XMotor:
         elif max_depth:
             ms_time = int(max_depth * ms_time / 3.0)
 
+        return env, ms_time
+
+    def seek_bestmove(self, max_time, max_depth, is_savelines):
+        env, ms_time = self.go_command(max_time, max_depth)
+
         self.reset()
         if is_savelines:
             self.mrm.save_lines()
@@ -253,13 +276,17 @@ class XMotor:
         self.mrm.ordena()
         return self.mrm
 
-    def set_game_position(self, partida, njg=99999):
+    def position_game(self, partida, njg=99999):
         posInicial = "startpos" if partida.siFenInicial() else "fen %s" % partida.iniPosicion.fen()
         li = [jg.movimiento().lower() for n, jg in enumerate(partida.liJugadas) if n < njg]
         moves = " moves %s" % (" ".join(li)) if li else ""
-        if not li:
+        return "position %s%s" % (posInicial, moves), not li
+
+    def set_game_position(self, partida, njg=99999):
+        orden, siNueva = self.position_game(partida, njg)
+        if siNueva:
             self.ucinewgame()
-        self.work_ok("position %s%s" % (posInicial, moves))
+        self.work_ok(orden)
         self.is_white = partida.siBlancas() if njg > 9000 else partida.jugada(njg).siBlancas()
 
     def set_fen_position(self, fen):
@@ -280,8 +307,8 @@ class XMotor:
     def ac_lee(self):
         if self.lockAC:
             return
-        for line in self.get_lines():
-            self.mrm.dispatch(line)
+        if self.engine.hay_datos():
+            self.lee()
 
     def ac_estado(self):
         self.ac_lee()
@@ -325,8 +352,8 @@ class XMotor:
             self.mrm.save_lines()
         self.put_line("go infinite")
         def lee():
-            for line in self.get_lines():
-                self.mrm.dispatch(line)
+            if self.engine.hay_datos():
+                self.lee()
             self.mrm.ordena()
             return self.mrm.mejorMov()
         ok_time = False if ktime else True
@@ -350,6 +377,75 @@ class XMotor:
         self.put_line("stop")
         return self.mrm
 
+    # Analysis without waiting for the engine, go_start sends the go and go_poll is called until it returns the mrm.
+    # Used by AnalisisScheduler to keep several engines working at the same time.
+    def go_start(self, orden, siNueva, max_time, max_depth, is_savelines, stability=None):
+        if self.go_limpio:  # nothing pending from the previous search, there is no need to wait for readyok
+            if siNueva:
+                self.put_line("ucinewgame")
+            self.put_line(orden)
+        else:
+            if siNueva:
+                self.ucinewgame()
+            self.work_ok(orden)
+        self.go_limpio = False
+
+        self.reset()
+        if is_savelines:
+            self.mrm.save_lines()
+        self.go_ini = time.time()
+        self.go_stop = False
+        self.go_stability = stability  # (ktime, kdepth, st_centipawns, st_depths, st_timelimit)
+        self.go_stable_ini = None
+        if stability:
+            self.put_line("go infinite")
+        else:
+            self.mrm.setTimeDepth(max_time, max_depth)
+            env, self.go_ms = self.go_command(max_time, max_depth)
+            self.put_line(env)
+
+    def go_game_jg(self, partida, njg, max_time, max_depth, is_savelines=False, stability=None):
+        orden, siNueva = self.position_game(partida, njg)
+        self.is_white = partida.jugada(njg).siBlancas()
+        self.go_start(orden, siNueva, max_time, max_depth, is_savelines, stability)
+
+    def go_fen(self, fen, max_time, max_depth, is_savelines=False):
+        self.is_white = "w" in fen
+        self.go_start("position fen %s" % fen, True, max_time, max_depth, is_savelines)
+
+    def go_poll(self):
+        if self.engine.hay_datos() and self.lee("bestmove"):
+            self.go_limpio = True
+            self.mrm.ordena()
+            return self.mrm
+
+        ms = int((time.time() - self.go_ini) * 1000)
+        if self.go_stability and not self.go_stop:
+            ktime, kdepth, st_centipawns, st_depths, st_timelimit = self.go_stability
+            self.mrm.ordena()
+            rm = self.mrm.mejorMov()
+            if self.go_stable_ini is None:
+                if rm.time >= ktime and rm.depth >= kdepth:
+                    self.go_stable_ini = time.time()
+            if self.go_stable_ini is not None:
+                if st_timelimit == 0:
+                    st_timelimit = 999999
+                if self.mrm.is_stable(st_centipawns, st_depths) or time.time() - self.go_stable_ini >= st_timelimit:
+                    self.put_line("stop")  # the analysis ends with the bestmove
+                    self.go_ms = ms + 2000
+                    self.go_stop = True
+            return None
+
+        if ms < self.go_ms:
+            return None
+        if not self.go_stop:
+            self.put_line("stop")
+            self.go_ms += 2000
+            self.go_stop = True
+            return None
+        self.mrm.ordena()
+        return self.mrm
+
     def ponGuiDispatch(self, guiDispatch, whoDispatch=None):
         self.guiDispatch = guiDispatch
         if whoDispatch is not None:
@@ -234,6 +234,7 @@ class RespuestaMotor:
 
 st_uci_claves = {"multipv", "depth", "seldepth", "score", "time", "nodes", "pv", "hashfull", "tbhits", "nps",
                      "currmove", "currmovenumber", "cpuload", "string", "refutation", "currline"}
+li_info_claves = ("depth", "seldepth", "multipv", "score", "nodes", "nps", "time", "pv")  # dispatch_info, pv at the end
 
 
 class MRespuestaMotor:
@@ -281,6 +282,17 @@ class MRespuestaMotor:
         if self.saveLines:
             self.lines.append(linea)
 
+    def dispatch_info(self, dClaves):
+        # info lines already split in keys by the native engine driver, saved lines are rebuilt from them
+        if "pv" in dClaves:
+            self.miraPVClaves(dClaves)
+        elif "score" in dClaves:
+            self.miraScoreClaves(dClaves)
+
+        if self.saveLines:
+            self.lines.append("info " + " ".join("%s %s" % (clave, dClaves[clave]) for clave in li_info_claves
+                                                 if clave in dClaves))
+
     def dispatchPV(self, pv):
         self.dispatch("info depth 1 score cp 0 time 1 pv %s" % pv)
         self.dispatch("bestmove %s" % pv)
@@ -309,8 +321,9 @@ class MRespuestaMotor:
         return 0
 
     def miraPV(self, pvBase):
-        dClaves = self.miraClaves(pvBase, st_uci_claves)
+        self.miraPVClaves(self.miraClaves(pvBase, st_uci_claves))
 
+    def miraPVClaves(self, dClaves):
         if "pv" in dClaves:
             pv = dClaves["pv"].strip()
             if not pv:
@@ -318,15 +331,13 @@ class MRespuestaMotor:
         else:
             return
 
+        score = dClaves.get("score", "")
         if "nodes" in dClaves:  # Toga en multipv, envia 0 si no tiene nada que contar
-            if (dClaves["nodes"] == "0") and ("mate" not in pvBase):
+            if (dClaves["nodes"] == "0") and ("mate" not in score):
                 return
 
-        if "score" in dClaves:
-            if "mate 0 " in pvBase or \
-                    "mate -0 " in pvBase or \
-                    "mate +0 " in pvBase:
-                return
+        if score in ("mate 0", "mate -0", "mate +0"):
+            return
 
         if "multipv" in dClaves:
             kMulti = dClaves["multipv"]
@@ -393,8 +404,9 @@ class MRespuestaMotor:
             self.dicDepth[depth][rm.movimiento()] = rm.puntosABS_5()
 
     def miraScore(self, pvBase):
-        dClaves = self.miraClaves(pvBase, st_uci_claves)
+        self.miraScoreClaves(self.miraClaves(pvBase, st_uci_claves))
 
+    def miraScoreClaves(self, dClaves):
         if "multipv" in dClaves:
             kMulti = dClaves["multipv"]
             if kMulti not in self.dicMultiPV:
@@ -91,6 +91,9 @@ static xboard_t XBoard[1];
 static state_t State[1];
 static xb_t XB[1];
 
+static bool PVPending; // a PV not sent yet, the next buffered line may replace it
+static int PVCoalesced;
+
 // prototypes
 
 
@@ -115,6 +118,8 @@ static void stop_search    ();
 
 static void send_board     (int extra_move);
 static void send_pv        ();
+static void send_pv_pending ();
+static bool is_pv_line     (const char string[]);
 static void tb_to_string   (char *tbstring,int size);
 
 static void xboard_send    (xboard_t * xboard, const char format[], ...);
@@ -179,6 +184,9 @@ void adapter_loop() {
 
    XB->my_time = 300.0;
    XB->opp_time = 300.0;
+
+   PVPending = false;
+   PVCoalesced = 0;
 #ifdef _WIN32
    // loop
    while(true) 
@@ -201,6 +209,7 @@ static void adapter_step() {
 
    while (io_line_ready(XBoard->io)) xboard_step(); // process available xboard lines
    while (io_line_ready(Engine->io)) engine_step(); // process available engine lines
+   send_pv_pending();
 
    // init
 
@@ -492,6 +501,11 @@ xboard_get(XBoard,string,sizeof(string));
 
 		} else if (match(string,"quit")) {
 			my_log("POLYGLOT *** \"quit\" from XBoard ***\n");
+#ifndef _WIN32
+			io_log_stats(XBoard->io);
+			io_log_stats(Engine->io);
+			my_log("POLYGLOT %d PV%s coalesced\n",PVCoalesced,(PVCoalesced>1)?"s":"");
+#endif
 			quit();
 		} else if (match(string,"random")) {
 
@@ -713,6 +727,7 @@ static void engine_step() {
 	// parse UCI line
 
 	    engine_get(Engine,string,StringSize); //blocking read...
+		if (PVPending && !is_pv_line(string)) send_pv_pending(); // keep the order of the output
 		event = uci_parse(Uci,string);
 		// react to events
 
@@ -752,7 +767,19 @@ static void engine_step() {
 
 			// the engine has sent a new PV
 
-			send_pv();
+#ifndef _WIN32
+			if (option_get_bool("CoalescePV") && !Uci->multipv_mode
+			 && !Engine->io->in_eof && io_line_ready(Engine->io)) {
+				// more lines are waiting, a newer PV would make this one useless
+				if (PVPending) PVCoalesced++;
+				PVPending = true;
+			} else
+#endif
+			{
+				if (PVPending) PVCoalesced++;
+				PVPending = false;
+				send_pv();
+			}
 		}
 		if ((event & EVENT_INFO) != 0){
 			if(!option_get_bool("InfoStrings"))
@@ -1354,6 +1381,25 @@ static void send_board(int extra_move) {
    engine_send(Engine,""); // newline
 }
 
+// send_pv_pending()
+
+static void send_pv_pending() {
+
+   if (!PVPending) return;
+
+   PVPending = false;
+   send_pv();
+}
+
+// is_pv_line()
+
+static bool is_pv_line(const char string[]) {
+
+   ASSERT(string!=NULL);
+
+   return strncmp(string,"info ",5) == 0 && strstr(string," pv ") != NULL;
+}
+
 // send_pv()
 
 static void send_pv() {
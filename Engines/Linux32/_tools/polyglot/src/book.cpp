@@ -8,13 +8,46 @@
 #include <cstdlib>
 #include <cstring>
 
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#else
+#include <sys/mman.h>
+#endif
+
 #include "board.h"
 #include "book.h"
 #include "move.h"
 #include "move_legal.h"
+#include "option.h"
 #include "san.h"
 #include "util.h"
 
+// constants
+
+// "BookMode": where the entries are read from
+
+static const int BookModeFile   = 0; // fseek + fgetc on every entry
+static const int BookModeMemory = 1; // whole book in RAM
+static const int BookModeMap    = 2; // memory mapped (private copy-on-write pages)
+
+static const int BookMemoryMax = 16 * 1024 * 1024; // "auto" loads smaller books in RAM
+
+// macros
+
+// entries are big endian, the hosts little endian
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#  define BSWAP16(x) (x)
+#  define BSWAP64(x) (x)
+#elif defined(_MSC_VER)
+#  define BSWAP16(x) _byteswap_ushort(x)
+#  define BSWAP64(x) _byteswap_uint64(x)
+#else
+#  define BSWAP16(x) __builtin_bswap16(x)
+#  define BSWAP64(x) __builtin_bswap64(x)
+#endif
+
 // types
 
 struct entry_t {
@@ -30,12 +63,30 @@ struct entry_t {
 static FILE * BookFile;
 static int BookSize;
 
+static int BookMode;
+static uint8 * BookData; // BookSize entries of 16 bytes, NULL in file mode
+#ifdef _WIN32
+static HANDLE BookMapping;
+#endif
+
+// write-back buffer: entries changed in BookData, written to the file by book_flush()
+
+static int * BookDirty;
+static int BookDirtyNb;
+static int BookDirtySize;
+
 // prototypes
 
+static bool   book_load     (const char mode[]);
+static bool   book_map      ();
+static void   book_unload   ();
+
 static int    find_pos      (uint64 key);
 
+static uint64 read_key      (int n);
 static void   read_entry    (entry_t * entry, int n);
 static void   write_entry   (const entry_t * entry, int n);
+static void   file_write_entry (const entry_t * entry, int n);
 
 static uint64 read_integer  (FILE * file, int size);
 static void   write_integer (FILE * file, int size, uint64 n);
@@ -48,6 +99,16 @@ void book_clear() {
 
    BookFile = NULL;
    BookSize = 0;
+
+   BookMode = BookModeFile;
+   BookData = NULL;
+#ifdef _WIN32
+   BookMapping = NULL;
+#endif
+
+   BookDirty = NULL;
+   BookDirtyNb = 0;
+   BookDirtySize = 0;
 }
 
 // book_open()
@@ -74,6 +135,13 @@ int book_open(const char file_name[]) {
 	   return 1;
 	   //my_fatal("book_open(): empty file\n");
    }
+
+   // a book that can't be loaded or mapped is read from the file
+
+   if (!book_load(option_get_string("BookMode"))) BookMode = BookModeFile;
+   my_log("POLYGLOT Book \"%s\" %d entries, mode %s\n",file_name,BookSize,
+          (BookMode == BookModeMemory) ? "memory" : (BookMode == BookModeMap) ? "mmap" : "file");
+
    return 0;
 }
 
@@ -81,6 +149,9 @@ int book_open(const char file_name[]) {
 
 void book_close() {
 
+   if (BookDirtyNb > 0) book_flush();
+   book_unload();
+
    if (fclose(BookFile) == EOF) {
       my_fatal("book_close(): fclose(): %s\n",strerror(errno));
    }
@@ -234,17 +305,130 @@ void book_learn_move(const board_t * board, int move, int result) {
 
 void book_flush() {
 
+   int i;
+   entry_t entry[1];
+
+   for (i = 0; i < BookDirtyNb; i++) {
+      read_entry(entry,BookDirty[i]);
+      file_write_entry(entry,BookDirty[i]);
+   }
+   BookDirtyNb = 0;
+
    if (fflush(BookFile) == EOF) {
       my_fatal("book_flush(): fflush(): %s\n",strerror(errno));
    }
 }
 
+// book_load()
+
+static bool book_load(const char mode[]) {
+
+   size_t size;
+
+   ASSERT(mode!=NULL);
+   ASSERT(BookData==NULL);
+
+   size = (size_t) BookSize * 16;
+
+   if (my_string_case_equal(mode,"file")) {
+      BookMode = BookModeFile;
+   } else if (my_string_case_equal(mode,"memory")) {
+      BookMode = BookModeMemory;
+   } else if (my_string_case_equal(mode,"mmap")) {
+      BookMode = BookModeMap;
+   } else { // auto
+      BookMode = (size <= (size_t) BookMemoryMax) ? BookModeMemory : BookModeMap;
+   }
+
+   if (BookMode == BookModeMap) return book_map();
+
+   if (BookMode == BookModeMemory) {
+
+      BookData = (uint8 *) malloc(size);
+      if (BookData == NULL) return book_map();
+
+      if (fseek(BookFile,0,SEEK_SET) == -1 || fread(BookData,1,size,BookFile) != size) {
+         free(BookData);
+         BookData = NULL;
+         return false;
+      }
+   }
+
+   return true;
+}
+
+// book_map()
+
+static bool book_map() {
+
+   size_t size;
+
+   size = (size_t) BookSize * 16;
+
+#ifdef _WIN32
+
+   BookMapping = CreateFileMapping((HANDLE) _get_osfhandle(_fileno(BookFile)),NULL,PAGE_WRITECOPY,0,0,NULL);
+   if (BookMapping == NULL) return false;
+
+   BookData = (uint8 *) MapViewOfFile(BookMapping,FILE_MAP_COPY,0,0,size);
+   if (BookData == NULL) {
+      CloseHandle(BookMapping);
+      BookMapping = NULL;
+      return false;
+   }
+
+#else
+
+   void * data;
+
+   data = mmap(NULL,size,PROT_READ|PROT_WRITE,MAP_PRIVATE,fileno(BookFile),0);
+   if (data == MAP_FAILED) return false;
+
+   BookData = (uint8 *) data;
+
+#endif
+
+   BookMode = BookModeMap;
+
+   return true;
+}
+
+// book_unload()
+
+static void book_unload() {
+
+   if (BookData != NULL) {
+
+      if (BookMode == BookModeMap) {
+#ifdef _WIN32
+         UnmapViewOfFile(BookData);
+         CloseHandle(BookMapping);
+         BookMapping = NULL;
+#else
+         munmap(BookData,(size_t) BookSize * 16);
+#endif
+      } else {
+         free(BookData);
+      }
+
+      BookData = NULL;
+   }
+
+   if (BookDirty != NULL) {
+      my_free(BookDirty);
+      BookDirty = NULL;
+   }
+   BookDirtyNb = 0;
+   BookDirtySize = 0;
+
+   BookMode = BookModeFile;
+}
+
 // find_pos()
 
 static int find_pos(uint64 key) {
 
    int left, right, mid;
-   entry_t entry[1];
 
    // binary search (finds the leftmost entry)
 
@@ -258,9 +442,7 @@ static int find_pos(uint64 key) {
       mid = (left + right) / 2;
       ASSERT(mid>=left&&mid<right);
 
-      read_entry(entry,mid);
-
-      if (key <= entry->key) {
+      if (key <= read_key(mid)) {
          right = mid;
       } else {
          left = mid+1;
@@ -269,18 +451,54 @@ static int find_pos(uint64 key) {
 
    ASSERT(left==right);
 
-   read_entry(entry,left);
+   return (read_key(left) == key) ? left : BookSize;
+}
+
+// read_key()
+
+static uint64 read_key(int n) {
+
+   uint64 key;
+   entry_t entry[1];
 
-   return (entry->key == key) ? left : BookSize;
+   ASSERT(n>=0&&n<BookSize);
+
+   if (BookData != NULL) {
+      memcpy(&key,BookData+(size_t)n*16,8);
+      return BSWAP64(key);
+   }
+
+   read_entry(entry,n);
+
+   return entry->key;
 }
 
 // read_entry()
 
 static void read_entry(entry_t * entry, int n) {
 
+   const uint8 * data;
+   uint16 word[4];
+
    ASSERT(entry!=NULL);
    ASSERT(n>=0&&n<BookSize);
 
+   if (BookData != NULL) {
+
+      data = BookData + (size_t) n * 16;
+
+      memcpy(&entry->key,data,8);
+      memcpy(word,data+8,8);
+
+      entry->key   = BSWAP64(entry->key);
+      entry->move  = BSWAP16(word[0]);
+      entry->count = BSWAP16(word[1]);
+      entry->n     = BSWAP16(word[2]);
+      entry->sum   = BSWAP16(word[3]);
+
+      return;
+   }
+
    if (fseek(BookFile,n*16,SEEK_SET) == -1) {
       my_fatal("read_entry(): fseek(): %s\n",strerror(errno));
    }
@@ -296,11 +514,54 @@ static void read_entry(entry_t * entry, int n) {
 
 static void write_entry(const entry_t * entry, int n) {
 
+   uint8 * data;
+   uint64 key;
+   uint16 word[4];
+   int i;
+
+   ASSERT(entry!=NULL);
+   ASSERT(n>=0&&n<BookSize);
+
+   if (BookData == NULL) {
+      file_write_entry(entry,n);
+      return;
+   }
+
+   // update the private copy, the file is written by book_flush()
+
+   data = BookData + (size_t) n * 16;
+
+   key = BSWAP64(entry->key);
+   word[0] = BSWAP16(entry->move);
+   word[1] = BSWAP16(entry->count);
+   word[2] = BSWAP16(entry->n);
+   word[3] = BSWAP16(entry->sum);
+
+   memcpy(data,&key,8);
+   memcpy(data+8,word,8);
+
+   for (i = 0; i < BookDirtyNb; i++) {
+      if (BookDirty[i] == n) return;
+   }
+
+   if (BookDirtyNb == BookDirtySize) {
+      BookDirtySize = (BookDirtySize == 0) ? 16 : BookDirtySize * 2;
+      BookDirty = (int *) ((BookDirty == NULL) ? my_malloc(BookDirtySize*sizeof(int))
+                                               : my_realloc(BookDirty,BookDirtySize*sizeof(int)));
+   }
+
+   BookDirty[BookDirtyNb++] = n;
+}
+
+// file_write_entry()
+
+static void file_write_entry(const entry_t * entry, int n) {
+
    ASSERT(entry!=NULL);
    ASSERT(n>=0&&n<BookSize);
 
    if (fseek(BookFile,n*16,SEEK_SET) == -1) {
-      my_fatal("write_entry(): fseek(): %s\n",strerror(errno));
+      my_fatal("file_write_entry(): fseek(): %s\n",strerror(errno));
    }
 
    write_integer(BookFile,8,entry->key);
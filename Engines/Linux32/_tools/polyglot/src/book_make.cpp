@@ -9,6 +9,12 @@
 #include <cstdlib>
 #include <cstring>
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
 #include "board.h"
 #include "book_make.h"
 #include "move.h"
@@ -17,31 +23,86 @@
 #include "pgn.h"
 #include "san.h"
 #include "util.h"
-#include "fen.h" 
+#include "fen.h"
 // constants
 
 static const int COUNT_MAX = 16384;
 
 static const int NIL = -1;
 
+static const int ThreadMax = 64;
+
+static const int BatchGames = 1024; // games given to a worker at a time
+static const int RunBuffer = 4096; // entries read at a time from a run file
+
 // types
 
 struct entry_t {
    uint64 key;
    uint16 move;
-   uint16 n;
-   uint16 sum;
    uint16 colour;
+   uint32 n;
+   uint32 sum;
 };
 
 struct book_t {
    int size;
    int alloc;
+   int limit;
    uint32 mask;
    entry_t * entry;
    sint32 * hash;
 };
 
+// games read from the PGN file, parsed by a worker
+
+struct san_t {
+   int string; // offset in text
+   int line;
+   int column;
+};
+
+struct game_t {
+   int number;
+   int result;
+   int fen; // offset in text, NIL from the initial position
+   int move;
+   int move_nb;
+};
+
+struct batch_t {
+   int game_nb;
+   int game_alloc;
+   game_t * game;
+   int move_nb;
+   int move_alloc;
+   san_t * move;
+   int text_size;
+   int text_alloc;
+   char * text;
+};
+
+struct worker_t {
+   int id;
+   book_t book[1];
+   int run_nb;
+   batch_t * batch;
+#ifdef _WIN32
+   HANDLE thread;
+#else
+   pthread_t thread;
+#endif
+};
+
+// sorted sequence of entries, a spilled file or the last run of a worker
+
+struct run_t {
+   FILE * file;
+   entry_t * entry;
+   int size;
+   int pos;
+};
+
 // variables
 
 static int MaxPly;
@@ -50,25 +111,45 @@ static double MinScore;
 static bool RemoveWhite, RemoveBlack;
 static bool Uniform;
 
-static book_t Book[1];
+static int ThreadNb;
+static int MemoryMB;
+
+static const char * BinFile;
+
+static worker_t Worker[ThreadMax];
 
 // prototypes
 
-static void   book_clear    ();
+static void   book_clear    (book_t * book, int limit);
 static void   book_insert   (const char file_name[]);
-static void   book_filter   ();
-static void   book_sort     ();
 static void   book_save     (const char file_name[]);
 
-static int    find_entry    (const board_t * board, int move);
-static void   resize        ();
-static void   halve_stats   (uint64 key);
+static void   batch_clear   (batch_t * batch);
+static bool   batch_read    (batch_t * batch, pgn_t * pgn);
+static int    batch_text    (batch_t * batch, const char string[]);
+
+static void   worker_start  (worker_t * worker);
+static void   worker_join   (worker_t * worker);
+static void   worker_insert (worker_t * worker);
+
+static int    find_entry    (worker_t * worker, const board_t * board, int move);
+static void   resize        (book_t * book);
+static void   spill         (worker_t * worker);
+static void   run_name      (char string[], int worker, int run);
 
-static bool   keep_entry    (int pos);
+static bool   run_next      (run_t * run);
+static bool   run_less      (const run_t * run_1, const run_t * run_2);
+static void   heap_down     (run_t * heap[], int size, int pos);
+
+static int    save_key      (FILE * file, entry_t entry[], int size);
+static void   halve_stats   (entry_t entry[], int size);
+
+static bool   keep_entry    (const entry_t * entry);
 
 static int    entry_score    (const entry_t * entry);
 
 static int    key_compare   (const void * p1, const void * p2);
+static int    move_compare  (const void * p1, const void * p2);
 
 static void   write_integer (FILE * file, int size, uint64 n);
 
@@ -95,6 +176,9 @@ void book_make(int argc, char * argv[]) {
    RemoveBlack = false;
    Uniform = false;
 
+   ThreadNb = 1;
+   MemoryMB = 256;
+
    for (i = 1; i < argc; i++) {
 
       if (false) {
@@ -155,24 +239,35 @@ void book_make(int argc, char * argv[]) {
 
          Uniform = true;
 
+      } else if (my_string_equal(argv[i],"-threads")) {
+
+         i++;
+         if (argv[i] == NULL) my_fatal("book_make(): missing argument\n");
+
+         ThreadNb = atoi(argv[i]);
+         if (ThreadNb < 1) ThreadNb = 1;
+         if (ThreadNb > ThreadMax) ThreadNb = ThreadMax;
+
+      } else if (my_string_equal(argv[i],"-memory")) {
+
+         i++;
+         if (argv[i] == NULL) my_fatal("book_make(): missing argument\n");
+
+         MemoryMB = atoi(argv[i]);
+         if (MemoryMB < 1) MemoryMB = 1;
+
       } else {
 
          my_fatal("book_make(): unknown option \"%s\"\n",argv[i]);
       }
    }
 
-   book_clear();
+   BinFile = bin_file;
 
    printf("inserting games ...\n");
    book_insert(pgn_file);
 
-   printf("filtering entries ...\n");
-   book_filter();
-
-   printf("sorting entries ...\n");
-   book_sort();
-
-   printf("saving entries ...\n");
+   printf("merging and saving entries ...\n");
    book_save(bin_file);
 
    printf("all done!\n");
@@ -180,19 +275,23 @@ void book_make(int argc, char * argv[]) {
 
 // book_clear()
 
-static void book_clear() {
+static void book_clear(book_t * book, int limit) {
 
    int index;
 
-   Book->alloc = 1;
-   Book->mask = (Book->alloc * 2) - 1;
+   ASSERT(book!=NULL);
+   ASSERT(limit>0);
 
-   Book->entry = (entry_t *) my_malloc(Book->alloc*sizeof(entry_t));
-   Book->size = 0;
+   book->alloc = 1;
+   book->limit = limit;
+   book->mask = (book->alloc * 2) - 1;
 
-   Book->hash = (sint32 *) my_malloc((Book->alloc*2)*sizeof(sint32));
-   for (index = 0; index < Book->alloc*2; index++) {
-      Book->hash[index] = NIL;
+   book->entry = (entry_t *) my_malloc(book->alloc*sizeof(entry_t));
+   book->size = 0;
+
+   book->hash = (sint32 *) my_malloc((book->alloc*2)*sizeof(sint32));
+   for (index = 0; index < book->alloc*2; index++) {
+      book->hash[index] = NIL;
    }
 }
 
@@ -201,142 +300,434 @@ static void book_clear() {
 static void book_insert(const char file_name[]) {
 
    pgn_t pgn[1];
-   board_t board[1];
-   int ply;
-   int result;
-   char string[256];
-   int move;
-   int pos;
+   batch_t batch[2][ThreadMax];
+   int round;
+   int limit;
+   int entry_nb;
+   int run_nb;
+   int i;
+   bool more;
 
    ASSERT(file_name!=NULL);
 
    // init
 
+   // each worker gets its share of the memory: entry + 2 hash slots per position/move
+
+   limit = 1;
+   while ((double) limit * 2 * (sizeof(entry_t) + 2*sizeof(sint32)) * ThreadNb <= (double) MemoryMB * 1048576.0) {
+      limit *= 2;
+   }
+
+   for (i = 0; i < ThreadNb; i++) {
+      Worker[i].id = i;
+      Worker[i].run_nb = 0;
+      book_clear(Worker[i].book,limit);
+      batch_clear(&batch[0][i]);
+      batch_clear(&batch[1][i]);
+   }
+
    pgn->game_nb=1;
    // scan loop
 
+   // the workers parse the games of one round while the next one is read
+
    pgn_open(pgn,file_name);
-   while (pgn_next_game(pgn)) {
 
-      board_start(board);
-      ply = 0;
-      result = 0;
+   round = 0;
+   more = true;
+   for (i = 0; i < ThreadNb && more; i++) more = batch_read(&batch[round][i],pgn);
+
+   while (batch[round][0].game_nb > 0) {
+
+      for (i = 0; i < ThreadNb; i++) {
+         Worker[i].batch = &batch[round][i];
+         worker_start(&Worker[i]);
+      }
+
+      for (i = 0; i < ThreadNb; i++) {
+         batch[1-round][i].game_nb = 0;
+         if (more) more = batch_read(&batch[1-round][i],pgn);
+      }
+
+      for (i = 0; i < ThreadNb; i++) worker_join(&Worker[i]);
+
+      round = 1 - round;
+   }
+
+   pgn_close(pgn);
+
+   entry_nb = 0;
+   run_nb = 0;
+
+   for (i = 0; i < ThreadNb; i++) {
+      entry_nb += Worker[i].book->size;
+      run_nb += Worker[i].run_nb;
+      my_free(batch[0][i].game);
+      my_free(batch[0][i].move);
+      my_free(batch[0][i].text);
+      my_free(batch[1][i].game);
+      my_free(batch[1][i].move);
+      my_free(batch[1][i].text);
+   }
+
+   printf("%d game%s.\n",pgn->game_nb,(pgn->game_nb>2)?"s":"");
+   printf("%d entries",entry_nb);
+   if (run_nb > 0) printf(", %d run%s spilled to disk",run_nb,(run_nb>1)?"s":"");
+   printf(".\n");
+
+   return;
+}
+
+// book_save()
+
+static void book_save(const char file_name[]) {
+
+   FILE * file;
+   run_t * run;
+   run_t * * heap;
+   int run_nb, heap_nb;
+   entry_t * group;
+   int group_nb, group_alloc;
+   entry_t * entry;
+   int entry_nb;
+   char name[256];
+   int i, r;
+
+   ASSERT(file_name!=NULL);
+
+   // runs: the files spilled by the workers and what is left in their tables
+
+   run_nb = 0;
+   for (i = 0; i < ThreadNb; i++) run_nb += Worker[i].run_nb + 1;
+
+   run = (run_t *) my_malloc(run_nb*sizeof(run_t));
+   heap = (run_t * *) my_malloc(run_nb*sizeof(run_t *));
+
+   run_nb = 0;
+
+   for (i = 0; i < ThreadNb; i++) {
+
+      for (r = 0; r < Worker[i].run_nb; r++) {
+
+         run_name(name,i,r);
+
+         run[run_nb].file = fopen(name,"rb");
+         if (run[run_nb].file == NULL) my_fatal("book_save(): can't open file \"%s\": %s\n",name,strerror(errno));
+
+         run[run_nb].entry = (entry_t *) my_malloc(RunBuffer*sizeof(entry_t));
+         run[run_nb].size = 0;
+         run[run_nb].pos = 0;
+         run_nb++;
+      }
+
+      my_free(Worker[i].book->hash);
+      qsort(Worker[i].book->entry,Worker[i].book->size,sizeof(entry_t),&move_compare);
+
+      run[run_nb].file = NULL;
+      run[run_nb].entry = Worker[i].book->entry;
+      run[run_nb].size = Worker[i].book->size;
+      run[run_nb].pos = -1;
+      run_nb++;
+   }
+
+   heap_nb = 0;
+
+   for (r = 0; r < run_nb; r++) {
+      if (run_next(&run[r])) heap[heap_nb++] = &run[r];
+   }
+
+   for (i = heap_nb / 2 - 1; i >= 0; i--) heap_down(heap,heap_nb,i);
+
+   file = fopen(file_name,"wb");
+   if (file == NULL) my_fatal("book_save(): can't open file \"%s\" for writing: %s\n",file_name,strerror(errno));
+   setvbuf(file,NULL,_IOFBF,1048576);
+
+   // k-way merge, the moves of a key are collected and saved together
+
+   group_alloc = 256;
+   group = (entry_t *) my_malloc(group_alloc*sizeof(entry_t));
+   group_nb = 0;
+
+   entry_nb = 0;
+
+   while (heap_nb > 0) {
+
+      entry = &heap[0]->entry[heap[0]->pos];
+
+      if (group_nb > 0 && group[group_nb-1].key != entry->key) {
+         entry_nb += save_key(file,group,group_nb);
+         group_nb = 0;
+      }
+
+      if (group_nb > 0 && group[group_nb-1].move == entry->move) {
+
+         group[group_nb-1].n += entry->n;
+         group[group_nb-1].sum += entry->sum;
+
+      } else {
+
+         if (group_nb == group_alloc) {
+            group_alloc *= 2;
+            group = (entry_t *) my_realloc(group,group_alloc*sizeof(entry_t));
+         }
+
+         group[group_nb++] = *entry;
+      }
+
+      if (!run_next(heap[0])) heap[0] = heap[--heap_nb];
+      heap_down(heap,heap_nb,0);
+   }
+
+   if (group_nb > 0) entry_nb += save_key(file,group,group_nb);
+
+   fclose(file);
+
+   printf("%d entries.\n",entry_nb);
+
+   // free
+
+   for (r = 0; r < run_nb; r++) {
+      if (run[r].file != NULL) {
+         fclose(run[r].file);
+      }
+      my_free(run[r].entry);
+   }
+
+   for (i = 0; i < ThreadNb; i++) {
+      for (r = 0; r < Worker[i].run_nb; r++) {
+         run_name(name,i,r);
+         remove(name);
+      }
+   }
+
+   my_free(group);
+   my_free(heap);
+   my_free(run);
+}
+
+// batch_clear()
+
+static void batch_clear(batch_t * batch) {
+
+   ASSERT(batch!=NULL);
+
+   batch->game_nb = 0;
+   batch->game_alloc = BatchGames;
+   batch->game = (game_t *) my_malloc(batch->game_alloc*sizeof(game_t));
+
+   batch->move_nb = 0;
+   batch->move_alloc = BatchGames * 64;
+   batch->move = (san_t *) my_malloc(batch->move_alloc*sizeof(san_t));
+
+   batch->text_size = 0;
+   batch->text_alloc = BatchGames * 64 * 8;
+   batch->text = (char *) my_malloc(batch->text_alloc);
+}
+
+// batch_read()
+
+static bool batch_read(batch_t * batch, pgn_t * pgn) {
+
+   game_t * game;
+   san_t * san;
+   char string[256];
+
+   ASSERT(batch!=NULL);
+   ASSERT(pgn!=NULL);
+
+   // moves after MaxPly are skipped here, the SAN is parsed by the workers
+
+   batch->game_nb = 0;
+   batch->move_nb = 0;
+   batch->text_size = 0;
+
+   while (batch->game_nb < BatchGames) {
+
+      if (!pgn_next_game(pgn)) return false;
+
+      game = &batch->game[batch->game_nb++];
+
+      game->number = pgn->game_nb;
+      game->result = 0;
+      game->fen = (strlen(pgn->fen) > 0) ? batch_text(batch,pgn->fen) : NIL;
+      game->move = batch->move_nb;
+      game->move_nb = 0;
 
-	  if(strlen(pgn->fen)>0) //we've got FEN !
-	  {
-		  board_from_fen(board,pgn->fen);
-		  //convert move number to ply number
-		  ply=(board->move_nb-1)/2;
-		  if(board->turn==Black) ply++;
-	  }
       if (false) {
       } else if (my_string_equal(pgn->result,"1-0")) {
-         result = +1;
+         game->result = +1;
       } else if (my_string_equal(pgn->result,"0-1")) {
-         result = -1;
+         game->result = -1;
       }
 
       while (pgn_next_move(pgn,string,sizeof(string))) {
 
-         if (ply < MaxPly) {
-
-            move = move_from_san(string,board);
+         if (game->move_nb >= MaxPly) continue;
 
-            if (move == MoveNone || !move_is_legal(move,board)) {
-               my_fatal("book_insert(): illegal move \"%s\" at line %d, column %d,game %d\n",string,pgn->move_line,pgn->move_column,pgn->game_nb);
-            }
-
-            pos = find_entry(board,move);
+         if (batch->move_nb == batch->move_alloc) {
+            batch->move_alloc *= 2;
+            batch->move = (san_t *) my_realloc(batch->move,batch->move_alloc*sizeof(san_t));
+         }
 
-            Book->entry[pos].n++;
-            Book->entry[pos].sum += (uint16)(result+1);
+         san = &batch->move[batch->move_nb++];
 
-            if (Book->entry[pos].n >= COUNT_MAX) {
-               halve_stats(board->key);
-            }
+         san->string = batch_text(batch,string);
+         san->line = pgn->move_line;
+         san->column = pgn->move_column;
 
-            move_do(board,move);
-            ply++;
-            result = -result;
-         }
+         game->move_nb++;
       }
-	  pgn->game_nb++;
+
+      pgn->game_nb++;
       if (pgn->game_nb % 10000 == 0) printf("%d games ...\n",pgn->game_nb);
    }
 
-   pgn_close(pgn);
+   return true;
+}
 
-   printf("%d game%s.\n",pgn->game_nb,(pgn->game_nb>2)?"s":"");
-   printf("%d entries.\n",Book->size);
+// batch_text()
 
-   return;
+static int batch_text(batch_t * batch, const char string[]) {
+
+   int pos;
+   int len;
+
+   ASSERT(batch!=NULL);
+   ASSERT(string!=NULL);
+
+   len = (int) strlen(string) + 1;
+
+   while (batch->text_size + len > batch->text_alloc) {
+      batch->text_alloc *= 2;
+      batch->text = (char *) my_realloc(batch->text,batch->text_alloc);
+   }
+
+   pos = batch->text_size;
+   memcpy(&batch->text[pos],string,len);
+   batch->text_size += len;
+
+   return pos;
 }
 
-// book_filter()
+// worker_loop()
 
-static void book_filter() {
+#ifdef _WIN32
 
-   int src, dst;
+static DWORD WINAPI worker_loop(LPVOID param) {
 
-   // entry loop
+   worker_insert((worker_t *) param);
 
-   dst = 0;
+   return 0;
+}
 
-   for (src = 0; src < Book->size; src++) {
-      if (keep_entry(src)) Book->entry[dst++] = Book->entry[src];
-   }
+#else
 
-   ASSERT(dst>=0&&dst<=Book->size);
-   Book->size = dst;
+static void * worker_loop(void * param) {
 
-   printf("%d entries.\n",Book->size);
+   worker_insert((worker_t *) param);
+
+   return NULL;
 }
 
-// book_sort()
+#endif
+
+// worker_start()
 
-static void book_sort() {
+static void worker_start(worker_t * worker) {
 
-   // sort keys for binary search
+   ASSERT(worker!=NULL);
 
-   qsort(Book->entry,Book->size,sizeof(entry_t),&key_compare);
+#ifdef _WIN32
+   worker->thread = CreateThread(NULL,0,worker_loop,worker,0,NULL);
+   if (worker->thread == NULL) my_fatal("worker_start(): CreateThread() failed\n");
+#else
+   if (pthread_create(&worker->thread,NULL,worker_loop,worker) != 0) {
+      my_fatal("worker_start(): pthread_create() failed\n");
+   }
+#endif
 }
 
-// book_save()
+// worker_join()
 
-static void book_save(const char file_name[]) {
+static void worker_join(worker_t * worker) {
 
-   FILE * file;
+   ASSERT(worker!=NULL);
+
+#ifdef _WIN32
+   WaitForSingleObject(worker->thread,INFINITE);
+   CloseHandle(worker->thread);
+#else
+   pthread_join(worker->thread,NULL);
+#endif
+}
+
+// worker_insert()
+
+static void worker_insert(worker_t * worker) {
+
+   const batch_t * batch;
+   const game_t * game;
+   const san_t * san;
+   board_t board[1];
+   int ply;
+   int result;
+   int move;
    int pos;
+   int g, m;
 
-   ASSERT(file_name!=NULL);
+   ASSERT(worker!=NULL);
 
-   file = fopen(file_name,"wb");
-   if (file == NULL) my_fatal("book_save(): can't open file \"%s\" for writing: %s\n",file_name,strerror(errno));
+   batch = worker->batch;
 
-   // entry loop
+   for (g = 0; g < batch->game_nb; g++) {
 
-   for (pos = 0; pos < Book->size; pos++) {
+      game = &batch->game[g];
 
-      ASSERT(keep_entry(pos));
+      board_start(board);
+      ply = 0;
+      result = game->result;
 
-      write_integer(file,8,Book->entry[pos].key);
-      write_integer(file,2,Book->entry[pos].move);
-      write_integer(file,2,entry_score(&Book->entry[pos]));
-      write_integer(file,2,0);
-      write_integer(file,2,0);
-   }
+	  if(game->fen != NIL) //we've got FEN !
+	  {
+		  board_from_fen(board,&batch->text[game->fen]);
+		  //convert move number to ply number
+		  ply=(board->move_nb-1)/2;
+		  if(board->turn==Black) ply++;
+	  }
 
-   fclose(file);
+      for (m = 0; m < game->move_nb && ply < MaxPly; m++) {
+
+         san = &batch->move[game->move+m];
+
+         move = move_from_san(&batch->text[san->string],board);
+
+         if (move == MoveNone || !move_is_legal(move,board)) {
+            my_fatal("book_insert(): illegal move \"%s\" at line %d, column %d,game %d\n",&batch->text[san->string],san->line,san->column,game->number);
+         }
+
+         pos = find_entry(worker,board,move);
+
+         worker->book->entry[pos].n++;
+         worker->book->entry[pos].sum += (uint32)(result+1);
+
+         move_do(board,move);
+         ply++;
+         result = -result;
+      }
+   }
 }
 
 // find_entry()
 
-static int find_entry(const board_t * board, int move) {
+static int find_entry(worker_t * worker, const board_t * board, int move) {
 
+   book_t * book;
    uint64 key;
    int index;
    int pos;
 
+   ASSERT(worker!=NULL);
    ASSERT(board!=NULL);
    ASSERT(move_is_ok(move));
 
@@ -344,128 +735,263 @@ static int find_entry(const board_t * board, int move) {
 
    // init
 
+   book = worker->book;
    key = board->key;
 
    // search
 
-   for (index = (int)(key & Book->mask); (pos=Book->hash[index]) != NIL; index = (index+1) & Book->mask) {
+   for (index = (int)(key & book->mask); (pos=book->hash[index]) != NIL; index = (index+1) & book->mask) {
 
-      ASSERT(pos>=0&&pos<Book->size);
+      ASSERT(pos>=0&&pos<book->size);
 
-      if (Book->entry[pos].key == key && Book->entry[pos].move == move) {
+      if (book->entry[pos].key == key && book->entry[pos].move == move) {
          return pos; // found
       }
    }
 
    // not found
 
-   ASSERT(Book->size<=Book->alloc);
+   ASSERT(book->size<=book->alloc);
 
-   if (Book->size == Book->alloc) {
+   if (book->size == book->alloc) {
 
-      // allocate more memory
+      // allocate more memory, or write the table to disk when it reached its limit
 
-      resize();
+      if (book->alloc < book->limit) {
+         resize(book);
+      } else {
+         spill(worker);
+      }
 
-      for (index = (int)(key & Book->mask); Book->hash[index] != NIL; index = (index+1) & Book->mask)
+      for (index = (int)(key & book->mask); book->hash[index] != NIL; index = (index+1) & book->mask)
          ;
    }
 
    // create a new entry
 
-   ASSERT(Book->size<Book->alloc);
-   pos = Book->size++;
+   ASSERT(book->size<book->alloc);
+   pos = book->size++;
 
-   Book->entry[pos].key = key;
-   Book->entry[pos].move = (uint16)move;
-   Book->entry[pos].n = 0;
-   Book->entry[pos].sum = 0;
-   Book->entry[pos].colour = board->turn;
+   book->entry[pos].key = key;
+   book->entry[pos].move = (uint16)move;
+   book->entry[pos].n = 0;
+   book->entry[pos].sum = 0;
+   book->entry[pos].colour = board->turn;
 
    // insert into the hash table
 
-   ASSERT(index>=0&&index<Book->alloc*2);
-   ASSERT(Book->hash[index]==NIL);
-   Book->hash[index] = pos;
+   ASSERT(index>=0&&index<book->alloc*2);
+   ASSERT(book->hash[index]==NIL);
+   book->hash[index] = pos;
 
-   ASSERT(pos>=0&&pos<Book->size);
+   ASSERT(pos>=0&&pos<book->size);
 
    return pos;
 }
 
 // resize()
 
-static void resize() {
+static void resize(book_t * book) {
 
-   int size;
+   double size;
    int pos;
    int index;
 
-   ASSERT(Book->size==Book->alloc);
+   ASSERT(book->size==book->alloc);
 
-   Book->alloc *= 2;
-   Book->mask = (Book->alloc * 2) - 1;
+   book->alloc *= 2;
+   book->mask = (book->alloc * 2) - 1;
 
    size = 0;
-   size += Book->alloc * sizeof(entry_t);
-   size += (Book->alloc*2) * sizeof(sint32);
-   if (size >= 1048576) printf("allocating %gMB ...\n",double(size)/1048576.0);
+   size += double(book->alloc) * sizeof(entry_t);
+   size += double(book->alloc*2) * sizeof(sint32);
+   if (size >= 1048576 && ThreadNb == 1) printf("allocating %gMB ...\n",size/1048576.0);
    // resize arrays
 
-   Book->entry = (entry_t *) my_realloc(Book->entry,Book->alloc*sizeof(entry_t));
-   Book->hash = (sint32 *) my_realloc(Book->hash,(Book->alloc*2)*sizeof(sint32));
+   book->entry = (entry_t *) my_realloc(book->entry,book->alloc*sizeof(entry_t));
+   book->hash = (sint32 *) my_realloc(book->hash,(book->alloc*2)*sizeof(sint32));
 
    // rebuild hash table
 
-   for (index = 0; index < Book->alloc*2; index++) {
-      Book->hash[index] = NIL;
+   for (index = 0; index < book->alloc*2; index++) {
+      book->hash[index] = NIL;
    }
 
-   for (pos = 0; pos < Book->size; pos++) {
+   for (pos = 0; pos < book->size; pos++) {
 
-      for (index = (int) (Book->entry[pos].key & Book->mask)
-		   ; Book->hash[index] != NIL; index = (index+1) & Book->mask)
+      for (index = (int) (book->entry[pos].key & book->mask)
+		   ; book->hash[index] != NIL; index = (index+1) & book->mask)
          ;
 
-      ASSERT(index>=0&&index<Book->alloc*2);
-      Book->hash[index] = pos;
+      ASSERT(index>=0&&index<book->alloc*2);
+      book->hash[index] = pos;
    }
 }
 
-// halve_stats()
+// spill()
 
-static void halve_stats(uint64 key) {
+static void spill(worker_t * worker) {
 
+   book_t * book;
+   FILE * file;
+   char name[256];
    int index;
+
+   ASSERT(worker!=NULL);
+
+   book = worker->book;
+
+   // sorted run, merged by book_save()
+
+   qsort(book->entry,book->size,sizeof(entry_t),&move_compare);
+
+   run_name(name,worker->id,worker->run_nb);
+
+   file = fopen(name,"wb");
+   if (file == NULL) my_fatal("spill(): can't open file \"%s\" for writing: %s\n",name,strerror(errno));
+
+   if (fwrite(book->entry,sizeof(entry_t),book->size,file) != (size_t) book->size) {
+      my_fatal("spill(): fwrite(): %s\n",strerror(errno));
+   }
+
+   if (fclose(file) == EOF) my_fatal("spill(): fclose(): %s\n",strerror(errno));
+
+   worker->run_nb++;
+
+   book->size = 0;
+
+   for (index = 0; index < book->alloc*2; index++) {
+      book->hash[index] = NIL;
+   }
+}
+
+// run_name()
+
+static void run_name(char string[], int worker, int run) {
+
+   ASSERT(string!=NULL);
+
+   sprintf(string,"%.200s.%d.%d.tmp",BinFile,worker,run);
+}
+
+// run_next()
+
+static bool run_next(run_t * run) {
+
+   ASSERT(run!=NULL);
+
+   run->pos++;
+
+   if (run->pos < run->size) return true;
+   if (run->file == NULL) return false;
+
+   run->size = (int) fread(run->entry,sizeof(entry_t),RunBuffer,run->file);
+   run->pos = 0;
+
+   return run->size > 0;
+}
+
+// run_less()
+
+static bool run_less(const run_t * run_1, const run_t * run_2) {
+
+   return move_compare(&run_1->entry[run_1->pos],&run_2->entry[run_2->pos]) < 0;
+}
+
+// heap_down()
+
+static void heap_down(run_t * heap[], int size, int pos) {
+
+   run_t * run;
+   int child;
+
+   ASSERT(heap!=NULL);
+
+   if (size == 0) return;
+
+   run = heap[pos];
+
+   while ((child = pos * 2 + 1) < size) {
+
+      if (child+1 < size && run_less(heap[child+1],heap[child])) child++;
+      if (!run_less(heap[child],run)) break;
+
+      heap[pos] = heap[child];
+      pos = child;
+   }
+
+   heap[pos] = run;
+}
+
+// save_key()
+
+static int save_key(FILE * file, entry_t entry[], int size) {
+
+   int src, dst;
+
+   ASSERT(file!=NULL);
+   ASSERT(entry!=NULL);
+   ASSERT(size>0);
+
+   // the counters are 32 bits, scaled down to the 16 bits of the file here
+
+   halve_stats(entry,size);
+
+   dst = 0;
+
+   for (src = 0; src < size; src++) {
+      if (keep_entry(&entry[src])) entry[dst++] = entry[src];
+   }
+
+   qsort(entry,dst,sizeof(entry_t),&key_compare);
+
+   for (src = 0; src < dst; src++) {
+
+      write_integer(file,8,entry[src].key);
+      write_integer(file,2,entry[src].move);
+      write_integer(file,2,entry_score(&entry[src]));
+      write_integer(file,2,0);
+      write_integer(file,2,0);
+   }
+
+   return dst;
+}
+
+// halve_stats()
+
+static void halve_stats(entry_t entry[], int size) {
+
+   uint32 max;
    int pos;
 
-   // search
+   max = 0;
 
-   for (index = (int)(key & Book->mask); (pos=Book->hash[index]) != NIL; index = (index+1) & Book->mask) {
+   for (pos = 0; pos < size; pos++) {
+      if (entry[pos].n > max) max = entry[pos].n;
+   }
 
-      ASSERT(pos>=0&&pos<Book->size);
+   while (max >= (uint32) COUNT_MAX) {
 
-      if (Book->entry[pos].key == key) {
-         Book->entry[pos].n = (Book->entry[pos].n + 1) / 2;
-         Book->entry[pos].sum = (Book->entry[pos].sum + 1) / 2;
+      for (pos = 0; pos < size; pos++) {
+         entry[pos].n = (entry[pos].n + 1) / 2;
+         entry[pos].sum = (entry[pos].sum + 1) / 2;
       }
+
+      max = (max + 1) / 2;
    }
 }
 
 // keep_entry()
 
-static bool keep_entry(int pos) {
+static bool keep_entry(const entry_t * entry) {
 
-   const entry_t * entry;
    int colour;
    double score;
 
-   ASSERT(pos>=0&&pos<Book->size);
-
-   entry = &Book->entry[pos];
+   ASSERT(entry!=NULL);
 
    // if (entry->n == 0) return false;
-   if (entry->n < MinGame) return false;
+   if (entry->n < (uint32) MinGame) return false;
 
    if (entry->sum == 0) return false;
 
@@ -520,8 +1046,33 @@ static int key_compare(const void * p1, const void * p2) {
       return +1;
    } else if (entry_1->key < entry_2->key) {
       return -1;
-   } else {
+   } else if (entry_score(entry_1) != entry_score(entry_2)) {
       return entry_score(entry_2) - entry_score(entry_1); // highest score first
+   } else {
+      return entry_1->move - entry_2->move;
+   }
+}
+
+// move_compare()
+
+static int move_compare(const void * p1, const void * p2) {
+
+   const entry_t * entry_1, * entry_2;
+
+   ASSERT(p1!=NULL);
+   ASSERT(p2!=NULL);
+
+   entry_1 = (const entry_t *) p1;
+   entry_2 = (const entry_t *) p2;
+
+   // order of the runs
+
+   if (entry_1->key > entry_2->key) {
+      return +1;
+   } else if (entry_1->key < entry_2->key) {
+      return -1;
+   } else {
+      return entry_1->move - entry_2->move;
    }
 }
 
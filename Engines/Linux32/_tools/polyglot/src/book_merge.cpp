@@ -1,4 +1,3 @@
-
 // book_merge.cpp
 
 // includes
@@ -11,11 +10,29 @@
 #include "book_merge.h"
 #include "util.h"
 
+// constants
+
+static const int BookMax = 1024;
+
+static const int BlockSize = 65536; // entries read or written at a time (1 MB)
+
+// what to do with a key found in several books
+
+static const int PolicyFirst   = 0; // the moves of the first book, the others are skipped
+static const int PolicySum     = 1; // weights and learn data added
+static const int PolicyMax     = 2; // highest weight, with its learn data
+static const int PolicyAverage = 3; // average weight, learn data averaged by weight
+
 // types
 
 struct book_t {
    FILE * file;
    int size;
+   int pos;
+   uint8 * block;
+   int block_size;
+   int block_pos;
+   bool write;
 };
 
 struct entry_t {
@@ -24,14 +41,17 @@ struct entry_t {
    uint16 count;
    uint16 n;
    uint16 sum;
+   int book;
 };
 
 // variables
 
-static book_t In1[1];
-static book_t In2[1];
+static int BookNb;
+static book_t Book[BookMax];
 static book_t Out[1];
 
+static int Policy;
+
 // prototypes
 
 static void   book_clear    (book_t * book);
@@ -39,11 +59,20 @@ static void   book_clear    (book_t * book);
 static void   book_open     (book_t * book, const char file_name[], const char mode[]);
 static void   book_close    (book_t * book);
 
-static bool   read_entry    (book_t * book, entry_t * entry, int n);
+static bool   read_entry    (book_t * book, entry_t * entry);
 static void   write_entry   (book_t * book, const entry_t * entry);
+static void   write_flush   (book_t * book);
+
+static bool   heap_less     (const entry_t * entry_1, const entry_t * entry_2);
+static void   heap_down     (entry_t heap[], int size, int pos);
+
+static int    merge_key     (entry_t entry[], int size);
+
+static int    move_compare  (const void * p1, const void * p2);
+static int    count_compare (const void * p1, const void * p2);
 
-static uint64 read_integer  (FILE * file, int size);
-static void   write_integer (FILE * file, int size, uint64 n);
+static uint64 get_integer   (const uint8 * data, int size);
+static void   put_integer   (uint8 * data, int size, uint64 n);
 
 // functions
 
@@ -52,23 +81,23 @@ static void   write_integer (FILE * file, int size, uint64 n);
 void book_merge(int argc, char * argv[]) {
 
    int i;
-   const char * in_file_1;
-   const char * in_file_2;
+   const char * in_file[BookMax];
    const char * out_file;
-   int i1, i2;
-   bool b1, b2;
-   entry_t e1[1], e2[1];
-   int skip;
-
-   in_file_1 = NULL;
-   my_string_clear(&in_file_1);
+   entry_t * heap;
+   int heap_nb;
+   entry_t * group;
+   int group_nb, group_alloc;
+   int read, written, skip;
+   int b;
 
-   in_file_2 = NULL;
-   my_string_clear(&in_file_2);
+   for (b = 0; b < BookMax; b++) in_file[b] = NULL;
+   BookNb = 0;
 
    out_file = NULL;
    my_string_set(&out_file,"out.bin");
 
+   Policy = PolicyFirst;
+
    for (i = 1; i < argc; i++) {
 
       if (false) {
@@ -77,19 +106,27 @@ void book_merge(int argc, char * argv[]) {
 
          // skip
 
-      } else if (my_string_equal(argv[i],"-in1")) {
+      } else if (my_string_equal(argv[i],"-in1") || my_string_equal(argv[i],"-in2")) {
+
+         // the first two books, as in the two book version
+
+         b = (argv[i][3] == '1') ? 0 : 1;
 
          i++;
          if (argv[i] == NULL) my_fatal("book_merge(): missing argument\n");
 
-         my_string_set(&in_file_1,argv[i]);
+         my_string_set(&in_file[b],argv[i]);
+         if (BookNb < b+1) BookNb = b+1;
 
-      } else if (my_string_equal(argv[i],"-in2")) {
+      } else if (my_string_equal(argv[i],"-in")) {
 
          i++;
          if (argv[i] == NULL) my_fatal("book_merge(): missing argument\n");
 
-         my_string_set(&in_file_2,argv[i]);
+         while (BookNb < BookMax && in_file[BookNb] != NULL) BookNb++;
+         if (BookNb == BookMax) my_fatal("book_merge(): too many books\n");
+
+         my_string_set(&in_file[BookNb++],argv[i]);
 
       } else if (my_string_equal(argv[i],"-out")) {
 
@@ -98,72 +135,108 @@ void book_merge(int argc, char * argv[]) {
 
          my_string_set(&out_file,argv[i]);
 
+      } else if (my_string_equal(argv[i],"-policy")) {
+
+         i++;
+         if (argv[i] == NULL) my_fatal("book_merge(): missing argument\n");
+
+         if (false) {
+         } else if (my_string_equal(argv[i],"first")) {
+            Policy = PolicyFirst;
+         } else if (my_string_equal(argv[i],"sum")) {
+            Policy = PolicySum;
+         } else if (my_string_equal(argv[i],"max")) {
+            Policy = PolicyMax;
+         } else if (my_string_equal(argv[i],"average")) {
+            Policy = PolicyAverage;
+         } else {
+            my_fatal("book_merge(): unknown policy \"%s\"\n",argv[i]);
+         }
+
       } else {
 
          my_fatal("book_merge(): unknown option \"%s\"\n",argv[i]);
       }
    }
 
-   book_clear(In1);
-   book_clear(In2);
-   book_clear(Out);
+   for (b = 0; b < BookNb; b++) {
+      if (in_file[b] == NULL) my_fatal("book_merge(): missing book %d\n",b+1);
+   }
+
+   if (BookNb == 0) my_fatal("book_merge(): no book to merge\n");
+
+   for (b = 0; b < BookNb; b++) {
+      book_clear(&Book[b]);
+      book_open(&Book[b],in_file[b],"rb");
+   }
 
-   book_open(In1,in_file_1,"rb");
-   book_open(In2,in_file_2,"rb");
+   book_clear(Out);
    book_open(Out,out_file,"wb");
 
-   skip = 0;
+   // k-way merge, the heap holds the next entry of each book
 
-   i1 = 0;
-   i2 = 0;
+   heap = (entry_t *) my_malloc(BookNb*sizeof(entry_t));
+   heap_nb = 0;
 
-   while (true) {
+   for (b = 0; b < BookNb; b++) {
+      if (read_entry(&Book[b],&heap[heap_nb])) {
+         heap[heap_nb++].book = b;
+      }
+   }
 
-      b1 = read_entry(In1,e1,i1);
-      b2 = read_entry(In2,e2,i2);
+   for (i = heap_nb / 2 - 1; i >= 0; i--) heap_down(heap,heap_nb,i);
 
-      if (false) {
+   group_alloc = 256;
+   group = (entry_t *) my_malloc(group_alloc*sizeof(entry_t));
+   group_nb = 0;
 
-      } else if (!b1 && !b2) {
+   read = 0;
+   written = 0;
 
-         break;
+   while (heap_nb > 0 || group_nb > 0) {
 
-      } else if (b1 && !b2) {
+      // the entries of a key are collected, book after book
 
-         write_entry(Out,e1);
-         i1++;
+      if (group_nb > 0 && (heap_nb == 0 || heap[0].key != group[0].key)) {
 
-      } else if (b2 && !b1) {
+         group_nb = merge_key(group,group_nb);
 
-         write_entry(Out,e2);
-         i2++;
+         for (i = 0; i < group_nb; i++) write_entry(Out,&group[i]);
+         written += group_nb;
 
-      } else {
+         group_nb = 0;
+         continue;
+      }
 
-         ASSERT(b1);
-         ASSERT(b2);
+      if (group_nb == group_alloc) {
+         group_alloc *= 2;
+         group = (entry_t *) my_realloc(group,group_alloc*sizeof(entry_t));
+      }
 
-         if (false) {
-         } else if (e1->key < e2->key) {
-            write_entry(Out,e1);
-            i1++;
-         } else if (e1->key > e2->key) {
-            write_entry(Out,e2);
-            i2++;
-         } else {
-            ASSERT(e1->key==e2->key);
-            skip++;
-            i2++;
-         }
+      group[group_nb++] = heap[0];
+      read++;
+
+      b = heap[0].book;
+
+      if (read_entry(&Book[b],&heap[0])) {
+         heap[0].book = b;
+      } else {
+         heap[0] = heap[--heap_nb];
       }
+
+      heap_down(heap,heap_nb,0);
    }
 
-   book_close(In1);
-   book_close(In2);
+   for (b = 0; b < BookNb; b++) book_close(&Book[b]);
    book_close(Out);
 
+   my_free(group);
+   my_free(heap);
+
+   skip = read - written;
+
    if (skip != 0) {
-      printf("skipped %d entr%s.\n",skip,(skip>1)?"ies":"y");
+      printf("%s %d entr%s.\n",(Policy==PolicyFirst)?"skipped":"merged",skip,(skip>1)?"ies":"y");
    }
 
    printf("done!\n");
@@ -177,6 +250,11 @@ static void book_clear(book_t * book) {
 
    book->file = NULL;
    book->size = 0;
+   book->pos = 0;
+   book->block = NULL;
+   book->block_size = 0;
+   book->block_pos = 0;
+   book->write = false;
 }
 
 // book_open()
@@ -195,6 +273,17 @@ static void book_open(book_t * book, const char file_name[], const char mode[])
    }
 
    book->size = ftell(book->file) / 16;
+
+   if (fseek(book->file,0,SEEK_SET) == -1) {
+      my_fatal("book_open(): fseek(): %s\n",strerror(errno));
+   }
+
+   // whole blocks are read and written, the stdio buffer is not needed
+
+   setvbuf(book->file,NULL,_IONBF,0);
+
+   book->block = (uint8 *) my_malloc(BlockSize*16);
+   book->write = (mode[0] == 'w');
 }
 
 // book_close()
@@ -203,31 +292,51 @@ static void book_close(book_t * book) {
 
    ASSERT(book!=NULL);
 
+   write_flush(book);
+
    if (fclose(book->file) == EOF) {
       my_fatal("book_close(): fclose(): %s\n",strerror(errno));
    }
+
+   my_free(book->block);
+   book->block = NULL;
 }
 
 // read_entry()
 
-static bool read_entry(book_t * book, entry_t * entry, int n) {
+static bool read_entry(book_t * book, entry_t * entry) {
+
+   const uint8 * data;
+   int size;
 
    ASSERT(book!=NULL);
    ASSERT(entry!=NULL);
 
-   if (n < 0 || n >= book->size) return false;
+   if (book->pos >= book->size) return false;
+
+   if (book->block_pos == book->block_size) {
+
+      size = book->size - book->pos;
+      if (size > BlockSize) size = BlockSize;
 
-   ASSERT(n>=0&&n<book->size);
+      if (fread(book->block,16,size,book->file) != (size_t) size) {
+         my_fatal("read_entry(): fread(): %s\n",feof(book->file)?"EOF reached":strerror(errno));
+      }
 
-   if (fseek(book->file,n*16,SEEK_SET) == -1) {
-      my_fatal("read_entry(): fseek(): %s\n",strerror(errno));
+      book->block_size = size;
+      book->block_pos = 0;
    }
 
-   entry->key   = read_integer(book->file,8);
-   entry->move  = (uint16)read_integer(book->file,2);
-   entry->count = (uint16)read_integer(book->file,2);
-   entry->n     = (uint16)read_integer(book->file,2);
-   entry->sum   = (uint16)read_integer(book->file,2);
+   data = book->block + book->block_pos * 16;
+
+   entry->key   = get_integer(data,8);
+   entry->move  = (uint16)get_integer(data+8,2);
+   entry->count = (uint16)get_integer(data+10,2);
+   entry->n     = (uint16)get_integer(data+12,2);
+   entry->sum   = (uint16)get_integer(data+14,2);
+
+   book->block_pos++;
+   book->pos++;
 
    return true;
 }
@@ -236,69 +345,235 @@ static bool read_entry(book_t * book, entry_t * entry, int n) {
 
 static void write_entry(book_t * book, const entry_t * entry) {
 
+   uint8 * data;
+
    ASSERT(book!=NULL);
    ASSERT(entry!=NULL);
 
-   write_integer(book->file,8,entry->key);
-   write_integer(book->file,2,entry->move);
-   write_integer(book->file,2,entry->count);
-   write_integer(book->file,2,entry->n);
-   write_integer(book->file,2,entry->sum);
+   if (book->block_size == BlockSize) write_flush(book);
+
+   data = book->block + book->block_size * 16;
+
+   put_integer(data,8,entry->key);
+   put_integer(data+8,2,entry->move);
+   put_integer(data+10,2,entry->count);
+   put_integer(data+12,2,entry->n);
+   put_integer(data+14,2,entry->sum);
+
+   book->block_size++;
 }
 
-// read_integer()
+// write_flush()
 
-static uint64 read_integer(FILE * file, int size) {
+static void write_flush(book_t * book) {
 
-   uint64 n;
-   int i;
-   int b;
+   ASSERT(book!=NULL);
 
-   ASSERT(file!=NULL);
-   ASSERT(size>0&&size<=8);
+   if (!book->write || book->block_size == 0) return;
 
-   n = 0;
+   if (fwrite(book->block,16,book->block_size,book->file) != (size_t) book->block_size) {
+      my_fatal("write_flush(): fwrite(): %s\n",strerror(errno));
+   }
 
-   for (i = 0; i < size; i++) {
+   book->block_size = 0;
+}
+
+// heap_less()
+
+static bool heap_less(const entry_t * entry_1, const entry_t * entry_2) {
+
+   if (entry_1->key != entry_2->key) return entry_1->key < entry_2->key;
 
-      b = fgetc(file);
+   return entry_1->book < entry_2->book;
+}
+
+// heap_down()
+
+static void heap_down(entry_t heap[], int size, int pos) {
+
+   entry_t entry;
+   int child;
+
+   ASSERT(heap!=NULL);
+
+   if (size == 0) return;
+
+   entry = heap[pos];
+
+   while ((child = pos * 2 + 1) < size) {
+
+      if (child+1 < size && heap_less(&heap[child+1],&heap[child])) child++;
+      if (!heap_less(&heap[child],&entry)) break;
+
+      heap[pos] = heap[child];
+      pos = child;
+   }
+
+   heap[pos] = entry;
+}
+
+// merge_key()
+
+static int merge_key(entry_t entry[], int size) {
+
+   int src, dst;
+   int first;
+   uint32 count, n, sum;
+   uint32 total;
+   double wn, wsum;
+   int books;
+
+   ASSERT(entry!=NULL);
+   ASSERT(size>0);
+
+   // entry[] holds the entries of one key, in book order
+
+   if (Policy == PolicyFirst) {
+      for (first = 0; first < size && entry[first].book == entry[0].book; first++)
+         ;
+      return first;
+   }
+
+   // same move together, the books in order
+
+   qsort(entry,size,sizeof(entry_t),&move_compare);
+
+   dst = 0;
+
+   for (src = 0; src < size; ) {
+
+      first = src;
+
+      count = 0;
+      n = 0;
+      sum = 0;
+      total = 0;
+      wn = 0.0;
+      wsum = 0.0;
+      books = 0;
+
+      for (; src < size && entry[src].move == entry[first].move; src++) {
+
+         books++;
+
+         if (false) {
+
+         } else if (Policy == PolicySum) {
+
+            count += entry[src].count;
+            n += entry[src].n;
+            sum += entry[src].sum;
+
+         } else if (Policy == PolicyMax) {
+
+            if (entry[src].count > count || books == 1) {
+               count = entry[src].count;
+               n = entry[src].n;
+               sum = entry[src].sum;
+            }
+
+         } else { // PolicyAverage
+
+            total += entry[src].count;
+            wn += double(entry[src].count) * entry[src].n;
+            wsum += double(entry[src].count) * entry[src].sum;
+            n += entry[src].n;
+            sum += entry[src].sum;
+         }
+      }
 
-      if (b == EOF) {
-         if (feof(file)) {
-            my_fatal("read_integer(): fgetc(): EOF reached\n");
-         } else { // error
-            my_fatal("read_integer(): fgetc(): %s\n",strerror(errno));
+      if (Policy == PolicyAverage) {
+         count = (total + books / 2) / books;
+         if (total > 0) {
+            n = (uint32) (wn / total + 0.5);
+            sum = (uint32) (wsum / total + 0.5);
+         } else { // no weights, plain average
+            n = (n + books / 2) / books;
+            sum = (sum + books / 2) / books;
          }
       }
 
-      ASSERT(b>=0&&b<256);
-      n = (n << 8) | b;
+      entry[dst] = entry[first];
+      entry[dst].count = (uint16) ((count > 0xFFFF) ? 0xFFFF : count);
+      entry[dst].n = (uint16) ((n > 0xFFFF) ? 0xFFFF : n);
+      entry[dst].sum = (uint16) ((sum > 0xFFFF) ? 0xFFFF : sum);
+      dst++;
+   }
+
+   // highest weight first, as make-book does
+
+   qsort(entry,dst,sizeof(entry_t),&count_compare);
+
+   return dst;
+}
+
+// move_compare()
+
+static int move_compare(const void * p1, const void * p2) {
+
+   const entry_t * entry_1, * entry_2;
+
+   ASSERT(p1!=NULL);
+   ASSERT(p2!=NULL);
+
+   entry_1 = (const entry_t *) p1;
+   entry_2 = (const entry_t *) p2;
+
+   if (entry_1->move != entry_2->move) return entry_1->move - entry_2->move;
+
+   return entry_1->book - entry_2->book;
+}
+
+// count_compare()
+
+static int count_compare(const void * p1, const void * p2) {
+
+   const entry_t * entry_1, * entry_2;
+
+   ASSERT(p1!=NULL);
+   ASSERT(p2!=NULL);
+
+   entry_1 = (const entry_t *) p1;
+   entry_2 = (const entry_t *) p2;
+
+   if (entry_1->count != entry_2->count) return entry_2->count - entry_1->count;
+
+   return entry_1->move - entry_2->move;
+}
+
+// get_integer()
+
+static uint64 get_integer(const uint8 * data, int size) {
+
+   uint64 n;
+   int i;
+
+   ASSERT(data!=NULL);
+   ASSERT(size>0&&size<=8);
+
+   n = 0;
+
+   for (i = 0; i < size; i++) {
+      n = (n << 8) | data[i];
    }
 
    return n;
 }
 
-// write_integer()
+// put_integer()
 
-static void write_integer(FILE * file, int size, uint64 n) {
+static void put_integer(uint8 * data, int size, uint64 n) {
 
    int i;
-   int b;
 
-   ASSERT(file!=NULL);
+   ASSERT(data!=NULL);
    ASSERT(size>0&&size<=8);
    ASSERT(size==8||n>>(size*8)==0);
 
    for (i = size-1; i >= 0; i--) {
-
-      b = (int)((n >> (i*8)) & 0xFF);
-      ASSERT(b>=0&&b<256);
-
-      if (fputc(b,file) == EOF) {
-         my_fatal("write_integer(): fputc(): %s\n",strerror(errno));
-      }
+      data[i] = (uint8) (n & 0xFF);
+      n >>= 8;
    }
 }
 
 // end of book_merge.cpp
-
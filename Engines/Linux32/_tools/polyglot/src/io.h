@@ -23,9 +23,22 @@ struct io_t {
 
    bool in_eof;
 
+   sint32 in_start; // input is a ring buffer
    sint32 in_size;
+   sint32 in_line;  // length of the first line, -1 if incomplete
+   sint32 in_scan;  // bytes already searched for LF
+   double in_ready; // time the first line became complete
+
    sint32 out_size;
 
+   // statistics
+
+   sint64 line_nb;
+   sint64 byte_nb;
+   sint64 read_nb;
+   double latency_sum;
+   double latency_max;
+
    char in_buffer[BufferSize];
    char out_buffer[BufferSize];
 };
@@ -45,6 +58,8 @@ extern bool io_get_line   (io_t * io, char string[], int size);
 extern void io_send       (io_t * io, const char format[], ...);
 extern void io_send_queue (io_t * io, const char format[], ...);
 
+extern void io_log_stats  (const io_t * io);
+
 #endif // !defined IO_H
 
 // end of io.h
@@ -51,6 +51,7 @@ static option_t Option[] = {
 
    { "Book",          NULL, }, // true/false
    { "BookFile",      NULL, }, // string
+   { "BookMode",      NULL, }, // auto/file/memory/mmap
 
    { "BookRandom",    NULL, }, // true/false
    { "BookLearn",     NULL, }, // true/false
@@ -66,6 +67,7 @@ static option_t Option[] = {
    { "NoGlobals",     NULL, }, // true/false
    { "InfoStrings",   NULL, }, // true/false
    { "MultiPVall",    NULL, }, // true/false
+   { "CoalescePV",    NULL, }, // true/false
 
    // work-arounds
 
@@ -118,6 +120,7 @@ void option_init() {
 
    option_set("Book","false");
    option_set("BookFile","book.bin");
+   option_set("BookMode","auto");
 
    option_set("BookRandom","true");
    option_set("BookLearn","false");
@@ -133,6 +136,7 @@ void option_init() {
    option_set("NoGlobals","false");
    option_set("InfoStrings","false");
    option_set("MultiPVall","false");
+   option_set("CoalescePV","true");
 
    // work-arounds
 
@@ -283,6 +283,8 @@ void MainThread::search() {
 
   previousScore = bestThread->rootMoves[0].score;
 
+  Tablebases::print_stats();
+
   // Send again PV info if we have a new best thread
   if (bestThread != this)
       sync_cout << UCI::pv(bestThread->rootPos, bestThread->completedDepth, -VALUE_INFINITE, VALUE_INFINITE) << sync_endl;
@@ -64,6 +64,9 @@ public:
   int selDepth, nmpMinPly;
   Color nmpColor;
   std::atomic<uint64_t> nodes, tbHits;
+  // Syzygy probe cache counters since the last Tablebases::print_stats(),
+  // written only by this thread and read after the search has finished
+  uint64_t tbProbes = 0, tbCacheHits = 0, tbDecodeTime = 0, tbDecodeMax = 0;
 
   Position rootPos;
   Search::RootMoves rootMoves;
@@ -19,6 +19,8 @@
 */
 
 #include <cassert>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <sstream>
 #include <string>
@@ -35,7 +37,7 @@
 
 using namespace std;
 
-extern vector<string> setup_bench(const Position&, istream&);
+extern vector<string> setup_bench(const Position&, istream&, string&);
 
 namespace {
 
@@ -136,16 +138,115 @@ namespace {
   }
 
 
+  // hash_file() reads the file name of the "savehash" and "loadhash" commands,
+  // the rest of the line, or the "Hash File" option if there is none.
+
+  string hash_file(istringstream& is) {
+
+    string fileName;
+
+    getline(is >> ws, fileName);
+    return fileName.empty() ? string(Options["Hash File"]) : fileName;
+  }
+
+
+  // BenchRecord keeps the results of the search of a bench position
+
+  struct BenchRecord {
+    string fen;
+    size_t threads, hash;
+    uint64_t nodes, tbHits;
+    TimePoint time;
+    int depth, selDepth, hashfull;
+  };
+
+
+  // bench_record() collects the results of the search just finished
+
+  BenchRecord bench_record(const Position& pos, TimePoint elapsed) {
+
+    MainThread* mainThread = Threads.main();
+    BenchRecord r;
+
+    r.fen      = pos.fen();
+    r.threads  = Options["Threads"];
+    r.hash     = Options["Hash"];
+    r.nodes    = Threads.nodes_searched();
+    r.tbHits   = Threads.tb_hits();
+    r.time     = elapsed;
+    r.depth    = mainThread->completedDepth / ONE_PLY;
+    r.selDepth = mainThread->rootMoves.empty() ? 0 : mainThread->rootMoves[0].selDepth;
+    r.hashfull = TT.hashfull();
+    return r;
+  }
+
+
+  // bench_report() writes the records of bench to a file, in CSV if the name
+  // ends with ".csv" and otherwise in JSON, to compare builds and settings.
+
+  void bench_report(const string& fileName, const string& limit, const vector<BenchRecord>& records) {
+
+    ofstream file(fileName);
+    bool csv = fileName.size() > 4 && fileName.compare(fileName.size() - 4, 4, ".csv") == 0;
+    string engine = engine_info(true);
+
+    engine = engine.substr(0, engine.find('\n'));
+
+    if (csv)
+        file << "threads,hash,position,fen,nodes,time,nps,depth,seldepth,hashfull,tbhits\n";
+    else
+        file << "{\n  \"engine\": \"" << engine << "\",\n"
+             << "  \"limit\": \"" << limit << "\",\n"
+             << "  \"results\": [";
+
+    size_t position = 0;
+
+    for (size_t i = 0; i < records.size(); ++i)
+    {
+        const BenchRecord& r = records[i];
+
+        // Positions are numbered again for each pair of threads and TT size
+        position = i && r.threads == records[i - 1].threads && r.hash == records[i - 1].hash ? position + 1 : 1;
+
+        if (csv)
+            file << r.threads << ',' << r.hash << ',' << position << ",\"" << r.fen << "\","
+                 << r.nodes << ',' << r.time << ',' << 1000 * r.nodes / (r.time + 1) << ','
+                 << r.depth << ',' << r.selDepth << ',' << r.hashfull << ',' << r.tbHits << '\n';
+        else
+            file << (i ? "," : "") << "\n    {\"threads\": " << r.threads
+                 << ", \"hash\": "     << r.hash
+                 << ", \"position\": " << position
+                 << ", \"fen\": \""     << r.fen
+                 << "\", \"nodes\": "  << r.nodes
+                 << ", \"time\": "     << r.time
+                 << ", \"nps\": "      << 1000 * r.nodes / (r.time + 1)
+                 << ", \"depth\": "    << r.depth
+                 << ", \"seldepth\": " << r.selDepth
+                 << ", \"hashfull\": " << r.hashfull
+                 << ", \"tbhits\": "   << r.tbHits << "}";
+    }
+
+    if (!csv)
+        file << "\n  ]\n}\n";
+
+    if (!file)
+        cerr << "Unable to write file " << fileName << endl;
+  }
+
+
   // bench() is called when engine receives the "bench" command. Firstly
   // a list of UCI commands is setup according to bench parameters, then
-  // it is run one by one printing a summary at the end.
+  // it is run one by one printing a summary at the end. With more than a
+  // pair of threads and TT size there is a line for each pair, and the
+  // results of every position can go to a report file.
 
   void bench(Position& pos, istream& args, StateListPtr& states) {
 
-    string token;
+    string token, reportFile, limit;
     uint64_t num, nodes = 0, cnt = 1;
+    vector<BenchRecord> records;
 
-    vector<string> list = setup_bench(pos, args);
+    vector<string> list = setup_bench(pos, args, reportFile);
     num = count_if(list.begin(), list.end(), [](string s) { return s.find("go ") == 0; });
 
     TimePoint elapsed = now();
@@ -158,9 +259,12 @@ namespace {
         if (token == "go")
         {
             cerr << "\nPosition: " << cnt++ << '/' << num << endl;
+            limit = cmd.substr(3);
+            TimePoint start = now();
             go(pos, is, states);
             Threads.main()->wait_for_search_finished();
             nodes += Threads.nodes_searched();
+            records.push_back(bench_record(pos, now() - start));
         }
         else if (token == "setoption")  setoption(is);
         else if (token == "position")   position(pos, is, states);
@@ -171,10 +275,32 @@ namespace {
 
     dbg_print(); // Just before exiting
 
+    // Totals of each pair of threads and TT size, when there are several
+    if (records.size() && (records.front().threads != records.back().threads || records.front().hash != records.back().hash))
+    {
+        cerr << "\n===========================\nThreads    Hash (MB)    Nodes/second";
+
+        for (size_t i = 0, j; i < records.size(); i = j)
+        {
+            uint64_t n = 0;
+            TimePoint t = 1;
+
+            for (j = i; j < records.size() && records[j].threads == records[i].threads && records[j].hash == records[i].hash; ++j)
+                n += records[j].nodes, t += records[j].time;
+
+            cerr << "\n" << setw(7) << records[i].threads << setw(13) << records[i].hash
+                 << setw(16) << 1000 * n / t;
+        }
+        cerr << endl;
+    }
+
     cerr << "\n==========================="
          << "\nTotal time (ms) : " << elapsed
          << "\nNodes searched  : " << nodes
          << "\nNodes/second    : " << 1000 * nodes / elapsed << endl;
+
+    if (!reportFile.empty())
+        bench_report(reportFile, limit, records);
   }
 
 } // namespace
@@ -236,6 +362,8 @@ void UCI::loop(int argc, char* argv[]) {
       else if (token == "bench") bench(pos, is, states);
       else if (token == "d")     sync_cout << pos << sync_endl;
       else if (token == "eval")  sync_cout << Eval::trace(pos) << sync_endl;
+      else if (token == "savehash") TT.save(hash_file(is));
+      else if (token == "loadhash") TT.load(hash_file(is));
       else
           sync_cout << "Unknown command: " << cmd << sync_endl;
 
@@ -38,9 +38,14 @@ namespace UCI {
 /// 'On change' actions, triggered by an option's value change
 void on_clear_hash(const Option&) { Search::clear(); }
 void on_hash_size(const Option& o) { TT.resize(o); }
+void on_large_pages(const Option&) { TT.resize(Options["Hash"]); }
+void on_save_hash(const Option&) { TT.save(Options["Hash File"]); }
+void on_load_hash(const Option&) { TT.load(Options["Hash File"]); }
+void on_numa(const Option&) { Threads.set(Options["Threads"]); }
 void on_logger(const Option& o) { start_logger(o); }
 void on_threads(const Option& o) { Threads.set(o); }
 void on_tb_path(const Option& o) { Tablebases::init(o); }
+void on_tb_prefetch(const Option& o) { Tablebases::Prefetch = o; }
 
 
 /// Our case insensitive less() function as required by UCI protocol
@@ -62,8 +67,13 @@ void init(OptionsMap& o) {
   o["Contempt"]              << Option(24, -100, 100);
   o["Analysis Contempt"]     << Option("Both var Off var White var Black var Both", "Both");
   o["Threads"]               << Option(1, 1, 512, on_threads);
+  o["NUMA"]                  << Option("Auto var Auto var On var Off", "Auto", on_numa);
   o["Hash"]                  << Option(16, 1, MaxHashMB, on_hash_size);
   o["Clear Hash"]            << Option(on_clear_hash);
+  o["Large Pages"]           << Option(true, on_large_pages);
+  o["Hash File"]             << Option("stockfish.hash");
+  o["Save Hash"]             << Option(on_save_hash);
+  o["Load Hash"]             << Option(on_load_hash);
   o["Ponder"]                << Option(false);
   o["MultiPV"]               << Option(1, 1, 500);
   o["Skill Level"]           << Option(20, 0, 20);
@@ -77,6 +87,7 @@ void init(OptionsMap& o) {
   o["SyzygyProbeDepth"]      << Option(1, 1, 100);
   o["Syzygy50MoveRule"]      << Option(true);
   o["SyzygyProbeLimit"]      << Option(7, 0, 7);
+  o["SyzygyPrefetch"]        << Option(false, on_tb_prefetch);
 }
 
 
@@ -11,9 +11,11 @@
 #include <cstring>
 
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #include "io.h"
+#include "posix.h"
 #include "util.h"
 
 // constants
@@ -28,8 +30,10 @@ static const char CR = '\r';
 
 // prototypes
 
-static int  my_read  (int fd, char string[], int size);
-static void my_write (int fd, const char string[], int size);
+static void find_line (io_t * io);
+
+static int  my_readv  (int fd, struct iovec vec[], int count);
+static void my_write  (int fd, const char string[], int size);
 
 // functions
 
@@ -43,7 +47,10 @@ bool io_is_ok(const io_t * io) {
 
    if (io->in_eof != true && io->in_eof != false) return false;
 
+   if (io->in_start < 0 || io->in_start >= BufferSize) return false;
    if (io->in_size < 0 || io->in_size > BufferSize) return false;
+   if (io->in_line < -1 || io->in_line >= io->in_size) return false;
+   if (io->in_scan < 0 || io->in_scan > io->in_size) return false;
    if (io->out_size < 0 || io->out_size > BufferSize) return false;
 
    return true;
@@ -57,9 +64,20 @@ void io_init(io_t * io) {
 
    io->in_eof = false;
 
+   io->in_start = 0;
    io->in_size = 0;
+   io->in_line = -1;
+   io->in_scan = 0;
+   io->in_ready = 0.0;
+
    io->out_size = 0;
 
+   io->line_nb = 0;
+   io->byte_nb = 0;
+   io->read_nb = 0;
+   io->latency_sum = 0.0;
+   io->latency_max = 0.0;
+
    ASSERT(io_is_ok(io));
 }
 
@@ -85,6 +103,8 @@ void io_close(io_t * io) {
 void io_get_update(io_t * io) {
 
    int pos, size;
+   struct iovec vec[2];
+   int count;
    int n;
 
    ASSERT(io_is_ok(io));
@@ -94,16 +114,34 @@ void io_get_update(io_t * io) {
 
    // init
 
-   pos = io->in_size;
+   if (io->in_size == 0) io->in_start = 0; // one block when possible
 
-   size = BufferSize - pos;
+   size = BufferSize - io->in_size;
    if (size <= 0) my_fatal("io_get_update(): buffer overflow\n");
 
+   // the free space, in one or two parts
+
+   pos = (io->in_start + io->in_size) % BufferSize;
+
+   vec[0].iov_base = &io->in_buffer[pos];
+
+   if (pos + size <= BufferSize) {
+      vec[0].iov_len = size;
+      count = 1;
+   } else {
+      vec[0].iov_len = BufferSize - pos;
+      vec[1].iov_base = &io->in_buffer[0];
+      vec[1].iov_len = size - (BufferSize - pos);
+      count = 2;
+   }
+
    // read as many data as possible
 
-   n = my_read(io->in_fd,&io->in_buffer[pos],size);
+   n = my_readv(io->in_fd,vec,count);
    if (UseDebug) my_log("POLYGLOT read %d byte%s from %s\n",n,(n>1)?"s":"",io->name);
 
+   io->read_nb++;
+
    if (n > 0) { // at least one character was read
 
       // update buffer size
@@ -111,8 +149,14 @@ void io_get_update(io_t * io) {
       ASSERT(n>=1&&n<=size);
 
       io->in_size += n;
+      io->byte_nb += n;
       ASSERT(io->in_size>=0&&io->in_size<=BufferSize);
 
+      if (io->in_line < 0) {
+         find_line(io);
+         if (io->in_line >= 0) io->in_ready = now_real();
+      }
+
    } else { // EOF
 
       ASSERT(n==0);
@@ -129,62 +173,80 @@ bool io_line_ready(const io_t * io) {
 
    if (io->in_eof) return true;
 
-   if (memchr(io->in_buffer,LF,io->in_size) != NULL) return true; // buffer contains LF
-
-   return false;
+   return io->in_line >= 0; // buffer contains LF
 }
 
 // io_get_line()
 
 bool io_get_line(io_t * io, char string[], int size) {
 
-   int src, dst;
-   int c;
+   int len, part;
+   char * dst;
+   const char * src;
+   double latency;
 
    ASSERT(io_is_ok(io));
    ASSERT(string!=NULL);
    ASSERT(size>=256);
 
-   src = 0;
-   dst = 0;
+   // test for end of buffer
 
-   while (true) {
+   if (io->in_line < 0) {
+      if (io->in_eof) {
+         my_log("%s->Adapter: EOF\n",io->name);
+         io_log_stats(io);
+         return false;
+      } else {
+         my_fatal("io_get_line(): no EOL in buffer\n");
+      }
+   }
 
-      // test for end of buffer
+   // test for end of string
 
-      if (src >= io->in_size) {
-         if (io->in_eof) {
-            my_log("%s->Adapter: EOF\n",io->name);
-            return false;
-         } else {
-            my_fatal("io_get_line(): no EOL in buffer\n");
-         }
-      }
+   len = io->in_line;
+   if (len >= size) my_fatal("io_get_line(): buffer overflow\n");
+
+   // copy the line, in two parts if it wraps around
 
-      // test for end of string
+   part = BufferSize - io->in_start;
+   if (part > len) part = len;
 
-      if (dst >= size) my_fatal("io_get_line(): buffer overflow\n");
+   memcpy(string,&io->in_buffer[io->in_start],part);
+   memcpy(&string[part],&io->in_buffer[0],len-part);
+   string[len] = '\0';
 
-      // copy the next character
+   // skip CRs
 
-      c = io->in_buffer[src++];
+   dst = (char *) memchr(string,CR,len);
 
-      if (c == LF) { // LF => line complete
-         string[dst] = '\0';
-         break;
-      } else if (c != CR) { // skip CRs
-         string[dst++] = c;
+   if (dst != NULL) {
+      for (src = dst; *src != '\0'; src++) {
+         if (*src != CR) *dst++ = *src;
       }
+      *dst = '\0';
    }
 
-   // shift the buffer
+   // consume the line and its LF
 
-   ASSERT(src>0);
-
-   io->in_size -= src;
+   io->in_start = (io->in_start + len + 1) % BufferSize;
+   io->in_size -= len + 1;
    ASSERT(io->in_size>=0);
 
-   if (io->in_size > 0) memmove(&io->in_buffer[0],&io->in_buffer[src],io->in_size);
+   io->in_line = -1;
+   io->in_scan = 0;
+
+   // statistics
+
+   io->line_nb++;
+
+   latency = now_real() - io->in_ready;
+   io->latency_sum += latency;
+   if (latency > io->latency_max) io->latency_max = latency;
+
+   // the next line may be already in the buffer, it is ready now
+
+   find_line(io);
+   if (io->in_line >= 0) io->in_ready = now_real();
 
    // return
 
@@ -193,6 +255,17 @@ bool io_get_line(io_t * io, char string[], int size) {
    return true;
 }
 
+// io_log_stats()
+
+void io_log_stats(const io_t * io) {
+
+   ASSERT(io_is_ok(io));
+
+   my_log("POLYGLOT %s: " S64_FORMAT " lines, " S64_FORMAT " bytes, " S64_FORMAT " reads, latency %.3f ms average %.3f ms max\n",
+      io->name,io->line_nb,io->byte_nb,io->read_nb,
+      (io->line_nb!=0)?io->latency_sum*1000.0/double(io->line_nb):0.0,io->latency_max*1000.0);
+}
+
 // io_send()
 
 void io_send(io_t * io, const char format[], ...) {
@@ -272,21 +345,53 @@ void io_send_queue(io_t * io, const char format[], ...) {
    ASSERT(io->out_size>=0&&io->out_size<=BufferSize-2);
 }
 
-// my_read()
+// find_line()
+
+static void find_line(io_t * io) {
+
+   int pos, size, part;
+   const char * lf;
+
+   ASSERT(io!=NULL);
+   ASSERT(io->in_line<0);
+
+   // only the bytes that were not searched yet
+
+   while (io->in_scan < io->in_size) {
 
-static int my_read(int fd, char string[], int size) {
+      pos = (io->in_start + io->in_scan) % BufferSize;
+      size = io->in_size - io->in_scan;
+
+      part = BufferSize - pos;
+      if (part > size) part = size;
+
+      lf = (const char *) memchr(&io->in_buffer[pos],LF,part);
+
+      if (lf != NULL) {
+         io->in_scan += int(lf - &io->in_buffer[pos]);
+         io->in_line = io->in_scan;
+         return;
+      }
+
+      io->in_scan += part;
+   }
+}
+
+// my_readv()
+
+static int my_readv(int fd, struct iovec vec[], int count) {
 
    int n;
 
    ASSERT(fd>=0);
-   ASSERT(string!=NULL);
-   ASSERT(size>0);
+   ASSERT(vec!=NULL);
+   ASSERT(count>0);
 
    do {
-      n = read(fd,string,size);
+      n = readv(fd,vec,count);
    } while (n == -1 && errno == EINTR);
 
-   if (n == -1) my_fatal("my_read(): read(): %s\n",strerror(errno));
+   if (n == -1) my_fatal("my_readv(): readv(): %s\n",strerror(errno));
 
    ASSERT(n>=0);
 
@@ -21,6 +21,7 @@
 #include <fstream>
 #include <iostream>
 #include <istream>
+#include <sstream>
 #include <vector>
 
 #include "position.h"
@@ -90,18 +91,23 @@ const vector<string> Defaults = {
 } // namespace
 
 /// setup_bench() builds a list of UCI commands to be run by bench. There
-/// are five parameters: TT size in MB, number of search threads that
+/// are six parameters: TT size in MB, number of search threads that
 /// should be used, the limit value spent for each position, a file name
-/// where to look for positions in FEN format and the type of the limit:
-/// depth, perft, nodes and movetime (in millisecs).
+/// where to look for positions in FEN format, the type of the limit:
+/// depth, perft, nodes and movetime (in millisecs), and the file where
+/// bench writes a report with the results of each position, in JSON or,
+/// if the name ends with ".csv", in CSV. TT sizes and threads can be
+/// comma separated lists, the positions are searched with each pair.
 ///
 /// bench -> search default positions up to depth 13
 /// bench 64 1 15 -> search default positions up to depth 15 (TT = 64MB)
 /// bench 64 4 5000 current movetime -> search current position with 4 threads for 5 sec
 /// bench 64 1 100000 default nodes -> search default positions for 100K nodes each
 /// bench 16 1 5 default perft -> run a perft 5 on default positions
+/// bench 64,256 1,2,4 18 default depth scaling.json -> up to depth 18 with 6
+///                        TT size and threads pairs, report in scaling.json
 
-vector<string> setup_bench(const Position& current, istream& is) {
+vector<string> setup_bench(const Position& current, istream& is, string& reportFile) {
 
   vector<string> fens, list;
   string go, token;
@@ -112,6 +118,7 @@ vector<string> setup_bench(const Position& current, istream& is) {
   string limit     = (is >> token) ? token : "13";
   string fenFile   = (is >> token) ? token : "default";
   string limitType = (is >> token) ? token : "depth";
+  reportFile       = (is >> token) ? token : "";
 
   go = "go " + limitType + " " + limit;
 
@@ -139,17 +146,30 @@ vector<string> setup_bench(const Position& current, istream& is) {
       file.close();
   }
 
-  list.emplace_back("ucinewgame");
-  list.emplace_back("setoption name Threads value " + threads);
-  list.emplace_back("setoption name Hash value " + ttSize);
-
-  for (const string& fen : fens)
-      if (fen.find("setoption") != string::npos)
-          list.emplace_back(fen);
-      else
+  auto split = [](const string& values) {
+      vector<string> v;
+      stringstream ss(values);
+      for (string value; getline(ss, value, ',');)
+          if (!value.empty())
+              v.push_back(value);
+      return v;
+  };
+
+  for (const string& size : split(ttSize))
+      for (const string& n : split(threads))
       {
-          list.emplace_back("position fen " + fen);
-          list.emplace_back(go);
+          list.emplace_back("ucinewgame");
+          list.emplace_back("setoption name Threads value " + n);
+          list.emplace_back("setoption name Hash value " + size);
+
+          for (const string& fen : fens)
+              if (fen.find("setoption") != string::npos)
+                  list.emplace_back(fen);
+              else
+              {
+                  list.emplace_back("position fen " + fen);
+                  list.emplace_back(go);
+              }
       }
 
   return list;
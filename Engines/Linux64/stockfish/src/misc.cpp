@@ -41,6 +41,14 @@ typedef bool(*fun3_t)(HANDLE, CONST GROUP_AFFINITY*, PGROUP_AFFINITY);
 }
 #endif
 
+#if defined(__linux__) && !defined(__ANDROID__)
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cstdlib>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
@@ -49,6 +57,7 @@ typedef bool(*fun3_t)(HANDLE, CONST GROUP_AFFINITY*, PGROUP_AFFINITY);
 
 #include "misc.h"
 #include "thread.h"
+#include "uci.h"
 
 using namespace std;
 
@@ -216,6 +225,114 @@ void prefetch2(void* addr) {
   prefetch((uint8_t*)addr + 64);
 }
 
+
+/// large_pages_alloc() allocates size bytes for the transposition table trying
+/// to reduce TLB misses. On Linux it first asks for transparent huge pages on a
+/// 2MB aligned mmap (madvise), then for explicit huge pages (MAP_HUGETLB, only
+/// if the system has reserved them in /proc/sys/vm/nr_hugepages), and at last
+/// falls back to malloc. Returns the memory, 64 bytes aligned, and fills alloc
+/// with what large_pages_free() needs.
+
+#if defined(__linux__) && !defined(__ANDROID__)
+
+namespace {
+
+constexpr size_t HugePageSize = 2 * 1024 * 1024;
+
+bool thp_enabled() {
+
+  std::ifstream f("/sys/kernel/mm/transparent_hugepage/enabled");
+  std::string modes;
+  return std::getline(f, modes) && modes.find("[never]") == std::string::npos;
+}
+
+void* mmap_thp(size_t size, size_t& mapped) {
+
+  // Over-allocate and trim the ends to get a 2MB aligned block
+  size_t len = size + HugePageSize;
+  void* mem = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED)
+      return nullptr;
+
+  uintptr_t start = uintptr_t(mem), aligned = (start + HugePageSize - 1) & ~(HugePageSize - 1);
+  if (aligned > start)
+      munmap(mem, aligned - start);
+  if (start + len > aligned + size)
+      munmap((void*)(aligned + size), start + len - aligned - size);
+
+  mem = (void*)aligned;
+  if (madvise(mem, size, MADV_HUGEPAGE))
+  {
+      munmap(mem, size);
+      return nullptr;
+  }
+  mapped = size;
+  return mem;
+}
+
+void* mmap_hugetlb(size_t size, size_t& mapped) {
+
+  size_t len = (size + HugePageSize - 1) & ~(HugePageSize - 1);
+  void* mem = mmap(nullptr, len, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (mem == MAP_FAILED)
+      return nullptr;
+
+  mapped = len;
+  return mem;
+}
+
+} // namespace
+
+#endif
+
+void* large_pages_alloc(size_t size, bool allowLarge, LargePagesAlloc& alloc) {
+
+  constexpr size_t CacheLineSize = 64;
+
+  alloc = LargePagesAlloc();
+
+#if defined(__linux__) && !defined(__ANDROID__)
+  // Round to whole huge pages, the table size is a multiple of the cluster size
+  size_t len = (size + HugePageSize - 1) & ~(HugePageSize - 1);
+
+  if (allowLarge && thp_enabled() && (alloc.mem = mmap_thp(len, alloc.size)) != nullptr)
+      alloc.mode = LP_TRANSPARENT;
+
+  else if (allowLarge && (alloc.mem = mmap_hugetlb(len, alloc.size)) != nullptr)
+      alloc.mode = LP_HUGETLB;
+
+  if (alloc.mem)
+      return alloc.mem;
+#endif
+
+  alloc.mode = LP_NONE;
+  alloc.mem = malloc(size + CacheLineSize - 1);
+  if (!alloc.mem)
+      return nullptr;
+
+  return (void*)((uintptr_t(alloc.mem) + CacheLineSize - 1) & ~(CacheLineSize - 1));
+}
+
+void large_pages_free(LargePagesAlloc& alloc) {
+
+#if defined(__linux__) && !defined(__ANDROID__)
+  if (alloc.mode != LP_NONE)
+      munmap(alloc.mem, alloc.size);
+  else
+#endif
+      free(alloc.mem);
+
+  alloc = LargePagesAlloc();
+}
+
+const char* large_pages_name(LargePagesMode mode) {
+
+  return mode == LP_TRANSPARENT ? "transparent huge pages"
+       : mode == LP_HUGETLB     ? "huge pages (MAP_HUGETLB)"
+                                : "normal pages";
+}
+
 namespace WinProcGroup {
 
 #ifndef _WIN32
@@ -320,3 +437,158 @@ void bindThisThread(size_t idx) {
 #endif
 
 } // namespace WinProcGroup
+
+
+namespace Numa {
+
+#if defined(__linux__) && !defined(__ANDROID__)
+
+namespace {
+
+/// Topology of the NUMA nodes that have cpus the process may use, read once from
+/// sysfs. The threads fill the cores of the biggest node first and then the next
+/// node, as in Texel, the extra logical processors of each core go at the end.
+
+struct Topology {
+
+  Topology();
+
+  std::vector<cpu_set_t> nodeCpus;
+  std::vector<int> threadToNode;
+};
+
+const std::string SysfsDir = "/sys/devices/system";
+
+std::string read_line(const std::string& fname) {
+
+  std::ifstream f(fname);
+  std::string line;
+  std::getline(f, line);
+  return line;
+}
+
+// "0-3,8-11" -> 0 1 2 3 8 9 10 11
+std::vector<int> cpu_list(const std::string& s) {
+
+  std::vector<int> cpus;
+  std::istringstream is(s);
+  std::string range;
+
+  while (std::getline(is, range, ','))
+  {
+      size_t dash = range.find('-');
+      if (range.empty() || !isdigit(range[0]))
+          continue;
+
+      int first = std::stoi(range), last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+      for (int c = first; c <= last; ++c)
+          cpus.push_back(c);
+  }
+  return cpus;
+}
+
+Topology::Topology() {
+
+  cpu_set_t allowed;
+  if (sched_getaffinity(getpid(), sizeof(allowed), &allowed))
+      return;
+
+  struct NodeInfo { int node, cores, threads; cpu_set_t cpus; };
+  std::vector<NodeInfo> nodes;
+
+  for (int n : cpu_list(read_line(SysfsDir + "/node/online")))
+  {
+      NodeInfo ni = { n, 0, 0, cpu_set_t() };
+      CPU_ZERO(&ni.cpus);
+      std::vector<std::string> cores;
+
+      for (int c : cpu_list(read_line(SysfsDir + "/node/node" + std::to_string(n) + "/cpulist")))
+      {
+          if (c >= CPU_SETSIZE || !CPU_ISSET(c, &allowed))
+              continue;
+
+          CPU_SET(c, &ni.cpus);
+          ni.threads++;
+
+          // Logical processors of the same core share the siblings list
+          std::string siblings = read_line(SysfsDir + "/cpu/cpu" + std::to_string(c) + "/topology/thread_siblings_list");
+          if (siblings.empty() || std::find(cores.begin(), cores.end(), siblings) == cores.end())
+          {
+              cores.push_back(siblings);
+              ni.cores++;
+          }
+      }
+      if (ni.threads)
+          nodes.push_back(ni);
+  }
+
+  // One node (or no sysfs information): nothing to do
+  if (nodes.size() < 2)
+      return;
+
+  std::stable_sort(nodes.begin(), nodes.end(), [](const NodeInfo& a, const NodeInfo& b) {
+      return a.cores > b.cores;
+  });
+
+  for (NodeInfo& ni : nodes)
+  {
+      nodeCpus.push_back(ni.cpus);
+      for (int i = 0; i < ni.cores; ++i)
+          threadToNode.push_back(int(nodeCpus.size() - 1));
+  }
+
+  for (bool added = true; added; )
+  {
+      added = false;
+      for (size_t i = 0; i < nodes.size(); ++i)
+          if (nodes[i].threads > nodes[i].cores)
+          {
+              threadToNode.push_back(int(i));
+              nodes[i].threads--;
+              added = true;
+          }
+  }
+}
+
+const Topology& topology() {
+
+  static Topology t; // Thread safe initialization
+  return t;
+}
+
+} // namespace
+
+size_t nodes() { return topology().nodeCpus.size(); }
+
+void bindThisThread(size_t idx) {
+
+  const Topology& t = topology();
+
+  // More threads than logical processors: let the OS decide
+  if (idx >= t.threadToNode.size())
+      return;
+
+  sched_setaffinity(0, sizeof(cpu_set_t), &t.nodeCpus[t.threadToNode[idx]]);
+}
+
+#else
+
+size_t nodes() { return 0; }
+
+void bindThisThread(size_t idx) { WinProcGroup::bindThisThread(idx); }
+
+#endif
+
+
+/// binding() tells if the search threads, and the threads that clear the hash,
+/// have to be bound to a node. With "Auto" only above 8 threads: several engines
+/// with a few threads each running side by side are better left to the OS.
+
+bool binding() {
+
+  const std::string mode = Options["NUMA"];
+
+  return mode == "On" || (mode == "Auto" && Options["Threads"] > 8);
+}
+
+} // namespace Numa
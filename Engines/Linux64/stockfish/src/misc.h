@@ -32,6 +32,18 @@
 const std::string engine_info(bool to_uci = false);
 void prefetch(void* addr);
 void prefetch2(void* addr);
+
+enum LargePagesMode { LP_NONE, LP_TRANSPARENT, LP_HUGETLB };
+
+struct LargePagesAlloc {
+  void* mem = nullptr;  // As returned by mmap or malloc
+  size_t size = 0;      // Mapped bytes
+  LargePagesMode mode = LP_NONE;
+};
+
+void* large_pages_alloc(size_t size, bool allowLarge, LargePagesAlloc& alloc);
+void large_pages_free(LargePagesAlloc& alloc);
+const char* large_pages_name(LargePagesMode mode);
 void start_logger(const std::string& fname);
 
 void dbg_hit_on(bool b);
@@ -111,4 +123,15 @@ namespace WinProcGroup {
   void bindThisThread(size_t idx);
 }
 
+/// On Linux each search thread is bound to the cpus of a NUMA node, discovered
+/// from sysfs, and the hash is cleared by threads bound the same way, so its
+/// pages are first touched, and so allocated, on the nodes of the threads that
+/// use them. On Windows it is the processor group binding above.
+
+namespace Numa {
+  size_t nodes();
+  bool binding();
+  void bindThisThread(size_t idx);
+}
+
 #endif // #ifndef MISC_H_INCLUDED
@@ -19,6 +19,7 @@
 
 #include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <cstdint>
 #include <cstring>   // For std::memset and std::memcpy
 #include <deque>
@@ -32,6 +33,7 @@
 #include "../movegen.h"
 #include "../position.h"
 #include "../search.h"
+#include "../thread.h"
 #include "../thread_win32.h"
 #include "../types.h"
 #include "../uci.h"
@@ -52,6 +54,7 @@
 using namespace Tablebases;
 
 int Tablebases::MaxCardinality;
+bool Tablebases::Prefetch;
 
 namespace {
 
@@ -464,6 +467,27 @@ void TBTables::add(const std::vector<PieceType>& pieces) {
     insert(wdlTable.back().key2, &wdlTable.back(), &dtzTable.back());
 }
 
+// The tables are mapped with MADV_RANDOM, so a probe reads only the pages of its
+// block. Probes of a search cluster on nearby blocks, with prefetch_blocks() the
+// kernel starts reading the ones around the block in the background, and the
+// next probes find them in memory instead of stalling on a page fault.
+void prefetch_blocks(PairsData* d, uint8_t* block) {
+
+#ifndef _WIN32
+    constexpr uintptr_t Window = 64 * 1024, PageSize = 4096;
+
+    uintptr_t begin = std::max((uintptr_t)block - Window / 2, (uintptr_t)d->data);
+    uintptr_t end   = std::min((uintptr_t)block + Window / 2,
+                               (uintptr_t)(d->data + (uint64_t)d->blocksNum * d->sizeofBlock));
+
+    begin &= ~(PageSize - 1);
+    if (begin < end)
+        madvise((void*)begin, end - begin, MADV_WILLNEED);
+#else
+    (void)d; (void)block;
+#endif
+}
+
 // TB tables are compressed with canonical Huffman code. The compressed data is divided into
 // blocks of size d->sizeofBlock, and each block stores a variable number of symbols.
 // Each symbol represents either a WDL or a (remapped) DTZ value, or a pair of other symbols
@@ -527,6 +551,9 @@ int decompress_pairs(PairsData* d, uint64_t idx) {
     // Finally, we find the start address of our block of canonical Huffman symbols
     uint32_t* ptr = (uint32_t*)(d->data + ((uint64_t)block * d->sizeofBlock));
 
+    if (Tablebases::Prefetch)
+        prefetch_blocks(d, (uint8_t*)ptr);
+
     // Read the first 64 bits in our block, this is a (truncated) sequence of
     // unknown number of symbols of unknown length but we know the first one
     // is at the beginning of this 64 bits sequence.
@@ -591,6 +618,56 @@ int decompress_pairs(PairsData* d, uint64_t idx) {
     return d->btree[sym].get<LR::Left>();
 }
 
+// ProbeCache keeps the values recently decompressed by the search threads. The
+// probes of endgame analysis come back again and again to the same positions,
+// and decompress_pairs() has to walk the Huffman symbols of a block for each of
+// them. An entry packs the upper 48 bits of a hash of (PairsData, index) with
+// the value in the lower 16 bits, so it is read and written with a single
+// atomic access, without locks. A false match needs the same 48 bits and the
+// same slot, as unlikely as a TT key collision.
+constexpr size_t ProbeCacheSize = 1 << 17; // 1 MB, a power of 2
+constexpr uint64_t ValueMask = 0xFFFF;
+
+std::atomic<uint64_t> ProbeCache[ProbeCacheSize];
+
+// The counters are kept by the probing thread (tbProbes, tbCacheHits, decode
+// times in nanoseconds), so the search threads don't share their cache lines.
+int decompress_cached(Thread* th, PairsData* d, uint64_t idx) {
+
+    // Nothing to decompress
+    if (d->flags & TBFlag::SingleValue)
+        return d->minSymLen;
+
+    uint64_t h = idx * 0x9E3779B97F4A7C15ULL ^ (uint64_t)(uintptr_t)d;
+    h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    h = (h ^ (h >> 27)) * 0x94D049BB133111EBULL;
+    h ^= h >> 31;
+
+    std::atomic<uint64_t>& slot = ProbeCache[h & (ProbeCacheSize - 1)];
+    uint64_t e = slot.load(std::memory_order_relaxed);
+
+    th->tbProbes++;
+
+    if (e && (e & ~ValueMask) == (h & ~ValueMask))
+    {
+        th->tbCacheHits++;
+        return int(e & ValueMask);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    int value = decompress_pairs(d, idx);
+
+    uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>
+                 (std::chrono::steady_clock::now() - start).count();
+
+    th->tbDecodeTime += ns;
+    th->tbDecodeMax = std::max(th->tbDecodeMax, ns);
+
+    slot.store((h & ~ValueMask) | uint64_t(value), std::memory_order_relaxed);
+    return value;
+}
+
 bool check_dtz_stm(TBTable<WDL>*, int, File) { return true; }
 
 bool check_dtz_stm(TBTable<DTZ>* entry, int stm, File f) {
@@ -850,7 +927,7 @@ encode_remaining:
     }
 
     // Now that we have the index, decompress the pair and get the score
-    return map_score(entry, tbFile, decompress_pairs(d, idx), wdl);
+    return map_score(entry, tbFile, decompress_cached(pos.this_thread(), d, idx), wdl);
 }
 
 // Group together pieces that will be encoded together. The general rule is that
@@ -1237,6 +1314,10 @@ void Tablebases::init(const std::string& paths) {
     MaxCardinality = 0;
     TBFile::Paths = paths;
 
+    // The cached values refer to the PairsData of the tables just freed
+    for (auto& e : ProbeCache)
+        e.store(0, std::memory_order_relaxed);
+
     if (paths.empty() || paths == "<empty>")
         return;
 
@@ -1375,6 +1456,34 @@ void Tablebases::init(const std::string& paths) {
     sync_cout << "info string Found " << TBTables.size() << " tablebases" << sync_endl;
 }
 
+/// Tablebases::print_stats() sends the hit rate of the probe cache and the
+/// time spent decompressing values since the last call, if there were probes.
+/// Called when the search threads have finished, it sums and resets their counters.
+void Tablebases::print_stats() {
+
+    uint64_t probes = 0, hits = 0, time = 0, max = 0;
+
+    for (Thread* th : Threads)
+    {
+        probes += th->tbProbes;
+        hits   += th->tbCacheHits;
+        time   += th->tbDecodeTime;
+        max     = std::max(max, th->tbDecodeMax);
+        th->tbProbes = th->tbCacheHits = th->tbDecodeTime = th->tbDecodeMax = 0;
+    }
+
+    if (!probes)
+        return;
+
+    uint64_t decoded = probes - hits;
+
+    sync_cout << "info string Syzygy probes " << probes
+              << " cache hits " << 100 * hits / probes << "%"
+              << " decoded " << decoded
+              << " average " << (decoded ? time / decoded : 0) << "ns"
+              << " max " << max / 1000 << "us" << sync_endl;
+}
+
 // Probe the WDL table for a particular position.
 // If *result != FAIL, the probe was successful.
 // The return value is from the point of view of the side to move:
@@ -45,8 +45,10 @@ enum ProbeState {
 };
 
 extern int MaxCardinality;
+extern bool Prefetch;
 
 void init(const std::string& paths);
+void print_stats();
 WDLScore probe_wdl(Position& pos, ProbeState* result);
 int probe_dtz(Position& pos, ProbeState* result);
 bool root_probe(Position& pos, Search::RootMoves& rootMoves);
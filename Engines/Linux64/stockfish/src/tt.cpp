@@ -18,17 +18,45 @@
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h> // For MoveFileExA
+#endif
+
+#include <cstdio>    // For std::rename and std::remove
 #include <cstring>   // For std::memset
+#include <fstream>
 #include <iostream>
 #include <thread>
 
 #include "bitboard.h"
 #include "misc.h"
+#include "thread.h"
 #include "tt.h"
 #include "uci.h"
 
 TranspositionTable TT; // Our global transposition table
 
+namespace {
+
+  // Header of a hash file. It is followed by one record for each cluster with
+  // some entry: the cluster index (uint32_t), a bit mask of the non-empty
+  // entries (uint8_t) and these entries.
+  struct HashFileHeader {
+    char magic[8];
+    uint64_t entrySize;
+    uint64_t clusterCount;
+    uint64_t generation;
+  };
+
+  const char HashFileMagic[8] = "SFHASH1";
+
+  // Cluster index and mask of a record
+  constexpr size_t RecordHeadSize = sizeof(uint32_t) + sizeof(uint8_t);
+}
+
 /// TTEntry::save saves a TTEntry
 void TTEntry::save(Key k, Value v, Bound b, Depth d, Move m, Value ev) {
 
@@ -58,19 +86,28 @@ void TTEntry::save(Key k, Value v, Bound b, Depth d, Move m, Value ev) {
 
 void TranspositionTable::resize(size_t mbSize) {
 
+  static bool firstCall = true;
+
   clusterCount = mbSize * 1024 * 1024 / sizeof(Cluster);
 
-  free(mem);
-  mem = malloc(clusterCount * sizeof(Cluster) + CacheLineSize - 1);
+  large_pages_free(alloc);
+  table = (Cluster*)large_pages_alloc(clusterCount * sizeof(Cluster), Options["Large Pages"], alloc);
 
-  if (!mem)
+  if (!table)
   {
       std::cerr << "Failed to allocate " << mbSize
                 << "MB for transposition table." << std::endl;
       exit(EXIT_FAILURE);
   }
 
-  table = (Cluster*)((uintptr_t(mem) + CacheLineSize - 1) & ~(CacheLineSize - 1));
+  // The first call is before 'uci', the output there confuses some GUIs
+  if (!firstCall)
+      sync_cout << "info string Hash table allocation: " << mbSize << "MB, "
+                << large_pages_name(alloc.mode)
+                << (Numa::binding() && Numa::nodes() > 1 ? ", first touch on the NUMA nodes" : "")
+                << sync_endl;
+  firstCall = false;
+
   clear();
 }
 
@@ -87,8 +124,8 @@ void TranspositionTable::clear() {
       threads.emplace_back([this, idx]() {
 
           // Thread binding gives faster search on systems with a first-touch policy
-          if (Options["Threads"] > 8)
-              WinProcGroup::bindThisThread(idx);
+          if (Numa::binding())
+              Numa::bindThisThread(idx);
 
           // Each thread will zero its part of the hash table
           const size_t stride = clusterCount / Options["Threads"],
@@ -154,3 +191,160 @@ int TranspositionTable::hashfull() const {
   }
   return cnt;
 }
+
+
+/// TranspositionTable::save() writes the non-empty entries of the table to a
+/// file, to be reloaded by a later session with load(). The entries are written
+/// to fileName + ".tmp", which replaces the file only when it is complete.
+
+void TranspositionTable::save(const std::string& fileName) const {
+
+  Threads.main()->wait_for_search_finished();
+
+  std::string tmpName = fileName + ".tmp";
+  std::ofstream file(tmpName, std::ios::binary);
+  HashFileHeader header = {};
+
+  std::memcpy(header.magic, HashFileMagic, sizeof(header.magic));
+  header.entrySize = sizeof(TTEntry);
+  header.clusterCount = clusterCount;
+  header.generation = generation8;
+  file.write((const char*)&header, sizeof(header));
+
+  std::vector<char> buffer;
+  size_t entries = 0;
+
+  for (size_t idx = 0; idx < clusterCount && file; ++idx)
+  {
+      const TTEntry* tte = &table[idx].entry[0];
+      uint8_t mask = 0;
+
+      for (int i = 0; i < ClusterSize; ++i)
+          if (tte[i].key16)
+              mask |= 1 << i;
+
+      if (!mask)
+          continue;
+
+      uint32_t idx32 = uint32_t(idx);
+      buffer.insert(buffer.end(), (const char*)&idx32, (const char*)&idx32 + sizeof(idx32));
+      buffer.push_back(char(mask));
+
+      for (int i = 0; i < ClusterSize; ++i)
+          if (mask & (1 << i))
+          {
+              buffer.insert(buffer.end(), (const char*)&tte[i], (const char*)&tte[i] + sizeof(TTEntry));
+              entries++;
+          }
+
+      if (buffer.size() >= 1024 * 1024)
+      {
+          file.write(buffer.data(), buffer.size());
+          buffer.clear();
+      }
+  }
+
+  file.write(buffer.data(), buffer.size());
+  file.close();
+
+  bool ok = bool(file);
+
+  if (ok)
+#ifdef _WIN32
+      ok = MoveFileExA(tmpName.c_str(), fileName.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+      ok = std::rename(tmpName.c_str(), fileName.c_str()) == 0;
+#endif
+
+  if (!ok)
+      std::remove(tmpName.c_str());
+
+  if (ok)
+      sync_cout << "info string Hash saved to " << fileName << ": "
+                << entries << " entries" << sync_endl;
+  else
+      sync_cout << "info string Failed to save the hash to " << fileName << sync_endl;
+}
+
+
+/// TranspositionTable::load() adds to the table the entries of a file written by
+/// save(). Their ages are kept relative to the current generation, so the stale
+/// ones are replaced first as usual. An entry only replaces a less valuable one,
+/// and with a different Hash size the clusters are mapped proportionally, some
+/// of the entries will be missed.
+
+void TranspositionTable::load(const std::string& fileName) {
+
+  Threads.main()->wait_for_search_finished();
+
+  std::ifstream file(fileName, std::ios::binary);
+  HashFileHeader header;
+
+  if (   !file.read((char*)&header, sizeof(header))
+      || std::memcmp(header.magic, HashFileMagic, sizeof(header.magic))
+      || header.entrySize != sizeof(TTEntry)
+      || header.clusterCount == 0)
+  {
+      sync_cout << "info string " << fileName << " is not a hash file" << sync_endl;
+      return;
+  }
+
+  char head[RecordHeadSize];
+  size_t entries = 0;
+
+  // Replace value of an entry, as in probe()
+  auto worth = [this](const TTEntry* tte) {
+      return tte->depth8 - ((259 + generation8 - tte->genBound8) & 0xFC) * 2;
+  };
+
+  while (file.read(head, RecordHeadSize))
+  {
+      uint32_t idx32;
+      std::memcpy(&idx32, head, sizeof(idx32));
+      uint8_t mask = uint8_t(head[sizeof(idx32)]);
+
+      if (idx32 >= header.clusterCount || !mask || mask >> ClusterSize)
+          break;
+
+      TTEntry* tte = &table[header.clusterCount == clusterCount ? idx32
+                            : size_t(idx32 * uint64_t(clusterCount) / header.clusterCount)].entry[0];
+
+      for (int i = 0; i < ClusterSize; ++i)
+      {
+          if (!(mask & (1 << i)))
+              continue;
+
+          TTEntry e;
+          if (!file.read((char*)&e, sizeof(TTEntry)))
+              break;
+
+          // Same age as when saved, relative to the current generation
+          uint8_t age = (259 + header.generation - e.genBound8) & 0xFC;
+          e.genBound8 = uint8_t(((generation8 - age) & 0xFC) | e.bound());
+
+          // The same position, an empty entry or the least valuable one
+          TTEntry* replace = nullptr;
+          for (int j = 0; j < ClusterSize && !replace; ++j)
+              if (!tte[j].key16 || tte[j].key16 == e.key16)
+                  replace = &tte[j];
+
+          if (!replace)
+          {
+              replace = tte;
+              for (int j = 1; j < ClusterSize; ++j)
+                  if (worth(replace) > worth(&tte[j]))
+                      replace = &tte[j];
+          }
+
+          if (!replace->key16 || worth(&e) > worth(replace))
+          {
+              *replace = e;
+              entries++;
+          }
+      }
+  }
+
+  sync_cout << "info string Hash loaded from " << fileName << ": " << entries << " entries"
+            << (header.clusterCount != clusterCount ? ", saved with another Hash size" : "")
+            << sync_endl;
+}
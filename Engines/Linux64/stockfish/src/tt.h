@@ -21,6 +21,8 @@
 #ifndef TT_H_INCLUDED
 #define TT_H_INCLUDED
 
+#include <string>
+
 #include "misc.h"
 #include "types.h"
 
@@ -75,12 +77,14 @@ class TranspositionTable {
   static_assert(CacheLineSize % sizeof(Cluster) == 0, "Cluster size incorrect");
 
 public:
- ~TranspositionTable() { free(mem); }
+ ~TranspositionTable() { large_pages_free(alloc); }
   void new_search() { generation8 += 4; } // Lower 2 bits are used by Bound
   TTEntry* probe(const Key key, bool& found) const;
   int hashfull() const;
   void resize(size_t mbSize);
   void clear();
+  void save(const std::string& fileName) const;
+  void load(const std::string& fileName);
 
   // The 32 lowest order bits of the key are used to get the index of the cluster
   TTEntry* first_entry(const Key key) const {
@@ -92,7 +96,7 @@ private:
 
   size_t clusterCount;
   Cluster* table;
-  void* mem;
+  LargePagesAlloc alloc;
   uint8_t generation8; // Size must be not bigger than TTEntry::genBound8
 };
 
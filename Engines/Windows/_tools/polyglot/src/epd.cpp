@@ -8,6 +8,10 @@
 #include <cstdlib>
 #include <cstring>
 
+#ifndef _WIN32
+#include <sys/select.h>
+#endif
+
 #include "board.h"
 #include "engine.h"
 #include "epd.h"
@@ -19,6 +23,7 @@
 #include "parse.h"
 #include "san.h"
 #include "uci.h"
+#include "uci_options.h"
 #include "util.h"
 
 // constants
@@ -28,6 +33,37 @@ static const bool UseTrace = false;
 
 static const int StringSize = 4096;
 
+static const int WorkerMax = 64;
+
+// types
+
+struct search_t {
+   int move;
+   int depth;
+   int sel_depth;
+   int score;
+   double time;
+   sint64 node_nb;
+   move_t pv[LineSize];
+};
+
+struct worker_t {
+
+   engine_t * engine;
+   uci_t * uci;
+
+   bool busy;
+   bool ready_wait;
+   bool stopped;
+
+   int pos;
+   char am[StringSize], bm[StringSize], id[StringSize];
+   board_t board[1];
+
+   search_t first[1]; // since the last change of best move
+   search_t last[1];
+};
+
 // variables
 
 static int MinDepth;
@@ -38,30 +74,27 @@ static double MinTime;
 
 static int DepthDelta;
 
-static int FirstMove;
-static int FirstDepth;
-static int FirstSelDepth;
-static int FirstScore;
-static double FirstTime;
-static sint64 FirstNodeNb;
-static move_t FirstPV[LineSize];
-
-static int LastMove;
-static int LastDepth;
-static int LastSelDepth;
-static int LastScore;
-static double LastTime;
-static sint64 LastNodeNb;
-static move_t LastPV[LineSize];
+static int WorkerNb;
+static worker_t Worker[WorkerMax];
+
+static FILE * Results;
 
 // prototypes
 
 static void epd_test_file  (const char file_name[]);
 
+static void worker_open    (worker_t * worker, int index);
+static void worker_close   (worker_t * worker, int index);
+static bool worker_start   (worker_t * worker, FILE * file, int pos);
+static bool worker_step    (worker_t * worker, const char string[]);
+
+static worker_t * worker_wait ();
+
 static bool is_solution    (int move, const board_t * board, const char bm[], const char am[]);
 static bool string_contain (const char string[], const char substring[]);
 
-static bool engine_step    ();
+static void search_clear   (search_t * search);
+static void search_update  (search_t * search, const uci_t * uci);
 
 // functions
 
@@ -71,10 +104,13 @@ void epd_test(int argc, char * argv[]) {
 
    int i;
    const char * epd_file;
+   const char * results_file;
 
    epd_file = NULL;
    my_string_set(&epd_file,"wac.epd");
 
+   results_file = NULL;
+
    MinDepth = 8;
    MaxDepth = 63;
 
@@ -83,6 +119,8 @@ void epd_test(int argc, char * argv[]) {
 
    DepthDelta = 3;
 
+   WorkerNb = 1;
+
    for (i = 1; i < argc; i++) {
 
       if (false) {
@@ -133,13 +171,48 @@ void epd_test(int argc, char * argv[]) {
 
          DepthDelta = atoi(argv[i]);
 
+      } else if (my_string_equal(argv[i],"-engines")) {
+
+         i++;
+         if (argv[i] == NULL) my_fatal("epd_test(): missing argument\n");
+
+         WorkerNb = atoi(argv[i]);
+         if (WorkerNb < 1) WorkerNb = 1;
+         if (WorkerNb > WorkerMax) WorkerNb = WorkerMax;
+
+      } else if (my_string_equal(argv[i],"-results")) {
+
+         i++;
+         if (argv[i] == NULL) my_fatal("epd_test(): missing argument\n");
+
+         my_string_set(&results_file,argv[i]);
+
       } else {
 
          my_fatal("epd_test(): unknown option \"%s\"\n",argv[i]);
       }
    }
 
+#ifdef _WIN32
+   if (WorkerNb > 1) { // engine.cpp drives a single engine
+      printf("-engines %d: only one engine on Windows\n",WorkerNb);
+      WorkerNb = 1;
+   }
+#endif
+
+   Results = NULL;
+
+   if (results_file != NULL) {
+
+      Results = fopen(results_file,"w");
+      if (Results == NULL) my_fatal("epd_test(): can't open file \"%s\": %s\n",results_file,strerror(errno));
+
+      fprintf(Results,"pos\tid\tcorrect\tmove\tdepth\tseldepth\tscore\ttime\tnodes\tengine\n");
+   }
+
    epd_test_file(epd_file);
+
+   if (Results != NULL) fclose(Results);
 }
 
 // epd_test_file()
@@ -148,14 +221,16 @@ static void epd_test_file(const char file_name[]) {
 
    FILE * file;
    int hit, tot;
-   char epd[StringSize];
-   char am[StringSize], bm[StringSize], id[StringSize];
-   board_t board[1];
+   int pos;
    char string[StringSize];
-   int move;
+   char move_string[256];
    char pv_string[StringSize];
+   worker_t * worker;
    bool correct;
+   int w, busy;
    double depth_tot, time_tot, node_tot;
+   double search_time, search_node;
+   my_timer_t timer[1];
 
    ASSERT(file_name!=NULL);
 
@@ -171,97 +246,76 @@ static void epd_test_file(const char file_name[]) {
    time_tot = 0.0;
    node_tot = 0.0;
 
-   // loop
+   search_time = 0.0;
+   search_node = 0.0;
 
-   while (my_file_read_line(file,epd,StringSize)) {
+   my_timer_reset(timer);
+   my_timer_start(timer);
 
-      if (UseTrace) printf("%s\n",epd);
+   // one position per engine, then a new one to each engine that finishes
 
-      if (!epd_get_op(epd,"am",am,StringSize)) strcpy(am,"");
-      if (!epd_get_op(epd,"bm",bm,StringSize)) strcpy(bm,"");
-      if (!epd_get_op(epd,"id",id,StringSize)) strcpy(id,"");
+   pos = 0;
+   busy = 0;
 
-      if (my_string_empty(am) && my_string_empty(bm)) {
-         my_fatal("epd_test(): no am or bm field in EPD\n");
+   for (w = 0; w < WorkerNb; w++) {
+      worker_open(&Worker[w],w);
+      if (worker_start(&Worker[w],file,pos)) {
+         pos++;
+         busy++;
       }
+   }
 
-      // init
+   // loop
 
-      uci_send_ucinewgame(Uci);
-      uci_send_isready_sync(Uci);
+   while (busy > 0) {
 
-      ASSERT(!Uci->searching);
+      worker = worker_wait();
 
-      // position
+      engine_get(worker->engine,string,StringSize);
+      if (worker_step(worker,string)) continue;
 
-      if (!board_from_fen(board,epd)) ASSERT(false);
-      if (!board_to_fen(board,string,sizeof(string))) ASSERT(false);
+      // search done
 
-      engine_send(Engine,"position fen %s",string);
+      correct = is_solution(worker->first->move,worker->board,worker->bm,worker->am);
 
-      // search
+      if (correct) hit++;
+      tot++;
 
-      engine_send(Engine,"go movetime %.0f depth %d",MaxTime*1000.0,MaxDepth);
-      // engine_send(Engine,"go infinite");
+      if (correct) {
+         depth_tot += double(worker->first->depth);
+         time_tot += worker->first->time;
+         node_tot += double(worker->first->node_nb);
+      }
 
-      // engine data
+      search_time += worker->last->time;
+      search_node += double(worker->last->node_nb);
 
-      board_copy(Uci->board,board);
-
-      uci_clear(Uci);
-      Uci->searching = true;
-      Uci->pending_nb++;
-
-      FirstMove = MoveNone;
-      FirstDepth = 0;
-      FirstSelDepth = 0;
-      FirstScore = 0;
-      FirstTime = 0.0;
-      FirstNodeNb = 0;
-      line_clear(FirstPV);
-
-      LastMove = MoveNone;
-      LastDepth = 0;
-      LastSelDepth = 0;
-      LastScore = 0;
-      LastTime = 0.0;
-      LastNodeNb = 0;
-      line_clear(LastPV);
-
-      // parse engine output
-
-      while (engine_step()) {
-
-         // stop search?
-
-         if (Uci->depth > MaxDepth
-          || Uci->time >= MaxTime
-          || (Uci->depth - FirstDepth >= DepthDelta
-           && Uci->depth > MinDepth
-           && Uci->time >= MinTime
-           && is_solution(FirstMove,board,bm,am))) {
-            engine_send(Engine,"stop");
-         }
-      }
+      printf("%s %d %4d %4d",worker->id,correct,hit,tot);
 
-      move = FirstMove;
-      correct = is_solution(move,board,bm,am);
+      if (!line_to_san(worker->last->pv,worker->uci->board,pv_string,sizeof(pv_string))) ASSERT(false);
+      printf(" - %2d %6.2f " S64_FORMAT_9 " %+6.2f %s\n",worker->first->depth,worker->first->time,worker->first->node_nb,double(worker->last->score)/100.0,pv_string);
 
-      if (correct) hit++;
-      tot++;
+      if (Results != NULL) {
 
-      if (correct) {
-         depth_tot += double(FirstDepth);
-         time_tot += FirstTime;
-         node_tot += double(FirstNodeNb);
+         if (!move_to_san(worker->first->move,worker->board,move_string,sizeof(move_string))) ASSERT(false);
+
+         fprintf(Results,"%d\t%s\t%d\t%s\t%d\t%d\t%d\t%.3f\t" S64_FORMAT "\t%d\n",
+            worker->pos+1,worker->id,correct,move_string,worker->first->depth,worker->first->sel_depth,
+            worker->last->score,worker->first->time,worker->first->node_nb,int(worker-Worker));
+         fflush(Results);
       }
 
-      printf("%s %d %4d %4d",id,correct,hit,tot);
+      worker->busy = false;
+      busy--;
 
-      if (!line_to_san(LastPV,Uci->board,pv_string,sizeof(pv_string))) ASSERT(false);
-      printf(" - %2d %6.2f " S64_FORMAT_9 " %+6.2f %s\n",FirstDepth,FirstTime,FirstNodeNb,double(LastScore)/100.0,pv_string);
+      if (worker_start(worker,file,pos)) {
+         pos++;
+         busy++;
+      }
    }
 
+   my_timer_stop(timer);
+
    printf("%d/%d",hit,tot);
 
    if (hit != 0) {
@@ -275,9 +329,248 @@ static void epd_test_file(const char file_name[]) {
 
    printf("\n");
 
+   // throughput, all the engines together
+
+   if (my_timer_elapsed_real(timer) > 0.0) {
+      printf("%d engine%s, %.1f s, %.2f positions/s, %.0f nodes/s (search %.1f s)\n",
+         WorkerNb,(WorkerNb>1)?"s":"",my_timer_elapsed_real(timer),double(tot)/my_timer_elapsed_real(timer),
+         search_node/my_timer_elapsed_real(timer),search_time);
+   }
+
+   for (w = 0; w < WorkerNb; w++) worker_close(&Worker[w],w);
+
    fclose(file);
 }
 
+// worker_open()
+
+static void worker_open(worker_t * worker, int index) {
+
+#ifndef _WIN32
+   uci_option_t * next;
+#endif
+
+   ASSERT(worker!=NULL);
+   ASSERT(index>=0&&index<WorkerNb);
+
+   worker->busy = false;
+   worker->ready_wait = false;
+   worker->stopped = false;
+   worker->pos = -1;
+
+   if (index == 0) { // launched by parse_option()
+      worker->engine = Engine;
+      worker->uci = Uci;
+      return;
+   }
+
+#ifndef _WIN32
+
+   // same command and options as the first engine
+
+   worker->engine = (engine_t *) my_malloc(sizeof(engine_t));
+   worker->uci = (uci_t *) my_malloc(sizeof(uci_t));
+
+   engine_open(worker->engine);
+   uci_open(worker->uci,worker->engine);
+
+   init_uci_list(&next);
+   while (next != NULL) {
+      if (next->var == NULL) break;
+      uci_send_option(worker->uci,next->var,"%s",next->val);
+      if (my_string_case_equal(next->var,"MultiPV") && atoi(next->val) > 1) worker->uci->multipv_mode = true;
+      next = next->next;
+   }
+
+   uci_send_isready_sync(worker->uci);
+#endif
+}
+
+// worker_close()
+
+static void worker_close(worker_t * worker, int index) {
+
+   ASSERT(worker!=NULL);
+   ASSERT(!worker->busy);
+
+   if (index == 0) return; // closed by main()
+
+   engine_send(worker->engine,"quit");
+   uci_close(worker->uci);
+
+   my_free(worker->uci);
+   my_free(worker->engine);
+}
+
+// worker_start()
+
+static bool worker_start(worker_t * worker, FILE * file, int pos) {
+
+   char epd[StringSize];
+
+   ASSERT(worker!=NULL);
+   ASSERT(!worker->busy);
+   ASSERT(file!=NULL);
+
+   if (!my_file_read_line(file,epd,StringSize)) return false;
+
+   if (UseTrace) printf("%s\n",epd);
+
+   if (!epd_get_op(epd,"am",worker->am,StringSize)) strcpy(worker->am,"");
+   if (!epd_get_op(epd,"bm",worker->bm,StringSize)) strcpy(worker->bm,"");
+   if (!epd_get_op(epd,"id",worker->id,StringSize)) strcpy(worker->id,"");
+
+   if (my_string_empty(worker->am) && my_string_empty(worker->bm)) {
+      my_fatal("epd_test(): no am or bm field in EPD\n");
+   }
+
+   if (!board_from_fen(worker->board,epd)) ASSERT(false);
+
+   worker->busy = true;
+   worker->pos = pos;
+
+   // init, the search starts on "readyok"
+
+   ASSERT(!worker->uci->searching);
+
+   uci_send_ucinewgame(worker->uci);
+   uci_send_isready(worker->uci);
+
+   worker->ready_wait = true;
+
+   return true;
+}
+
+// worker_step()
+
+static bool worker_step(worker_t * worker, const char string[]) {
+
+   uci_t * uci;
+   char fen[StringSize];
+   int event;
+
+   ASSERT(worker!=NULL);
+   ASSERT(worker->busy);
+   ASSERT(string!=NULL);
+
+   uci = worker->uci;
+   event = uci_parse(uci,string);
+
+   if (worker->ready_wait) {
+
+      if ((event & EVENT_READY) == 0) return true;
+
+      worker->ready_wait = false;
+
+      // position
+
+      if (!board_to_fen(worker->board,fen,sizeof(fen))) ASSERT(false);
+
+      engine_send(worker->engine,"position fen %s",fen);
+
+      // search
+
+      engine_send(worker->engine,"go movetime %.0f depth %d",MaxTime*1000.0,MaxDepth);
+
+      // engine data
+
+      board_copy(uci->board,worker->board);
+
+      uci_clear(uci);
+      uci->searching = true;
+      uci->pending_nb++;
+
+      worker->stopped = false;
+
+      search_clear(worker->first);
+      search_clear(worker->last);
+
+      return true;
+   }
+
+   if ((event & EVENT_MOVE) != 0) return false;
+
+   if ((event & EVENT_PV) != 0) {
+
+      search_update(worker->last,uci);
+
+      if (worker->last->move != worker->first->move) {
+         search_update(worker->first,uci);
+      }
+   }
+
+   // stop search?
+
+   if (!worker->stopped
+    && (uci->depth > MaxDepth
+     || uci->time >= MaxTime
+     || (uci->depth - worker->first->depth >= DepthDelta
+      && uci->depth > MinDepth
+      && uci->time >= MinTime
+      && is_solution(worker->first->move,worker->board,worker->bm,worker->am)))) {
+      engine_send(worker->engine,"stop");
+      worker->stopped = true;
+   }
+
+   return true;
+}
+
+// worker_wait()
+
+static worker_t * worker_wait() {
+
+#ifdef _WIN32
+
+   ASSERT(WorkerNb==1);
+
+   return &Worker[0]; // engine_get() waits for the line
+
+#else
+
+   int w;
+   int fd_max;
+   fd_set set[1];
+   worker_t * worker;
+
+   while (true) {
+
+      // a complete line already buffered?
+
+      for (w = 0; w < WorkerNb; w++) {
+         worker = &Worker[w];
+         if (worker->busy && io_line_ready(worker->engine->io)) return worker;
+      }
+
+      // wait for any engine
+
+      FD_ZERO(set);
+      fd_max = -1;
+
+      for (w = 0; w < WorkerNb; w++) {
+         worker = &Worker[w];
+         if (!worker->busy) continue;
+         FD_SET(worker->engine->io->in_fd,set);
+         if (worker->engine->io->in_fd > fd_max) fd_max = worker->engine->io->in_fd;
+      }
+
+      ASSERT(fd_max>=0);
+
+      if (select(fd_max+1,set,NULL,NULL,NULL) == -1) {
+         if (errno == EINTR) continue;
+         my_fatal("worker_wait(): select(): %s\n",strerror(errno));
+      }
+
+      for (w = 0; w < WorkerNb; w++) {
+         worker = &Worker[w];
+         if (worker->busy && FD_ISSET(worker->engine->io->in_fd,set)) {
+            io_get_update(worker->engine->io);
+         }
+      }
+   }
+
+#endif
+}
+
 // is_solution()
 
 static bool is_solution(int move, const board_t * board, const char bm[], const char am[]) {
@@ -366,43 +659,35 @@ static bool string_contain(const char string[], const char substring[]) {
    return false;
 }
 
-// engine_step()
+// search_clear()
 
-static bool engine_step() {
+static void search_clear(search_t * search) {
 
-   char string[StringSize];
-   int event;
+   ASSERT(search!=NULL);
 
-   engine_get(Engine,string,StringSize);
-   event = uci_parse(Uci,string);
-
-   if ((event & EVENT_MOVE) != 0) {
+   search->move = MoveNone;
+   search->depth = 0;
+   search->sel_depth = 0;
+   search->score = 0;
+   search->time = 0.0;
+   search->node_nb = 0;
+   line_clear(search->pv);
+}
 
-      return false;
-   }
+// search_update()
 
-   if ((event & EVENT_PV) != 0) {
+static void search_update(search_t * search, const uci_t * uci) {
 
-      LastMove = Uci->best_pv[0];
-      LastDepth = Uci->best_depth;
-      LastSelDepth = Uci->best_sel_depth;
-      LastScore = Uci->best_score;
-      LastTime = Uci->time;
-      LastNodeNb = Uci->node_nb;
-      line_copy(LastPV,Uci->best_pv);
-
-      if (LastMove != FirstMove) {
-         FirstMove = LastMove;
-         FirstDepth = LastDepth;
-         FirstSelDepth = LastSelDepth;
-         FirstScore = LastScore;
-         FirstTime = LastTime;
-         FirstNodeNb = LastNodeNb;
-         line_copy(FirstPV,LastPV);
-      }
-   }
+   ASSERT(search!=NULL);
+   ASSERT(uci!=NULL);
 
-   return true;
+   search->move = uci->best_pv[0];
+   search->depth = uci->best_depth;
+   search->sel_depth = uci->best_sel_depth;
+   search->score = uci->best_score;
+   search->time = uci->time;
+   search->node_nb = uci->node_nb;
+   line_copy(search->pv,uci->best_pv);
 }
 
 // end of epd.cpp
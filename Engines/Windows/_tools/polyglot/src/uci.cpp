@@ -193,7 +193,7 @@ void uci_send_stop(uci_t * uci) {
    ASSERT(uci->searching);
    ASSERT(uci->pending_nb>=1);
 
-   engine_send(Engine,"stop");
+   engine_send(uci->engine,"stop");
    uci->searching = false;
 }
 
@@ -610,7 +610,7 @@ static int parse_info(uci_t * uci, const char string[]) {
          ASSERT(!my_string_empty(argument));
 
          n = atoi(argument);
-		 if(Uci->multipv_mode) multipvline=n;
+		 if(uci->multipv_mode) multipvline=n;
         
          ASSERT(n>=1);
 
@@ -666,7 +666,7 @@ static int parse_info(uci_t * uci, const char string[]) {
 		  if(!strncmp(argument,"Resign",6))
 			  event |= EVENT_RESIGN;
 		  else{
-			  strncpy(Uci->info_string,parse->string+7,sizeof(Uci->info_string));
+			  strncpy(uci->info_string,parse->string+7,sizeof(uci->info_string));
 			  event |= EVENT_INFO;
 		  }
          // TODO: argument to EOS
@@ -1,4 +1,6 @@
 cimport cython
+from cpython.mem cimport PyMem_Malloc, PyMem_Free
+from libc.string cimport strcpy
 
 
 cdef extern from "irina.h":
@@ -21,7 +23,20 @@ cdef extern from "irina.h":
     void getMoveEx( int num, char * info )
     char * toSan(int num, char *sanMove)
     char inCheck()
+
+    ctypedef struct MoveInfo:
+        char pv[6]
+        char san[10]
+        char piece
+        char promotion
+        unsigned char from_sq
+        unsigned char to_sq
+        unsigned flags
+
+    int move_list(MoveInfo *li)
+    int line_info(char *pv, MoveInfo *li, int max)
     void set_level(int lv)
+    void hash_set_size(int mb)
 
     void pgn_start(char * fich, int depth)
     void pgn_stop()
@@ -34,6 +49,224 @@ cdef extern from "irina.h":
     int pgn_raw()
     int pgn_numfens()
     char * pgn_fen(int num)
+    char * pgn_xpv()
+    int pgn_plies()
+
+    ctypedef struct PGNgame:
+        int status
+        int raw
+        int plies
+        int numlabels
+        int numfens
+        int result
+        size_t pgn
+        size_t pv
+        size_t xpv
+        size_t labels
+        size_t fens
+
+    ctypedef struct c_XPVset "XPVset":
+        pass
+
+    c_XPVset * xpvset_new()
+    void xpvset_free(c_XPVset *set)
+    char xpvset_add(c_XPVset *set, char *xpv)
+    int xpvset_count(c_XPVset *set)
+
+    ctypedef struct PGNslice:
+        char *ptr
+        size_t len
+
+    ctypedef struct PGNtag:
+        PGNslice label
+        PGNslice value
+
+    ctypedef struct PGNscanGame:
+        unsigned long long offset
+        PGNslice text
+        PGNslice body
+        int numtags
+        PGNtag *tags
+
+    ctypedef struct c_PGNscanner "PGNscanner":
+        pass
+
+    c_PGNscanner * pgnscan_open(char *fich)
+    void pgnscan_close(c_PGNscanner *sc)
+    char pgnscan_next(c_PGNscanner *sc, PGNscanGame *game) nogil
+    unsigned long long pgnscan_size(c_PGNscanner *sc)
+    unsigned long long pgnscan_pos(c_PGNscanner *sc)
+
+    ctypedef struct StatsEntry:
+        unsigned long long key
+        unsigned move
+        int w, b, d, o
+
+    ctypedef struct c_StatsMap "StatsMap":
+        pass
+
+    c_StatsMap * stats_new()
+    void stats_free(c_StatsMap *map)
+    StatsEntry * stats_entry(c_StatsMap *map, unsigned long long key, unsigned move, char create)
+    void stats_merge(c_StatsMap *dst, c_StatsMap *src)
+    int stats_count(c_StatsMap *map)
+    int stats_result(char *result)
+    void stats_add_counts(c_StatsMap *map, unsigned long long key, unsigned move, int w, int b, int d, int o)
+    void stats_clear(c_StatsMap *map)
+    char stats_save(c_StatsMap *map, char *fich, int depth) nogil
+    int stats_load(c_StatsMap *map, char *fich) nogil
+
+    ctypedef struct c_PGNimport "PGNimport":
+        pass
+
+    c_PGNimport * pgnimport_new(char **files, int nfiles, int nworkers, int depth, int stats_depth)
+    void pgnimport_free(c_PGNimport *imp)
+    int pgnimport_next(c_PGNimport *imp, c_XPVset *dups) nogil
+    PGNgame * pgnimport_game(c_PGNimport *imp, int num)
+    char * pgnimport_str(c_PGNimport *imp, size_t offset)
+    int pgnimport_file(c_PGNimport *imp)
+    unsigned long long pgnimport_done(c_PGNimport *imp)
+    unsigned long long pgnimport_total(c_PGNimport *imp)
+    c_StatsMap * pgnimport_stats(c_PGNimport *imp) nogil
+
+    ctypedef struct PolyglotEntry:
+        unsigned move
+        unsigned weight
+        unsigned learn
+
+    ctypedef struct c_PolyglotBook "PolyglotBook":
+        pass
+
+    unsigned long long polyglot_key()
+    unsigned long long polyglot_key_fen(char *fen)
+    c_PolyglotBook * polyglot_open(char *fich)
+    void polyglot_close(c_PolyglotBook *book)
+    int polyglot_size(c_PolyglotBook *book)
+    int polyglot_probe(c_PolyglotBook *book, unsigned long long key, PolyglotEntry *entries, int max) nogil
+
+    ctypedef struct UCIinfo:
+        unsigned fields
+        int multipv
+        int depth
+        int seldepth
+        int score
+        int time
+        unsigned long long nodes
+        unsigned long long nps
+        char pv[1024]
+
+    ctypedef struct c_UCIengine "UCIengine":
+        pass
+
+    c_UCIengine * uci_engine_open(char *dir, char **args, int nargs)
+    void uci_engine_close(c_UCIengine *e) nogil
+    int uci_engine_pid(c_UCIengine *e)
+    char uci_engine_put(c_UCIengine *e, char *line)
+    void uci_engine_set_raw(c_UCIengine *e, char raw)
+    int uci_engine_read(c_UCIengine *e) nogil
+    char uci_engine_pending(c_UCIengine *e)
+    int uci_engine_lines(c_UCIengine *e, char *dst, int size)
+    int uci_engine_infos(c_UCIengine *e, UCIinfo *dst, int max)
+    void uci_engine_clear(c_UCIengine *e)
+    int uci_engines_wait(int ms) nogil
+
+    ctypedef struct c_AnCache "AnCache":
+        pass
+    c_AnCache * ancache_open(char *name)
+    void ancache_close(c_AnCache *c)
+    unsigned ancache_engine_id(char *name)
+    int ancache_size(c_AnCache *c)
+    char ancache_probe(c_AnCache *c, unsigned long long key, unsigned engine, int *depth, int *time)
+    int ancache_get(c_AnCache *c, unsigned long long key, unsigned engine, UCIinfo *lines, int max)
+    char ancache_put(c_AnCache *c, unsigned long long key, unsigned engine, UCIinfo *lines, int n)
+    char ancache_compact(c_AnCache *c)
+
+    int pv_to_xpv(char *pv, char *xpv, int size)
+    int xpv_to_pv(char *xpv, char *pv, int size)
+    int mvx_encode(char *fen, char *pv, char *mvx, int size)
+    int mvx_decode(char *fen, char *mvx, char *pv, int size)
+    int pv_codec_list(int codec, char **src, char **dst, int *sizes, int num) nogil
+
+    ctypedef struct c_PosIndex "PosIndex":
+        pass
+    ctypedef struct c_PosIndexBuilder "PosIndexBuilder":
+        pass
+    unsigned long long posindex_material_fen(char *fen)
+    c_PosIndex * posindex_open(char *name)
+    void posindex_close(c_PosIndex *x)
+    int posindex_maxply(c_PosIndex *x)
+    unsigned posindex_maxrowid(c_PosIndex *x)
+    int posindex_games(c_PosIndex *x)
+    int posindex_find(c_PosIndex *x, int kind, unsigned long long key, unsigned *rowids, int max) nogil
+    c_PosIndexBuilder * posindex_builder_new(char *name, int maxply, char update, char mvx)
+    void posindex_builder_free(c_PosIndexBuilder *b)
+    unsigned posindex_builder_maxrowid(c_PosIndexBuilder *b)
+    char posindex_builder_add(c_PosIndexBuilder *b, unsigned rowid, char *xpv)
+    char posindex_builder_finish(c_PosIndexBuilder *b) nogil
+
+    ctypedef struct c_GameQuery "GameQuery":
+        pass
+    c_GameQuery * gamequery_new(char *expr, int minplies, char mvx, char *error, int size)
+    void gamequery_free(c_GameQuery *q)
+    int gamequery_match(c_GameQuery *q, char *xpv)
+    void gamequery_run(c_GameQuery *q, int nworkers, char **xpvs, int num, int *plies) nogil
+
+    ctypedef struct LCContext:
+        pass
+
+    LCContext * lc_ctx_new()
+    void lc_ctx_free(LCContext *ctx)
+    void lc_fen_board(LCContext *ctx, char *fen) nogil
+    char * lc_board_fen(LCContext *ctx, char *fen) nogil
+    int lc_movegen(LCContext *ctx) nogil
+    int c_lc_pgn2pv "lc_pgn2pv"(LCContext *ctx, char *pgn, char *pv) nogil
+    int lc_make_nummove(LCContext *ctx, int num) nogil
+    char * lc_playFen(LCContext *ctx, char *fen, int depth, int time) nogil
+    int lc_numMoves(LCContext *ctx) nogil
+    void lc_getMove(LCContext *ctx, int num, char *pv) nogil
+    int lc_numBaseMove(LCContext *ctx) nogil
+    int lc_searchMove(LCContext *ctx, char *desde, char *hasta, char *promotion) nogil
+    char * lc_toSan(LCContext *ctx, int num, char *sanMove) nogil
+    int lc_move_list(LCContext *ctx, MoveInfo *li) nogil
+    char lc_inCheck(LCContext *ctx) nogil
+    void lc_set_level(LCContext *ctx, int lv) nogil
+    void lc_pgn_start(LCContext *ctx, char *fich, int depth) nogil
+    void lc_pgn_stop(LCContext *ctx) nogil
+    int lc_pgn_read(LCContext *ctx) nogil
+    char * lc_pgn_game(LCContext *ctx) nogil
+    char * lc_pgn_pv(LCContext *ctx) nogil
+    int lc_pgn_numlabels(LCContext *ctx) nogil
+    char * lc_pgn_label(LCContext *ctx, int num) nogil
+    char * lc_pgn_value(LCContext *ctx, int num) nogil
+    int lc_pgn_raw(LCContext *ctx) nogil
+    int lc_pgn_numfens(LCContext *ctx) nogil
+    char * lc_pgn_fen(LCContext *ctx, int num) nogil
+    char * lc_pgn_xpv(LCContext *ctx) nogil
+    int lc_pgn_plies(LCContext *ctx) nogil
+    int lc_pgn_read_batch(LCContext *ctx, int max_games, c_XPVset *dups) nogil
+    PGNgame * lc_pgn_batch_game(LCContext *ctx, int num) nogil
+    char * lc_pgn_batch_str(LCContext *ctx, size_t offset) nogil
+    int lc_stats_add_pv(LCContext *ctx, c_StatsMap *map, char *pv, int result, int r, int depth) nogil
+    int lc_stats_children(LCContext *ctx, c_StatsMap *map, StatsEntry *children) nogil
+    unsigned long long lc_board_hashkey(LCContext *ctx)
+    unsigned long long lc_polyglot_key(LCContext *ctx)
+
+MOVE_CAPTURE = 1
+MOVE_CHECK = 2
+MOVE_MATE = 4
+MOVE_EP = 8
+MOVE_CASTLE_K = 16
+MOVE_CASTLE_Q = 32
+
+PGN_OK = 0
+PGN_ERROR = 1
+PGN_NOTINITIAL = 2
+PGN_DUPLICATE = 3
+
+RESULT_WHITE = 0
+RESULT_BLACK = 1
+RESULT_DRAW = 2
+RESULT_OTHER = 3
 
 
 class PGNreader:
@@ -70,6 +303,719 @@ class PGNreader:
             raise StopIteration
 
 
+cdef class Context:
+    """Independent engine state (board, pgn reader, level).
+    Several contexts can work at the same time from different threads, the long calls release the GIL.
+    A context must not be used by two threads at once.
+    """
+    cdef LCContext *ctx
+
+    def __cinit__(self):
+        self.ctx = lc_ctx_new()
+        if self.ctx is NULL:
+            raise MemoryError()
+
+    def __dealloc__(self):
+        if self.ctx is not NULL:
+            lc_ctx_free(self.ctx)
+
+    def setFen(self, fen):
+        cdef char *cfen = fen
+        cdef int n
+        with nogil:
+            lc_fen_board(self.ctx, cfen)
+            n = lc_movegen(self.ctx)
+        return n
+
+    def getFen(self):
+        cdef char fen[100]
+        lc_board_fen(self.ctx, fen)
+        x = fen
+        return x
+
+    def setFenInicial(self):
+        return self.setFen("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1")
+
+    def getMoves(self):
+        cdef char pv[10]
+        cdef int nmoves, x, nbase
+        nmoves = lc_numMoves(self.ctx)
+        nbase = lc_numBaseMove(self.ctx)
+        li = []
+        for x in range(nmoves):
+            lc_getMove(self.ctx, x+nbase, pv)
+            r = pv
+            li.append(r)
+        return li
+
+    def getExMoves(self):
+        cdef MoveInfo li[256]
+        cdef int n
+        with nogil:
+            n = lc_move_list(self.ctx, li)
+        return infoMoves(li, n)
+
+    def makeMove(self, move):
+        cdef int num
+        desde = move[:2]
+        hasta = move[2:4]
+        coronacion = move[4:]
+        num = lc_searchMove(self.ctx, desde, hasta, coronacion)
+        if num == -1:
+            return False
+        with nogil:
+            lc_make_nummove(self.ctx, num)
+        return True
+
+    def makePV(self, pv):
+        self.setFenInicial()
+        if pv:
+            for move in pv.split(" "):
+                self.makeMove(move)
+        return self.getFen()
+
+    def getPGN(self, desdeA1H8, hastaA1H8, coronacion):
+        cdef char san[10]
+        cdef int num
+        if not coronacion:
+            coronacion = ""
+        num = lc_searchMove(self.ctx, desdeA1H8, hastaA1H8, coronacion)
+        if num == -1:
+            return None
+        lc_toSan(self.ctx, num, san)
+        return san
+
+    def pgn2pv(self, pgn1):
+        cdef char pv[10]
+        resp = c_lc_pgn2pv(self.ctx, pgn1, pv)
+        if resp == 9999:
+            return ""
+        else:
+            return pv
+
+    def isCheck(self):
+        return lc_inCheck(self.ctx)
+
+    def polyglotKey(self):
+        return lc_polyglot_key(self.ctx)
+
+    def runFen(self, fen, int depth, int ms, int level):
+        cdef char *cfen = fen
+        cdef char *resp
+        with nogil:
+            lc_set_level(self.ctx, level)
+            resp = lc_playFen(self.ctx, cfen, depth, ms)
+            lc_set_level(self.ctx, 0)
+        x = resp
+        return x
+
+    def pgnReader(self, fich, depth):
+        return PGNreaderCtx(self, fich, depth)
+
+
+cdef class XPVset:
+    """Set of xpv digests, to find duplicated games while importing."""
+    cdef c_XPVset *st
+
+    def __cinit__(self):
+        self.st = xpvset_new()
+        if self.st is NULL:
+            raise MemoryError()
+
+    def __dealloc__(self):
+        if self.st is not NULL:
+            xpvset_free(self.st)
+
+    def add(self, xpv):
+        """True if xpv was not in the set"""
+        return xpvset_add(self.st, xpv) != 0
+
+    def __len__(self):
+        return xpvset_count(self.st)
+
+
+cdef class PGNreaderCtx:
+    """PGNreader on its own Context, parsing runs without the GIL."""
+    cdef Context context
+    cdef object fich
+    cdef int depth
+
+    def __init__(self, Context context, fich, int depth):
+        self.context = context
+        self.fich = fich
+        self.depth = depth
+
+    def __enter__(self):
+        lc_pgn_start(self.context.ctx, self.fich, self.depth)
+        return self
+
+    def __exit__(self, type, value, traceback):
+        lc_pgn_stop(self.context.ctx)
+
+    def __iter__(self):
+        return self
+
+    def __next__(self):
+        cdef LCContext *ctx = self.context.ctx
+        cdef int ok, n, x
+        cdef char *cpv
+        with nogil:
+            ok = lc_pgn_read(ctx)
+            if ok:
+                cpv = lc_pgn_pv(ctx)
+        if not ok:
+            raise StopIteration
+        pgn = lc_pgn_game(ctx)
+        pv = cpv
+        d = {}
+        dlw = {}
+        n = lc_pgn_numlabels(ctx)
+        r = lc_pgn_raw(ctx)
+        fens = [ lc_pgn_fen(ctx, x) for x in range(lc_pgn_numfens(ctx)) ]
+        for x in range(n):
+            d[lc_pgn_label(ctx, x).upper()] = lc_pgn_value(ctx, x)
+            dlw[lc_pgn_label(ctx, x).upper()] = lc_pgn_label(ctx, x)
+        return pgn, pv, d, r, fens, dlw
+
+    def batch(self, int max_games, XPVset dups=None):
+        """Reads up to max_games games in one native call.
+        Returns a list of (status, pgn, pv, xpv, plies, dic_labels, raw, li_fens, dic_labels_lower),
+        status is one of PGN_OK, PGN_ERROR, PGN_NOTINITIAL, PGN_DUPLICATE. Empty list at end of file.
+        """
+        cdef LCContext *ctx = self.context.ctx
+        cdef c_XPVset *st = NULL
+        cdef int n
+
+        if dups is not None:
+            st = dups.st
+        with nogil:
+            n = lc_pgn_read_batch(ctx, max_games, st)
+
+        if n == 0:
+            return []
+        return games2list(lc_pgn_batch_game(ctx, 0), lc_pgn_batch_str(ctx, 0), n)
+
+
+cdef list games2list(PGNgame *games, char *buf, int n):
+    cdef PGNgame *game
+    cdef int x, k
+    cdef size_t pos
+    cdef char *label
+    cdef char *value
+    cdef char *fen
+
+    li = []
+    for x in range(n):
+        game = &games[x]
+        d = {}
+        dlw = {}
+        pos = game.labels
+        for k in range(game.numlabels):
+            label = buf + pos
+            pos += len(label) + 1
+            value = buf + pos
+            pos += len(value) + 1
+            lb = label
+            lbu = lb.upper()
+            d[lbu] = value
+            dlw[lbu] = lb
+        fens = []
+        pos = game.fens
+        for k in range(game.numfens):
+            fen = buf + pos
+            pos += len(fen) + 1
+            fens.append(fen)
+        li.append((game.status, buf + game.pgn, buf + game.pv,
+                   buf + game.xpv, game.plies, d, game.raw, fens, dlw))
+    return li
+
+
+cdef class StatsMap:
+    """W/B/D/O counters of (position zobrist key, move2num) pairs."""
+    cdef c_StatsMap *map
+    cdef LCContext *ctx
+
+    def __cinit__(self):
+        self.map = stats_new()
+        self.ctx = lc_ctx_new()
+        if self.map is NULL or self.ctx is NULL:
+            raise MemoryError()
+
+    def __dealloc__(self):
+        if self.map is not NULL:
+            stats_free(self.map)
+        if self.ctx is not NULL:
+            lc_ctx_free(self.ctx)
+
+    def get(self, unsigned long long key, unsigned move):
+        """(w, b, d, o) or None"""
+        cdef StatsEntry *e
+        e = stats_entry(self.map, key, move, 0)
+        if e is NULL:
+            return None
+        return e.w, e.b, e.d, e.o
+
+    def merge(self, StatsMap other):
+        stats_merge(self.map, other.map)
+
+    def clear(self):
+        stats_clear(self.map)
+
+    def add_pv(self, pv, result, int r=1, int depth=9999):
+        """Adds the first depth moves of pv (a1h8), result as in the Result label"""
+        cdef char *cpv = pv
+        cdef int res = stats_result(result)
+        cdef int n
+        with nogil:
+            n = lc_stats_add_pv(self.ctx, self.map, cpv, res, r, depth)
+        return n
+
+    def add_fen_move(self, fen, move, int w, int b, int d, int o):
+        """Adds counters to the move (a1h8) played in fen"""
+        lc_fen_board(self.ctx, fen)
+        stats_add_counts(self.map, lc_board_hashkey(self.ctx), move2num(move), w, b, d, o)
+
+    def children(self, pv):
+        """[(move a1h8, w, b, d, o), ...] of the legal moves after pv, movegen order"""
+        cdef StatsEntry li[256]
+        cdef int n, x
+        cdef char *cpv
+        lc_fen_board(self.ctx, "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1")
+        lc_movegen(self.ctx)
+        if pv:
+            for move in pv.split(" "):
+                n = lc_searchMove(self.ctx, move[:2], move[2:4], move[4:])
+                if n == -1:
+                    return []
+                lc_make_nummove(self.ctx, n)
+        n = lc_stats_children(self.ctx, self.map, li)
+        return [(num2move(li[x].move), li[x].w, li[x].b, li[x].d, li[x].o) for x in range(n)]
+
+    def save(self, fich, int depth):
+        cdef char *cfich = fich
+        cdef char ok
+        with nogil:
+            ok = stats_save(self.map, cfich, depth)
+        return ok != 0
+
+    def load(self, fich):
+        """Adds the stats of fich, returns its depth, -1 if it is not a stats file"""
+        cdef char *cfich = fich
+        cdef int depth
+        with nogil:
+            depth = stats_load(self.map, cfich)
+        return depth
+
+    def __len__(self):
+        return stats_count(self.map)
+
+
+cdef class PGNimport:
+    """Import of several pgn files, parsed by nworkers native threads (0 = in the calling thread).
+    next() gives the games chunk by chunk in file order, in the PGNreaderCtx.batch format,
+    stats() the merged position stats of the games imported when stats_depth > 0.
+    """
+    cdef c_PGNimport *imp
+
+    def __cinit__(self, files, int nworkers, int depth, int stats_depth=0):
+        cdef char **cfiles
+        cdef int x
+        lifiles = list(files)
+        cfiles = <char **> PyMem_Malloc((len(lifiles) or 1) * sizeof(char *))
+        if cfiles is NULL:
+            raise MemoryError()
+        for x in range(len(lifiles)):
+            cfiles[x] = lifiles[x]
+        self.imp = pgnimport_new(cfiles, len(lifiles), nworkers, depth, stats_depth)
+        PyMem_Free(cfiles)
+        if self.imp is NULL:
+            raise MemoryError()
+
+    def __dealloc__(self):
+        self.close()
+
+    def close(self):
+        if self.imp is not NULL:
+            pgnimport_free(self.imp)
+            self.imp = NULL
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, type, value, traceback):
+        self.close()
+
+    def next(self, XPVset dups=None):
+        """Games of the next chunk, empty list at the end of the files"""
+        cdef c_XPVset *st = NULL
+        cdef int n
+        if dups is not None:
+            st = dups.st
+        with nogil:
+            n = pgnimport_next(self.imp, st)
+        if n == 0:
+            return []
+        return games2list(pgnimport_game(self.imp, 0), pgnimport_str(self.imp, 0), n)
+
+    def file(self):
+        """Position in files of the games returned by the last next()"""
+        return pgnimport_file(self.imp)
+
+    def progress(self):
+        """(bytes read, total bytes)"""
+        return pgnimport_done(self.imp), pgnimport_total(self.imp)
+
+    def stats(self):
+        cdef StatsMap sm
+        cdef c_StatsMap *map
+        with nogil:
+            map = pgnimport_stats(self.imp)
+        if map is NULL:
+            return None
+        sm = StatsMap()
+        stats_free(sm.map)
+        sm.map = map
+        return sm
+
+
+cdef class PGNscanner:
+    """Memory mapped pgn file, games are found without parsing the moves.
+    Iterating gives (offset, size, dic_labels) for each game, enough to build an index of the file in one pass
+    (label values as written in the file, escapes included);
+    game(offset, size) reads back the text of a game.
+    """
+    cdef c_PGNscanner *sc
+    cdef PGNscanGame cur
+    cdef object fich
+
+    def __cinit__(self, fich):
+        self.fich = fich
+        self.sc = pgnscan_open(fich)
+        if self.sc is NULL:
+            raise IOError("Unable to open %s" % fich)
+
+    def __dealloc__(self):
+        self.close()
+
+    def close(self):
+        if self.sc is not NULL:
+            pgnscan_close(self.sc)
+            self.sc = NULL
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, type, value, traceback):
+        self.close()
+
+    def __iter__(self):
+        return self
+
+    def __next__(self):
+        cdef int ok, x
+        cdef PGNtag *tag
+        if self.sc is NULL:
+            raise StopIteration
+        with nogil:
+            ok = pgnscan_next(self.sc, &self.cur)
+        if not ok:
+            raise StopIteration
+        d = {}
+        for x in range(self.cur.numtags):
+            tag = &self.cur.tags[x]
+            d[tag.label.ptr[:tag.label.len].upper()] = tag.value.ptr[:tag.value.len]
+        return self.cur.offset, self.cur.text.len, d
+
+    def body(self):
+        """Movetext of the last game found"""
+        return self.cur.body.ptr[:self.cur.body.len]
+
+    def size(self):
+        return pgnscan_size(self.sc)
+
+    def pos(self):
+        """Bytes already scanned, for progress bars"""
+        return pgnscan_pos(self.sc)
+
+    def game(self, offset, size):
+        with open(self.fich, "rb") as f:
+            f.seek(offset)
+            return f.read(size)
+
+
+cdef class PolyglotBook:
+    """Polyglot .bin book, memory mapped while the object is open.
+    probe(key)/lista(fen) give [(move, weight, learn), ...] in file order, move in the polyglot encoding.
+    """
+    cdef c_PolyglotBook *book
+    cdef object fich
+
+    def __cinit__(self, fich):
+        self.fich = fich
+        self.book = polyglot_open(fich)
+        if self.book is NULL:
+            raise IOError("Unable to open %s" % fich)
+
+    def __dealloc__(self):
+        self.close()
+
+    def close(self):
+        if self.book is not NULL:
+            polyglot_close(self.book)
+            self.book = NULL
+
+    def probe(self, unsigned long long key):
+        cdef PolyglotEntry li[256]
+        cdef int n, x
+        with nogil:
+            n = polyglot_probe(self.book, key, li, 256)
+        return [(li[x].move, li[x].weight, li[x].learn) for x in range(n)]
+
+    def lista(self, fen):
+        return self.probe(polyglot_key_fen(fen))
+
+    def __len__(self):
+        if self.book is NULL:
+            return 0
+        return polyglot_size(self.book)
+
+
+def polyglotKey(fen=None):
+    """Polyglot key of fen, of the current board without fen"""
+    if fen is None:
+        return polyglot_key()
+    return polyglot_key_fen(fen)
+
+
+def polyglotProbe(books, fen):
+    """[[(move, weight, learn), ...], ...] of fen in each PolyglotBook of books"""
+    cdef unsigned long long key = polyglot_key_fen(fen)
+    cdef PolyglotBook book
+    resp = []
+    for book in books:
+        resp.append(book.probe(key))
+    return resp
+
+
+cdef enum:
+    UCI_DEPTH = 1
+    UCI_SELDEPTH = 2
+    UCI_MULTIPV = 4
+    UCI_SCORE = 8
+    UCI_MATE = 16
+    UCI_TIME = 32
+    UCI_NODES = 64
+    UCI_NPS = 128
+    UCI_PV = 256
+
+
+cdef info2dic(UCIinfo *info):
+    d = {}
+    if info.fields & UCI_MULTIPV:
+        d["multipv"] = str(info.multipv)
+    if info.fields & UCI_DEPTH:
+        d["depth"] = str(info.depth)
+    if info.fields & UCI_SELDEPTH:
+        d["seldepth"] = str(info.seldepth)
+    if info.fields & UCI_SCORE:
+        d["score"] = ("mate %d" if info.fields & UCI_MATE else "cp %d") % info.score
+    if info.fields & UCI_TIME:
+        d["time"] = str(info.time)
+    if info.fields & UCI_NODES:
+        d["nodes"] = str(info.nodes)
+    if info.fields & UCI_NPS:
+        d["nps"] = str(info.nps)
+    if info.fields & UCI_PV:
+        d["pv"] = info.pv
+    return d
+
+
+cdef dic2info(d, UCIinfo *info):
+    info.fields = 0
+    info.pv[0] = 0
+    if "multipv" in d:
+        info.fields |= UCI_MULTIPV
+        info.multipv = int(d["multipv"])
+    if "depth" in d:
+        info.fields |= UCI_DEPTH
+        info.depth = int(d["depth"])
+    if "seldepth" in d:
+        info.fields |= UCI_SELDEPTH
+        info.seldepth = int(d["seldepth"])
+    if "score" in d:
+        tipo, valor = d["score"].split()[:2]
+        info.fields |= UCI_SCORE | (UCI_MATE if tipo == "mate" else 0)
+        info.score = int(valor)
+    if "time" in d:
+        info.fields |= UCI_TIME
+        info.time = int(d["time"])
+    if "nodes" in d:
+        info.fields |= UCI_NODES
+        info.nodes = int(d["nodes"])
+    if "nps" in d:
+        info.fields |= UCI_NPS
+        info.nps = int(d["nps"])
+    if "pv" in d:
+        pv = d["pv"][:1023]
+        info.fields |= UCI_PV
+        strcpy(info.pv, pv)
+
+
+cdef class UCIEngine:
+    """UCI engine running as a child process, its output is read without blocking.
+    lines() gives the text lines ("\\n" included), updates() the info lines already parsed,
+    as dicts with the keys of the engine protocol and the values as strings.
+    With set_raw(True) all the output is given by lines(), only needed by the engine logs.
+    """
+    cdef c_UCIengine *engine
+    cdef char buffer[65536]
+    cdef UCIinfo infos[64]
+
+    def __cinit__(self, args, folder=""):
+        cdef char **argv
+        cdef char *cfolder = NULL
+        cdef int x, nargs = len(args)
+        argv = <char **>PyMem_Malloc(nargs * sizeof(char *))
+        if argv is NULL:
+            raise MemoryError()
+        try:
+            for x in range(nargs):
+                argv[x] = args[x]
+            if folder:
+                cfolder = folder
+            self.engine = uci_engine_open(cfolder, argv, nargs)
+        finally:
+            PyMem_Free(argv)
+        if self.engine is NULL:
+            raise OSError("Unable to run %s" % args[0])
+
+    def __dealloc__(self):
+        self.close()
+
+    def close(self):
+        if self.engine is not NULL:
+            with nogil:
+                uci_engine_close(self.engine)
+            self.engine = NULL
+
+    def pid(self):
+        return uci_engine_pid(self.engine) if self.engine is not NULL else None
+
+    def put_line(self, line):
+        if self.engine is NULL:
+            return False
+        return uci_engine_put(self.engine, line) != 0
+
+    def set_raw(self, raw):
+        if self.engine is not NULL:
+            uci_engine_set_raw(self.engine, 1 if raw else 0)
+
+    def read(self):
+        """Reads what the engine has written, -1 when the engine has finished and all has been given"""
+        cdef int n
+        if self.engine is NULL:
+            return -1
+        with nogil:
+            n = uci_engine_read(self.engine)
+        return n
+
+    def pending(self):
+        return self.engine is not NULL and uci_engine_pending(self.engine) != 0
+
+    def lines(self):
+        cdef int n
+        resp = []
+        if self.engine is NULL:
+            return resp
+        while True:
+            n = uci_engine_lines(self.engine, self.buffer, sizeof(self.buffer))
+            if n == 0:
+                break
+            resp.extend(self.buffer[:n].splitlines(True))
+        return resp
+
+    def updates(self):
+        cdef int n, x
+        resp = []
+        if self.engine is NULL:
+            return resp
+        while True:
+            n = uci_engine_infos(self.engine, self.infos, 64)
+            for x in range(n):
+                resp.append(info2dic(&self.infos[x]))
+            if n < 64:
+                break
+        return resp
+
+    def clear(self):
+        if self.engine is not NULL:
+            uci_engine_clear(self.engine)
+
+
+def uciWait(int ms):
+    """Waits up to ms milliseconds until any UCIEngine has written something, number of engines read"""
+    cdef int n
+    with nogil:
+        n = uci_engines_wait(ms)
+    return n
+
+
+cdef class AnalysisCache:
+    """Analyses kept on disk (fich.dat + fich.idx), by polyglot key of the position and engine id.
+    The lines are dicts as UCIEngine.updates() gives them, the last of each multipv.
+    """
+    cdef c_AnCache *cache
+    cdef UCIinfo infos[64]
+
+    def __cinit__(self, fich):
+        self.cache = ancache_open(fich)
+        if self.cache is NULL:
+            raise IOError("Unable to open %s" % fich)
+
+    def __dealloc__(self):
+        self.close()
+
+    def close(self):
+        if self.cache is not NULL:
+            ancache_close(self.cache)
+            self.cache = NULL
+
+    def get(self, unsigned long long key, unsigned engine, int mindepth=0, int mintime=0):
+        """Lines of the analysis if it reaches mindepth or mintime (ms), else None"""
+        cdef int depth, time, n, x
+        if self.cache is NULL or not ancache_probe(self.cache, key, engine, &depth, &time):
+            return None
+        if depth < mindepth or time < mintime:
+            return None
+        n = ancache_get(self.cache, key, engine, self.infos, 64)
+        if n == 0:
+            return None
+        return [info2dic(&self.infos[x]) for x in range(n)]
+
+    def put(self, unsigned long long key, unsigned engine, lines):
+        """False if there is already a deeper analysis"""
+        cdef int n = min(len(lines), 64), x
+        if self.cache is NULL or n == 0:
+            return False
+        for x in range(n):
+            dic2info(lines[x], &self.infos[x])
+        return ancache_put(self.cache, key, engine, self.infos, n) != 0
+
+    def compact(self):
+        return self.cache is not NULL and ancache_compact(self.cache) != 0
+
+    def __len__(self):
+        if self.cache is NULL:
+            return 0
+        return ancache_size(self.cache)
+
+
+def engineId(name):
+    """Id of an engine (with its options) for AnalysisCache"""
+    return ancache_engine_id(name)
+
+
+
 def lc_pgn2pv(pgn1):
     cdef char pv[10];
     resp = pgn2pv(pgn1, pv)
@@ -178,40 +1124,307 @@ def liNMinimo(x, y, celdas_ocupadas):
         li = knightmoves(x, y, ot, 0, nv)
     return li
 
+cdef xbytes(s):
+    # xpv and pv read from the databases are unicode
+    if isinstance(s, unicode):
+        return s.encode("latin-1")
+    return s
+
 def xpv2lipv(xpv):
-    li = []
-    siBlancas = True
-    for c in xpv:
-        x = ord(c)
-        if x >= 58:
-            move = posA1(x - 58)
-            if siBlancas:
-                base = move
-            else:
-                li.append(base + move)
-            siBlancas = not siBlancas
-        else:
-            c = {50: "q", 51: "r", 52: "b", 53: "n"}.get(x, "")
-            li[-1] += c
-    return li
+    pv = xpv2pv(xpv)
+    return pv.split(" ") if pv else []
 
 def xpv2pv(xpv):
-    return " ".join(xpv2lipv(xpv))
+    xpv = xbytes(xpv)
+    cdef int size = len(xpv) * 3 + 1  # "e2e4 " of 2 chars, "e7e8q " of 3
+    cdef char *pv = <char *>PyMem_Malloc(size)
+    if pv is NULL:
+        raise MemoryError()
+    try:
+        xpv_to_pv(xpv, pv, size)
+        return pv
+    finally:
+        PyMem_Free(pv)
 
 def pv2xpv(pv):
-    if pv:
-        li = pv.split(" ")
-        lix = []
-        for move in li:
-            d = chr(a1Pos(move[:2]) + 58)  # 58 is an arbitrary number, to remain in range 58..122
-            h = chr(a1Pos(move[2:4]) + 58)
-            c = move[4:]
-            if c:
-                c = {"q": chr(50), "r": chr(51), "b": chr(52), "n": chr(53)}.get(c.lower(), "")
-            lix.append(d + h + c)
-        return "".join(lix)
-    else:
-        return ""
+    pv = xbytes(pv)
+    cdef int size = len(pv) + 1
+    cdef char *xpv = <char *>PyMem_Malloc(size)
+    if xpv is NULL:
+        raise MemoryError()
+    try:
+        pv_to_xpv(pv, xpv, size)
+        return xpv
+    finally:
+        PyMem_Free(xpv)
+
+cdef enum:
+    CODEC_PV_XPV = 0
+    CODEC_XPV_PV = 1
+    CODEC_PV_MVX = 2
+    CODEC_MVX_PV = 3
+    CODEC_XPV_MVX = 4
+    CODEC_MVX_XPV = 5
+
+cdef int codec_size(int codec, int n):
+    # room for the coded line of n chars: pv 4-5 chars + space, xpv 2-3, mvx 1-2
+    if codec == CODEC_PV_XPV or codec == CODEC_XPV_MVX:
+        return n + 1
+    elif codec == CODEC_PV_MVX:
+        return n / 2 + 2
+    elif codec == CODEC_MVX_PV:
+        return n * 6 + 1
+    return n * 3 + 1
+
+cdef codec_list(int codec, li):
+    """each line of li coded with codec, in one native call without the GIL"""
+    cdef int n = len(li), k
+    cdef size_t total = 0
+    cdef char **src
+    cdef char **dst
+    cdef int *sizes
+    cdef char *block = NULL
+    liBytes = [xbytes(x) for x in li]  # alive while pv_codec_list uses them
+    src = <char **>PyMem_Malloc(max(n, 1) * sizeof(char *))
+    dst = <char **>PyMem_Malloc(max(n, 1) * sizeof(char *))
+    sizes = <int *>PyMem_Malloc(max(n, 1) * sizeof(int))
+    if src is not NULL and dst is not NULL and sizes is not NULL:
+        for k in range(n):
+            src[k] = liBytes[k]
+            sizes[k] = codec_size(codec, len(liBytes[k]))
+            total += sizes[k]
+        block = <char *>PyMem_Malloc(max(total, 1))
+    if block is NULL:
+        PyMem_Free(src)
+        PyMem_Free(dst)
+        PyMem_Free(sizes)
+        raise MemoryError()
+    total = 0
+    for k in range(n):
+        dst[k] = block + total
+        total += sizes[k]
+    with nogil:
+        pv_codec_list(codec, src, dst, sizes, n)
+    try:
+        return [dst[k] for k in range(n)]
+    finally:
+        PyMem_Free(block)
+        PyMem_Free(src)
+        PyMem_Free(dst)
+        PyMem_Free(sizes)
+
+def xpv2pvList(lixpv):
+    """pv of each xpv of lixpv, the whole list in one native call"""
+    return codec_list(CODEC_XPV_PV, lixpv)
+
+def pv2xpvList(lipv):
+    """xpv of each pv of lipv, the whole list in one native call"""
+    return codec_list(CODEC_PV_XPV, lipv)
+
+def pv2mvx(pv, fen=None):
+    """mvx (an index of the legal moves per move) of pv from fen, None the initial position.
+    Uses the board of the thread as setFen.
+    """
+    pv = xbytes(pv)
+    cdef int size = len(pv) / 2 + 2  # 2 chars at most of 5 or 6
+    cdef char *mvx = <char *>PyMem_Malloc(size)
+    cdef char *cfen = NULL
+    if mvx is NULL:
+        raise MemoryError()
+    if fen:
+        fen = xbytes(fen)
+        cfen = fen
+    try:
+        mvx_encode(cfen, pv, mvx, size)
+        return mvx
+    finally:
+        PyMem_Free(mvx)
+
+def mvx2pv(mvx, fen=None):
+    """pv of mvx from fen, None the initial position. Uses the board of the thread as setFen."""
+    mvx = xbytes(mvx)
+    cdef int size = len(mvx) * 6 + 1
+    cdef char *pv = <char *>PyMem_Malloc(size)
+    cdef char *cfen = NULL
+    if pv is NULL:
+        raise MemoryError()
+    if fen:
+        fen = xbytes(fen)
+        cfen = fen
+    try:
+        mvx_decode(cfen, mvx, pv, size)
+        return pv
+    finally:
+        PyMem_Free(pv)
+
+def mvx2xpv(mvx):
+    """xpv of mvx from the initial position"""
+    return pv2xpv(mvx2pv(mvx))
+
+def xpv2mvx(xpv):
+    """mvx of xpv from the initial position"""
+    return pv2mvx(xpv2pv(xpv))
+
+def pv2mvxList(lipv):
+    """mvx of each pv of lipv, from the initial position, the whole list in one native call"""
+    return codec_list(CODEC_PV_MVX, lipv)
+
+def mvx2pvList(limvx):
+    """pv of each mvx of limvx, from the initial position, the whole list in one native call"""
+    return codec_list(CODEC_MVX_PV, limvx)
+
+def xpv2mvxList(lixpv):
+    """mvx of each xpv of lixpv, the whole list in one native call"""
+    return codec_list(CODEC_XPV_MVX, lixpv)
+
+def mvx2xpvList(limvx):
+    """xpv of each mvx of limvx, the whole list in one native call"""
+    return codec_list(CODEC_MVX_XPV, limvx)
+
+cdef enum:
+    PIX_POSITION = 0
+    PIX_MATERIAL = 1
+
+
+cdef class PositionIndex:
+    """Games (rowids) of a database that reach each position (polyglot key) or material signature,
+    fich.idx + fich.dat memory mapped while the object is open. Built with PositionIndexBuilder.
+    """
+    cdef c_PosIndex *pix
+
+    def __cinit__(self, fich):
+        self.pix = posindex_open(fich)
+        if self.pix is NULL:
+            raise IOError("Unable to open %s" % fich)
+
+    def __dealloc__(self):
+        self.close()
+
+    def close(self):
+        if self.pix is not NULL:
+            posindex_close(self.pix)
+            self.pix = NULL
+
+    cdef find(self, int kind, unsigned long long key):
+        cdef unsigned buf[4096]
+        cdef unsigned *rowids = buf
+        cdef int n, x
+        with nogil:
+            n = posindex_find(self.pix, kind, key, rowids, 4096)
+        if n > 4096:
+            rowids = <unsigned *>PyMem_Malloc(n * sizeof(unsigned))
+            if rowids is NULL:
+                raise MemoryError()
+            with nogil:
+                posindex_find(self.pix, kind, key, rowids, n)
+        try:
+            return [rowids[x] for x in range(n)]
+        finally:
+            if rowids != buf:
+                PyMem_Free(rowids)
+
+    def positions(self, fen):
+        """rowids of the games that reach the position of fen (up to maxply)"""
+        return self.find(PIX_POSITION, polyglot_key_fen(fen))
+
+    def material(self, fen):
+        """rowids of the games that reach the material of fen"""
+        return self.find(PIX_MATERIAL, posindex_material_fen(fen))
+
+    def maxply(self):
+        return posindex_maxply(self.pix)
+
+    def maxrowid(self):
+        return posindex_maxrowid(self.pix)
+
+    def __len__(self):
+        return posindex_games(self.pix)
+
+
+cdef class PositionIndexBuilder:
+    """Writes a PositionIndex: new with the positions up to maxply, or update of the current one
+    (its maxply is kept) with the games of rowids greater than maxrowid().
+    With mvx the games are added in mvx instead of xpv. Uses the board of the thread as setFen.
+    """
+    cdef c_PosIndexBuilder *builder
+
+    def __cinit__(self, fich, int maxply, update=False, mvx=False):
+        self.builder = posindex_builder_new(fich, maxply, 1 if update else 0, 1 if mvx else 0)
+        if self.builder is NULL:
+            raise MemoryError()
+
+    def __dealloc__(self):
+        if self.builder is not NULL:
+            posindex_builder_free(self.builder)
+            self.builder = NULL
+
+    def maxrowid(self):
+        return posindex_builder_maxrowid(self.builder)
+
+    def add(self, unsigned rowid, xpv):
+        return posindex_builder_add(self.builder, rowid, xbytes(xpv)) != 0
+
+    def addList(self, lirowidxpv):
+        """[(rowid, xpv), ...]"""
+        cdef unsigned rowid
+        for rowid, xpv in lirowidxpv:
+            if not posindex_builder_add(self.builder, rowid, xbytes(xpv)):
+                return False
+        return True
+
+    def finish(self):
+        """Writes the index, False if it can't be written"""
+        cdef char ok
+        with nogil:
+            ok = posindex_builder_finish(self.builder)
+        self.builder = NULL
+        return ok != 0
+
+
+cdef class GameQuery:
+    """Expression over the pieces of the positions of the games, "R == 1 and b == 1 and Q+q+B+r+N+n == 0",
+    evaluated after each move (syntax in gamequery.c). With minplies it has to be true for that number of
+    consecutive plies. With mvx the games are matched in mvx instead of xpv.
+    """
+    cdef c_GameQuery *q
+
+    def __cinit__(self, expr, int minplies=1, mvx=False):
+        cdef char error[256]
+        self.q = gamequery_new(xbytes(expr), minplies, 1 if mvx else 0, error, sizeof(error))
+        if self.q is NULL:
+            raise ValueError(error)
+
+    def __dealloc__(self):
+        if self.q is not NULL:
+            gamequery_free(self.q)
+            self.q = NULL
+
+    def match(self, xpv):
+        """first ply where it matches, -1 if it doesn't"""
+        return gamequery_match(self.q, xbytes(xpv))
+
+    def run(self, lixpv, int nworkers=0):
+        """match of each xpv of lixpv, shared by the thread of the caller and nworkers threads"""
+        cdef int n = len(lixpv), k
+        cdef char **xpvs
+        cdef int *plies
+        liBytes = [xbytes(xpv) for xpv in lixpv]  # alive while the threads use them
+        xpvs = <char **>PyMem_Malloc(max(n, 1) * sizeof(char *))
+        plies = <int *>PyMem_Malloc(max(n, 1) * sizeof(int))
+        if xpvs is NULL or plies is NULL:
+            PyMem_Free(xpvs)
+            PyMem_Free(plies)
+            raise MemoryError()
+        for k in range(n):
+            xpvs[k] = liBytes[k]
+        with nogil:
+            gamequery_run(self.q, nworkers, xpvs, n, plies)
+        try:
+            return [plies[k] for k in range(n)]
+        finally:
+            PyMem_Free(xpvs)
+            PyMem_Free(plies)
+
 
 def runFen( fen, depth, ms, level ):
     set_level(level)
@@ -219,6 +1432,10 @@ def runFen( fen, depth, ms, level ):
     set_level(0)
     return x
 
+def setHashSize(mb):
+    # transposition table of runFen, in the calling thread
+    hash_set_size(mb)
+
 def setFen(fen):
     fen_board(fen)
     return movegen()
@@ -256,35 +1473,29 @@ def getPGN(desdeA1H8, hastaA1H8, coronacion):
     return san
 
 def xpv2pgn(xpv):
-    cdef char san[10]
+    cdef MoveInfo li[1024]
+    cdef int n, x
+    cdef object pv
     setFenInicial()
-    siW = True
-    num = 1
-    li = []
+    pv = " ".join(xpv2lipv(xpv))
+    n = line_info(pv, li, 1024)
+    lix = []
     tam = 0
-    for pv in xpv2lipv(xpv):
-        if siW:
-            x = str(num)+"."
-            tam += len(x)
-            li.append(x)
-            num += 1
-        siW = not siW
-
-        numMove = searchMove( pv[:2], pv[2:4], pv[4:] )
-        if numMove == -1:
-            break
-        toSan(numMove, san)
-        x = str(san)
-        li.append(x)
-        tam += len(x)
+    for x in range(n):
+        if x % 2 == 0:
+            t = str(x/2+1)+"."
+            tam += len(t)
+            lix.append(t)
+        t = li[x].san
+        lix.append(t)
+        tam += len(t)
         if tam >= 80:
-            li.append("\n")
+            lix.append("\n")
             tam = 0
         else:
-            li.append(" ")
+            lix.append(" ")
             tam += 1
-        make_nummove(numMove)
-    return "".join(li)
+    return "".join(lix)
 
 def isCheck():
     return inCheck()
@@ -348,15 +1559,35 @@ class InfoMove(object):
     def isEnPassant(self):
         return self._ep
 
-def getExMoves():
-    nmoves = numMoves()
+cdef list infoMoves(MoveInfo *li, int n):
+    cdef int x
+    cdef MoveInfo *mi
+    resp = []
+    for x in range(n):
+        mi = &li[x]
+        mv = InfoMove.__new__(InfoMove)
+        mv._castle_K = (mi.flags & MOVE_CASTLE_K) != 0
+        mv._castle_Q = (mi.flags & MOVE_CASTLE_Q) != 0
+        mv._ep = (mi.flags & MOVE_EP) != 0
+        pv = mi.pv
+        mv._piece = chr(mi.piece)
+        mv._pv = mv._piece + pv
+        mv._san = mi.san
+        mv._from = pv[:2]
+        mv._to = pv[2:4]
+        mv._promotion = pv[4:]
+        mv._check = (mi.flags & MOVE_CHECK) != 0
+        mv._mate = (mi.flags & MOVE_MATE) != 0
+        mv._capture = (mi.flags & MOVE_CAPTURE) != 0
+        resp.append(mv)
+    return resp
 
-    nbase = numBaseMove()
-    li = []
-    for x in range(nmoves):
-        mv = InfoMove(x + nbase)
-        li.append(mv)
-    return li
+def getExMoves():
+    # all the moves in one call to the engine
+    cdef MoveInfo li[256]
+    cdef int n
+    n = move_list(li)
+    return infoMoves(li, n)
 
 def moveExPV(desde, hasta, coronacion):
     if not coronacion:
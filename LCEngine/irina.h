@@ -1,6 +1,8 @@
 #ifndef IRINA_DEFS_H
 #define IRINA_DEFS_H
 
+#include <stddef.h>
+
 typedef struct
 {
    unsigned from      : 6;
@@ -29,7 +31,28 @@ int searchMove( char *desde, char *hasta, char * promotion );
 void getMoveEx( int num, char * info );
 char * toSan(int num, char *sanMove);
 char inCheck(void);
+
+#define MOVE_CAPTURE    1
+#define MOVE_CHECK      2
+#define MOVE_MATE       4
+#define MOVE_EP         8
+#define MOVE_CASTLE_K   16
+#define MOVE_CASTLE_Q   32
+
+typedef struct
+{
+   char     pv[6];
+   char     san[10];
+   char     piece;
+   char     promotion;
+   unsigned char from_sq, to_sq;
+   unsigned flags;
+} MoveInfo;
+
+int move_list(MoveInfo *li);
+int line_info(char *pv, MoveInfo *li, int max);
 void set_level(int lv);
+void hash_set_size(int mb);
 
 void pgn_start(char * fich, int depth);
 void pgn_stop( void );
@@ -42,6 +65,256 @@ char * pgn_value(int num);
 int pgn_raw(void);
 int pgn_numfens(void);
 char * pgn_fen(int num);
+char * pgn_xpv(void);
+int pgn_plies(void);
+
+#define PGN_OK           0
+#define PGN_ERROR        1
+#define PGN_NOTINITIAL   2
+#define PGN_DUPLICATE    3
+
+#define RESULT_WHITE     0
+#define RESULT_BLACK     1
+#define RESULT_DRAW      2
+#define RESULT_OTHER     3
+
+typedef struct
+{
+   int      status;
+   int      raw;
+   int      plies;
+   int      numlabels;
+   int      numfens;
+   int      result;
+   size_t   pgn;
+   size_t   pv;
+   size_t   xpv;
+   size_t   labels;
+   size_t   fens;
+} PGNgame;
+
+typedef struct XPVset XPVset;
+
+XPVset * xpvset_new(void);
+void xpvset_free(XPVset *set);
+char xpvset_add(XPVset *set, char *xpv);
+int xpvset_count(XPVset *set);
+int pgn_read_batch(int max_games, XPVset *dups);
+PGNgame * pgn_batch_game(int num);
+char * pgn_batch_str(size_t offset);
+
+#define MAX_PGN_TAGS    256
+
+typedef struct
+{
+   char     *ptr;
+   size_t   len;
+} PGNslice;
+
+typedef struct
+{
+   PGNslice label;
+   PGNslice value;
+} PGNtag;
+
+typedef struct
+{
+   unsigned long long offset;
+   PGNslice text;
+   PGNslice body;
+   int      numtags;
+   PGNtag   tags[MAX_PGN_TAGS];
+} PGNscanGame;
+
+typedef struct PGNscanner PGNscanner;
+
+PGNscanner * pgnscan_open(char *fich);
+void pgnscan_close(PGNscanner *sc);
+char pgnscan_next(PGNscanner *sc, PGNscanGame *game);
+unsigned long long pgnscan_size(PGNscanner *sc);
+unsigned long long pgnscan_pos(PGNscanner *sc);
+
+typedef struct
+{
+   unsigned long long key;
+   unsigned move;
+   int      w, b, d, o;
+} StatsEntry;
+
+typedef struct StatsMap StatsMap;
+
+StatsMap * stats_new(void);
+void stats_free(StatsMap *map);
+StatsEntry * stats_entry(StatsMap *map, unsigned long long key, unsigned move, char create);
+void stats_merge(StatsMap *dst, StatsMap *src);
+int stats_count(StatsMap *map);
+int stats_result(char *result);
+void stats_add_counts(StatsMap *map, unsigned long long key, unsigned move, int w, int b, int d, int o);
+void stats_clear(StatsMap *map);
+char stats_save(StatsMap *map, char *fich, int depth);
+int stats_load(StatsMap *map, char *fich);
+
+typedef struct PGNimport PGNimport;
+
+PGNimport * pgnimport_new(char **files, int nfiles, int nworkers, int depth, int stats_depth);
+void pgnimport_free(PGNimport *imp);
+int pgnimport_next(PGNimport *imp, XPVset *dups);
+PGNgame * pgnimport_game(PGNimport *imp, int num);
+char * pgnimport_str(PGNimport *imp, size_t offset);
+int pgnimport_file(PGNimport *imp);
+unsigned long long pgnimport_done(PGNimport *imp);
+unsigned long long pgnimport_total(PGNimport *imp);
+StatsMap * pgnimport_stats(PGNimport *imp);
+
+typedef struct
+{
+   unsigned move;
+   unsigned weight;
+   unsigned learn;
+} PolyglotEntry;
+
+typedef struct PolyglotBook PolyglotBook;
+
+unsigned long long polyglot_key(void);
+unsigned long long polyglot_key_fen(char *fen);
+PolyglotBook * polyglot_open(char *fich);
+void polyglot_close(PolyglotBook *book);
+int polyglot_size(PolyglotBook *book);
+int polyglot_probe(PolyglotBook *book, unsigned long long key, PolyglotEntry *entries, int max);
+
+#define UCI_DEPTH       1
+#define UCI_SELDEPTH    2
+#define UCI_MULTIPV     4
+#define UCI_SCORE       8
+#define UCI_MATE        16
+#define UCI_TIME        32
+#define UCI_NODES       64
+#define UCI_NPS         128
+#define UCI_PV          256
+#define UCI_PV_SIZE     1024
+
+typedef struct
+{
+   unsigned fields;
+   int multipv;
+   int depth;
+   int seldepth;
+   int score;
+   int time;
+   unsigned long long nodes;
+   unsigned long long nps;
+   char pv[UCI_PV_SIZE];
+} UCIinfo;
+
+typedef struct UCIengine UCIengine;
+
+UCIengine * uci_engine_open(char *dir, char **args, int nargs);
+void uci_engine_close(UCIengine *e);
+int uci_engine_pid(UCIengine *e);
+char uci_engine_put(UCIengine *e, char *line);
+void uci_engine_set_raw(UCIengine *e, char raw);
+int uci_engine_read(UCIengine *e);
+char uci_engine_pending(UCIengine *e);
+int uci_engine_lines(UCIengine *e, char *dst, int size);
+int uci_engine_infos(UCIengine *e, UCIinfo *dst, int max);
+void uci_engine_clear(UCIengine *e);
+int uci_engines_wait(int ms);
+
+typedef struct AnCache AnCache;
+
+AnCache * ancache_open(char *name);
+void ancache_close(AnCache *c);
+unsigned ancache_engine_id(char *name);
+int ancache_size(AnCache *c);
+char ancache_probe(AnCache *c, unsigned long long key, unsigned engine, int *depth, int *time);
+int ancache_get(AnCache *c, unsigned long long key, unsigned engine, UCIinfo *lines, int max);
+char ancache_put(AnCache *c, unsigned long long key, unsigned engine, UCIinfo *lines, int n);
+char ancache_compact(AnCache *c);
+
+int pv_to_xpv(char *pv, char *xpv, int size);
+int xpv_to_pv(char *xpv, char *pv, int size);
+int mvx_encode(char *fen, char *pv, char *mvx, int size);
+int mvx_decode(char *fen, char *mvx, char *pv, int size);
+int pv_codec_list(int codec, char **src, char **dst, int *sizes, int num);
+
+#define CODEC_PV_XPV    0
+#define CODEC_XPV_PV    1
+#define CODEC_PV_MVX    2
+#define CODEC_MVX_PV    3
+#define CODEC_XPV_MVX   4
+#define CODEC_MVX_XPV   5
+
+#define PIX_POSITION    0
+#define PIX_MATERIAL    1
+
+typedef struct PosIndex PosIndex;
+typedef struct PosIndexBuilder PosIndexBuilder;
+
+unsigned long long posindex_material_fen(char *fen);
+PosIndex * posindex_open(char *name);
+void posindex_close(PosIndex *x);
+int posindex_maxply(PosIndex *x);
+unsigned posindex_maxrowid(PosIndex *x);
+int posindex_games(PosIndex *x);
+int posindex_find(PosIndex *x, int kind, unsigned long long key, unsigned *rowids, int max);
+PosIndexBuilder * posindex_builder_new(char *name, int maxply, char update, char mvx);
+void posindex_builder_free(PosIndexBuilder *b);
+unsigned posindex_builder_maxrowid(PosIndexBuilder *b);
+char posindex_builder_add(PosIndexBuilder *b, unsigned rowid, char *xpv);
+char posindex_builder_finish(PosIndexBuilder *b);
+
+typedef struct GameQuery GameQuery;
+
+GameQuery * gamequery_new(char *expr, int minplies, char mvx, char *error, int size);
+void gamequery_free(GameQuery *q);
+int gamequery_match(GameQuery *q, char *xpv);
+void gamequery_run(GameQuery *q, int nworkers, char **xpvs, int num, int *plies);
+
+// Re-entrant API (ctx.c), the only thread-safe one: a context per thread. The functions above share one board.
+typedef struct LCContext LCContext;
+
+LCContext * lc_ctx_new(void);
+void lc_ctx_free(LCContext *ctx);
+void lc_init_board(LCContext *ctx);
+void lc_fen_board(LCContext *ctx, char *fen);
+char * lc_board_fen(LCContext *ctx, char *fen);
+int lc_movegen(LCContext *ctx);
+int lc_pgn2pv(LCContext *ctx, char *pgn, char *pv);
+int lc_make_nummove(LCContext *ctx, int num);
+char * lc_playFen(LCContext *ctx, char *fen, int depth, int time);
+int lc_numMoves(LCContext *ctx);
+void lc_getMove(LCContext *ctx, int num, char *pv);
+int lc_numBaseMove(LCContext *ctx);
+int lc_searchMove(LCContext *ctx, char *desde, char *hasta, char *promotion);
+void lc_getMoveEx(LCContext *ctx, int num, char *info);
+char * lc_toSan(LCContext *ctx, int num, char *sanMove);
+int lc_move_list(LCContext *ctx, MoveInfo *li);
+int lc_line_info(LCContext *ctx, char *pv, MoveInfo *li, int max);
+int lc_mvx_encode(LCContext *ctx, char *fen, char *pv, char *mvx, int size);
+int lc_mvx_decode(LCContext *ctx, char *fen, char *mvx, char *pv, int size);
+char lc_inCheck(LCContext *ctx);
+void lc_set_level(LCContext *ctx, int lv);
+void lc_pgn_start(LCContext *ctx, char *fich, int depth);
+void lc_pgn_stop(LCContext *ctx);
+int lc_pgn_read(LCContext *ctx);
+char * lc_pgn_game(LCContext *ctx);
+char * lc_pgn_pv(LCContext *ctx);
+int lc_pgn_numlabels(LCContext *ctx);
+char * lc_pgn_label(LCContext *ctx, int num);
+char * lc_pgn_value(LCContext *ctx, int num);
+int lc_pgn_raw(LCContext *ctx);
+int lc_pgn_numfens(LCContext *ctx);
+char * lc_pgn_fen(LCContext *ctx, int num);
+char * lc_pgn_xpv(LCContext *ctx);
+int lc_pgn_plies(LCContext *ctx);
+int lc_pgn_read_batch(LCContext *ctx, int max_games, XPVset *dups);
+PGNgame * lc_pgn_batch_game(LCContext *ctx, int num);
+char * lc_pgn_batch_str(LCContext *ctx, size_t offset);
+int lc_stats_add_pv(LCContext *ctx, StatsMap *map, char *pv, int result, int r, int depth);
+int lc_stats_children(LCContext *ctx, StatsMap *map, StatsEntry *children);
+unsigned long long lc_board_hashkey(LCContext *ctx);
+unsigned long long lc_polyglot_key(LCContext *ctx);
+int lc_gamequery_match(LCContext *ctx, GameQuery *q, char *xpv);
 
 
 #endif
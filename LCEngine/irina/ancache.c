@@ -0,0 +1,652 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <io.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "defs.h"
+#include "protos.h"
+
+/*
+ * Analysis cache: engine analyses kept between sessions.
+ *
+ * name.dat   records appended at the end, never modified:
+ *            key(8) engine(4) time(4) depth(2) nlines(2) size(4), then size bytes with the lines
+ * name.idx   memory mapped hash table (open addressing) pointing to the records of name.dat,
+ *            a probe reads one slot and, if the analysis is deep enough, one record.
+ *
+ * Keys are the polyglot keys of the positions, engine an id of the engine (ancache_engine_id).
+ * A deeper (or longer) analysis of the same key and engine is appended and the slot points to it, the old
+ * record is garbage until the data file is compacted (ancache_compact, automatic when more than
+ * half of the file is garbage). If name.idx is lost or doesn't match name.dat, it is rebuilt
+ * reading name.dat; an incomplete record at the end of name.dat is dropped.
+ *
+ * Numbers in name.dat are little endian, name.idx is native (rebuilt if the magic differs).
+ */
+
+#define ANC_MAGIC_DAT       "LCANCDAT"
+#define ANC_MAGIC_IDX       "LCANCIX1"
+#define ANC_RECORD          24          // record header in name.dat
+#define ANC_MIN_SLOTS       4096
+#define ANC_COMPACT_MIN     (1 << 20)   // bytes of garbage before compacting
+
+typedef struct
+{
+    char        magic[8];
+    Bitmap      nslots;
+    Bitmap      used;
+    Bitmap      datasize;   // name.dat size when the index was last written
+    Bitmap      garbage;    // bytes of replaced records
+} ANCheader;
+
+typedef struct
+{
+    Bitmap      key;
+    Bitmap      offset;     // 0 = free, records start after the magic
+    unsigned    engine;
+    unsigned    time;
+    unsigned    size;       // record + lines
+    unsigned short depth;
+    unsigned short nlines;
+} ANCslot;
+
+struct AnCache
+{
+    char        *fdat;
+    char        *fidx;
+    FILE        *dat;
+
+    ANCheader   *header;    // mapped name.idx
+    ANCslot     *slots;
+    size_t      map_len;
+#if defined(_WIN32)
+    HANDLE      hfile;
+    HANDLE      hmap;
+#endif
+};
+
+#if defined(_WIN32)
+#define anc_seek(f, pos)    _fseeki64(f, (__int64) (pos), SEEK_SET)
+#define anc_seek_end(f)     _fseeki64(f, 0, SEEK_END)
+#define anc_tell(f)         ((Bitmap) _ftelli64(f))
+#define anc_truncate(f, n)  _chsize_s(_fileno(f), (__int64) (n))
+#else
+#define anc_seek(f, pos)    fseeko(f, (off_t) (pos), SEEK_SET)
+#define anc_seek_end(f)     fseeko(f, 0, SEEK_END)
+#define anc_tell(f)         ((Bitmap) ftello(f))
+#define anc_truncate(f, n)  ftruncate(fileno(f), (off_t) (n))
+#endif
+
+static void put_le(unsigned char *c, Bitmap n, int len)
+{
+    while( len-- )
+    {
+        *c++ = (unsigned char) (n & 0xff);
+        n >>= 8;
+    }
+}
+
+static Bitmap get_le(unsigned char *c, int len)
+{
+    Bitmap n = 0;
+
+    while( len-- ) n = (n << 8) | c[len];
+    return n;
+}
+
+
+// ---------------------------------------------------------------------------------------------
+// Index
+// ---------------------------------------------------------------------------------------------
+
+static void idx_unmap(AnCache *c)
+{
+    if( !c->header ) return;
+#if defined(_WIN32)
+    UnmapViewOfFile(c->header);
+    CloseHandle(c->hmap);
+    CloseHandle(c->hfile);
+#else
+    munmap(c->header, c->map_len);
+#endif
+    c->header = NULL;
+    c->slots = NULL;
+}
+
+// maps name.idx with nslots, a new file (create) has all the slots free
+static bool idx_map(AnCache *c, Bitmap nslots, bool create)
+{
+    size_t len = sizeof(ANCheader) + (size_t) nslots * sizeof(ANCslot);
+    void *map;
+
+#if defined(_WIN32)
+    c->hfile = CreateFileA(c->fidx, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL,
+                           create ? CREATE_ALWAYS : OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+    if( c->hfile == INVALID_HANDLE_VALUE ) return false;
+    c->hmap = CreateFileMappingA(c->hfile, NULL, PAGE_READWRITE, (DWORD) ((Bitmap) len >> 32), (DWORD) len, NULL);
+    if( !c->hmap )
+    {
+        CloseHandle(c->hfile);
+        return false;
+    }
+    map = MapViewOfFile(c->hmap, FILE_MAP_ALL_ACCESS, 0, 0, len);
+    if( !map )
+    {
+        CloseHandle(c->hmap);
+        CloseHandle(c->hfile);
+        return false;
+    }
+#else
+    int fd;
+
+    fd = open(c->fidx, O_RDWR | O_CREAT | (create ? O_TRUNC : 0), 0644);
+    if( fd < 0 ) return false;
+    if( create && ftruncate(fd, (off_t) len) )
+    {
+        close(fd);
+        return false;
+    }
+    map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    // the mapping keeps the file open
+    close(fd);
+    if( map == MAP_FAILED ) return false;
+    madvise(map, len, MADV_RANDOM);
+#endif
+    c->header = (ANCheader *) map;
+    c->slots = (ANCslot *) (c->header + 1);
+    c->map_len = len;
+    if( create )
+    {
+        memcpy(c->header->magic, ANC_MAGIC_IDX, 8);
+        c->header->nslots = nslots;
+    }
+    return true;
+}
+
+static ANCslot * find_slot(AnCache *c, Bitmap key, unsigned engine)
+{
+    Bitmap nslots = c->header->nslots;
+    Bitmap pos = (key ^ ((Bitmap) engine * 0x9E3779B97F4A7C15ULL)) % nslots;
+    ANCslot *slot;
+
+    while( 1 )
+    {
+        slot = &c->slots[pos];
+        if( !slot->offset || (slot->key == key && slot->engine == engine) ) return slot;
+        if( ++pos == nslots ) pos = 0;
+    }
+}
+
+// new index of nslots with the live slots of the current one
+static bool idx_resize(AnCache *c, Bitmap nslots)
+{
+    ANCheader header = *c->header;
+    ANCslot *live, *slot;
+    Bitmap i, n;
+
+    live = (ANCslot *) malloc((size_t) (header.used ? header.used : 1) * sizeof(ANCslot));
+    if( !live ) return false;
+    n = 0;
+    for( i = 0; i < header.nslots && n < header.used; i++ )
+    {
+        if( c->slots[i].offset ) live[n++] = c->slots[i];
+    }
+    idx_unmap(c);
+    if( !idx_map(c, nslots, true) )
+    {
+        free(live);
+        return false;
+    }
+    for( i = 0; i < n; i++ )
+    {
+        slot = find_slot(c, live[i].key, live[i].engine);
+        *slot = live[i];
+    }
+    free(live);
+    c->header->used = n;
+    c->header->datasize = header.datasize;
+    c->header->garbage = header.garbage;
+    return true;
+}
+
+// slots of name.idx if it is valid for a name.dat of datasize bytes, 0 if it has to be rebuilt
+static Bitmap idx_slots(AnCache *c, Bitmap datasize)
+{
+    ANCheader header;
+    Bitmap size;
+    FILE *f = fopen(c->fidx, "rb");
+
+    if( !f ) return 0;
+    if( fread(&header, sizeof(header), 1, f) != 1 || anc_seek_end(f) )
+    {
+        fclose(f);
+        return 0;
+    }
+    size = anc_tell(f);
+    fclose(f);
+    if( memcmp(header.magic, ANC_MAGIC_IDX, 8) || header.datasize != datasize || !header.nslots ||
+            size != sizeof(ANCheader) + header.nslots * sizeof(ANCslot) ) return 0;
+    return header.nslots;
+}
+
+// an analysis replaces the one in slot if it is deeper, or as deep and longer
+static bool better(int depth, unsigned time, ANCslot *slot)
+{
+    return depth > slot->depth || (depth == slot->depth && time > slot->time);
+}
+
+static bool read_record(FILE *f, Bitmap offset, ANCslot *slot)
+{
+    unsigned char rec[ANC_RECORD];
+
+    if( anc_seek(f, offset) || fread(rec, 1, ANC_RECORD, f) != ANC_RECORD ) return false;
+    slot->key = get_le(rec, 8);
+    slot->engine = (unsigned) get_le(rec + 8, 4);
+    slot->time = (unsigned) get_le(rec + 12, 4);
+    slot->depth = (unsigned short) get_le(rec + 16, 2);
+    slot->nlines = (unsigned short) get_le(rec + 18, 2);
+    slot->size = ANC_RECORD + (unsigned) get_le(rec + 20, 4);
+    slot->offset = offset;
+    return true;
+}
+
+// index built reading all the records of name.dat
+static bool idx_rebuild(AnCache *c)
+{
+    Bitmap size, offset, nslots, used, garbage;
+    ANCslot rec, *slot;
+
+    anc_seek_end(c->dat);
+    size = anc_tell(c->dat);
+
+    nslots = ANC_MIN_SLOTS;
+    while( nslots * 3 < (size / 256) * 4 ) nslots *= 2;      // a record of 256 bytes at least, 75% load
+    idx_unmap(c);
+    if( !idx_map(c, nslots, true) ) return false;
+
+    used = garbage = 0;
+    offset = 8;
+    // a size that wraps (< ANC_RECORD) or runs past the end is a broken record, the rest is dropped
+    while( offset < size && read_record(c->dat, offset, &rec) && rec.size >= ANC_RECORD && offset + rec.size <= size )
+    {
+        if( (used + 1) * 4 > c->header->nslots * 3 )
+        {
+            c->header->used = used;
+            if( !idx_resize(c, c->header->nslots * 2) ) return false;
+        }
+        slot = find_slot(c, rec.key, rec.engine);
+        if( slot->offset )
+        {
+            if( better(rec.depth, rec.time, slot) )
+            {
+                garbage += slot->size;
+                *slot = rec;
+            }
+            else garbage += rec.size;
+        }
+        else
+        {
+            *slot = rec;
+            used++;
+        }
+        offset += rec.size;
+    }
+    if( offset != size ) anc_truncate(c->dat, offset);    // incomplete record
+    c->header->used = used;
+    c->header->datasize = offset;
+    c->header->garbage = garbage;
+    return true;
+}
+
+
+// ---------------------------------------------------------------------------------------------
+// Cache
+// ---------------------------------------------------------------------------------------------
+
+// engine + multipv, FNV-1a
+unsigned ancache_engine_id(char *name)
+{
+    unsigned h = 2166136261U;
+
+    while( *name )
+    {
+        h ^= (unsigned char) *name++;
+        h *= 16777619U;
+    }
+    return h;
+}
+
+static char * file_name(char *name, char *ext)
+{
+    char *fich = (char *) malloc(strlen(name) + strlen(ext) + 1);
+
+    if( fich )
+    {
+        strcpy(fich, name);
+        strcat(fich, ext);
+    }
+    return fich;
+}
+
+// false after a failed resize or compaction left the cache without index or data file
+static bool anc_ready(AnCache *c)
+{
+    return c->header && c->dat;
+}
+
+/*
+ * Opens or creates name.dat and name.idx.
+ * NULL if the files can't be created or name.dat isn't a cache.
+ */
+AnCache * ancache_open(char *name)
+{
+    AnCache *c;
+    char magic[8];
+    Bitmap size, nslots;
+
+    c = (AnCache *) calloc(1, sizeof(AnCache));
+    if( !c ) return NULL;
+    c->fdat = file_name(name, ".dat");
+    c->fidx = file_name(name, ".idx");
+    if( !c->fdat || !c->fidx )
+    {
+        ancache_close(c);
+        return NULL;
+    }
+
+    c->dat = fopen(c->fdat, "r+b");
+    if( !c->dat )
+    {
+        c->dat = fopen(c->fdat, "w+b");
+        if( !c->dat || fwrite(ANC_MAGIC_DAT, 1, 8, c->dat) != 8 || fflush(c->dat) )
+        {
+            ancache_close(c);
+            return NULL;
+        }
+    }
+    else if( fread(magic, 1, 8, c->dat) != 8 || memcmp(magic, ANC_MAGIC_DAT, 8) )
+    {
+        ancache_close(c);
+        return NULL;
+    }
+    anc_seek_end(c->dat);
+    size = anc_tell(c->dat);
+
+    nslots = idx_slots(c, size);
+    if( !nslots || !idx_map(c, nslots, false) )
+    {
+        if( !idx_rebuild(c) )
+        {
+            ancache_close(c);
+            return NULL;
+        }
+    }
+    return c;
+}
+
+void ancache_close(AnCache *c)
+{
+    if( !c ) return;
+    idx_unmap(c);
+    if( c->dat ) fclose(c->dat);
+    free(c->fdat);
+    free(c->fidx);
+    free(c);
+}
+
+// analyses in the cache
+int ancache_size(AnCache *c)
+{
+    return c->header ? (int) c->header->used : 0;
+}
+
+/*
+ * Depth and time (ms) of the analysis of key by engine, false if there is none.
+ * Only the index is read.
+ */
+bool ancache_probe(AnCache *c, Bitmap key, unsigned engine, int *depth, int *time)
+{
+    ANCslot *slot;
+
+    if( !anc_ready(c) ) return false;
+    slot = find_slot(c, key, engine);
+    if( !slot->offset ) return false;
+    *depth = slot->depth;
+    *time = (int) slot->time;
+    return true;
+}
+
+/*
+ * Lines of the analysis of key by engine, at most max.
+ * Returns the number of lines, 0 if there is no analysis.
+ */
+int ancache_get(AnCache *c, Bitmap key, unsigned engine, UCIinfo *lines, int max)
+{
+    ANCslot *slot;
+    unsigned char *buf, *p, *end;
+    UCIinfo *info;
+    int n, i, nmoves;
+    unsigned move;
+    char *pv;
+
+    if( !anc_ready(c) ) return 0;
+    slot = find_slot(c, key, engine);
+    if( !slot->offset ) return 0;
+    buf = (unsigned char *) malloc(slot->size);
+    if( !buf ) return 0;
+    if( anc_seek(c->dat, slot->offset) || fread(buf, 1, slot->size, c->dat) != slot->size )
+    {
+        free(buf);
+        return 0;
+    }
+
+    p = buf + ANC_RECORD;
+    end = buf + slot->size;
+    for( n = 0; n < slot->nlines && n < max && end - p >= 32; n++ )
+    {
+        info = &lines[n];
+        info->fields = (unsigned) get_le(p, 2);
+        info->multipv = (int) get_le(p + 2, 2);
+        info->depth = p[4];
+        info->seldepth = p[5];
+        info->score = (int) (unsigned) get_le(p + 6, 4);
+        info->time = (int) get_le(p + 10, 4);
+        info->nodes = get_le(p + 14, 8);
+        info->nps = get_le(p + 22, 8);
+        nmoves = (int) get_le(p + 30, 2);
+        p += 32;
+        pv = info->pv;
+        for( i = 0; i < nmoves && end - p >= 2; i++, p += 2 )
+        {
+            move = (unsigned) get_le(p, 2);
+            if( pv + 7 >= info->pv + UCI_PV_SIZE ) continue;
+            if( i ) *pv++ = ' ';
+            *pv++ = 'a' + (move & 7);
+            *pv++ = '1' + ((move >> 3) & 7);
+            *pv++ = 'a' + ((move >> 6) & 7);
+            *pv++ = '1' + ((move >> 9) & 7);
+            if( move >> 12 ) *pv++ = " nbrq"[(move >> 12) & 7];
+        }
+        *pv = '\0';
+    }
+    free(buf);
+    return n;
+}
+
+// pv "e2e4 e7e8q ..." as from | to << 6 | promotion << 12
+static int encode_pv(char *pv, unsigned char *dst, int max)
+{
+    int n = 0;
+    unsigned move;
+    char *c = pv, *prom;
+
+    while( *c && n < max )
+    {
+        while( *c == ' ' ) c++;
+        if( c[0] < 'a' || c[0] > 'h' || c[1] < '1' || c[1] > '8' || c[2] < 'a' || c[2] > 'h' || c[3] < '1' || c[3] > '8' ) break;
+        move = (c[0] - 'a') | (c[1] - '1') << 3 | (c[2] - 'a') << 6 | (c[3] - '1') << 9;
+        c += 4;
+        if( *c && *c != ' ' )
+        {
+            prom = strchr("nbrq", *c | 0x20);
+            if( prom ) move |= (unsigned) (prom - "nbrq" + 1) << 12;
+            c++;
+        }
+        put_le(dst + 2 * n++, move, 2);
+        while( *c && *c != ' ' ) c++;
+    }
+    return n;
+}
+
+/*
+ * Keeps the analysis (lines of the last depth of each multipv) of key by engine,
+ * unless the one in the cache is deeper, or as deep and as long. Returns true if it is kept.
+ */
+bool ancache_put(AnCache *c, Bitmap key, unsigned engine, UCIinfo *lines, int n)
+{
+    unsigned char *buf, *p;
+    ANCslot *slot, rec;
+    size_t size;
+    int i, nmoves, depth, time;
+
+    if( n <= 0 || !anc_ready(c) ) return false;
+    depth = time = 0;
+    for( i = 0; i < n; i++ )
+    {
+        if( lines[i].depth > depth ) depth = lines[i].depth;
+        if( lines[i].time > time ) time = lines[i].time;
+    }
+    slot = find_slot(c, key, engine);
+    if( slot->offset && !better(depth, (unsigned) time, slot) ) return false;
+
+    size = ANC_RECORD;
+    for( i = 0; i < n; i++ ) size += 32 + 2 * (strlen(lines[i].pv) / 4 + 1);
+    buf = (unsigned char *) malloc(size);
+    if( !buf ) return false;
+
+    p = buf + ANC_RECORD;
+    for( i = 0; i < n; i++ )
+    {
+        put_le(p, lines[i].fields, 2);
+        put_le(p + 2, (Bitmap) lines[i].multipv, 2);
+        p[4] = (unsigned char) (lines[i].depth > 255 ? 255 : lines[i].depth);
+        p[5] = (unsigned char) (lines[i].seldepth > 255 ? 255 : lines[i].seldepth);
+        put_le(p + 6, (unsigned) lines[i].score, 4);
+        put_le(p + 10, (unsigned) lines[i].time, 4);
+        put_le(p + 14, lines[i].nodes, 8);
+        put_le(p + 22, lines[i].nps, 8);
+        nmoves = encode_pv(lines[i].pv, p + 32, (int) (strlen(lines[i].pv) / 4 + 1));
+        put_le(p + 30, (Bitmap) nmoves, 2);
+        p += 32 + 2 * nmoves;
+    }
+    size = p - buf;
+    put_le(buf, key, 8);
+    put_le(buf + 8, engine, 4);
+    put_le(buf + 12, (unsigned) time, 4);
+    put_le(buf + 16, (Bitmap) (depth > 65535 ? 65535 : depth), 2);
+    put_le(buf + 18, (Bitmap) n, 2);
+    put_le(buf + 20, (Bitmap) (size - ANC_RECORD), 4);
+
+    if( anc_seek(c->dat, c->header->datasize) || fwrite(buf, 1, size, c->dat) != size || fflush(c->dat) )
+    {
+        free(buf);
+        anc_truncate(c->dat, c->header->datasize);
+        return false;
+    }
+    free(buf);
+
+    rec.key = key;
+    rec.engine = engine;
+    rec.offset = c->header->datasize;
+    rec.time = (unsigned) time;
+    rec.depth = (unsigned short) (depth > 65535 ? 65535 : depth);
+    rec.nlines = (unsigned short) n;
+    rec.size = (unsigned) size;
+    if( slot->offset ) c->header->garbage += slot->size;
+    else c->header->used++;
+    *slot = rec;
+    c->header->datasize += size;
+
+    if( c->header->used * 4 > c->header->nslots * 3 ) idx_resize(c, c->header->nslots * 2);
+    if( c->header->garbage > ANC_COMPACT_MIN && c->header->garbage * 2 > c->header->datasize ) ancache_compact(c);
+    return true;
+}
+
+/*
+ * Rewrites name.dat with only the analyses in the index.
+ * Returns false if the new file can't be written, the cache is unchanged then.
+ */
+bool ancache_compact(AnCache *c)
+{
+    char *ftmp;
+    FILE *f;
+    unsigned char *buf = NULL;
+    unsigned bufsize = 0;
+    Bitmap i, offset, *offsets;
+    ANCslot *slot;
+    bool ok;
+
+    if( !anc_ready(c) ) return false;
+    ftmp = file_name(c->fdat, ".tmp");
+    offsets = (Bitmap *) malloc((size_t) c->header->nslots * sizeof(Bitmap));
+    f = ftmp ? fopen(ftmp, "wb") : NULL;
+    ok = f && offsets && fwrite(ANC_MAGIC_DAT, 1, 8, f) == 8;
+    offset = 8;
+    for( i = 0; ok && i < c->header->nslots; i++ )
+    {
+        slot = &c->slots[i];
+        if( !slot->offset ) continue;
+        if( slot->size > bufsize )
+        {
+            free(buf);
+            bufsize = slot->size;
+            buf = (unsigned char *) malloc(bufsize);
+            if( !buf ) bufsize = 0;
+        }
+        ok = buf && !anc_seek(c->dat, slot->offset) && fread(buf, 1, slot->size, c->dat) == slot->size &&
+             fwrite(buf, 1, slot->size, f) == slot->size;
+        offsets[i] = offset;
+        offset += slot->size;
+    }
+    free(buf);
+    if( f && fclose(f) ) ok = false;
+    if( ok )
+    {
+#if defined(_WIN32)
+        // an open file can't be replaced
+        fclose(c->dat);
+        c->dat = NULL;
+#endif
+        ok = replace_file(ftmp, c->fdat);
+        // the old handle is kept until the new one is open, its offsets are still right
+        f = fopen(c->fdat, "r+b");
+        if( f )
+        {
+            if( c->dat ) fclose(c->dat);
+            c->dat = f;
+        }
+        if( ok && f )
+        {
+            for( i = 0; i < c->header->nslots; i++ )
+            {
+                if( c->slots[i].offset ) c->slots[i].offset = offsets[i];
+            }
+            c->header->datasize = offset;
+            c->header->garbage = 0;
+        }
+        ok = ok && f;
+    }
+    if( !ok && ftmp ) remove(ftmp);
+    free(offsets);
+    free(ftmp);
+    return ok;
+}
@@ -161,6 +161,7 @@ void fen_board(char *fen) {
     bitmap_pz(board.pz, board.white_king, WHITE_KING);
 
     board.hashkey = board_hashkey();
+    eval_init();
 
     board_reset();
 
@@ -174,6 +175,7 @@ void board_reset(void) {
     board.history[0].ep = board.ep;
     board.history[0].fifty = board.fifty;
     board.history[0].hashkey = board.hashkey;
+    board.history[0].psq = board.psq;
 }
 
 void bitmap_pz(unsigned pz[], Bitmap bm, int piece) {
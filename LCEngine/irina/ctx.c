@@ -0,0 +1,358 @@
+#include <stdlib.h>
+
+#include "defs.h"
+#include "protos.h"
+#include "globals.h"
+
+/*
+ * Re-entrant API: every lc_* function works on its own LCContext instead of the global board.
+ *
+ * The engine code still addresses "board" and the pgn reader state through the thread local
+ * cur_board/cur_pgn pointers, so each call points them at the context, runs the classic function
+ * and restores them. Only this API is thread-safe: the pointers of every thread start at the same
+ * static default board and pgn state, so the classic API has to be used from one thread at a time
+ * (the GIL for LCEngine4). Different threads can work at the same time if each one uses its own context.
+ */
+
+#define CTX_ENTER(ctx)  Board *sv_board = cur_board; \
+                        PGNstate *sv_pgn = cur_pgn; \
+                        int sv_level = LEVEL_EVAL; \
+                        cur_board = &(ctx)->ctx_board; \
+                        cur_pgn = &(ctx)->ctx_pgn; \
+                        LEVEL_EVAL = (ctx)->ctx_level
+
+#define CTX_LEAVE(ctx)  (ctx)->ctx_level = LEVEL_EVAL; \
+                        cur_board = sv_board; \
+                        cur_pgn = sv_pgn; \
+                        LEVEL_EVAL = sv_level
+
+
+LCContext * lc_ctx_new(void)
+{
+    LCContext *ctx;
+
+    // shared tables are built here, before any worker thread can race on them
+    if( !HASH_wk ) init_hash();
+    init_data();
+
+    ctx = (LCContext *) calloc(1, sizeof(LCContext));
+    if( !ctx ) return NULL;
+    lc_init_board(ctx);
+    return ctx;
+}
+
+void lc_ctx_free(LCContext *ctx)
+{
+    if( !ctx ) return;
+    if( ctx->ctx_pgn.pgn ) lc_pgn_stop(ctx);
+    free(ctx);
+}
+
+void lc_init_board(LCContext *ctx)
+{
+    CTX_ENTER(ctx);
+    init_board();
+    CTX_LEAVE(ctx);
+}
+
+void lc_fen_board(LCContext *ctx, char *fen)
+{
+    CTX_ENTER(ctx);
+    fen_board(fen);
+    CTX_LEAVE(ctx);
+}
+
+char * lc_board_fen(LCContext *ctx, char *fen)
+{
+    CTX_ENTER(ctx);
+    board_fen(fen);
+    CTX_LEAVE(ctx);
+    return fen;
+}
+
+int lc_movegen(LCContext *ctx)
+{
+    int r;
+    CTX_ENTER(ctx);
+    r = movegen();
+    CTX_LEAVE(ctx);
+    return r;
+}
+
+int lc_pgn2pv(LCContext *ctx, char *pgn, char *pv)
+{
+    int r;
+    CTX_ENTER(ctx);
+    r = pgn2pv(pgn, pv);
+    CTX_LEAVE(ctx);
+    return r;
+}
+
+int lc_make_nummove(LCContext *ctx, int num)
+{
+    int r;
+    CTX_ENTER(ctx);
+    r = make_nummove(num);
+    CTX_LEAVE(ctx);
+    return r;
+}
+
+char * lc_playFen(LCContext *ctx, char *fen, int depth, int time)
+{
+    char *r;
+    CTX_ENTER(ctx);
+    r = playFen(fen, depth, time);
+    CTX_LEAVE(ctx);
+    return r;
+}
+
+int lc_numMoves(LCContext *ctx)
+{
+    int r;
+    CTX_ENTER(ctx);
+    r = numMoves();
+    CTX_LEAVE(ctx);
+    return r;
+}
+
+void lc_getMove(LCContext *ctx, int num, char *pv)
+{
+    CTX_ENTER(ctx);
+    getMove(num, pv);
+    CTX_LEAVE(ctx);
+}
+
+int lc_numBaseMove(LCContext *ctx)
+{
+    int r;
+    CTX_ENTER(ctx);
+    r = numBaseMove();
+    CTX_LEAVE(ctx);
+    return r;
+}
+
+int lc_searchMove(LCContext *ctx, char *desde, char *hasta, char *promotion)
+{
+    int r;
+    CTX_ENTER(ctx);
+    r = searchMove(desde, hasta, promotion);
+    CTX_LEAVE(ctx);
+    return r;
+}
+
+void lc_getMoveEx(LCContext *ctx, int num, char *info)
+{
+    CTX_ENTER(ctx);
+    getMoveEx(num, info);
+    CTX_LEAVE(ctx);
+}
+
+char * lc_toSan(LCContext *ctx, int num, char *sanMove)
+{
+    CTX_ENTER(ctx);
+    toSan(num, sanMove);
+    CTX_LEAVE(ctx);
+    return sanMove;
+}
+
+int lc_move_list(LCContext *ctx, MoveInfo *li)
+{
+    int r;
+    CTX_ENTER(ctx);
+    r = move_list(li);
+    CTX_LEAVE(ctx);
+    return r;
+}
+
+int lc_line_info(LCContext *ctx, char *pv, MoveInfo *li, int max)
+{
+    int r;
+    CTX_ENTER(ctx);
+    r = line_info(pv, li, max);
+    CTX_LEAVE(ctx);
+    return r;
+}
+
+int lc_mvx_encode(LCContext *ctx, char *fen, char *pv, char *mvx, int size)
+{
+    int r;
+    CTX_ENTER(ctx);
+    r = mvx_encode(fen, pv, mvx, size);
+    CTX_LEAVE(ctx);
+    return r;
+}
+
+int lc_mvx_decode(LCContext *ctx, char *fen, char *mvx, char *pv, int size)
+{
+    int r;
+    CTX_ENTER(ctx);
+    r = mvx_decode(fen, mvx, pv, size);
+    CTX_LEAVE(ctx);
+    return r;
+}
+
+char lc_inCheck(LCContext *ctx)
+{
+    char r;
+    CTX_ENTER(ctx);
+    r = inCheck();
+    CTX_LEAVE(ctx);
+    return r;
+}
+
+void lc_set_level(LCContext *ctx, int lv)
+{
+    ctx->ctx_level = lv;
+}
+
+void lc_pgn_start(LCContext *ctx, char *fich, int depth)
+{
+    CTX_ENTER(ctx);
+    pgn_start(fich, depth);
+    CTX_LEAVE(ctx);
+}
+
+void lc_pgn_stop(LCContext *ctx)
+{
+    CTX_ENTER(ctx);
+    pgn_stop();
+    CTX_LEAVE(ctx);
+}
+
+int lc_pgn_read(LCContext *ctx)
+{
+    int r;
+    CTX_ENTER(ctx);
+    r = pgn_read();
+    CTX_LEAVE(ctx);
+    return r;
+}
+
+char * lc_pgn_game(LCContext *ctx)
+{
+    return ctx->ctx_pgn.pgn;
+}
+
+char * lc_pgn_pv(LCContext *ctx)
+{
+    char *r;
+    CTX_ENTER(ctx);
+    r = pgn_pv();
+    CTX_LEAVE(ctx);
+    return r;
+}
+
+int lc_pgn_numlabels(LCContext *ctx)
+{
+    return ctx->ctx_pgn.pos_label;
+}
+
+char * lc_pgn_label(LCContext *ctx, int num)
+{
+    return ctx->ctx_pgn.labels[num];
+}
+
+char * lc_pgn_value(LCContext *ctx, int num)
+{
+    return ctx->ctx_pgn.values[num];
+}
+
+int lc_pgn_raw(LCContext *ctx)
+{
+    return ctx->ctx_pgn.raw;
+}
+
+int lc_pgn_numfens(LCContext *ctx)
+{
+    return ctx->ctx_pgn.pos_fens;
+}
+
+char * lc_pgn_fen(LCContext *ctx, int num)
+{
+    return ctx->ctx_pgn.fens[num];
+}
+
+char * lc_pgn_xpv(LCContext *ctx)
+{
+    return ctx->ctx_pgn.xpv;
+}
+
+int lc_pgn_plies(LCContext *ctx)
+{
+    return ctx->ctx_pgn.plies;
+}
+
+int lc_pgn_read_batch(LCContext *ctx, int max_games, XPVset *dups)
+{
+    int r;
+    CTX_ENTER(ctx);
+    r = pgn_read_batch(max_games, dups);
+    CTX_LEAVE(ctx);
+    return r;
+}
+
+PGNgame * lc_pgn_batch_game(LCContext *ctx, int num)
+{
+    return &ctx->ctx_pgn.batch.games[num];
+}
+
+char * lc_pgn_batch_str(LCContext *ctx, size_t offset)
+{
+    return ctx->ctx_pgn.batch.buf + offset;
+}
+
+int lc_pgn_range(LCContext *ctx, unsigned long long start, unsigned long long end)
+{
+    int r;
+    CTX_ENTER(ctx);
+    r = pgn_range(start, end);
+    CTX_LEAVE(ctx);
+    return r;
+}
+
+void lc_pgn_stats(LCContext *ctx, StatsMap *stats, int depth)
+{
+    ctx->ctx_pgn.stats = stats;
+    ctx->ctx_pgn.stats_depth = depth;
+}
+
+int lc_stats_add_pv(LCContext *ctx, StatsMap *map, char *pv, int result, int r, int depth)
+{
+    int n;
+    CTX_ENTER(ctx);
+    n = stats_add_pv(map, pv, result, r, depth);
+    CTX_LEAVE(ctx);
+    return n;
+}
+
+int lc_stats_children(LCContext *ctx, StatsMap *map, StatsEntry *children)
+{
+    int n;
+    CTX_ENTER(ctx);
+    n = stats_children(map, children);
+    CTX_LEAVE(ctx);
+    return n;
+}
+
+unsigned long long lc_board_hashkey(LCContext *ctx)
+{
+    return ctx->ctx_board.hashkey;
+}
+
+unsigned long long lc_polyglot_key(LCContext *ctx)
+{
+    Bitmap key;
+    CTX_ENTER(ctx);
+    key = polyglot_key();
+    CTX_LEAVE(ctx);
+    return key;
+}
+
+int lc_gamequery_match(LCContext *ctx, GameQuery *q, char *xpv)
+{
+    int ply;
+    CTX_ENTER(ctx);
+    ply = gamequery_match(q, xpv);
+    CTX_LEAVE(ctx);
+    return ply;
+}
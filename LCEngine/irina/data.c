@@ -5,7 +5,9 @@
 #include "defs.h"
 #include "protos.h"
 
-Board board;
+// board of the classic API, the same for all the threads (a TLS pointer can't start at a TLS object)
+static Board default_board;
+TLS Board *cur_board = &default_board;
 Bitmap BITSET[64];
 Bitmap FREEWAY[64][64];
 Bitmap WHITE_PAWN_ATTACKS[64];
@@ -32,7 +34,7 @@ Bitmap BLACK_SQUARES;
 Bitmap WHITE_SQUARES;
 
 
-Bitmap inodes;
+TLS Bitmap inodes;
 
 
 char *POS_AH[64] ={
@@ -147,12 +149,21 @@ int ROOKPOS_B[64];
 int QUEENPOS_B[64];
 int KINGPOS_B[64];
 int KINGPOS_ENDGAME_B[64];
+int PSQ[16][64];    // piece square value of each piece with the sign of its side, 0 the kings
+
+static bool data_ready = false;
 
 void init_data(void) {
     int i;
     int from, to, col_from, col_to, fil_from, fil_to, dif_fil, dif_col;
     Bitmap tmp;
 
+    // The tables are shared by every context and the _W eval tables are mirrored in place,
+    // so they must be built only once.
+    if (data_ready) {
+        return;
+    }
+
     BITSET[0] = 1;
     for (i = 1; i < 64; i++) {
         BITSET[i] = BITSET[i - 1] << 1;
@@ -450,4 +461,19 @@ void init_data(void) {
         KINGPOS_W[i] = KINGPOS_B[MIRROR[i]];
         KINGPOS_ENDGAME_W[i] = KINGPOS_ENDGAME_B[MIRROR[i]];
     }
+
+    for (i = 0; i < 64; i++) {
+        PSQ[WHITE_PAWN][i] = PAWNPOS_W[i];
+        PSQ[WHITE_KNIGHT][i] = KNIGHTPOS_W[i];
+        PSQ[WHITE_BISHOP][i] = BISHOPPOS_W[i];
+        PSQ[WHITE_ROOK][i] = ROOKPOS_W[i];
+        PSQ[WHITE_QUEEN][i] = QUEENPOS_W[i];
+        PSQ[BLACK_PAWN][i] = -PAWNPOS_B[i];
+        PSQ[BLACK_KNIGHT][i] = -KNIGHTPOS_B[i];
+        PSQ[BLACK_BISHOP][i] = -BISHOPPOS_B[i];
+        PSQ[BLACK_ROOK][i] = -ROOKPOS_B[i];
+        PSQ[BLACK_QUEEN][i] = -QUEENPOS_B[i];
+    }
+
+    data_ready = true;
 }
@@ -4,6 +4,16 @@
 
 typedef unsigned long long   Bitmap;
 typedef char bool;
+
+// Per-thread storage for the current board/pgn pointers and search state.
+// Builds for systems where TLS in a dynamically loaded module is unreliable (XP) define IRINA_NO_TLS.
+#if defined(IRINA_NO_TLS)
+#define TLS
+#elif defined(_MSC_VER)
+#define TLS __declspec(thread)
+#else
+#define TLS __thread
+#endif
 #define true	1
 #define false	0
 
@@ -60,6 +70,7 @@ typedef struct
    unsigned fifty;
    Move     move;
    Bitmap   hashkey;
+   int      psq;
 } History;
 
 typedef struct
@@ -74,6 +85,8 @@ typedef struct
    unsigned pz[64];
    unsigned fullmove;
    Bitmap   hashkey;
+   int      count[16];  // pieces on the board by type, kept by make_move/unmake_move for eval
+   int      psq;        // white - black piece square values, kings excluded
    unsigned ply;
    unsigned idx_moves;
    Move     moves[MAX_MOVES];
@@ -81,6 +94,217 @@ typedef struct
    History  history[MAX_GAMELINE];
 } Board;
 
+#define PGN_OK           0
+#define PGN_ERROR        1      // movetext can't be replayed
+#define PGN_NOTINITIAL   2      // starts from a FEN other than the initial position
+#define PGN_DUPLICATE    3      // xpv already seen in this import
+
+#define RESULT_WHITE     0
+#define RESULT_BLACK     1
+#define RESULT_DRAW      2
+#define RESULT_OTHER     3
+
+typedef struct
+{
+   int      status;
+   int      raw;
+   int      plies;
+   int      numlabels;
+   int      numfens;
+   int      result;     // RESULT_xxx of the Result tag
+   size_t   pgn;        // offsets in PGNbatch.buf of zero terminated strings
+   size_t   pv;
+   size_t   xpv;
+   size_t   labels;     // numlabels pairs label, value
+   size_t   fens;       // numfens fens
+} PGNgame;
+
+typedef struct
+{
+   char     *buf;
+   size_t   size;
+   size_t   max;
+   PGNgame  *games;
+   int      num;
+   int      max_games;  // allocated games
+} PGNbatch;
+
+// W/B/D/O counters of a move played in a position (stats.c)
+typedef struct
+{
+   Bitmap   key;        // zobrist key of the position
+   unsigned move;       // LCEngine4.move2num encoding, 0 = empty slot
+   int      w, b, d, o;
+} StatsEntry;
+
+typedef struct StatsMap
+{
+   StatsEntry *entries;
+   unsigned size;
+   unsigned count;
+} StatsMap;
+
+typedef struct PGNimport PGNimport;
+
+// Entry of a polyglot opening book (polyglot.c)
+typedef struct
+{
+   unsigned move;       // polyglot encoding
+   unsigned weight;
+   unsigned learn;
+} PolyglotEntry;
+
+typedef struct PolyglotBook PolyglotBook;
+
+// Info line of a UCI engine, parsed (uciengine.c)
+#define UCI_DEPTH       1
+#define UCI_SELDEPTH    2
+#define UCI_MULTIPV     4
+#define UCI_SCORE       8
+#define UCI_MATE        16      // score in moves to mate, else centipawns
+#define UCI_TIME        32
+#define UCI_NODES       64
+#define UCI_NPS         128
+#define UCI_PV          256
+#define UCI_PV_SIZE     1024
+typedef struct
+{
+   unsigned fields;     // UCI_* present in the line
+   int multipv;
+   int depth;
+   int seldepth;
+   int score;
+   int time;            // ms
+   unsigned long long nodes;
+   unsigned long long nps;
+   char pv[UCI_PV_SIZE];
+} UCIinfo;
+
+typedef struct UCIengine UCIengine;
+
+// Encodings of the lines of moves, pv_codec_list (xpv.c)
+#define CODEC_PV_XPV    0       // pv -> xpv
+#define CODEC_XPV_PV    1       // xpv -> pv
+#define CODEC_PV_MVX    2       // pv -> mvx, the mvx codecs from the initial position
+#define CODEC_MVX_PV    3       // mvx -> pv
+#define CODEC_XPV_MVX   4       // xpv -> mvx
+#define CODEC_MVX_XPV   5       // mvx -> xpv
+
+// Analyses kept on disk (ancache.c)
+typedef struct AnCache AnCache;
+
+// Games of each position of a database (posindex.c)
+#define PIX_POSITION    0       // polyglot key
+#define PIX_MATERIAL    1       // material signature
+typedef struct PosIndex PosIndex;
+typedef struct PosIndexBuilder PosIndexBuilder;
+
+// Query over the positions of the games (gamequery.c)
+typedef struct GameQuery GameQuery;
+
+// Everything about a legal move the GUI needs, filled in one pass (lc.c move_list, line_info)
+#define MOVE_CAPTURE    1
+#define MOVE_CHECK      2
+#define MOVE_MATE       4
+#define MOVE_EP         8
+#define MOVE_CASTLE_K   16
+#define MOVE_CASTLE_Q   32
+
+typedef struct
+{
+   char     pv[6];      // a1h8 + promotion
+   char     san[10];    // with + or #
+   char     piece;      // NAMEPZ
+   char     promotion;  // lowercase, 0 none
+   unsigned char from_sq, to_sq;
+   unsigned flags;      // MOVE_xxx
+} MoveInfo;
+
+// Set of xpv digests used to detect duplicated games while importing
+typedef struct XPVset
+{
+   Bitmap   *keys;
+   unsigned size;
+   unsigned count;
+} XPVset;
+
+// Zero-copy PGN scanner (pgnscan.c): slices point into the mapped file, they are not zero terminated
+#define MAX_PGN_TAGS    256
+
+typedef struct
+{
+   char     *ptr;
+   size_t   len;
+} PGNslice;
+
+typedef struct
+{
+   PGNslice label;
+   PGNslice value;      // as written in the file, with the \ escapes
+} PGNtag;
+
+typedef struct
+{
+   unsigned long long offset;   // byte offset of the game in the file
+   PGNslice text;               // whole game, tags + movetext
+   PGNslice body;               // movetext
+   int      numtags;
+   PGNtag   tags[MAX_PGN_TAGS];
+} PGNscanGame;
+
+typedef struct PGNscanner
+{
+   int      fd;
+   void     *hfile;             // windows handles
+   void     *hmap;
+   unsigned long long size;
+   unsigned long long pos;      // where the search of the next game starts
+   unsigned long long limit;    // games must start before it
+   unsigned bom;                // size of the UTF-8 BOM
+   bool     bol;                // pos is at the beginning of a line
+   void     *map;
+   size_t   map_len;
+   size_t   window;
+   unsigned long long map_offset;   // file offset of data
+   char     *data;
+   char     *end;
+} PGNscanner;
+
+typedef struct
+{
+   PGNscanner *scan;
+   PGNscanGame game;
+   char     *labels_buf;        // storage of labels, values and fens
+   char     *pgn;
+   size_t   max_pgn;
+   char     *pos_body;
+   char     *pv;
+   char     *xpv;
+   int      plies;
+   char     fen[64];
+   char     *labels[256];
+   char     *values[256];
+   int      pos_label;
+   int      raw;
+   char     *fens[256];
+   int      pos_fens;
+   int      max_depth;
+   Bitmap   keys[256];          // position before each move
+   unsigned short moves[256];   // stats_move of each move
+   StatsMap *stats;             // pgn_read_batch adds the games to it
+   int      stats_depth;
+   PGNbatch batch;
+} PGNstate;
+
+// Everything a caller needs to use the engine independently of other callers:
+// one context per thread (or per job) makes the lc_* API re-entrant.
+typedef struct LCContext
+{
+   Board    ctx_board;
+   PGNstate ctx_pgn;
+   int      ctx_level;
+} LCContext;
+
 // #define FILA(x) RANKS[x]
 // #define COLUMNA(x) FILES[x]
 #define FILA(x)       ((x) / 8)
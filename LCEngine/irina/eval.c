@@ -1,16 +1,106 @@
+#include <string.h>
+
 #include "defs.h"
 #include "protos.h"
 #include "globals.h"
 
-int LEVEL_EVAL=0; // 0=Normal, 1=Solo valor de piezas+normal en finales
+TLS int LEVEL_EVAL=0; // 0=Normal, 1=Solo valor de piezas+normal en finales
 
 void set_level(int lv)
 {
     LEVEL_EVAL = lv;
 }
 
+// ---------------------------------------------------------------------------------------------
+// Incremental state: board.count (pieces by type) and board.psq (piece square sum without
+// kings) are set by fen_board and kept by make_move/unmake_move, eval doesn't scan the
+// bitmaps. Compiling with -DEVAL_CHECK recomputes them in every eval and reports differences.
+// ---------------------------------------------------------------------------------------------
+
+void eval_init(void)
+{
+    int square;
+
+    memset(board.count, 0, sizeof(board.count));
+    board.psq = 0;
+    for (square = 0; square < 64; square++) {
+        if (board.pz[square] == EMPTY) continue;
+        board.count[board.pz[square]]++;
+        board.psq += PSQ[board.pz[square]][square];
+    }
+}
+
+static void eval_rook_castle(Move move, int *from, int *to)
+{
+    int base = IS_BLACK_PIECE(move.piece) ? A8 : A1;
+
+    if (move.is_castle & CASTLE_OO) {
+        *from = base + 7;
+        *to = base + 5;
+    } else {
+        *from = base;
+        *to = base + 3;
+    }
+}
+
+// before the move is made, the board still has the previous position
+void eval_make_move(Move move)
+{
+    int piece = move.piece, rook, from, to;
+
+    board.psq += PSQ[piece][move.to] - PSQ[piece][move.from];
+    if (move.is_ep) {
+        to = IS_BLACK_PIECE(piece) ? move.to + 8 : move.to - 8;
+        board.count[board.pz[to]]--;
+        board.psq -= PSQ[board.pz[to]][to];
+    } else if (move.capture) {
+        board.count[move.capture]--;
+        board.psq -= PSQ[move.capture][move.to];
+    }
+    if (move.promotion) {
+        board.count[piece]--;
+        board.count[move.promotion]++;
+        board.psq += PSQ[move.promotion][move.to] - PSQ[piece][move.to];
+    }
+    if (move.is_castle) {
+        rook = IS_BLACK_PIECE(piece) ? BLACK_ROOK : WHITE_ROOK;
+        eval_rook_castle(move, &from, &to);
+        board.psq += PSQ[rook][to] - PSQ[rook][from];
+    }
+}
+
+// psq is restored from the history, only the counters are undone
+void eval_unmake_move(Move move)
+{
+    if (move.is_ep) {
+        board.count[IS_BLACK_PIECE(move.piece) ? WHITE_PAWN : BLACK_PAWN]++;
+    } else if (move.capture) {
+        board.count[move.capture]++;
+    }
+    if (move.promotion) {
+        board.count[move.piece]++;
+        board.count[move.promotion]--;
+    }
+}
+
+#if defined(EVAL_CHECK)
+static void eval_check(void)
+{
+    int count[16], psq, i;
+
+    memcpy(count, board.count, sizeof(count));
+    psq = board.psq;
+    eval_init();
+    if (memcmp(count, board.count, sizeof(count)) || psq != board.psq) {
+        fprintf(stderr, "eval: incremental state differs (psq %d, real %d) in ", psq, board.psq);
+        for (i = 0; i < 16; i++) if (count[i] != board.count[i]) fprintf(stderr, "[%c %d/%d]", NAMEPZ[i], count[i], board.count[i]);
+        fprintf(stderr, "\n");
+    }
+}
+#endif
+
 int eval() {
-    int score, square;
+    int score;
     int whitepawns, whiteknights, whitebishops, whiterooks, whitequeens, whitetotal;
     int blackpawns, blackknights, blackbishops, blackrooks, blackqueens, blacktotal;
     int totalpawns;
@@ -19,21 +109,23 @@ int eval() {
     int valpawn, valknight, valbishop, valrook, valqueen;
     //bool opening, middlegame; endgame;
     bool endgame;
-    Bitmap temp;
 
+#if defined(EVAL_CHECK)
+    eval_check();
+#endif
 
-    whitepawns = bit_count(board.white_pawns);
-    whiteknights = bit_count(board.white_knights);
-    whitebishops = bit_count(board.white_bishops);
-    whiterooks = bit_count(board.white_rooks);
-    whitequeens = bit_count(board.white_queens);
+    whitepawns = board.count[WHITE_PAWN];
+    whiteknights = board.count[WHITE_KNIGHT];
+    whitebishops = board.count[WHITE_BISHOP];
+    whiterooks = board.count[WHITE_ROOK];
+    whitequeens = board.count[WHITE_QUEEN];
     whitetotalmat = 3 * whiteknights + 3 * whitebishops + 5 * whiterooks + 10 * whitequeens;
     whitetotal = whitepawns + whiteknights + whitebishops + whiterooks + whitequeens;
-    blackpawns = bit_count(board.black_pawns);
-    blackknights = bit_count(board.black_knights);
-    blackbishops = bit_count(board.black_bishops);
-    blackrooks = bit_count(board.black_rooks);
-    blackqueens = bit_count(board.black_queens);
+    blackpawns = board.count[BLACK_PAWN];
+    blackknights = board.count[BLACK_KNIGHT];
+    blackbishops = board.count[BLACK_BISHOP];
+    blackrooks = board.count[BLACK_ROOK];
+    blackqueens = board.count[BLACK_QUEEN];
     blacktotalmat = 3 * blackknights + 3 * blackbishops + 5 * blackrooks + 10 * blackqueens;
     blacktotal = blackpawns + blackknights + blackbishops + blackrooks + blackqueens;
 
@@ -174,80 +266,13 @@ int eval() {
     }
 
     // ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
-    // Evaluate WHITE PIECES
+    // Position on the board of the pieces, kept by make_move
     // ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
 
-    // ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
-    // Evaluate white pawns
-    // - position on the board
-    // - distance from opponent king
-    // - distance from own king
-    // - passed, doubled, isolated or backward pawns
-    // ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
-
-    temp = board.white_pawns;
-    while (temp) {
-        square = first_one(temp);
-        score += PAWNPOS_W[square];
-        temp ^= BITSET[square];
-    }
+    score += board.psq;
 
     // ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
-    // Evaluate white knights
-    // - position on the board
-    // - distance from opponent king
-    // ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
-
-    temp = board.white_knights;
-    while (temp) {
-        square = first_one(temp);
-        score += KNIGHTPOS_W[square];
-        temp ^= BITSET[square];
-    }
-
-    // ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
-    // Evaluate white bishops
-    // - having the pair
-    // - position on the board
-    // - distance from opponent king
-    // ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
-
-    temp = board.white_bishops;
-    while (temp) {
-        square = first_one(temp);
-        score += BISHOPPOS_W[square];
-        temp ^= BITSET[square];
-    }
-
-    // ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
-    // Evaluate white rooks
-    // - position on the board
-    // - distance from opponent king
-    // - on the same file as a passed pawn
-    // ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
-
-    temp = board.white_rooks;
-    while (temp) {
-        square = first_one(temp);
-        score += ROOKPOS_W[square];
-        temp ^= BITSET[square];
-    }
-
-    // ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
-    // Evaluate white queens
-    // - position on the board
-    // - distance from opponent king
-    // ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
-
-    temp = board.white_queens;
-    while (temp) {
-        square = first_one(temp);
-        score += QUEENPOS_W[square];
-        temp ^= BITSET[square];
-    }
-
-    // ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
-    // Evaluate the white king
+    // Evaluate the kings
     // - position on the board
     // - proximity to the pawns
     // - pawn shield (not in the endgame)
@@ -255,93 +280,9 @@ int eval() {
 
     if (endgame) {
         score += KINGPOS_ENDGAME_W[whitekingsquare];
-    } else {
-        score += KINGPOS_W[whitekingsquare];
-    }
-
-    // ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
-    // Evaluate BLACK PIECES
-    // ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
-
-    // ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
-    // Evaluate black pawns
-    // - position on the board
-    // - distance from opponent king
-    // - distance from own king
-    // - passed, doubled, isolated or backward pawns
-    // ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
-
-    temp = board.black_pawns;
-    while (temp) {
-        square = first_one(temp);
-        score -= PAWNPOS_B[square];
-        temp ^= BITSET[square];
-    }
-
-    // ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
-    // Evaluate black knights
-    // - position on the board
-    // - distance from opponent king
-    // ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
-
-    temp = board.black_knights;
-    while (temp) {
-        square = first_one(temp);
-        score -= KNIGHTPOS_B[square];
-        temp ^= BITSET[square];
-    }
-
-    // ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
-    // Evaluate black bishops
-    // - having the pair
-    // - position on the board
-    // - distance from opponent king
-    // ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
-
-    temp = board.black_bishops;
-    while (temp) {
-        square = first_one(temp);
-        score -= BISHOPPOS_B[square];
-        temp ^= BITSET[square];
-    }
-
-    // ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
-    // Evaluate black rooks
-    // - position on the board
-    // - distance from opponent king
-    // - on the same file as a passed pawn
-    // ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
-
-    temp = board.black_rooks;
-    while (temp) {
-        square = first_one(temp);
-        score -= ROOKPOS_B[square];
-        temp ^= BITSET[square];
-    }
-
-    // ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
-    // Evaluate black queens
-    // - position on the board
-    // - distance from opponent king
-    // ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
-
-    temp = board.black_queens;
-    while (temp) {
-        square = first_one(temp);
-        score -= QUEENPOS_B[square];
-        temp ^= BITSET[square];
-    }
-
-    // ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
-    // Evaluate the black king
-    // - position on the board
-    // - proximity to the pawns
-    // - pawn shield (not in the endgame)
-    // ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
-
-    if (endgame) {
         score -= KINGPOS_ENDGAME_B[blackkingsquare];
     } else {
+        score += KINGPOS_W[whitekingsquare];
         score -= KINGPOS_B[blackkingsquare];
     }
     // ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
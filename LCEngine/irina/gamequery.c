@@ -0,0 +1,582 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#if defined(IRINA_NO_TLS)
+// without TLS all the threads would share the same board
+#define QUERY_NO_THREADS
+#elif defined(_WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#include "defs.h"
+#include "protos.h"
+#include "globals.h"
+
+/*
+ * Queries over the positions of the games.
+ *
+ * An expression is compiled to a postfix program that is evaluated over the bitboards after every
+ * move of a game (and in the initial position). A game matches at the first ply where it is true,
+ * the replay stops there. With minplies > 1 it must be true for that number of consecutive plies
+ * (or until the end of the game), so the intermediate positions of an exchange don't count.
+ *
+ *   pieces     one or more of KQRBNP (white) kqrbnp (black): number of those pieces, "RQ" rooks + queens,
+ *              followed by @region, only the ones on the region: files "a" "a-d", ranks "7" "1-3",
+ *              or both "d1" "c-f3-6"
+ *   values     ply, move (move number), white (1 white to move), check (the side to move is in check),
+ *              capture (the last move was a capture), promotion (the last move was a promotion),
+ *              material (white - black, P=1 N=B=3 R=5 Q=9), numbers
+ *   operators  + - == != < <= > >= not and or ( ), also = ! && ||
+ *
+ *   "R == 1 and B == 0 and r == 0 and b == 1 and Q+q+N+n == 0"       R vs B
+ *   "P+p == P@a-d+p@a-d or P+p == P@e-h+p@e-h"                       pawns on one wing
+ *   "move <= 20 and Q == 0 and q == 1 and material < 0"              white has given the queen
+ */
+
+#define GQ_MAX_OPS          256
+#define GQ_BLOCK            64      // games taken by a worker each time
+
+enum { GQ_NUM, GQ_PIECES, GQ_VAR, GQ_ADD, GQ_SUB, GQ_NEG,
+       GQ_EQ, GQ_NE, GQ_LT, GQ_LE, GQ_GT, GQ_GE, GQ_AND, GQ_OR, GQ_NOT };
+
+enum { GQ_PLY, GQ_MOVE, GQ_WHITE, GQ_CHECK, GQ_CAPTURE, GQ_PROMOTION, GQ_MATERIAL };
+
+static const char *GQ_VARS[] = { "ply", "move", "white", "check", "capture", "promotion", "material", NULL };
+static const char GQ_PIECE_NAMES[] = "KQRBNPkqrbnp";
+
+typedef struct
+{
+    int         op;
+    int         arg;        // number, pieces (bits of GQ_PIECE_NAMES), GQ_PLY...
+    Bitmap      region;
+} GQop;
+
+struct GameQuery
+{
+    GQop        ops[GQ_MAX_OPS];
+    int         nops;
+    int         minplies;
+    bool        mvx;        // games coded in mvx, else xpv
+};
+
+typedef struct
+{
+    GameQuery   *q;
+    char        *c;
+    char        *error;
+    int         size;
+} GQparser;
+
+
+// ---------------------------------------------------------------------------------------------
+// Compilation
+// ---------------------------------------------------------------------------------------------
+
+static bool parse_error(GQparser *p, const char *msg)
+{
+    if( p->error && !*p->error ) snprintf(p->error, p->size, "%s: %.20s", msg, p->c);
+    return false;
+}
+
+static bool emit(GQparser *p, int op, int arg, Bitmap region)
+{
+    GQop *o;
+
+    if( p->q->nops >= GQ_MAX_OPS ) return parse_error(p, "Expression too long");
+    o = &p->q->ops[p->q->nops++];
+    o->op = op;
+    o->arg = arg;
+    o->region = region;
+    return true;
+}
+
+static void skip_spaces(GQparser *p)
+{
+    while( isspace((unsigned char) *p->c) ) p->c++;
+}
+
+// word of letters, *len its length
+static bool next_word(GQparser *p, char *word, int *len)
+{
+    char *c = p->c;
+    int n = 0;
+
+    while( isalpha((unsigned char) *c) && n < 15 ) word[n++] = *c++;
+    if( isalpha((unsigned char) *c) ) return false;
+    word[n] = 0;
+    *len = n;
+    return n > 0;
+}
+
+static bool keyword(GQparser *p, const char *kw, const char *sym1, const char *sym2)
+{
+    char word[16];
+    int len;
+
+    skip_spaces(p);
+    if( sym1 && !strncmp(p->c, sym1, strlen(sym1)) && (!sym2 || strncmp(p->c, sym2, strlen(sym2))) )
+    {
+        p->c += strlen(sym1);
+        return true;
+    }
+    if( next_word(p, word, &len) && !strcmp(word, kw) )
+    {
+        p->c += len;
+        return true;
+    }
+    return false;
+}
+
+// files and ranks, "a-d" "7" "c-f3-6"
+static Bitmap parse_region(GQparser *p)
+{
+    Bitmap files = 0, ranks = 0, region = 0;
+    int x, y, k;
+
+    while( *p->c >= 'a' && *p->c <= 'h' )
+    {
+        x = y = *p->c++ - 'a';
+        if( p->c[0] == '-' && p->c[1] >= 'a' && p->c[1] <= 'h' )
+        {
+            y = p->c[1] - 'a';
+            p->c += 2;
+        }
+        for( k = x; k <= y; k++ ) files |= 1 << k;
+    }
+    while( *p->c >= '1' && *p->c <= '8' )
+    {
+        x = y = *p->c++ - '1';
+        if( p->c[0] == '-' && p->c[1] >= '1' && p->c[1] <= '8' )
+        {
+            y = p->c[1] - '1';
+            p->c += 2;
+        }
+        for( k = x; k <= y; k++ ) ranks |= 1 << k;
+    }
+    if( !files ) files = 0xFF;
+    if( !ranks ) ranks = 0xFF;
+    for( k = 0; k < 64; k++ )
+    {
+        if( (files & (1 << COLUMNA(k))) && (ranks & (1 << FILA(k))) ) region |= BITSET[k];
+    }
+    return region;
+}
+
+static bool parse_or(GQparser *p);
+
+static bool parse_value(GQparser *p)
+{
+    char word[16], *d;
+    int len, k, pieces;
+    long num;
+
+    skip_spaces(p);
+    if( *p->c == '(' )
+    {
+        p->c++;
+        if( !parse_or(p) ) return false;
+        skip_spaces(p);
+        if( *p->c != ')' ) return parse_error(p, "Expected )");
+        p->c++;
+        return true;
+    }
+    if( *p->c == '-' )
+    {
+        p->c++;
+        return parse_value(p) && emit(p, GQ_NEG, 0, 0);
+    }
+    if( isdigit((unsigned char) *p->c) )
+    {
+        num = strtol(p->c, &p->c, 10);
+        return emit(p, GQ_NUM, (int) num, 0);
+    }
+    if( !next_word(p, word, &len) ) return parse_error(p, "Expected a value");
+    for( k = 0; GQ_VARS[k]; k++ )
+    {
+        if( strcmp(word, GQ_VARS[k]) ) continue;
+        p->c += len;
+        return emit(p, GQ_VAR, k, 0);
+    }
+    pieces = 0;
+    for( k = 0; k < len; k++ )
+    {
+        d = strchr(GQ_PIECE_NAMES, word[k]);
+        if( !d ) return parse_error(p, "Unknown name");
+        pieces |= 1 << (d - GQ_PIECE_NAMES);
+    }
+    p->c += len;
+    if( *p->c != '@' ) return emit(p, GQ_PIECES, pieces, ~0ULL);
+    p->c++;
+    return emit(p, GQ_PIECES, pieces, parse_region(p));
+}
+
+static bool parse_sum(GQparser *p)
+{
+    if( !parse_value(p) ) return false;
+    while( 1 )
+    {
+        skip_spaces(p);
+        if( *p->c == '+' )
+        {
+            p->c++;
+            if( !parse_value(p) || !emit(p, GQ_ADD, 0, 0) ) return false;
+        }
+        else if( *p->c == '-' )
+        {
+            p->c++;
+            if( !parse_value(p) || !emit(p, GQ_SUB, 0, 0) ) return false;
+        }
+        else return true;
+    }
+}
+
+static bool parse_comparison(GQparser *p)
+{
+    static const char *SYMS[] = { "==", "!=", "<=", ">=", "<", ">", "=", NULL };
+    static const int OPS[] = { GQ_EQ, GQ_NE, GQ_LE, GQ_GE, GQ_LT, GQ_GT, GQ_EQ };
+    int k;
+
+    if( !parse_sum(p) ) return false;
+    skip_spaces(p);
+    for( k = 0; SYMS[k]; k++ )
+    {
+        if( strncmp(p->c, SYMS[k], strlen(SYMS[k])) ) continue;
+        p->c += strlen(SYMS[k]);
+        return parse_sum(p) && emit(p, OPS[k], 0, 0);
+    }
+    return true;
+}
+
+static bool parse_not(GQparser *p)
+{
+    if( keyword(p, "not", "!", "!=") ) return parse_not(p) && emit(p, GQ_NOT, 0, 0);
+    return parse_comparison(p);
+}
+
+static bool parse_and(GQparser *p)
+{
+    if( !parse_not(p) ) return false;
+    while( keyword(p, "and", "&&", NULL) )
+    {
+        if( !parse_not(p) || !emit(p, GQ_AND, 0, 0) ) return false;
+    }
+    return true;
+}
+
+static bool parse_or(GQparser *p)
+{
+    if( !parse_and(p) ) return false;
+    while( keyword(p, "or", "||", NULL) )
+    {
+        if( !parse_and(p) || !emit(p, GQ_OR, 0, 0) ) return false;
+    }
+    return true;
+}
+
+/*
+ * Compiles expr, NULL with the reason in error (size chars) if it is not valid.
+ */
+GameQuery * gamequery_new(char *expr, int minplies, bool mvx, char *error, int size)
+{
+    GQparser p;
+
+    if( error && size ) *error = 0;
+    p.q = (GameQuery *) calloc(1, sizeof(GameQuery));
+    if( !p.q ) return NULL;
+    p.q->minplies = minplies > 1 ? minplies : 1;
+    p.q->mvx = mvx;
+    p.c = expr;
+    p.error = error;
+    p.size = size;
+    if( parse_or(&p) )
+    {
+        skip_spaces(&p);
+        if( !*p.c ) return p.q;
+        parse_error(&p, "Unexpected");
+    }
+    free(p.q);
+    return NULL;
+}
+
+void gamequery_free(GameQuery *q)
+{
+    free(q);
+}
+
+
+// ---------------------------------------------------------------------------------------------
+// Evaluation
+// ---------------------------------------------------------------------------------------------
+
+static Bitmap pieces_bitmap(int pieces)
+{
+    Bitmap bm = 0;
+
+    if( pieces & 0x001 ) bm |= board.white_king;
+    if( pieces & 0x002 ) bm |= board.white_queens;
+    if( pieces & 0x004 ) bm |= board.white_rooks;
+    if( pieces & 0x008 ) bm |= board.white_bishops;
+    if( pieces & 0x010 ) bm |= board.white_knights;
+    if( pieces & 0x020 ) bm |= board.white_pawns;
+    if( pieces & 0x040 ) bm |= board.black_king;
+    if( pieces & 0x080 ) bm |= board.black_queens;
+    if( pieces & 0x100 ) bm |= board.black_rooks;
+    if( pieces & 0x200 ) bm |= board.black_bishops;
+    if( pieces & 0x400 ) bm |= board.black_knights;
+    if( pieces & 0x800 ) bm |= board.black_pawns;
+    return bm;
+}
+
+static int material(void)
+{
+    return (int) (bit_count(board.white_pawns) - bit_count(board.black_pawns))
+         + 3 * (int) (bit_count(board.white_knights) + bit_count(board.white_bishops)
+                      - bit_count(board.black_knights) - bit_count(board.black_bishops))
+         + 5 * (int) (bit_count(board.white_rooks) - bit_count(board.black_rooks))
+         + 9 * (int) (bit_count(board.white_queens) - bit_count(board.black_queens));
+}
+
+static int variable(int var, int ply, Move *last)
+{
+    switch( var )
+    {
+    case GQ_PLY:        return ply;
+    case GQ_MOVE:       return ply / 2 + 1;
+    case GQ_WHITE:      return board.color == WHITE;
+    case GQ_CHECK:      return inCheck() ? 1 : 0;
+    case GQ_CAPTURE:    return last && (last->capture || last->is_ep);
+    case GQ_PROMOTION:  return last && last->promotion;
+    default:            return material();
+    }
+}
+
+// value of the program in the position of the board, last = move that reached it
+static bool evaluate(GameQuery *q, int ply, Move *last)
+{
+    int stack[GQ_MAX_OPS], sp = 0, k, a, b;
+    GQop *o;
+
+    for( k = 0; k < q->nops; k++ )
+    {
+        o = &q->ops[k];
+        switch( o->op )
+        {
+        case GQ_NUM:
+            stack[sp++] = o->arg;
+            continue;
+        case GQ_PIECES:
+            stack[sp++] = (int) bit_count(pieces_bitmap(o->arg) & o->region);
+            continue;
+        case GQ_VAR:
+            stack[sp++] = variable(o->arg, ply, last);
+            continue;
+        case GQ_NEG:
+            stack[sp - 1] = -stack[sp - 1];
+            continue;
+        case GQ_NOT:
+            stack[sp - 1] = !stack[sp - 1];
+            continue;
+        }
+        b = stack[--sp];
+        a = stack[sp - 1];
+        switch( o->op )
+        {
+        case GQ_ADD: a = a + b; break;
+        case GQ_SUB: a = a - b; break;
+        case GQ_EQ:  a = a == b; break;
+        case GQ_NE:  a = a != b; break;
+        case GQ_LT:  a = a < b; break;
+        case GQ_LE:  a = a <= b; break;
+        case GQ_GT:  a = a > b; break;
+        case GQ_GE:  a = a >= b; break;
+        case GQ_AND: a = a && b; break;
+        case GQ_OR:  a = a || b; break;
+        }
+        stack[sp - 1] = a;
+    }
+    return sp > 0 && stack[sp - 1] != 0;
+}
+
+/*
+ * Replays xpv (mvx if the query was created for mvx) from the initial position with the board of the thread.
+ * Returns the first ply where the query matches, -1 if it doesn't.
+ */
+int gamequery_match(GameQuery *q, char *xpv)
+{
+    int ply, first = -1;
+    Move move, *last = NULL;
+
+    init_board();
+    for( ply = 0; ; ply++ )
+    {
+        if( evaluate(q, ply, last) )
+        {
+            if( first < 0 ) first = ply;
+            if( ply - first + 1 >= q->minplies ) return first;
+        }
+        else first = -1;
+
+        if( !(q->mvx ? mvx_make_move(&xpv, &move) : xpv_make_move(&xpv, &move)) ) break;
+        last = &move;
+    }
+    // true until the end of the game
+    return first;
+}
+
+
+// ---------------------------------------------------------------------------------------------
+// Workers
+// ---------------------------------------------------------------------------------------------
+
+typedef struct
+{
+    GameQuery   *q;
+    char        **xpvs;
+    int         *plies;
+    int         num;
+    int         next;
+#if defined(QUERY_NO_THREADS)
+#elif defined(_WIN32)
+    CRITICAL_SECTION mutex;
+#else
+    pthread_mutex_t mutex;
+#endif
+} GQrun;
+
+static int next_block(GQrun *run)
+{
+    int k;
+
+#if defined(QUERY_NO_THREADS)
+    k = run->next;
+    run->next += GQ_BLOCK;
+#elif defined(_WIN32)
+    EnterCriticalSection(&run->mutex);
+    k = run->next;
+    run->next += GQ_BLOCK;
+    LeaveCriticalSection(&run->mutex);
+#else
+    pthread_mutex_lock(&run->mutex);
+    k = run->next;
+    run->next += GQ_BLOCK;
+    pthread_mutex_unlock(&run->mutex);
+#endif
+    return k;
+}
+
+static void run_blocks(GQrun *run, LCContext *ctx)
+{
+    int k, end;
+
+    while( (k = next_block(run)) < run->num )
+    {
+        end = k + GQ_BLOCK < run->num ? k + GQ_BLOCK : run->num;
+        for( ; k < end; k++ ) run->plies[k] = lc_gamequery_match(ctx, run->q, run->xpvs[k]);
+    }
+}
+
+#if !defined(QUERY_NO_THREADS)
+typedef struct
+{
+    GQrun       *run;
+    LCContext   *ctx;
+#if defined(_WIN32)
+    HANDLE      thread;
+#else
+    pthread_t   thread;
+#endif
+    bool        started;
+} GQworker;
+
+#if defined(_WIN32)
+static DWORD WINAPI worker_loop(LPVOID arg)
+#else
+static void * worker_loop(void *arg)
+#endif
+{
+    GQworker *wk = (GQworker *) arg;
+
+    run_blocks(wk->run, wk->ctx);
+    return 0;
+}
+#endif
+
+/*
+ * plies[k] = gamequery_match of xpvs[k], the games shared by the caller and nworkers threads,
+ * each one with its own context.
+ */
+void gamequery_run(GameQuery *q, int nworkers, char **xpvs, int num, int *plies)
+{
+    GQrun run;
+    LCContext *ctx;
+    int k;
+#if !defined(QUERY_NO_THREADS)
+    GQworker *workers = NULL;
+    int i;
+#endif
+
+    for( k = 0; k < num; k++ ) plies[k] = -1;
+    memset(&run, 0, sizeof(run));
+    run.q = q;
+    run.xpvs = xpvs;
+    run.plies = plies;
+    run.num = num;
+
+#if defined(QUERY_NO_THREADS)
+    nworkers = 0;
+#elif defined(_WIN32)
+    InitializeCriticalSection(&run.mutex);
+#else
+    pthread_mutex_init(&run.mutex, NULL);
+#endif
+    // no more workers than blocks
+    if( nworkers > (num + GQ_BLOCK - 1) / GQ_BLOCK ) nworkers = (num + GQ_BLOCK - 1) / GQ_BLOCK;
+
+#if !defined(QUERY_NO_THREADS)
+    if( nworkers > 0 ) workers = (GQworker *) calloc(nworkers, sizeof(GQworker));
+    for( i = 0; workers && i < nworkers; i++ )
+    {
+        workers[i].run = &run;
+        workers[i].ctx = lc_ctx_new();
+        if( !workers[i].ctx ) break;
+#if defined(_WIN32)
+        workers[i].thread = CreateThread(NULL, 0, worker_loop, &workers[i], 0, NULL);
+        workers[i].started = workers[i].thread != NULL;
+#else
+        workers[i].started = pthread_create(&workers[i].thread, NULL, worker_loop, &workers[i]) == 0;
+#endif
+        if( !workers[i].started ) break;
+    }
+#endif
+
+    // the caller takes blocks too, and all of them if the threads couldn't be started
+    ctx = lc_ctx_new();
+    if( ctx ) run_blocks(&run, ctx);
+    lc_ctx_free(ctx);
+
+#if !defined(QUERY_NO_THREADS)
+    for( i = 0; workers && i < nworkers; i++ )
+    {
+        if( workers[i].started )
+        {
+#if defined(_WIN32)
+            WaitForSingleObject(workers[i].thread, INFINITE);
+            CloseHandle(workers[i].thread);
+#else
+            pthread_join(workers[i].thread, NULL);
+#endif
+        }
+        lc_ctx_free(workers[i].ctx);
+    }
+    free(workers);
+#if defined(_WIN32)
+    DeleteCriticalSection(&run.mutex);
+#else
+    pthread_mutex_destroy(&run.mutex);
+#endif
+#endif
+}
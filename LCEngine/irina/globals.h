@@ -1,7 +1,9 @@
 #ifndef IRINA_GLOBALS_H
 #define IRINA_GLOBALS_H
 
-extern Board  board;
+extern TLS Board *cur_board;
+#define board (*cur_board)
+extern TLS PGNstate *cur_pgn;
 extern Bitmap BITSET[64];
 extern Bitmap FREEWAY[64][64];
 extern Bitmap WHITE_PAWN_ATTACKS[64];
@@ -26,7 +28,7 @@ extern int    QUEEN_VALUE;
 extern int    KING_VALUE;
 extern int    CHECK_MATE;
 
-extern Bitmap inodes;
+extern TLS Bitmap inodes;
 
 extern Bitmap HASH_keys[64][16];
 extern Bitmap HASH_ep[64];
@@ -56,8 +58,9 @@ extern int ROOKPOS_B[64];
 extern int QUEENPOS_B[64];
 extern int KINGPOS_B[64];
 extern int KINGPOS_ENDGAME_B[64];
+extern int PSQ[16][64];
 
-extern int LEVEL_EVAL;
+extern TLS int LEVEL_EVAL;
 
 
 #endif
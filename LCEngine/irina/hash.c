@@ -16,18 +16,24 @@ Bitmap HASH_side;
 
 Bitmap register_max;
 
+// fixed seed: the keys are stored on disk (stats.c), they must be the same in every run
+#define HASH_SEED   0x4c75636173436865ULL
+static Bitmap rand_seed = HASH_SEED;
 
 Bitmap rand64()
 {
-    return rand() ^ ((Bitmap) rand() << 15) ^ ((Bitmap) rand() << 30) ^ ((Bitmap) rand() << 45) ^ ((Bitmap) rand() << 60);
+    // splitmix64
+    Bitmap z = (rand_seed += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
 }
 
 void init_hash()
 {
     int i, j;
 
-    srand((unsigned int) get_ms());
-
+    rand_seed = HASH_SEED;
     for (i = 0; i < 64; i++)
     {
         HASH_ep[i] = rand64();
@@ -43,3 +49,80 @@ void init_hash()
     HASH_bq = rand64();
 
 }
+
+
+// ---------------------------------------------------------------------------------------------
+// Transposition table
+//
+// One table per thread, like the rest of the search state. It is kept between searches, the
+// entries of previous searches are replaced first; a change of LEVEL_EVAL clears it, the
+// values depend on the evaluation.
+// ---------------------------------------------------------------------------------------------
+
+static TLS HASH_reg *hash_table = NULL;
+static TLS unsigned hash_mask = 0;
+static TLS int hash_mb = HASH_DEFAULT_MB;
+static TLS int hash_age = 0;
+static TLS int hash_level = -1;
+
+// size in MB, rounded down to a power of two of entries; 0 frees the table
+void hash_set_size(int mb)
+{
+    free(hash_table);
+    hash_table = NULL;
+    hash_mask = 0;
+    hash_mb = mb;
+}
+
+void hash_clear(void)
+{
+    if( hash_table ) memset(hash_table, 0, (hash_mask + 1) * sizeof(HASH_reg));
+    hash_age = 0;
+}
+
+// called at the start of each search
+void hash_new_search(void)
+{
+    unsigned size;
+
+    if( !hash_table && hash_mb > 0 )
+    {
+        size = 1;
+        while( (Bitmap) size * 2 * sizeof(HASH_reg) <= (Bitmap) hash_mb * 1024 * 1024 ) size *= 2;
+        hash_table = (HASH_reg *) calloc(size, sizeof(HASH_reg));
+        hash_mask = hash_table ? size - 1 : 0;
+        hash_level = LEVEL_EVAL;
+    }
+    if( hash_level != LEVEL_EVAL )
+    {
+        hash_clear();
+        hash_level = LEVEL_EVAL;
+    }
+    hash_age++;
+}
+
+HASH_reg * hash_probe(void)
+{
+    HASH_reg *reg;
+
+    if( !hash_table ) return NULL;
+    reg = &hash_table[board.hashkey & hash_mask];
+    return reg->hashkey == board.hashkey ? reg : NULL;
+}
+
+void hash_store(int depth, int val, int flags, Move move)
+{
+    HASH_reg *reg;
+
+    if( !hash_table ) return;
+    reg = &hash_table[board.hashkey & hash_mask];
+    // same position or a deeper result replaces, an entry of an old search always
+    if( reg->hashkey != board.hashkey && reg->age == hash_age && reg->depth > depth ) return;
+    // a result without move keeps the move of the position
+    if( reg->hashkey != board.hashkey || move.from != move.to ) reg->move = move;
+    reg->hashkey = board.hashkey;
+    reg->depth = depth;
+    reg->val = val;
+    reg->flags = flags;
+    reg->age = hash_age;
+}
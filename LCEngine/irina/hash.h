@@ -6,6 +6,8 @@
 #define    HASH_ALPHA   1
 #define    HASH_BETA    2
 
+#define    HASH_DEFAULT_MB  2
+
 typedef struct
 {
    Bitmap   hashkey;
@@ -13,6 +15,7 @@ typedef struct
    int      val;
    int      flags;
    Move     move;
+   int      age;        // search that stored it, older entries are replaced first
 } HASH_reg;
 
 #endif
@@ -255,42 +255,41 @@ void getMoveEx( int num, char * info )
     sprintf(info, "%s%c%c%c", info, promotion, castle, en_passant);
 }
 
-char * toSan(int num, char *sanMove)
+// SAN of board.moves[num] without the check mark, returns its length
+static int san_base(int num, char *san)
 {
     Move move, movet;
-    int i;
+    int i, n;
     int fromMoves, toMoves;
     bool is_amb_ah, is_amb_18;
 
-    fromMoves = board.ply_moves[board.ply - 1];
-    toMoves = board.ply_moves[board.ply];
-
     move = board.moves[num];
+    n = 0;
 
     // Castle
     if( move.is_castle ){
-        if( move.is_castle == CASTLE_OO ) sprintf(sanMove,"O-O");
-        else sprintf(sanMove,"O-O-O");
+        strcpy(san, move.is_castle == CASTLE_OO ? "O-O" : "O-O-O");
+        return (int) strlen(san);
     }
 
     // Pawns
-    else if( (move.piece == WHITE_PAWN || move.piece == BLACK_PAWN)) {
+    if( move.piece == WHITE_PAWN || move.piece == BLACK_PAWN ) {
         if( move.capture ) {
-            sprintf(sanMove, "%cx%s", POS_AH[move.from][0], POS_AH[move.to]);
-        }
-        else  {
-            sprintf(sanMove, "%s", POS_AH[move.to]);
+            san[n++] = POS_AH[move.from][0];
+            san[n++] = 'x';
         }
-//        if( move.is_ep ){
-//            sprintf(sanMove, "%s e.p.", sanMove);
-//        }
+        san[n++] = POS_AH[move.to][0];
+        san[n++] = POS_AH[move.to][1];
         if( move.promotion ) {
-            sprintf(sanMove, "%s=%c", sanMove, toupper(NAMEPZ[move.promotion]));
+            san[n++] = '=';
+            san[n++] = toupper(NAMEPZ[move.promotion]);
         }
     }
 
     // Pieces
     else {
+        fromMoves = board.ply_moves[board.ply - 1];
+        toMoves = board.ply_moves[board.ply];
         is_amb_ah = false;
         is_amb_18 = false;
         for(i=fromMoves; i<toMoves;i++ ){
@@ -302,22 +301,135 @@ char * toSan(int num, char *sanMove)
                 }
             }
         }
-        sprintf(sanMove,"%c", toupper(NAMEPZ[move.piece]));
-        if( is_amb_ah ) sprintf(sanMove,"%s%c", sanMove, POS_AH[move.from][0]);
-        if( is_amb_18 ) sprintf(sanMove,"%s%c", sanMove, POS_AH[move.from][1]);
-        if(move.capture) sprintf(sanMove,"%sx", sanMove);
-        sprintf(sanMove,"%s%s", sanMove, POS_AH[move.to]);
+        san[n++] = toupper(NAMEPZ[move.piece]);
+        if( is_amb_ah ) san[n++] = POS_AH[move.from][0];
+        if( is_amb_18 ) san[n++] = POS_AH[move.from][1];
+        if( move.capture ) san[n++] = 'x';
+        san[n++] = POS_AH[move.to][0];
+        san[n++] = POS_AH[move.to][1];
     }
+    san[n] = '\0';
+    return n;
+}
 
-    // Check + Mate
-    make_move(move);
+// MOVE_CHECK | MOVE_MATE of board.moves[num], the replies are generated only when it gives check
+static unsigned check_flags(int num)
+{
+    unsigned flags = 0;
+
+    make_move(board.moves[num]);
     if( inCheck() ){
-        if(!movegen()){
-            sprintf(sanMove,"%s#", sanMove);
-        } else {
-            sprintf(sanMove,"%s+", sanMove);
-        }
+        flags = movegen() ? MOVE_CHECK : (MOVE_CHECK | MOVE_MATE);
     }
     unmake_move();
+    return flags;
+}
+
+char * toSan(int num, char *sanMove)
+{
+    int n;
+    unsigned flags;
+
+    n = san_base(num, sanMove);
+
+    // Check + Mate
+    flags = check_flags(num);
+    if( flags & MOVE_MATE ) sanMove[n++] = '#';
+    else if( flags & MOVE_CHECK ) sanMove[n++] = '+';
+    sanMove[n] = '\0';
     return sanMove;
 }
+
+static void move_info(int num, MoveInfo *mi)
+{
+    Move move;
+    int n;
+
+    move = board.moves[num];
+    mi->from_sq = move.from;
+    mi->to_sq = move.to;
+    mi->piece = NAMEPZ[move.piece];
+    mi->promotion = move.promotion ? tolower(NAMEPZ[move.promotion]) : 0;
+    memcpy(mi->pv, POS_AH[move.from], 2);
+    memcpy(mi->pv + 2, POS_AH[move.to], 2);
+    mi->pv[4] = mi->promotion;
+    mi->pv[5] = '\0';
+
+    mi->flags = check_flags(num);
+    if( move.capture ) mi->flags |= MOVE_CAPTURE;
+    if( move.is_ep ) mi->flags |= MOVE_EP;
+    if( move.is_castle == CASTLE_OO ) mi->flags |= MOVE_CASTLE_K;
+    else if( move.is_castle == CASTLE_OOO ) mi->flags |= MOVE_CASTLE_Q;
+
+    n = san_base(num, mi->san);
+    if( mi->flags & MOVE_MATE ) mi->san[n++] = '#';
+    else if( mi->flags & MOVE_CHECK ) mi->san[n++] = '+';
+    mi->san[n] = '\0';
+}
+
+/*
+ * All the legal moves of the current position, in movegen order.
+ * li must have room for 256 moves. Returns the number of moves.
+ */
+int move_list(MoveInfo *li)
+{
+    unsigned k;
+    int n;
+
+    board.idx_moves = board.ply_moves[board.ply - 1];
+    movegen();
+    n = 0;
+    for( k = board.ply_moves[board.ply - 1]; k < board.ply_moves[board.ply]; k++ ) move_info(k, &li[n++]);
+    return n;
+}
+
+/*
+ * Reads the next move of *pv (a1h8 format, moves separated by spaces) and looks for it in the
+ * moves of the last movegen, *pv is left after the move.
+ * Returns its index in board.moves, -1 at the end of pv or with a move that is not legal.
+ */
+int pv_nummove(char **pv)
+{
+    char *c = *pv;
+    int from, to, k;
+    char promotion;
+    Move move;
+
+    while( *c == ' ' ) c++;
+    if( !c[0] || !c[1] || !c[2] || !c[3] ) return -1;
+    from = ah_pos(c);
+    to = ah_pos(c+2);
+    c += 4;
+    promotion = 0;
+    if( *c && *c != ' ' ) promotion = tolower(*c++);
+    *pv = c;
+
+    for( k = board.ply_moves[board.ply - 1]; k < board.ply_moves[board.ply]; k++ )
+    {
+        move = board.moves[k];
+        if( move.from != from || move.to != to ) continue;
+        if( move.promotion && tolower(NAMEPZ[move.promotion]) != promotion ) continue;
+        return k;
+    }
+    return -1;
+}
+
+/*
+ * The moves of pv (a1h8 separated by spaces) played from the current position, one MoveInfo
+ * per move, at most max. The board stays at the end of the line, as after make_nummove.
+ * Returns the number of moves played, less than the moves of pv if one is not legal.
+ */
+int line_info(char *pv, MoveInfo *li, int max)
+{
+    int num, k;
+
+    board.idx_moves = board.ply_moves[board.ply - 1];
+    movegen();
+    num = 0;
+    while( num < max && (k = pv_nummove(&pv)) >= 0 )
+    {
+        move_info(k, &li[num++]);
+        make_nummove(k);
+    }
+    return num;
+}
@@ -19,10 +19,13 @@ void make_move(Move move) {
     board.history[ply].fifty = board.fifty;
     board.history[ply].move = move;
     board.history[ply].hashkey = board.hashkey;
+    board.history[ply].psq = board.psq;
     board.ply++;
 
     board.fifty++;
 
+    eval_make_move(move);
+
     if( board.color == BLACK ) board.fullmove++;
 
     board.hashkey ^= (HASH_keys[from][piece] ^ HASH_keys[to][piece]);
@@ -352,7 +355,9 @@ void unmake_move(void) {
     board.fifty = board.history[board.ply].fifty;
     board.idx_moves = board.ply_moves[board.ply];
     board.hashkey = board.history[board.ply].hashkey;
+    board.psq = board.history[board.ply].psq;
     move = board.history[board.ply].move;
+    eval_unmake_move(move);
 
     if( board.color == WHITE ) board.fullmove--;
 
@@ -7,25 +7,9 @@
 #include "protos.h"
 #include "globals.h"
 
-FILE * fpgn;
-
-char * pgn;
-char * w_pgn;
-char * line;
-int max_pgn;
-char * pos_body;
-
-char * pv;
-char fen[64];
-char * labels[256];
-char * values[256];
-int pos_label;
-int raw;
-
-char * fens[256];
-int pos_fens;
-int max_depth;
-int max_line;
+// pgn state of the classic API, the same for all the threads, as default_board (data.c)
+static PGNstate default_pgn;
+TLS PGNstate *cur_pgn = &default_pgn;
 
 
 /*d = {"B":"WHITE_BISHOP", "P":"WHITE_PAWN", "Q":"WHITE_QUEEN", "R":"WHITE_ROOK", "N":"WHITE_KNIGHT", "K":"WHITE_KING"}
@@ -53,209 +37,130 @@ unsigned PZNAME[] =
     0,            0, BLACK_KNIGHT,            0,   BLACK_PAWN,  BLACK_QUEEN,   BLACK_ROOK
 };
 
+static char xpv_promotion(char promotion)
+{
+    switch( toupper(promotion) )
+    {
+    case 'Q': return 50;
+    case 'R': return 51;
+    case 'B': return 52;
+    default:  return 53;
+    }
+}
+
 char * pgn_game(void)
 {
-    return pgn;
+    return cur_pgn->pgn;
 }
 
+#define PGN_LABEL_SIZE  256
+#define PGN_FEN_SIZE    128
+
 void pgn_start(char * fich, int depth)
 {
     int i;
-    int c;
+    char *c;
 
     if( depth > 256 ) depth = 256;
-    max_depth = depth;
-
-    fpgn = fopen(fich, "rb");
-    max_pgn = 64*1024;
-    max_line = 64*1024;
-    pgn = (char *)malloc(max_pgn);
-    pv = (char *)malloc(5*1024);
-    line = (char *)malloc(max_line);
-    for( i=0; i < 256; i++)
-    {
-        labels[i] = (char *) malloc(256);
-        values[i] = (char *) malloc(256);
-        fens[i] = (char *) malloc(128);
-    }
-    c = fgetc(fpgn);
-    if( c == 0xef ) { // UTF-BOM
-        c = fgetc(fpgn);
-        if( c == 0xbb ) c = fgetc(fpgn);
-        else rewind(fpgn);
-    }
-    else rewind(fpgn);
-    w_pgn = pgn;
-}
+    cur_pgn->max_depth = depth;
 
-void pgn_stop( void )
-{
-    int i;
-    fclose(fpgn);
-    free(pgn);
-    free(pv);
-    free(line);
+    cur_pgn->scan = pgnscan_open(fich);
+    cur_pgn->max_pgn = 64*1024;
+    cur_pgn->pgn = (char *)malloc(cur_pgn->max_pgn);
+    cur_pgn->pv = (char *)malloc(5*1024);
+    cur_pgn->xpv = (char *)malloc(4*1024);
+
+    // one block for all labels, values and fens
+    cur_pgn->labels_buf = (char *)malloc(256*(2*PGN_LABEL_SIZE+PGN_FEN_SIZE));
+    c = cur_pgn->labels_buf;
     for( i=0; i < 256; i++)
     {
-        free(labels[i]);
-        free(values[i]);
-        free(fens[i]);
+        cur_pgn->labels[i] = c;
+        c += PGN_LABEL_SIZE;
+        cur_pgn->values[i] = c;
+        c += PGN_LABEL_SIZE;
+        cur_pgn->fens[i] = c;
+        c += PGN_FEN_SIZE;
     }
 }
 
-bool empty_line()
+void pgn_stop( void )
 {
-    char * c;
-    for(c = w_pgn; *c; c++ )
-    {
-        if(!isspace((int) (*c))) return false;
-    }
-    return true;
+    pgnscan_close(cur_pgn->scan);
+    free(cur_pgn->pgn);
+    free(cur_pgn->pv);
+    free(cur_pgn->xpv);
+    free(cur_pgn->labels_buf);
+    pgn_batch_free();
+    cur_pgn->scan = NULL;
+    cur_pgn->pgn = NULL;
+    cur_pgn->stats = NULL;
 }
 
-bool test_label()
+// the next games are read from [start, end), see pgnscan_range
+int pgn_range(unsigned long long start, unsigned long long end)
 {
-    char * c;
-    char * end;
-    int n;
-    size_t size;
-
-    if(w_pgn[0] != '[') return false;
-    size = strlen(w_pgn);
-
-    end = w_pgn + size - 1;
-    while (end >= w_pgn && isspace(*end))
-        end--;
-    if( end[0] != ']') return false;
-
-    c = w_pgn;
-    n = 0;
-    while( *c ) {
-        if( *c == '\\') c++;
-        else {
-            if( *c == '"') n++;
-        }
-        c++;
-    }
-    return n == 2;
+    if( !cur_pgn->scan ) return false;
+    return pgnscan_range(cur_pgn->scan, start, end);
 }
 
-void test_size_pgn(void)
+static void copy_label(PGNtag *tag, char *lk, char *lv)
 {
-    int tam_line, dif;
-    tam_line = strlen(w_pgn);
-    w_pgn += tam_line;
-    dif = w_pgn-pgn;
-    if((dif+1024) > max_pgn)
-    {
-        max_pgn += 64*1024;
-        pgn = realloc(pgn, max_pgn);
-        w_pgn = pgn + dif;
-    }
-}
-
-void mas_label(void)
-{
-    char *c, *lk, *lv;
+    char *c, *end, *lk_end, *lv_end;
 
-    if( pos_label > 255 || !test_label()) return;
-
-    lk = labels[pos_label];
-    lv = values[pos_label];
-
-    c = w_pgn+1;
-    while( *c && *c == ' ') c++; // fuera espacios
-    while( *c && *c != '"' )     // hasta las "
+    lk_end = lk + PGN_LABEL_SIZE - 1;
+    end = tag->label.ptr + tag->label.len;
+    for( c = tag->label.ptr; c < end && lk < lk_end; c++ )
     {
-        if( *c != ' ' )
-        {
-            *lk = *c;
-            lk++;
-        }
-        c++;
+        if( *c != ' ' ) *lk++ = *c;
     }
     *lk = 0; // FDL
-    if( *c == '"' )
+
+    lv_end = lv + PGN_LABEL_SIZE - 1;
+    end = tag->value.ptr + tag->value.len;
+    for( c = tag->value.ptr; c < end && lv < lv_end; c++ )
     {
-        c++;
-        while( *c && *c != '"' )
+        if( *c == '\\' )
         {
-            if( *c == '\\' )
-            {
-                c++;
-                if( ! *c ) break;
-            }
-            *lv = *c;
-            lv++;
             c++;
+            if( c == end ) break;
         }
+        *lv++ = *c;
     }
     *lv = 0; // FDL
-
-    if( !strcmp("FEN", labels[pos_label] ) )
-    {
-        strncpy(fen, values[pos_label], 63);
-    }
-
-    ++pos_label;
 }
 
-
 int pgn_read( void )
 {
-    long int max_tam;
-    w_pgn = pgn;
-    fen[0] = 0;
-    pos_label = 0;
-    pos_fens = 0;
-
-    /* leemos primer label*/
-    do
-    {
-        max_tam = max_pgn - (w_pgn-pgn);
-        if(!fgets(w_pgn, max_tam, fpgn)) return false;
-//        printf("PL:[%s]", w_pgn);
+    PGNscanGame *game = &cur_pgn->game;
+    int i;
 
-        if(w_pgn[0] == '[' )
-        {
-            mas_label();
-            test_size_pgn();
-            break;
-        }
-    }
-    while(1);
+    cur_pgn->fen[0] = 0;
+    cur_pgn->pos_label = 0;
+    cur_pgn->pos_fens = 0;
 
-    /* leemos resto labels */
-    do
+    if( !cur_pgn->scan || !pgnscan_next(cur_pgn->scan, game) ) return false;
+
+    // the game is copied once, pgn_gen_pv needs it zero terminated
+    if( game->text.len + 1 > cur_pgn->max_pgn )
     {
-        max_tam = max_pgn - (w_pgn-pgn);
-        if(!fgets(w_pgn, max_tam, fpgn)) return false; /*EOF*/
-        if(w_pgn[0] != '[') break;
-//        printf("+L:[%s]", w_pgn);
-        mas_label();
-        test_size_pgn();
+        while( game->text.len + 1 > cur_pgn->max_pgn ) cur_pgn->max_pgn *= 2;
+        free(cur_pgn->pgn);
+        cur_pgn->pgn = (char *)malloc(cur_pgn->max_pgn);
     }
-    while(1);
-//    printf("PR:[%s]", w_pgn);
-
-    pos_body = w_pgn;
-    test_size_pgn();
+    memcpy(cur_pgn->pgn, game->text.ptr, game->text.len);
+    cur_pgn->pgn[game->text.len] = 0;
+    cur_pgn->pos_body = cur_pgn->pgn + (game->body.ptr - game->text.ptr);
 
-    /* leemos hasta linea en blanco */
-    do
+    for( i = 0; i < game->numtags; i++ )
     {
-        max_tam = max_pgn - (w_pgn-pgn);
-        if(!fgets(w_pgn, max_tam, fpgn)) break; /*EOF*/
-        if(w_pgn[0] == '[' && test_label()) {
-            fseek( fpgn, -strlen(w_pgn)-1, SEEK_CUR );
-//            printf("FR:[%s,%d]", w_pgn, -strlen(w_pgn)-1);
-            w_pgn[0] = '\0';
-            break;
+        copy_label(&game->tags[i], cur_pgn->labels[i], cur_pgn->values[i]);
+        if( !strcmp("FEN", cur_pgn->labels[i]) )
+        {
+            strncpy(cur_pgn->fen, cur_pgn->values[i], 63);
         }
-//        printf("+R:[%s]", w_pgn);
-        test_size_pgn();
     }
-    while(1);
+    cur_pgn->pos_label = game->numtags;
 
     return true;
 }
@@ -269,6 +174,7 @@ int pgn_gen_pv(void)
     char from_AH, from_18;
     char to_AH, to_18;
     char *p_pv;
+    char *p_xpv;
     bool ok;
 
     int par;
@@ -276,17 +182,20 @@ int pgn_gen_pv(void)
     unsigned k;
     Move move;
 
-    p_pv = pv;
+    p_pv = cur_pgn->pv;
     *p_pv = 0;
+    p_xpv = cur_pgn->xpv;
+    *p_xpv = 0;
+    cur_pgn->plies = 0;
 
-    raw = true;
+    cur_pgn->raw = true;
 
-    if( *fen ) fen_board( fen );
+    if( *cur_pgn->fen ) fen_board( cur_pgn->fen );
     else init_board();
 
-    pos_fens = 0;
+    cur_pgn->pos_fens = 0;
 
-    c = pos_body;
+    c = cur_pgn->pos_body;
     piece = 'P';
     from_AH = 0;
     from_18 = 0;
@@ -403,11 +312,13 @@ int pgn_gen_pv(void)
             if( *(c+1) == '-' && *(c+2) == '0' )
             {
                 *p_pv = 0;
+                *p_xpv = 0;
                 return true;
             }
             if( *(c+1) == '/' && *(c+2) == '2' && *(c+3) == '-' && *(c+4) == '1' && *(c+5) == '/' && *(c+6) == '2')
             {
                 *p_pv = 0;
+                *p_xpv = 0;
                 return true;
             }
         case '2':
@@ -427,6 +338,7 @@ int pgn_gen_pv(void)
             if( *(c+1) == '-' && *(c+2) == '1' )
             {
                 *p_pv = 0;
+                *p_xpv = 0;
                 return true;
             }
 
@@ -475,7 +387,7 @@ int pgn_gen_pv(void)
         case '%':
         case ';':
             while ( *c && !(*c == '\n'||*c == '\r') ) c++;
-            if(raw) raw = false;
+            if(cur_pgn->raw) cur_pgn->raw = false;
             break;
 
         case '(':
@@ -490,17 +402,17 @@ int pgn_gen_pv(void)
                 if( *c == '(' ) par++;
                 else if( *c == ')' ) par--;
             }
-            if(raw) raw = false;
+            if(cur_pgn->raw) cur_pgn->raw = false;
             break;
 
         case '{':
             while ( *c && *c != '}' ) c++;
-            if(raw) raw = false;
+            if(cur_pgn->raw) cur_pgn->raw = false;
             break;
 
         case '$':
             c++;
-            if(raw) raw = false;
+            if(cur_pgn->raw) cur_pgn->raw = false;
             break;
 
         default:
@@ -532,7 +444,7 @@ int pgn_gen_pv(void)
                     if(from_18 && (move.from/8 != (from_18-'1'))) continue;
                     if( move.promotion && NAMEPZ[move.promotion] != promotion ) continue;
                     if( promotion && !move.promotion ) continue;
-                    if( pv != p_pv )
+                    if( cur_pgn->pv != p_pv )
                     {
                         *p_pv = ' ';
                         p_pv++;
@@ -547,8 +459,22 @@ int pgn_gen_pv(void)
                         p_pv++;
                     }
 
+                    // xpv: same encoding as LCEngine4.pv2xpv
+                    *p_xpv++ = (char) (move.from + 58);
+                    *p_xpv++ = (char) (move.to + 58);
+                    if( promotion )
+                    {
+                        *p_xpv++ = xpv_promotion(promotion);
+                    }
+                    if( cur_pgn->plies < 256 )
+                    {
+                        cur_pgn->keys[cur_pgn->plies] = board.hashkey;
+                        cur_pgn->moves[cur_pgn->plies] = (unsigned short) stats_move(move);
+                    }
+                    cur_pgn->plies++;
+
                     make_move(move);
-                    if( pos_fens < max_depth ) board_fenM2( fens[pos_fens++] );
+                    if( cur_pgn->pos_fens < cur_pgn->max_depth ) board_fenM2( cur_pgn->fens[cur_pgn->pos_fens++] );
                     ok = true;
                     break;
                 }
@@ -563,41 +489,57 @@ int pgn_gen_pv(void)
         }
     }
     *p_pv = 0;
+    *p_xpv = 0;
     return true;
 }
 
 char * pgn_pv(void)
 {
-    if( ! pgn_gen_pv() ) pv[0] = 0;
-    return pv;
+    if( ! pgn_gen_pv() )
+    {
+        cur_pgn->pv[0] = 0;
+        cur_pgn->xpv[0] = 0;
+        cur_pgn->plies = 0;
+    }
+    return cur_pgn->pv;
+}
+
+char * pgn_xpv(void)
+{
+    return cur_pgn->xpv;
+}
+
+int pgn_plies(void)
+{
+    return cur_pgn->plies;
 }
 
 char * pgn_label(int num)
 {
-    return (char *)labels[num];
+    return (char *)cur_pgn->labels[num];
 }
 
 char * pgn_value(int num)
 {
-    return (char *)values[num];
+    return (char *)cur_pgn->values[num];
 }
 
 int pgn_numlabels(void)
 {
-    return pos_label;
+    return cur_pgn->pos_label;
 }
 
 int pgn_raw(void)
 {
-    return raw;
+    return cur_pgn->raw;
 }
 
 char * pgn_fen(int num)
 {
-    return (char *)fens[num];
+    return (char *)cur_pgn->fens[num];
 }
 
 int pgn_numfens(void)
 {
-    return pos_fens;
+    return cur_pgn->pos_fens;
 }
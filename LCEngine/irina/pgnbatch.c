@@ -0,0 +1,233 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "defs.h"
+#include "protos.h"
+#include "globals.h"
+
+/*
+ * Batch import: reads many games per call, replays them and stores everything the database
+ * needs (tags, pv, xpv, plies, fens) in one buffer, so the caller only pays one round-trip
+ * per batch. Duplicates are detected with an in-memory set of xpv digests.
+ */
+
+static char * INITIAL_FEN = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+
+
+// ---------------------------------------------------------------------------------------------
+// XPVset
+// ---------------------------------------------------------------------------------------------
+
+static Bitmap xpv_digest(char *xpv)
+{
+    // FNV-1a + final mix
+    Bitmap h = 0xcbf29ce484222325ULL;
+    unsigned char *c;
+
+    for( c = (unsigned char *) xpv; *c; c++ )
+    {
+        h ^= *c;
+        h *= 0x100000001b3ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h ? h : 1; // 0 marks an empty slot
+}
+
+XPVset * xpvset_new(void)
+{
+    XPVset *set;
+
+    set = (XPVset *) malloc(sizeof(XPVset));
+    if( !set ) return NULL;
+    set->size = 1 << 16;
+    set->count = 0;
+    set->keys = (Bitmap *) calloc(set->size, sizeof(Bitmap));
+    if( !set->keys )
+    {
+        free(set);
+        return NULL;
+    }
+    return set;
+}
+
+void xpvset_free(XPVset *set)
+{
+    if( !set ) return;
+    free(set->keys);
+    free(set);
+}
+
+static bool xpvset_insert(Bitmap *keys, unsigned size, Bitmap key)
+{
+    unsigned pos, mask;
+
+    mask = size - 1;
+    for( pos = (unsigned) key & mask; keys[pos]; pos = (pos + 1) & mask )
+    {
+        if( keys[pos] == key ) return false;
+    }
+    keys[pos] = key;
+    return true;
+}
+
+static void xpvset_grow(XPVset *set)
+{
+    Bitmap *keys;
+    unsigned i, size;
+
+    size = set->size * 2;
+    keys = (Bitmap *) calloc(size, sizeof(Bitmap));
+    if( !keys ) return;
+    for( i = 0; i < set->size; i++ )
+    {
+        if( set->keys[i] ) xpvset_insert(keys, size, set->keys[i]);
+    }
+    free(set->keys);
+    set->keys = keys;
+    set->size = size;
+}
+
+// returns true when xpv was not in the set
+bool xpvset_add(XPVset *set, char *xpv)
+{
+    if( set->count * 2 >= set->size ) xpvset_grow(set);
+    if( !xpvset_insert(set->keys, set->size, xpv_digest(xpv)) ) return false;
+    set->count++;
+    return true;
+}
+
+int xpvset_count(XPVset *set)
+{
+    return (int) set->count;
+}
+
+
+// ---------------------------------------------------------------------------------------------
+// Batch
+// ---------------------------------------------------------------------------------------------
+
+static size_t batch_add(PGNbatch *batch, char *txt)
+{
+    size_t tam, pos;
+
+    tam = strlen(txt) + 1;
+    if( batch->size + tam > batch->max )
+    {
+        while( batch->size + tam > batch->max ) batch->max *= 2;
+        batch->buf = (char *) realloc(batch->buf, batch->max);
+    }
+    pos = batch->size;
+    memcpy(batch->buf + pos, txt, tam);
+    batch->size += tam;
+    return pos;
+}
+
+static void batch_reset(PGNbatch *batch)
+{
+    if( !batch->buf )
+    {
+        batch->max = 4*1024*1024;
+        batch->buf = (char *) malloc(batch->max);
+    }
+    batch->size = 0;
+    batch->num = 0;
+}
+
+static PGNgame * batch_new_game(PGNbatch *batch)
+{
+    if( batch->num == batch->max_games )
+    {
+        batch->max_games = batch->max_games ? batch->max_games * 2 : 1024;
+        batch->games = (PGNgame *) realloc(batch->games, batch->max_games * sizeof(PGNgame));
+    }
+    return &batch->games[batch->num++];
+}
+
+void pgn_batch_free(void)
+{
+    PGNbatch *batch = &cur_pgn->batch;
+
+    free(batch->buf);
+    free(batch->games);
+    memset(batch, 0, sizeof(PGNbatch));
+}
+
+/*
+ * Reads up to max_games games of the opened pgn file.
+ * dups can be NULL, then no duplicate detection is done.
+ * With pgn_stats, the moves of the games with PGN_OK status are added to the stats.
+ * Returns the number of games stored in the batch, 0 at end of file.
+ */
+int pgn_read_batch(int max_games, XPVset *dups)
+{
+    PGNbatch *batch = &cur_pgn->batch;
+    PGNgame *game;
+    char *fen;
+    int i, nstats;
+
+    batch_reset(batch);
+
+    while( batch->num < max_games && pgn_read() )
+    {
+        game = batch_new_game(batch);
+
+        pgn_pv();
+        game->pgn = batch_add(batch, cur_pgn->pgn);
+        game->pv = batch_add(batch, cur_pgn->pv);
+        game->xpv = batch_add(batch, cur_pgn->xpv);
+        game->plies = cur_pgn->plies;
+        game->raw = cur_pgn->raw;
+
+        fen = NULL;
+        game->result = RESULT_OTHER;
+        game->numlabels = cur_pgn->pos_label;
+        game->labels = batch->size;
+        for( i = 0; i < cur_pgn->pos_label; i++ )
+        {
+            batch_add(batch, cur_pgn->labels[i]);
+            batch_add(batch, cur_pgn->values[i]);
+            if( !strcmp(cur_pgn->labels[i], "FEN") ) fen = cur_pgn->values[i];
+            else if( !strcmp(cur_pgn->labels[i], "Result") ) game->result = stats_result(cur_pgn->values[i]);
+        }
+
+        game->numfens = cur_pgn->pos_fens;
+        game->fens = batch->size;
+        for( i = 0; i < cur_pgn->pos_fens; i++ )
+        {
+            batch_add(batch, cur_pgn->fens[i]);
+        }
+
+        if( !cur_pgn->pv[0] ) game->status = PGN_ERROR;
+        else if( fen && *fen && strcmp(fen, INITIAL_FEN) ) game->status = PGN_NOTINITIAL;
+        else if( dups && !xpvset_add(dups, cur_pgn->xpv) ) game->status = PGN_DUPLICATE;
+        else game->status = PGN_OK;
+
+        if( cur_pgn->stats && game->status == PGN_OK )
+        {
+            nstats = game->plies;
+            if( nstats > cur_pgn->stats_depth ) nstats = cur_pgn->stats_depth;
+            if( nstats > 256 ) nstats = 256;
+            stats_add_line(cur_pgn->stats, cur_pgn->keys, cur_pgn->moves, nstats, game->result, 1);
+        }
+    }
+    return batch->num;
+}
+
+void pgn_stats(StatsMap *stats, int depth)
+{
+    cur_pgn->stats = stats;
+    cur_pgn->stats_depth = depth;
+}
+
+PGNgame * pgn_batch_game(int num)
+{
+    return &cur_pgn->batch.games[num];
+}
+
+// strings of a PGNgame are consecutive in the buffer: next = this + strlen(this) + 1
+char * pgn_batch_str(size_t offset)
+{
+    return cur_pgn->batch.buf + offset;
+}
@@ -0,0 +1,473 @@
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#if defined(IRINA_NO_TLS)
+// without TLS all the threads would share the same board
+#define IMPORT_NO_THREADS
+#elif defined(_WIN32)
+#ifndef _WIN32_WINNT
+#define _WIN32_WINNT 0x0600     // condition variables
+#endif
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#include "defs.h"
+#include "protos.h"
+#include "globals.h"
+
+/*
+ * Parallel import of pgn files.
+ *
+ * The files are split in chunks of games (game aligned byte ranges, pgnscan_game_start).
+ * A pool of workers, each one with its own LCContext, parses the chunks and replays their
+ * moves; every worker adds the games to its own StatsMap. The consumer takes the chunks in
+ * file order with pgnimport_next, so duplicates are detected in the same order as a
+ * sequential import, and at the end pgnimport_stats merges the maps of the workers.
+ *
+ * Only a few chunks are parsed ahead of the consumer, the memory doesn't grow with the file.
+ */
+
+#define IMPORT_CHUNK        (4*1024*1024)
+#define IMPORT_AHEAD        2       // chunks parsed ahead of the consumer, per worker
+
+#define CHUNK_WAITING       0
+#define CHUNK_DONE          1
+
+#if defined(IMPORT_NO_THREADS)
+typedef int                 ImportMutex;
+typedef int                 ImportCond;
+typedef int                 ImportThread;
+#define mutex_init(m)
+#define mutex_free(m)
+#define mutex_lock(m)
+#define mutex_unlock(m)
+#define cond_init(c)
+#define cond_free(c)
+#define cond_wait(c, m)
+#define cond_broadcast(c)
+#elif defined(_WIN32)
+typedef CRITICAL_SECTION    ImportMutex;
+typedef CONDITION_VARIABLE  ImportCond;
+typedef HANDLE              ImportThread;
+#define mutex_init(m)       InitializeCriticalSection(m)
+#define mutex_free(m)       DeleteCriticalSection(m)
+#define mutex_lock(m)       EnterCriticalSection(m)
+#define mutex_unlock(m)     LeaveCriticalSection(m)
+#define cond_init(c)        InitializeConditionVariable(c)
+#define cond_free(c)
+#define cond_wait(c, m)     SleepConditionVariableCS(c, m, INFINITE)
+#define cond_broadcast(c)   WakeAllConditionVariable(c)
+#else
+typedef pthread_mutex_t     ImportMutex;
+typedef pthread_cond_t      ImportCond;
+typedef pthread_t           ImportThread;
+#define mutex_init(m)       pthread_mutex_init(m, NULL)
+#define mutex_free(m)       pthread_mutex_destroy(m)
+#define mutex_lock(m)       pthread_mutex_lock(m)
+#define mutex_unlock(m)     pthread_mutex_unlock(m)
+#define cond_init(c)        pthread_cond_init(c, NULL)
+#define cond_free(c)        pthread_cond_destroy(c)
+#define cond_wait(c, m)     pthread_cond_wait(c, m)
+#define cond_broadcast(c)   pthread_cond_broadcast(c)
+#endif
+
+typedef struct
+{
+    int         file;
+    unsigned long long start;
+    unsigned long long end;
+    int         state;
+    PGNbatch    batch;
+} ImportChunk;
+
+typedef struct
+{
+    PGNimport   *imp;
+    LCContext   *ctx;
+    StatsMap    *stats;
+    int         file;       // file opened in ctx, -1 none
+    ImportThread thread;
+} ImportWorker;
+
+struct PGNimport
+{
+    char        **files;
+    int         nfiles;
+    int         depth;
+    int         stats_depth;
+    unsigned long long total;
+
+    ImportChunk *chunks;
+    int         nchunks;
+    int         next_chunk; // next chunk for the workers
+    int         cur_chunk;  // chunk of the consumer
+    int         ahead;
+
+    ImportWorker *workers;
+    int         nworkers;
+    ImportWorker inline_worker; // without threads the consumer parses the chunks
+    bool        stop;
+    ImportMutex mutex;
+    ImportCond  cond_work;
+    ImportCond  cond_done;
+
+    LCContext   *ctx;       // consumer
+    StatsMap    *fixes;     // duplicates found by the consumer are subtracted here
+};
+
+
+static bool add_chunks(PGNimport *imp, int file)
+{
+    PGNscanner *sc;
+    unsigned long long start, end;
+    ImportChunk *chunk;
+
+    sc = pgnscan_open(imp->files[file]);
+    if( !sc ) return true;      // like pgn_start: a file that can't be read has no games
+    imp->total += pgnscan_size(sc);
+
+    start = 0;
+    while( start < pgnscan_size(sc) )
+    {
+        end = pgnscan_game_start(sc, start + IMPORT_CHUNK);
+        chunk = (ImportChunk *) realloc(imp->chunks, (imp->nchunks + 1) * sizeof(ImportChunk));
+        if( !chunk )
+        {
+            pgnscan_close(sc);
+            return false;
+        }
+        imp->chunks = chunk;
+        chunk = &imp->chunks[imp->nchunks++];
+        memset(chunk, 0, sizeof(ImportChunk));
+        chunk->file = file;
+        chunk->start = start;
+        chunk->end = end;
+        chunk->state = CHUNK_WAITING;
+        start = end;
+    }
+    pgnscan_close(sc);
+    return true;
+}
+
+static void parse_chunk(ImportWorker *wk, ImportChunk *chunk)
+{
+    PGNimport *imp = wk->imp;
+
+    if( wk->file != chunk->file )
+    {
+        if( wk->file >= 0 ) lc_pgn_stop(wk->ctx);
+        lc_pgn_start(wk->ctx, imp->files[chunk->file], imp->depth);
+        wk->file = chunk->file;
+    }
+    if( wk->stats ) lc_pgn_stats(wk->ctx, wk->stats, imp->stats_depth);
+
+    if( lc_pgn_range(wk->ctx, chunk->start, chunk->end) ) lc_pgn_read_batch(wk->ctx, INT_MAX, NULL);
+
+    // the chunk keeps the batch, the context starts a new one
+    chunk->batch = wk->ctx->ctx_pgn.batch;
+    memset(&wk->ctx->ctx_pgn.batch, 0, sizeof(PGNbatch));
+}
+
+#if !defined(IMPORT_NO_THREADS)
+#if defined(_WIN32)
+static DWORD WINAPI worker_loop(LPVOID arg)
+#else
+static void * worker_loop(void *arg)
+#endif
+{
+    ImportWorker *wk = (ImportWorker *) arg;
+    PGNimport *imp = wk->imp;
+    int k;
+
+    mutex_lock(&imp->mutex);
+    while( 1 )
+    {
+        while( !imp->stop && imp->next_chunk < imp->nchunks && imp->next_chunk > imp->cur_chunk + imp->ahead )
+        {
+            cond_wait(&imp->cond_work, &imp->mutex);
+        }
+        if( imp->stop || imp->next_chunk >= imp->nchunks ) break;
+        k = imp->next_chunk++;
+        mutex_unlock(&imp->mutex);
+
+        parse_chunk(wk, &imp->chunks[k]);
+
+        mutex_lock(&imp->mutex);
+        imp->chunks[k].state = CHUNK_DONE;
+        cond_broadcast(&imp->cond_done);
+    }
+    mutex_unlock(&imp->mutex);
+    return 0;
+}
+#endif
+
+static bool worker_init(PGNimport *imp, ImportWorker *wk)
+{
+    wk->imp = imp;
+    wk->file = -1;
+    wk->ctx = lc_ctx_new();
+    if( !wk->ctx ) return false;
+    if( imp->stats_depth > 0 )
+    {
+        wk->stats = stats_new();
+        if( !wk->stats ) return false;
+    }
+    return true;
+}
+
+static void worker_free(ImportWorker *wk)
+{
+    lc_ctx_free(wk->ctx);
+    stats_free(wk->stats);
+    wk->ctx = NULL;
+    wk->stats = NULL;
+}
+
+static void stop_workers(PGNimport *imp)
+{
+#if !defined(IMPORT_NO_THREADS)
+    int i;
+
+    mutex_lock(&imp->mutex);
+    imp->stop = true;
+    cond_broadcast(&imp->cond_work);
+    mutex_unlock(&imp->mutex);
+    for( i = 0; i < imp->nworkers; i++ )
+    {
+        if( !imp->workers[i].thread ) continue;
+#if defined(_WIN32)
+        WaitForSingleObject(imp->workers[i].thread, INFINITE);
+        CloseHandle(imp->workers[i].thread);
+#else
+        pthread_join(imp->workers[i].thread, NULL);
+#endif
+        imp->workers[i].thread = 0;
+    }
+#endif
+}
+
+/*
+ * nworkers = 0 parses in the thread calling pgnimport_next.
+ * depth is the number of fens of each game, as in pgn_start.
+ * stats_depth > 0 builds the stats of the first stats_depth moves of the games imported.
+ */
+PGNimport * pgnimport_new(char **files, int nfiles, int nworkers, int depth, int stats_depth)
+{
+    PGNimport *imp;
+    int i;
+
+    imp = (PGNimport *) calloc(1, sizeof(PGNimport));
+    if( !imp ) return NULL;
+
+#if defined(IMPORT_NO_THREADS)
+    nworkers = 0;
+#endif
+    imp->nfiles = nfiles;
+    imp->depth = depth;
+    // the workers count at most 256 plies (pgnbatch.c), the duplicates are uncounted with the same ceiling
+    if( stats_depth > 256 ) stats_depth = 256;
+    imp->stats_depth = stats_depth;
+    imp->cur_chunk = -1;
+    imp->ahead = nworkers ? nworkers * IMPORT_AHEAD : 1;
+    mutex_init(&imp->mutex);
+    cond_init(&imp->cond_work);
+    cond_init(&imp->cond_done);
+
+    imp->files = (char **) calloc(nfiles, sizeof(char *));
+    imp->ctx = lc_ctx_new();
+    if( stats_depth > 0 ) imp->fixes = stats_new();
+    if( !imp->files || !imp->ctx || (stats_depth > 0 && !imp->fixes) ) goto error;
+    for( i = 0; i < nfiles; i++ )
+    {
+        imp->files[i] = strdup(files[i]);
+        if( !imp->files[i] || !add_chunks(imp, i) ) goto error;
+    }
+
+    if( !nworkers )
+    {
+        if( !worker_init(imp, &imp->inline_worker) ) goto error;
+        return imp;
+    }
+
+    imp->workers = (ImportWorker *) calloc(nworkers, sizeof(ImportWorker));
+    if( !imp->workers ) goto error;
+    imp->nworkers = nworkers;
+    for( i = 0; i < nworkers; i++ )
+    {
+        if( !worker_init(imp, &imp->workers[i]) ) goto error;
+    }
+#if !defined(IMPORT_NO_THREADS)
+    for( i = 0; i < nworkers; i++ )
+    {
+#if defined(_WIN32)
+        imp->workers[i].thread = CreateThread(NULL, 0, worker_loop, &imp->workers[i], 0, NULL);
+        if( !imp->workers[i].thread ) goto error;
+#else
+        if( pthread_create(&imp->workers[i].thread, NULL, worker_loop, &imp->workers[i]) )
+        {
+            imp->workers[i].thread = 0;
+            goto error;
+        }
+#endif
+    }
+#endif
+    return imp;
+
+error:
+    pgnimport_free(imp);
+    return NULL;
+}
+
+void pgnimport_free(PGNimport *imp)
+{
+    int i;
+
+    if( !imp ) return;
+    stop_workers(imp);
+    for( i = 0; i < imp->nworkers; i++ ) worker_free(&imp->workers[i]);
+    worker_free(&imp->inline_worker);
+    for( i = 0; i < imp->nchunks; i++ )
+    {
+        free(imp->chunks[i].batch.buf);
+        free(imp->chunks[i].batch.games);
+    }
+    for( i = 0; i < imp->nfiles && imp->files; i++ ) free(imp->files[i]);
+    free(imp->files);
+    free(imp->chunks);
+    free(imp->workers);
+    lc_ctx_free(imp->ctx);
+    stats_free(imp->fixes);
+    cond_free(&imp->cond_work);
+    cond_free(&imp->cond_done);
+    mutex_free(&imp->mutex);
+    free(imp);
+}
+
+/*
+ * Next chunk of games, in file order, the previous one is released.
+ * With dups, the games already seen get the PGN_DUPLICATE status.
+ * Returns the number of games (pgnimport_game), 0 when all the files have been read.
+ */
+int pgnimport_next(PGNimport *imp, XPVset *dups)
+{
+    ImportChunk *chunk;
+    PGNgame *game;
+    int i;
+
+    while( 1 )
+    {
+        mutex_lock(&imp->mutex);
+        if( imp->cur_chunk >= 0 && imp->cur_chunk < imp->nchunks )
+        {
+            chunk = &imp->chunks[imp->cur_chunk];
+            free(chunk->batch.buf);
+            free(chunk->batch.games);
+            memset(&chunk->batch, 0, sizeof(PGNbatch));
+        }
+        if( imp->cur_chunk < imp->nchunks ) imp->cur_chunk++;
+        cond_broadcast(&imp->cond_work);
+        if( imp->cur_chunk >= imp->nchunks )
+        {
+            mutex_unlock(&imp->mutex);
+            return 0;
+        }
+        chunk = &imp->chunks[imp->cur_chunk];
+        if( !imp->nworkers )
+        {
+            parse_chunk(&imp->inline_worker, chunk);
+            chunk->state = CHUNK_DONE;
+        }
+        while( chunk->state != CHUNK_DONE ) cond_wait(&imp->cond_done, &imp->mutex);
+        mutex_unlock(&imp->mutex);
+
+        if( chunk->batch.num ) break;
+    }
+
+    if( dups )
+    {
+        for( i = 0; i < chunk->batch.num; i++ )
+        {
+            game = &chunk->batch.games[i];
+            if( game->status != PGN_OK ) continue;
+            if( xpvset_add(dups, chunk->batch.buf + game->xpv) ) continue;
+            game->status = PGN_DUPLICATE;
+            // the worker has already counted it
+            if( imp->fixes ) lc_stats_add_pv(imp->ctx, imp->fixes, chunk->batch.buf + game->pv, game->result, -1, imp->stats_depth);
+        }
+    }
+    return chunk->batch.num;
+}
+
+PGNgame * pgnimport_game(PGNimport *imp, int num)
+{
+    return &imp->chunks[imp->cur_chunk].batch.games[num];
+}
+
+char * pgnimport_str(PGNimport *imp, size_t offset)
+{
+    return imp->chunks[imp->cur_chunk].batch.buf + offset;
+}
+
+// file of the games returned by the last pgnimport_next
+int pgnimport_file(PGNimport *imp)
+{
+    if( imp->cur_chunk < 0 || imp->cur_chunk >= imp->nchunks ) return -1;
+    return imp->chunks[imp->cur_chunk].file;
+}
+
+// bytes of the files already returned by pgnimport_next
+unsigned long long pgnimport_done(PGNimport *imp)
+{
+    unsigned long long done = 0;
+    int i;
+
+    for( i = 0; i <= imp->cur_chunk && i < imp->nchunks; i++ ) done += imp->chunks[i].end - imp->chunks[i].start;
+    return done;
+}
+
+unsigned long long pgnimport_total(PGNimport *imp)
+{
+    return imp->total;
+}
+
+// the games of a chunk parsed ahead but never returned by pgnimport_next are taken out of the stats
+static void uncount_chunk(PGNimport *imp, ImportChunk *chunk)
+{
+    PGNgame *game;
+    int i;
+
+    for( i = 0; i < chunk->batch.num; i++ )
+    {
+        game = &chunk->batch.games[i];
+        if( game->status != PGN_OK ) continue;
+        lc_stats_add_pv(imp->ctx, imp->fixes, chunk->batch.buf + game->pv, game->result, -1, imp->stats_depth);
+    }
+    free(chunk->batch.buf);
+    free(chunk->batch.games);
+    memset(&chunk->batch, 0, sizeof(PGNbatch));
+}
+
+/*
+ * Stats of the games returned by pgnimport_next, merged from the workers.
+ * The workers are stopped, pgnimport_next can't be used after it; when the import is cancelled
+ * the chunks parsed ahead are not included.
+ * The map belongs to the caller (stats_free), NULL without stats_depth.
+ */
+StatsMap * pgnimport_stats(PGNimport *imp)
+{
+    StatsMap *stats;
+    int i;
+
+    if( !imp->fixes ) return NULL;
+    stop_workers(imp);
+    for( i = imp->cur_chunk + 1; i < imp->next_chunk; i++ ) uncount_chunk(imp, &imp->chunks[i]);
+    stats = stats_new();
+    if( !stats ) return NULL;
+    for( i = 0; i < imp->nworkers; i++ ) stats_merge(stats, imp->workers[i].stats);
+    if( imp->inline_worker.stats ) stats_merge(stats, imp->inline_worker.stats);
+    stats_merge(stats, imp->fixes);
+    return stats;
+}
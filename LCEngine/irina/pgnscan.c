@@ -0,0 +1,413 @@
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SCAN_SSE2
+#endif
+
+#include "defs.h"
+#include "protos.h"
+
+/*
+ * Zero-copy PGN scanner: the file is memory mapped and games are returned as slices of the
+ * mapping, with their byte offsets, so a whole file can be indexed in a single pass.
+ *
+ * A game starts at a line beginning with '[', its tags are the following '[' lines and its
+ * movetext runs until the next line that is a valid tag, the same rules pgn_read always used.
+ *
+ * 64 bits builds map the whole file. 32 bits builds map a window that moves forward with the
+ * games (and grows when one game doesn't fit), so files bigger than the address space work too.
+ */
+
+#define SCAN_WINDOW     (256*1024*1024)
+
+#define SCAN_OK         1
+#define SCAN_EOF        0
+#define SCAN_MORE       -1      // the game goes on past the end of the window
+
+
+static size_t map_granularity(void)
+{
+#if defined(_WIN32)
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    return si.dwAllocationGranularity;
+#else
+    return (size_t) sysconf(_SC_PAGESIZE);
+#endif
+}
+
+static void scan_unmap(PGNscanner *sc)
+{
+    if( !sc->map ) return;
+#if defined(_WIN32)
+    UnmapViewOfFile(sc->map);
+#else
+    munmap(sc->map, sc->map_len);
+#endif
+    sc->map = NULL;
+    sc->data = NULL;
+    sc->map_len = 0;
+}
+
+// maps at least len bytes from offset, or up to the end of the file
+static bool scan_map(PGNscanner *sc, unsigned long long offset, size_t len)
+{
+    unsigned long long start, rest;
+    size_t delta;
+
+    scan_unmap(sc);
+
+    delta = (size_t) (offset % map_granularity());
+    start = offset - delta;
+    rest = sc->size - start;
+    len += delta;
+    if( (unsigned long long) len > rest ) len = (size_t) rest;
+    if( len == 0 ) return true;
+
+#if defined(_WIN32)
+    sc->map = MapViewOfFile((HANDLE) sc->hmap, FILE_MAP_READ, (DWORD) (start >> 32), (DWORD) start, len);
+    if( !sc->map ) return false;
+#else
+    sc->map = mmap(NULL, len, PROT_READ, MAP_SHARED, sc->fd, (off_t) start);
+    if( sc->map == MAP_FAILED )
+    {
+        sc->map = NULL;
+        return false;
+    }
+    madvise(sc->map, len, MADV_SEQUENTIAL);
+#endif
+    sc->map_len = len;
+    sc->map_offset = offset;
+    sc->data = (char *) sc->map + delta;
+    sc->end = (char *) sc->map + len;
+    return true;
+}
+
+PGNscanner * pgnscan_open(char *fich)
+{
+    PGNscanner *sc;
+
+    sc = (PGNscanner *) calloc(1, sizeof(PGNscanner));
+    if( !sc ) return NULL;
+
+#if defined(_WIN32)
+    {
+        HANDLE hf;
+        LARGE_INTEGER li;
+
+        hf = CreateFileA(fich, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if( hf == INVALID_HANDLE_VALUE )
+        {
+            free(sc);
+            return NULL;
+        }
+        GetFileSizeEx(hf, &li);
+        sc->size = (unsigned long long) li.QuadPart;
+        sc->hfile = hf;
+        if( sc->size ) sc->hmap = CreateFileMappingA(hf, NULL, PAGE_READONLY, 0, 0, NULL);
+        if( sc->size && !sc->hmap )
+        {
+            CloseHandle(hf);
+            free(sc);
+            return NULL;
+        }
+    }
+#else
+    {
+        struct stat st;
+
+        sc->fd = open(fich, O_RDONLY);
+        if( sc->fd < 0 )
+        {
+            free(sc);
+            return NULL;
+        }
+        fstat(sc->fd, &st);
+        sc->size = (unsigned long long) st.st_size;
+    }
+#endif
+
+    if( sizeof(size_t) > 4 ) sc->window = (size_t) sc->size;
+    else sc->window = SCAN_WINDOW;
+
+    if( !scan_map(sc, 0, sc->window) )
+    {
+        pgnscan_close(sc);
+        return NULL;
+    }
+
+    // UTF-BOM
+    sc->limit = sc->size;
+    sc->bom = 0;
+    if( sc->data && sc->end - sc->data >= 3 && !memcmp(sc->data, "\xef\xbb\xbf", 3) ) sc->bom = 3;
+    sc->pos = sc->bom;
+    sc->bol = true;
+    return sc;
+}
+
+void pgnscan_close(PGNscanner *sc)
+{
+    if( !sc ) return;
+    scan_unmap(sc);
+#if defined(_WIN32)
+    if( sc->hmap ) CloseHandle((HANDLE) sc->hmap);
+    if( sc->hfile ) CloseHandle((HANDLE) sc->hfile);
+#else
+    if( sc->fd >= 0 ) close(sc->fd);
+#endif
+    free(sc);
+}
+
+unsigned long long pgnscan_size(PGNscanner *sc)
+{
+    return sc->size;
+}
+
+unsigned long long pgnscan_pos(PGNscanner *sc)
+{
+    return sc->pos;
+}
+
+static int first_bit(unsigned m)
+{
+#if defined(_MSC_VER)
+    unsigned long n;
+    _BitScanForward(&n, m);
+    return (int) n;
+#else
+    return __builtin_ctz(m);
+#endif
+}
+
+// returns the '[' of the first "\n[" in [p, end), NULL if there is none
+static char * find_tag_line(char *p, char *end)
+{
+#if defined(SCAN_SSE2)
+    __m128i nl = _mm_set1_epi8('\n');
+    __m128i br = _mm_set1_epi8('[');
+    unsigned m;
+
+    while( p + 17 <= end )
+    {
+        m = (unsigned) _mm_movemask_epi8(_mm_and_si128(
+                _mm_cmpeq_epi8(_mm_loadu_si128((__m128i *) p), nl),
+                _mm_cmpeq_epi8(_mm_loadu_si128((__m128i *) (p+1)), br)));
+        if( m ) return p + first_bit(m) + 1;
+        p += 16;
+    }
+#endif
+    while( p < end - 1 )
+    {
+        p = (char *) memchr(p, '\n', end - 1 - p);
+        if( !p ) return NULL;
+        if( p[1] == '[' ) return p + 1;
+        p++;
+    }
+    return NULL;
+}
+
+// same test as pgn.c:test_label, on a line [p, e)
+static bool is_tag(char *p, char *e)
+{
+    int n;
+
+    if( *p != '[' ) return false;
+    while( e > p && (e[-1] == ' ' || e[-1] == '\t' || e[-1] == '\r' || e[-1] == '\n') ) e--;
+    if( e == p || e[-1] != ']' ) return false;
+
+    n = 0;
+    for( ; p < e; p++ )
+    {
+        if( *p == '\\' ) p++;
+        else if( *p == '"' ) n++;
+    }
+    return n == 2;
+}
+
+static void add_tag(PGNscanGame *game, char *p, char *e)
+{
+    PGNtag *tag;
+    char *c;
+
+    if( game->numtags >= MAX_PGN_TAGS || !is_tag(p, e) ) return;
+    tag = &game->tags[game->numtags++];
+
+    c = p + 1;
+    while( c < e && *c == ' ' ) c++;
+    tag->label.ptr = c;
+    while( c < e && *c != '"' ) c++;
+    tag->label.len = c - tag->label.ptr;
+    while( tag->label.len && tag->label.ptr[tag->label.len-1] == ' ' ) tag->label.len--;
+
+    c++;
+    tag->value.ptr = c;
+    while( c < e && *c != '"' )
+    {
+        if( *c == '\\' ) c++;
+        c++;
+    }
+    tag->value.len = c - tag->value.ptr;
+}
+
+static int scan_game(PGNscanner *sc, PGNscanGame *game)
+{
+    char *p, *line, *nl, *start, *body, *fin;
+    bool eof;
+
+    if( !sc->data ) return SCAN_EOF;
+    eof = sc->map_offset + (sc->end - sc->data) >= sc->size;
+    p = sc->data + (size_t) (sc->pos - sc->map_offset);
+
+    // first tag
+    if( sc->bol && p < sc->end && *p == '[' ) start = p;
+    else
+    {
+        start = find_tag_line(p, sc->end);
+        if( !start )
+        {
+            if( eof ) return SCAN_EOF;
+            // nothing in this window, the search goes on from its last byte
+            sc->pos = sc->map_offset + (sc->end - 1 - sc->data);
+            sc->bol = false;
+            return SCAN_MORE;
+        }
+    }
+
+    if( sc->map_offset + (start - sc->data) >= sc->limit ) return SCAN_EOF;
+
+    // tags
+    game->numtags = 0;
+    line = start;
+    while( 1 )
+    {
+        if( line >= sc->end ) return eof ? SCAN_EOF : SCAN_MORE;
+        if( *line != '[' ) break;
+        nl = (char *) memchr(line, '\n', sc->end - line);
+        if( !nl )
+        {
+            if( !eof ) return SCAN_MORE;
+            return SCAN_EOF;
+        }
+        add_tag(game, line, nl + 1);
+        line = nl + 1;
+    }
+
+    // movetext
+    body = line;
+    fin = NULL;
+    p = body;
+    while( !fin )
+    {
+        p = find_tag_line(p, sc->end);
+        if( !p )
+        {
+            if( !eof ) return SCAN_MORE;
+            fin = sc->end;
+            break;
+        }
+        nl = (char *) memchr(p, '\n', sc->end - p);
+        if( !nl && !eof ) return SCAN_MORE;
+        if( is_tag(p, nl ? nl : sc->end) ) fin = p;
+    }
+
+    game->offset = sc->map_offset + (start - sc->data);
+    game->text.ptr = start;
+    game->text.len = fin - start;
+    game->body.ptr = body;
+    game->body.len = fin - body;
+    sc->pos = game->offset + game->text.len;
+    sc->bol = true;
+    return SCAN_OK;
+}
+
+// remaps when offset is out of the window
+static bool scan_at(PGNscanner *sc, unsigned long long offset)
+{
+    if( sc->data && offset >= sc->map_offset && offset < sc->map_offset + (sc->end - sc->data) ) return true;
+    return scan_map(sc, offset, sc->window);
+}
+
+/*
+ * Offset of the first game that starts at or after offset, the size of the file if there is none.
+ * Only tags after a line not starting with '[' are taken, so the game can't be
+ * the continuation of a tag section.
+ */
+unsigned long long pgnscan_game_start(PGNscanner *sc, unsigned long long offset)
+{
+    char *p, *q, *nl;
+    bool eof;
+
+    if( offset == 0 ) return 0;
+    offset--;       // the search is for "\n["
+    while( offset < sc->size )
+    {
+        if( !scan_at(sc, offset) ) break;
+        eof = sc->map_offset + (sc->end - sc->data) >= sc->size;
+        p = sc->data + (size_t) (offset - sc->map_offset);
+        while( (p = find_tag_line(p, sc->end)) != NULL )
+        {
+            nl = (char *) memchr(p, '\n', sc->end - p);
+            if( !nl && !eof ) break;
+
+            // first char of the previous line
+            for( q = p - 2; q >= sc->data && *q != '\n'; q-- );
+            q++;
+            if( *q != '[' && is_tag(p, nl ? nl : sc->end) ) return sc->map_offset + (p - sc->data);
+        }
+        if( eof ) break;
+        // the window goes on from the last complete line
+        for( p = sc->end - 1; p > sc->data && *p != '\n'; p-- );
+        if( sc->map_offset + (p - sc->data) > offset ) offset = sc->map_offset + (p - sc->data);
+        else offset = sc->map_offset + (sc->end - 1 - sc->data);
+    }
+    return sc->size;
+}
+
+/*
+ * Limits the scan to the games that start in [start, end),
+ * start must be the beginning of a game (pgnscan_game_start).
+ */
+bool pgnscan_range(PGNscanner *sc, unsigned long long start, unsigned long long end)
+{
+    if( start < sc->bom ) start = sc->bom;
+    if( start < sc->size && !scan_at(sc, start) ) return false;
+    sc->pos = start;
+    sc->bol = true;
+    sc->limit = end;
+    return true;
+}
+
+/*
+ * Finds the next game. Returns false at end of file.
+ * The slices point into the mapping, they are valid until the next call or pgnscan_close.
+ */
+bool pgnscan_next(PGNscanner *sc, PGNscanGame *game)
+{
+    unsigned long long pos;
+    int r;
+
+    while( (r = scan_game(sc, game)) == SCAN_MORE )
+    {
+        pos = sc->pos;
+        // the window didn't move forward: the game is bigger than the window
+        if( pos == sc->map_offset && sc->map_len )
+        {
+            if( sc->window > ((size_t) -1) / 2 ) return false;
+            sc->window *= 2;
+        }
+        if( !scan_map(sc, pos, sc->window) ) return false;
+    }
+    return r == SCAN_OK;
+}
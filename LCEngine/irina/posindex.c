@@ -0,0 +1,700 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "defs.h"
+#include "protos.h"
+#include "globals.h"
+
+/*
+ * Position index of a database of games: the games (rowids) that reach each position.
+ *
+ * name.idx   header + entries (key, offset in name.dat) sorted by key, first the polyglot keys of the
+ *            positions, then the material signatures (PIX_MATERIAL)
+ * name.dat   rowids of each entry, ascending, as varint deltas
+ *
+ * A probe is a binary search over the mapped entries and the decoding of one posting list.
+ * Positions are indexed up to maxply, the material signatures of the whole game.
+ *
+ * Building: the (key, rowid) pairs of the games are sorted in memory by chunks, each chunk is a run
+ * written to a temporary file, and the runs (plus the current index when it is updated) are merged
+ * in one pass into the new files. Numbers are little endian.
+ */
+
+#define PIX_MAGIC           "LCPIX001"
+#define PIX_HEADER          64
+#define PIX_ENTRY           16
+#define PIX_RUN_PAIRS       (2 * 1024 * 1024)
+
+typedef struct
+{
+    Bitmap      key;
+    unsigned    rowid;
+    unsigned    kind;       // PIX_POSITION, PIX_MATERIAL
+} PIXpair;
+
+struct PosIndex
+{
+    unsigned char *idx, *dat;
+    size_t      idx_len, dat_len;
+#if defined(_WIN32)
+    HANDLE      hidx, hdat;
+#endif
+    Bitmap      npos, nmat, games;
+    unsigned    maxply, maxrowid;
+};
+
+struct PosIndexBuilder
+{
+    char        *name;
+    int         maxply;
+    unsigned    maxrowid;
+    Bitmap      games;
+    PosIndex    *base;      // index updated, NULL new
+    PIXpair     *pairs;
+    int         npairs;
+    int         nruns;
+    bool        error;
+    bool        mvx;        // games coded in mvx, else xpv
+};
+
+static void put_le(unsigned char *c, Bitmap n, int len)
+{
+    while( len-- )
+    {
+        *c++ = (unsigned char) (n & 0xff);
+        n >>= 8;
+    }
+}
+
+static Bitmap get_le(const unsigned char *c, int len)
+{
+    Bitmap n = 0;
+
+    while( len-- ) n = (n << 8) | c[len];
+    return n;
+}
+
+static char * file_name(char *name, char *ext)
+{
+    char *fich = (char *) malloc(strlen(name) + strlen(ext) + 16);
+
+    if( fich ) sprintf(fich, "%s%s", name, ext);
+    return fich;
+}
+
+
+// ---------------------------------------------------------------------------------------------
+// Keys
+// ---------------------------------------------------------------------------------------------
+
+// 4 bits per count: P N B R Q p n b r q
+static Bitmap material_key(int *counts)
+{
+    Bitmap key = 0;
+    int i;
+
+    for( i = 9; i >= 0; i-- ) key = (key << 4) | (Bitmap) (counts[i] > 15 ? 15 : counts[i]);
+    return key;
+}
+
+static Bitmap material_key_board(void)
+{
+    int counts[10];
+
+    counts[0] = bit_count(board.white_pawns);
+    counts[1] = bit_count(board.white_knights);
+    counts[2] = bit_count(board.white_bishops);
+    counts[3] = bit_count(board.white_rooks);
+    counts[4] = bit_count(board.white_queens);
+    counts[5] = bit_count(board.black_pawns);
+    counts[6] = bit_count(board.black_knights);
+    counts[7] = bit_count(board.black_bishops);
+    counts[8] = bit_count(board.black_rooks);
+    counts[9] = bit_count(board.black_queens);
+    return material_key(counts);
+}
+
+// material signature of the pieces of fen
+Bitmap posindex_material_fen(char *fen)
+{
+    static const char pieces[] = "PNBRQpnbrq";
+    int counts[10];
+    char *c, *p;
+
+    memset(counts, 0, sizeof(counts));
+    for( c = fen; *c && *c != ' '; c++ )
+    {
+        p = strchr(pieces, *c);
+        if( p ) counts[p - pieces]++;
+    }
+    return material_key(counts);
+}
+
+
+// ---------------------------------------------------------------------------------------------
+// Index
+// ---------------------------------------------------------------------------------------------
+
+static void unmap_file(unsigned char *data, size_t len, void *hmap)
+{
+    if( !data ) return;
+#if defined(_WIN32)
+    UnmapViewOfFile(data);
+    CloseHandle((HANDLE) hmap);
+    (void) len;
+#else
+    munmap(data, len);
+    (void) hmap;
+#endif
+}
+
+// read only mapping of the whole file, *data NULL if it is empty
+static bool map_file(char *fich, unsigned char **data, size_t *len, void **hmap)
+{
+    *data = NULL;
+    *len = 0;
+    *hmap = NULL;
+#if defined(_WIN32)
+    {
+        HANDLE hf;
+        LARGE_INTEGER li;
+
+        hf = CreateFileA(fich, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+        if( hf == INVALID_HANDLE_VALUE ) return false;
+        GetFileSizeEx(hf, &li);
+        *len = (size_t) li.QuadPart;
+        if( *len )
+        {
+            *hmap = CreateFileMappingA(hf, NULL, PAGE_READONLY, 0, 0, NULL);
+            if( *hmap ) *data = (unsigned char *) MapViewOfFile((HANDLE) *hmap, FILE_MAP_READ, 0, 0, *len);
+        }
+        // the mapping keeps the file open
+        CloseHandle(hf);
+        if( *len && !*data )
+        {
+            if( *hmap ) CloseHandle((HANDLE) *hmap);
+            return false;
+        }
+    }
+#else
+    {
+        struct stat st;
+        int fd;
+        void *map;
+
+        fd = open(fich, O_RDONLY);
+        if( fd < 0 ) return false;
+        fstat(fd, &st);
+        *len = (size_t) st.st_size;
+        if( *len )
+        {
+            map = mmap(NULL, *len, PROT_READ, MAP_SHARED, fd, 0);
+            if( map == MAP_FAILED )
+            {
+                close(fd);
+                return false;
+            }
+            madvise(map, *len, MADV_RANDOM);
+            *data = (unsigned char *) map;
+        }
+        // the mapping keeps the file open
+        close(fd);
+    }
+#endif
+    return true;
+}
+
+/*
+ * Opens name.idx + name.dat, NULL if they don't exist or don't match (the index has to be built).
+ */
+PosIndex * posindex_open(char *name)
+{
+    PosIndex *x;
+    char *fidx, *fdat;
+    void *hidx = NULL, *hdat = NULL;
+    bool ok;
+
+    x = (PosIndex *) calloc(1, sizeof(PosIndex));
+    fidx = file_name(name, ".idx");
+    fdat = file_name(name, ".dat");
+    ok = x && fidx && fdat && map_file(fidx, &x->idx, &x->idx_len, &hidx);
+    if( ok && !map_file(fdat, &x->dat, &x->dat_len, &hdat) )
+    {
+        unmap_file(x->idx, x->idx_len, hidx);
+        x->idx = NULL;
+        ok = false;
+    }
+    free(fidx);
+    free(fdat);
+    if( !ok )
+    {
+        free(x);
+        return NULL;
+    }
+#if defined(_WIN32)
+    x->hidx = (HANDLE) hidx;
+    x->hdat = (HANDLE) hdat;
+#endif
+
+    if( x->idx_len < PIX_HEADER || memcmp(x->idx, PIX_MAGIC, 8) )
+    {
+        posindex_close(x);
+        return NULL;
+    }
+    x->maxply = (unsigned) get_le(x->idx + 8, 4);
+    x->maxrowid = (unsigned) get_le(x->idx + 12, 4);
+    x->npos = get_le(x->idx + 16, 8);
+    x->nmat = get_le(x->idx + 24, 8);
+    x->games = get_le(x->idx + 40, 8);
+    if( x->idx_len != PIX_HEADER + (x->npos + x->nmat) * PIX_ENTRY || x->dat_len != get_le(x->idx + 32, 8) )
+    {
+        posindex_close(x);
+        return NULL;
+    }
+    return x;
+}
+
+void posindex_close(PosIndex *x)
+{
+    if( !x ) return;
+#if defined(_WIN32)
+    unmap_file(x->idx, x->idx_len, x->hidx);
+    unmap_file(x->dat, x->dat_len, x->hdat);
+#else
+    unmap_file(x->idx, x->idx_len, NULL);
+    unmap_file(x->dat, x->dat_len, NULL);
+#endif
+    free(x);
+}
+
+int posindex_maxply(PosIndex *x)
+{
+    return (int) x->maxply;
+}
+
+unsigned posindex_maxrowid(PosIndex *x)
+{
+    return x->maxrowid;
+}
+
+// games indexed
+int posindex_games(PosIndex *x)
+{
+    return (int) x->games;
+}
+
+static Bitmap entry_key(PosIndex *x, Bitmap n)
+{
+    return get_le(x->idx + PIX_HEADER + n * PIX_ENTRY, 8);
+}
+
+static Bitmap entry_offset(PosIndex *x, Bitmap n)
+{
+    if( n == x->npos + x->nmat ) return x->dat_len;
+    return get_le(x->idx + PIX_HEADER + n * PIX_ENTRY + 8, 8);
+}
+
+static unsigned read_varint(const unsigned char **c)
+{
+    unsigned n = 0;
+    int shift = 0;
+
+    while( **c & 0x80 )
+    {
+        n |= (unsigned) (*(*c)++ & 0x7f) << shift;
+        shift += 7;
+    }
+    n |= (unsigned) *(*c)++ << shift;
+    return n;
+}
+
+/*
+ * Rowids of the games with the key (PIX_POSITION polyglot key, PIX_MATERIAL material signature),
+ * ascending, at most max. Returns the number of games, that can be greater than max.
+ */
+int posindex_find(PosIndex *x, int kind, Bitmap key, unsigned *rowids, int max)
+{
+    Bitmap lo, hi, mid, k;
+    const unsigned char *c, *end;
+    unsigned rowid = 0;
+    int n = 0;
+
+    lo = kind == PIX_MATERIAL ? x->npos : 0;
+    hi = kind == PIX_MATERIAL ? x->npos + x->nmat : x->npos;
+    while( lo < hi )
+    {
+        mid = lo + (hi - lo) / 2;
+        k = entry_key(x, mid);
+        if( k < key ) lo = mid + 1;
+        else hi = mid;
+    }
+    if( lo == (kind == PIX_MATERIAL ? x->npos + x->nmat : x->npos) || entry_key(x, lo) != key ) return 0;
+
+    c = x->dat + entry_offset(x, lo);
+    end = x->dat + entry_offset(x, lo + 1);
+    while( c < end )
+    {
+        rowid += read_varint(&c);
+        if( n < max ) rowids[n] = rowid;
+        n++;
+    }
+    return n;
+}
+
+
+// ---------------------------------------------------------------------------------------------
+// Builder
+// ---------------------------------------------------------------------------------------------
+
+/*
+ * New index name of positions up to maxply, or an update of the current one (update, its maxply is kept)
+ * with the games of rowids greater than the last indexed.
+ */
+PosIndexBuilder * posindex_builder_new(char *name, int maxply, bool update, bool mvx)
+{
+    PosIndexBuilder *b;
+
+    b = (PosIndexBuilder *) calloc(1, sizeof(PosIndexBuilder));
+    if( !b ) return NULL;
+    b->name = file_name(name, "");
+    b->pairs = (PIXpair *) malloc(PIX_RUN_PAIRS * sizeof(PIXpair));
+    if( !b->name || !b->pairs )
+    {
+        posindex_builder_free(b);
+        return NULL;
+    }
+    b->maxply = maxply;
+    b->mvx = mvx;
+    if( update )
+    {
+        b->base = posindex_open(name);
+        if( b->base )
+        {
+            b->maxply = (int) b->base->maxply;
+            b->maxrowid = b->base->maxrowid;
+            b->games = b->base->games;
+        }
+    }
+    return b;
+}
+
+static void remove_runs(PosIndexBuilder *b)
+{
+    char ext[32];
+    char *fich;
+    int i;
+
+    for( i = 0; i < b->nruns; i++ )
+    {
+        sprintf(ext, ".run%d", i);
+        fich = file_name(b->name, ext);
+        if( fich ) remove(fich);
+        free(fich);
+    }
+    b->nruns = 0;
+}
+
+void posindex_builder_free(PosIndexBuilder *b)
+{
+    if( !b ) return;
+    if( b->name ) remove_runs(b);
+    posindex_close(b->base);
+    free(b->pairs);
+    free(b->name);
+    free(b);
+}
+
+// last indexed rowid, the games of an update have to be greater
+unsigned posindex_builder_maxrowid(PosIndexBuilder *b)
+{
+    return b->maxrowid;
+}
+
+static int cmp_pairs(const void *a, const void *b)
+{
+    const PIXpair *pa = (const PIXpair *) a, *pb = (const PIXpair *) b;
+
+    if( pa->kind != pb->kind ) return pa->kind < pb->kind ? -1 : 1;
+    if( pa->key != pb->key ) return pa->key < pb->key ? -1 : 1;
+    if( pa->rowid != pb->rowid ) return pa->rowid < pb->rowid ? -1 : 1;
+    return 0;
+}
+
+// the pairs in memory, sorted without repetitions, to a run file
+static bool write_run(PosIndexBuilder *b)
+{
+    char ext[32];
+    char *fich;
+    FILE *f;
+    unsigned char rec[16];
+    int i;
+    bool ok;
+
+    if( !b->npairs ) return true;
+    qsort(b->pairs, b->npairs, sizeof(PIXpair), cmp_pairs);
+
+    sprintf(ext, ".run%d", b->nruns);
+    fich = file_name(b->name, ext);
+    f = fich ? fopen(fich, "wb") : NULL;
+    free(fich);
+    if( !f ) return false;
+    b->nruns++;
+    ok = true;
+    for( i = 0; i < b->npairs && ok; i++ )
+    {
+        if( i && !cmp_pairs(&b->pairs[i], &b->pairs[i - 1]) ) continue;
+        put_le(rec, b->pairs[i].key, 8);
+        put_le(rec + 8, b->pairs[i].rowid, 4);
+        put_le(rec + 12, b->pairs[i].kind, 4);
+        ok = fwrite(rec, 1, 16, f) == 16;
+    }
+    if( fclose(f) ) ok = false;
+    b->npairs = 0;
+    return ok;
+}
+
+static void add_pair(PosIndexBuilder *b, int kind, Bitmap key, unsigned rowid)
+{
+    PIXpair *p;
+
+    if( b->npairs == PIX_RUN_PAIRS && !write_run(b) ) b->error = true;
+    if( b->error ) return;
+    p = &b->pairs[b->npairs++];
+    p->key = key;
+    p->rowid = rowid;
+    p->kind = (unsigned) kind;
+}
+
+/*
+ * Adds the game rowid with the moves xpv (pgn.c, xpv.c), or mvx if the builder was created for mvx,
+ * from the initial position.
+ * Uses the board of the thread. Returns false if the index can't be written.
+ */
+bool posindex_builder_add(PosIndexBuilder *b, unsigned rowid, char *xpv)
+{
+    int ply;
+    Bitmap material, last_material = 0;
+    Move move;
+
+    if( b->error ) return false;
+    init_board();
+    for( ply = 0; ; ply++ )
+    {
+        if( ply <= b->maxply ) add_pair(b, PIX_POSITION, polyglot_key(), rowid);
+        material = material_key_board();
+        if( !ply || material != last_material ) add_pair(b, PIX_MATERIAL, material, rowid);
+        last_material = material;
+
+        if( !(b->mvx ? mvx_make_move(&xpv, &move) : xpv_make_move(&xpv, &move)) ) break;
+    }
+    if( rowid > b->maxrowid ) b->maxrowid = rowid;
+    b->games++;
+    return !b->error;
+}
+
+typedef struct
+{
+    PIXpair     pair;
+    FILE        *f;             // run
+    PosIndex    *base;          // or current index
+    Bitmap      entry;
+    const unsigned char *c, *end;
+} PIXsource;
+
+static bool source_next(PIXsource *s)
+{
+    unsigned char rec[16];
+
+    if( s->f )
+    {
+        if( fread(rec, 1, 16, s->f) != 16 ) return false;
+        s->pair.key = get_le(rec, 8);
+        s->pair.rowid = (unsigned) get_le(rec + 8, 4);
+        s->pair.kind = (unsigned) get_le(rec + 12, 4);
+        return true;
+    }
+    while( s->c == s->end )
+    {
+        if( ++s->entry >= s->base->npos + s->base->nmat ) return false;
+        s->c = s->base->dat + entry_offset(s->base, s->entry);
+        s->end = s->base->dat + entry_offset(s->base, s->entry + 1);
+        s->pair.key = entry_key(s->base, s->entry);
+        s->pair.kind = s->entry >= s->base->npos ? PIX_MATERIAL : PIX_POSITION;
+        s->pair.rowid = 0;
+    }
+    s->pair.rowid += read_varint(&s->c);
+    return true;
+}
+
+static void heap_down(PIXsource **heap, int n, int i)
+{
+    PIXsource *tmp;
+    int child;
+
+    while( (child = 2 * i + 1) < n )
+    {
+        if( child + 1 < n && cmp_pairs(&heap[child + 1]->pair, &heap[child]->pair) < 0 ) child++;
+        if( cmp_pairs(&heap[child]->pair, &heap[i]->pair) >= 0 ) break;
+        tmp = heap[i];
+        heap[i] = heap[child];
+        heap[child] = tmp;
+        i = child;
+    }
+}
+
+// bytes written, 0 if error
+static int write_varint(FILE *f, unsigned n)
+{
+    unsigned char buf[5];
+    int len = 0;
+
+    while( n >= 0x80 )
+    {
+        buf[len++] = (unsigned char) (n | 0x80);
+        n >>= 7;
+    }
+    buf[len++] = (unsigned char) n;
+    return fwrite(buf, 1, len, f) == (size_t) len ? len : 0;
+}
+
+// merge of the runs and the current index to name.idx.tmp + name.dat.tmp
+static bool merge(PosIndexBuilder *b, char *fidx, char *fdat)
+{
+    PIXsource *sources, **heap, *s;
+    FILE *fi, *fd;
+    unsigned char rec[PIX_HEADER];
+    char ext[32], *fich;
+    int nsources, nheap, i, len;
+    Bitmap npos = 0, nmat = 0, offset = 0, key = 0;
+    unsigned kind = 0, last = 0;
+    bool ok, first = true;
+
+    nsources = b->nruns + (b->base ? 1 : 0);
+    sources = (PIXsource *) calloc(nsources + 1, sizeof(PIXsource));
+    heap = (PIXsource **) calloc(nsources + 1, sizeof(PIXsource *));
+    fi = fopen(fidx, "wb");
+    fd = fopen(fdat, "wb");
+    ok = sources && heap && fi && fd;
+
+    nheap = 0;
+    for( i = 0; ok && i < b->nruns; i++ )
+    {
+        sprintf(ext, ".run%d", i);
+        fich = file_name(b->name, ext);
+        sources[i].f = fich ? fopen(fich, "rb") : NULL;
+        free(fich);
+        if( !sources[i].f ) ok = false;
+        else if( source_next(&sources[i]) ) heap[nheap++] = &sources[i];
+    }
+    if( ok && b->base )
+    {
+        s = &sources[b->nruns];
+        s->base = b->base;
+        s->entry = (Bitmap) -1;     // the first source_next goes to entry 0
+        if( source_next(s) ) heap[nheap++] = s;
+    }
+    for( i = nheap / 2 - 1; i >= 0; i-- ) heap_down(heap, nheap, i);
+
+    memset(rec, 0, PIX_HEADER);
+    ok = ok && fwrite(rec, 1, PIX_HEADER, fi) == PIX_HEADER;
+    while( ok && nheap )
+    {
+        s = heap[0];
+        if( first || s->pair.kind != kind || s->pair.key != key )
+        {
+            put_le(rec, s->pair.key, 8);
+            put_le(rec + 8, offset, 8);
+            ok = fwrite(rec, 1, PIX_ENTRY, fi) == PIX_ENTRY;
+            if( s->pair.kind == PIX_MATERIAL ) nmat++;
+            else npos++;
+            kind = s->pair.kind;
+            key = s->pair.key;
+            first = false;
+            len = ok ? write_varint(fd, s->pair.rowid) : 0;
+            ok = len > 0;
+            offset += len;
+            last = s->pair.rowid;
+        }
+        else if( s->pair.rowid != last )
+        {
+            len = write_varint(fd, s->pair.rowid - last);
+            ok = len > 0;
+            offset += len;
+            last = s->pair.rowid;
+        }
+        if( source_next(s) ) heap_down(heap, nheap, 0);
+        else
+        {
+            heap[0] = heap[--nheap];
+            heap_down(heap, nheap, 0);
+        }
+    }
+
+    if( ok )
+    {
+        memcpy(rec, PIX_MAGIC, 8);
+        put_le(rec + 8, (Bitmap) b->maxply, 4);
+        put_le(rec + 12, b->maxrowid, 4);
+        put_le(rec + 16, npos, 8);
+        put_le(rec + 24, nmat, 8);
+        put_le(rec + 32, offset, 8);
+        put_le(rec + 40, b->games, 8);
+        ok = fseek(fi, 0, SEEK_SET) == 0 && fwrite(rec, 1, PIX_HEADER, fi) == PIX_HEADER;
+    }
+    for( i = 0; sources && i < b->nruns; i++ )
+    {
+        if( sources[i].f ) fclose(sources[i].f);
+    }
+    if( fi && fclose(fi) ) ok = false;
+    if( fd && fclose(fd) ) ok = false;
+    free(sources);
+    free(heap);
+    return ok;
+}
+
+/*
+ * Writes the index and frees the builder. Returns false if it can't be written, the previous index is kept then.
+ * An update without new games leaves the files as they are.
+ */
+bool posindex_builder_finish(PosIndexBuilder *b)
+{
+    char *fidx, *fdat, *tidx, *tdat;
+    bool ok;
+
+    if( b->base && !b->error && !b->npairs && !b->nruns && b->games == b->base->games )
+    {
+        posindex_builder_free(b);
+        return true;
+    }
+
+    fidx = file_name(b->name, ".idx");
+    fdat = file_name(b->name, ".dat");
+    tidx = file_name(b->name, ".idx.tmp");
+    tdat = file_name(b->name, ".dat.tmp");
+    ok = !b->error && fidx && fdat && tidx && tdat && write_run(b) && merge(b, tidx, tdat);
+
+    // the current index was a source of the merge, it is replaced now
+    posindex_close(b->base);
+    b->base = NULL;
+    // each file is replaced at once, the header of the idx has the length of the dat it was written with
+    if( ok ) ok = replace_file(tdat, fdat) && replace_file(tidx, fidx);
+    if( !ok && tidx ) remove(tidx);
+    if( !ok && tdat ) remove(tdat);
+    free(fidx);
+    free(fdat);
+    free(tidx);
+    free(tdat);
+    posindex_builder_free(b);
+    return ok;
+}
@@ -11,6 +11,7 @@ int ah_pos(char *ah);
 Bitmap get_ms(void);
 bool bioskey(void);
 char *move2str(Move move, char *str_dest);
+bool replace_file(char *from, char *to);
 
 // test.c
 void test(void);
@@ -38,6 +39,9 @@ void perft_file(char * file);
 // eval.c
 int eval(void);
 void set_level(int lv);
+void eval_init(void);
+void eval_make_move(Move move);
+void eval_unmake_move(Move move);
 
 // loop.c
 void begin(void);
@@ -81,6 +85,11 @@ int quiescence(int alpha, int beta, int ply);
 // hash.c
 Bitmap rand64();
 void init_hash();
+void hash_set_size(int mb);
+void hash_clear(void);
+void hash_new_search(void);
+HASH_reg * hash_probe(void);
+void hash_store(int depth, int val, int flags, Move move);
 
 // lc.c
 int pgn2pv(char *pgn, char * pv);
@@ -92,5 +101,178 @@ int numBaseMove( void );
 int searchMove( char *desde, char *hasta, char * promotion );
 void getMoveEx( int num, char * info );
 char * toSan(int num, char *sanMove);
+int move_list(MoveInfo *li);
+int pv_nummove(char **pv);
+int line_info(char *pv, MoveInfo *li, int max);
+
+// pgn.c
+void pgn_start(char * fich, int depth);
+void pgn_stop( void );
+int pgn_read( void );
+char * pgn_game(void);
+char * pgn_pv(void);
+int pgn_numlabels(void);
+char * pgn_label(int num);
+char * pgn_value(int num);
+int pgn_raw(void);
+int pgn_numfens(void);
+char * pgn_fen(int num);
+char * pgn_xpv(void);
+int pgn_plies(void);
+int pgn_range(unsigned long long start, unsigned long long end);
+
+// pgnscan.c
+PGNscanner * pgnscan_open(char *fich);
+void pgnscan_close(PGNscanner *sc);
+bool pgnscan_next(PGNscanner *sc, PGNscanGame *game);
+unsigned long long pgnscan_size(PGNscanner *sc);
+unsigned long long pgnscan_pos(PGNscanner *sc);
+unsigned long long pgnscan_game_start(PGNscanner *sc, unsigned long long offset);
+bool pgnscan_range(PGNscanner *sc, unsigned long long start, unsigned long long end);
+
+// pgnbatch.c
+XPVset * xpvset_new(void);
+void xpvset_free(XPVset *set);
+bool xpvset_add(XPVset *set, char *xpv);
+int xpvset_count(XPVset *set);
+int pgn_read_batch(int max_games, XPVset *dups);
+PGNgame * pgn_batch_game(int num);
+char * pgn_batch_str(size_t offset);
+void pgn_batch_free(void);
+void pgn_stats(StatsMap *stats, int depth);
+
+// stats.c
+StatsMap * stats_new(void);
+void stats_free(StatsMap *map);
+StatsEntry * stats_entry(StatsMap *map, Bitmap key, unsigned move, bool create);
+void stats_add(StatsMap *map, Bitmap key, unsigned move, int result, int r);
+void stats_add_line(StatsMap *map, Bitmap *keys, unsigned short *moves, int num, int result, int r);
+void stats_merge(StatsMap *dst, StatsMap *src);
+int stats_count(StatsMap *map);
+unsigned stats_move(Move move);
+int stats_result(char *result);
+int stats_add_pv(StatsMap *map, char *pv, int result, int r, int depth);
+int stats_children(StatsMap *map, StatsEntry *children);
+void stats_add_counts(StatsMap *map, Bitmap key, unsigned move, int w, int b, int d, int o);
+void stats_clear(StatsMap *map);
+bool stats_save(StatsMap *map, char *fich, int depth);
+int stats_load(StatsMap *map, char *fich);
+
+// pgnimport.c
+PGNimport * pgnimport_new(char **files, int nfiles, int nworkers, int depth, int stats_depth);
+void pgnimport_free(PGNimport *imp);
+int pgnimport_next(PGNimport *imp, XPVset *dups);
+PGNgame * pgnimport_game(PGNimport *imp, int num);
+char * pgnimport_str(PGNimport *imp, size_t offset);
+int pgnimport_file(PGNimport *imp);
+unsigned long long pgnimport_done(PGNimport *imp);
+unsigned long long pgnimport_total(PGNimport *imp);
+StatsMap * pgnimport_stats(PGNimport *imp);
+
+// polyglot.c
+Bitmap polyglot_key(void);
+Bitmap polyglot_key_fen(char *fen);
+PolyglotBook * polyglot_open(char *fich);
+void polyglot_close(PolyglotBook *book);
+int polyglot_size(PolyglotBook *book);
+int polyglot_probe(PolyglotBook *book, Bitmap key, PolyglotEntry *entries, int max);
+
+// uciengine.c
+UCIengine * uci_engine_open(char *dir, char **args, int nargs);
+void uci_engine_close(UCIengine *e);
+int uci_engine_pid(UCIengine *e);
+bool uci_engine_put(UCIengine *e, char *line);
+void uci_engine_set_raw(UCIengine *e, bool raw);
+int uci_engine_read(UCIengine *e);
+bool uci_engine_pending(UCIengine *e);
+int uci_engine_lines(UCIengine *e, char *dst, int size);
+int uci_engine_infos(UCIengine *e, UCIinfo *dst, int max);
+void uci_engine_clear(UCIengine *e);
+int uci_engines_wait(int ms);
+
+// ancache.c
+AnCache * ancache_open(char *name);
+void ancache_close(AnCache *c);
+unsigned ancache_engine_id(char *name);
+int ancache_size(AnCache *c);
+bool ancache_probe(AnCache *c, Bitmap key, unsigned engine, int *depth, int *time);
+int ancache_get(AnCache *c, Bitmap key, unsigned engine, UCIinfo *lines, int max);
+bool ancache_put(AnCache *c, Bitmap key, unsigned engine, UCIinfo *lines, int n);
+bool ancache_compact(AnCache *c);
+
+// xpv.c
+int pv_to_xpv(char *pv, char *xpv, int size);
+int xpv_to_pv(char *xpv, char *pv, int size);
+int mvx_encode(char *fen, char *pv, char *mvx, int size);
+int mvx_decode(char *fen, char *mvx, char *pv, int size);
+int pv_codec_list(int codec, char **src, char **dst, int *sizes, int num);
+bool xpv_make_move(char **xpv, Move *move);
+bool mvx_make_move(char **mvx, Move *move);
+
+// posindex.c
+Bitmap posindex_material_fen(char *fen);
+PosIndex * posindex_open(char *name);
+void posindex_close(PosIndex *x);
+int posindex_maxply(PosIndex *x);
+unsigned posindex_maxrowid(PosIndex *x);
+int posindex_games(PosIndex *x);
+int posindex_find(PosIndex *x, int kind, Bitmap key, unsigned *rowids, int max);
+PosIndexBuilder * posindex_builder_new(char *name, int maxply, bool update, bool mvx);
+void posindex_builder_free(PosIndexBuilder *b);
+unsigned posindex_builder_maxrowid(PosIndexBuilder *b);
+bool posindex_builder_add(PosIndexBuilder *b, unsigned rowid, char *xpv);
+bool posindex_builder_finish(PosIndexBuilder *b);
+
+// gamequery.c
+GameQuery * gamequery_new(char *expr, int minplies, bool mvx, char *error, int size);
+void gamequery_free(GameQuery *q);
+int gamequery_match(GameQuery *q, char *xpv);
+void gamequery_run(GameQuery *q, int nworkers, char **xpvs, int num, int *plies);
+
+// ctx.c
+LCContext * lc_ctx_new(void);
+void lc_ctx_free(LCContext *ctx);
+void lc_init_board(LCContext *ctx);
+void lc_fen_board(LCContext *ctx, char *fen);
+char * lc_board_fen(LCContext *ctx, char *fen);
+int lc_movegen(LCContext *ctx);
+int lc_pgn2pv(LCContext *ctx, char *pgn, char *pv);
+int lc_make_nummove(LCContext *ctx, int num);
+char * lc_playFen(LCContext *ctx, char *fen, int depth, int time);
+int lc_numMoves(LCContext *ctx);
+void lc_getMove(LCContext *ctx, int num, char *pv);
+int lc_numBaseMove(LCContext *ctx);
+int lc_searchMove(LCContext *ctx, char *desde, char *hasta, char *promotion);
+void lc_getMoveEx(LCContext *ctx, int num, char *info);
+char * lc_toSan(LCContext *ctx, int num, char *sanMove);
+int lc_move_list(LCContext *ctx, MoveInfo *li);
+int lc_line_info(LCContext *ctx, char *pv, MoveInfo *li, int max);
+int lc_mvx_encode(LCContext *ctx, char *fen, char *pv, char *mvx, int size);
+int lc_mvx_decode(LCContext *ctx, char *fen, char *mvx, char *pv, int size);
+char lc_inCheck(LCContext *ctx);
+void lc_set_level(LCContext *ctx, int lv);
+void lc_pgn_start(LCContext *ctx, char *fich, int depth);
+void lc_pgn_stop(LCContext *ctx);
+int lc_pgn_read(LCContext *ctx);
+char * lc_pgn_game(LCContext *ctx);
+char * lc_pgn_pv(LCContext *ctx);
+int lc_pgn_numlabels(LCContext *ctx);
+char * lc_pgn_label(LCContext *ctx, int num);
+char * lc_pgn_value(LCContext *ctx, int num);
+int lc_pgn_raw(LCContext *ctx);
+int lc_pgn_numfens(LCContext *ctx);
+char * lc_pgn_fen(LCContext *ctx, int num);
+char * lc_pgn_xpv(LCContext *ctx);
+int lc_pgn_plies(LCContext *ctx);
+int lc_pgn_read_batch(LCContext *ctx, int max_games, XPVset *dups);
+PGNgame * lc_pgn_batch_game(LCContext *ctx, int num);
+char * lc_pgn_batch_str(LCContext *ctx, size_t offset);
+int lc_pgn_range(LCContext *ctx, unsigned long long start, unsigned long long end);
+void lc_pgn_stats(LCContext *ctx, StatsMap *stats, int depth);
+int lc_stats_add_pv(LCContext *ctx, StatsMap *map, char *pv, int result, int r, int depth);
+int lc_stats_children(LCContext *ctx, StatsMap *map, StatsEntry *children);
+unsigned long long lc_board_hashkey(LCContext *ctx);
+unsigned long long lc_polyglot_key(LCContext *ctx);
+int lc_gamequery_match(LCContext *ctx, GameQuery *q, char *xpv);
 
 #endif
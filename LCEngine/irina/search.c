@@ -7,34 +7,57 @@
 #include "globals.h"
 #include "hash.h"
 
-bool ok_time_kb;
-Bitmap time_ini;
-Bitmap time_end;
-Bitmap time_last;
+TLS bool ok_time_kb;
+TLS Bitmap time_ini;
+TLS Bitmap time_end;
+TLS Bitmap time_last;
 
-int xxx;
+TLS int xxx;
 #define TEST_KEY_TIME    32543*2
 #define MSG_INTERVAL     1800
 
-int working_depth;
+TLS int working_depth;
 
-int triangularLength[MAX_PLY];
-Move triangularArray[MAX_PLY][MAX_PLY];
+TLS int triangularLength[MAX_PLY];
+TLS Move triangularArray[MAX_PLY][MAX_PLY];
 
-typedef struct MoveOrder {
-    Move move;
-    int score;
-} MoveOrder;
-MoveOrder moveOrder[MAX_PLY];
-int maxMoveOrder;
+// Move ordering: hash move, captures by MVV-LVA, killers, history of the quiet moves
+#define ORDER_HASH      (1 << 30)
+#define ORDER_CAPTURE   (1 << 24)
+#define ORDER_KILLER1   (1 << 23)
+#define ORDER_KILLER2   (1 << 22)
+
+TLS int moveScore[MAX_MOVES];
+TLS Move killers[MAX_PLY][2];
+TLS int history[16][64];
+
+static const int MVV_LVA_VALUE[8] = { 0, 1, 6, 2, 0, 3, 4, 5 };   // by piece & 7, king the last one
 
 int alphaBetaFast(int alpha, int beta, int depth, int ply);
 
-void orderMoves( int ply );
-void orderMovesO( );
-void quick_sort(int low, int high);
+void orderMoves( int ply, Move hashmove );
+Move pickMove( unsigned k, unsigned hasta );
+void ageHistory( void );
+
+TLS char bestmove[6];
+
+#define SAME_MOVE(a, b)     ((a).from == (b).from && (a).to == (b).to && (a).promotion == (b).promotion)
+#define NO_MOVE(a)          ((a).from == (a).to)
 
-char bestmove[6];
+// mate scores are stored relative to the position, not to the root
+static int value_to_hash(int val, int ply)
+{
+    if( val > 9000 ) return val + ply / 2;
+    if( val < -9000 ) return val - ply / 2;
+    return val;
+}
+
+static int value_from_hash(int val, int ply)
+{
+    if( val > 9000 ) return val - ply / 2;
+    if( val < -9000 ) return val + ply / 2;
+    return val;
+}
 
 char * play(int depth, int time) {
     int score;
@@ -50,6 +73,9 @@ char * play(int depth, int time) {
     if (depth<=0) depth = 120;
 
     board_reset();
+    hash_new_search();
+    memset(killers, 0, sizeof (killers));
+    memset(history, 0, sizeof (history));
 
     for (working_depth = 1; working_depth <= depth && ok_time_kb; working_depth++) {
         memset(triangularLength, 0, sizeof (triangularLength));
@@ -83,8 +109,9 @@ int noMovesScore(int ply) {
 }
 
 int quiescence(int alpha, int beta, int ply) {
-    unsigned k, j;
+    unsigned k, j, hasta;
     int score;
+    Move move, nomove = {0};
 
     triangularLength[ply] = ply;
 /*    if (inCheck()) {
@@ -100,8 +127,11 @@ int quiescence(int alpha, int beta, int ply) {
     }
 
     movegenCaptures();
-    for (k = board.ply_moves[ply]; k < board.ply_moves[ply + 1] && ok_time_kb; k++) {
-        make_move(board.moves[k]);
+    hasta = board.ply_moves[ply + 1];
+    orderMoves(ply, nomove);
+    for (k = board.ply_moves[ply]; k < hasta && ok_time_kb; k++) {
+        move = pickMove(k, hasta);
+        make_move(move);
         inodes++;
         score = -quiescence(-beta, -alpha, ply + 1);
         unmake_move();
@@ -110,7 +140,7 @@ int quiescence(int alpha, int beta, int ply) {
         }
         if (score > alpha) {
             alpha = score;
-            triangularArray[ply][ply] = board.moves[k];
+            triangularArray[ply][ply] = move;
             for (j = ply + 1; j < triangularLength[ply + 1]; j++) {
                 triangularArray[ply][j] = triangularArray[ply + 1][j];
             }
@@ -121,11 +151,12 @@ int quiescence(int alpha, int beta, int ply) {
 }
 
 int alphaBeta(int alpha, int beta, int depth, int ply) {
-    int score;
+    int score, alpha_ini;
     int desde, hasta;
     unsigned k, j;
     Bitmap ms;
-    Move move;
+    Move move, bestmv = {0}, hashmove = {0};
+    HASH_reg *reg;
 
     if (--xxx == 0) {
         ms = get_ms();
@@ -139,23 +170,54 @@ int alphaBeta(int alpha, int beta, int depth, int ply) {
         return score;
     }
 
+    reg = hash_probe();
+    if (reg) {
+        hashmove = reg->move;
+        // the root always searches, it has to give a move
+        if (ply && reg->depth >= depth) {
+            score = value_from_hash(reg->val, ply);
+            if ((reg->flags == HASH_EXACT) ||
+                (reg->flags == HASH_BETA && score >= beta) ||
+                (reg->flags == HASH_ALPHA && score <= alpha)) {
+                triangularLength[ply] = ply;
+                if (score >= beta) return beta;
+                if (score <= alpha) return alpha;
+                triangularArray[ply][ply] = hashmove;
+                triangularLength[ply] = ply + 1;
+                return score;
+            }
+        }
+    }
+
     if (!movegen()) {
         return noMovesScore(ply);
     }
+    alpha_ini = alpha;
     desde = board.ply_moves[ply];
     hasta = board.ply_moves[ply + 1];
-    orderMoves(ply);
+    orderMoves(ply, hashmove);
     for (k = desde; k < hasta && ok_time_kb; k++) {
-        move = board.moves[k];
+        move = pickMove(k, hasta);
         make_move(move);
         inodes++;
         score = -alphaBeta(-beta, -alpha, depth - 1, ply + 1);
         unmake_move();
         if (score >= beta) {
+            if (!ok_time_kb) return beta;
+            if (!move.capture && !move.promotion) {
+                if (!SAME_MOVE(killers[ply][0], move)) {
+                    killers[ply][1] = killers[ply][0];
+                    killers[ply][0] = move;
+                }
+                history[move.piece][move.to] += depth * depth;
+                if (history[move.piece][move.to] > ORDER_KILLER2) ageHistory();
+            }
+            hash_store(depth, value_to_hash(beta, ply), HASH_BETA, move);
             return beta;
         }
         if (score > alpha) {
             alpha = score; // both sides want to maximize from *their* perspective
+            bestmv = move;
             triangularArray[ply][ply] = move; // save this move
             for (j = ply + 1; j < triangularLength[ply + 1]; j++) {
                 triangularArray[ply][j] = triangularArray[ply + 1][j]; // and append the latest best PV from deeper plies
@@ -163,6 +225,9 @@ int alphaBeta(int alpha, int beta, int depth, int ply) {
             triangularLength[ply] = triangularLength[ply + 1];
         }
     }
+    if (ok_time_kb) {
+        hash_store(depth, value_to_hash(alpha, ply), alpha > alpha_ini ? HASH_EXACT : HASH_ALPHA, bestmv);
+    }
     return alpha;
 }
 
@@ -171,7 +236,7 @@ int alphaBetaFast(int alpha, int beta, int depth, int ply) {
     int desde, hasta;
     unsigned k, j;
     Bitmap ms;
-    Move move;
+    Move move, nomove = {0};
 
     if (--xxx == 0) {
         ms = get_ms();
@@ -189,9 +254,9 @@ int alphaBetaFast(int alpha, int beta, int depth, int ply) {
     }
     desde = board.ply_moves[ply];
     hasta = board.ply_moves[ply + 1];
-    orderMoves(ply);
+    orderMoves(ply, nomove);
     for (k = desde; k < hasta && ok_time_kb; k++) {
-        move = board.moves[k];
+        move = pickMove(k, hasta);
         make_move(move);
         inodes++;
         score = -alphaBetaFast(-beta, -alpha, depth - 1, ply + 1);
@@ -212,50 +277,58 @@ int alphaBetaFast(int alpha, int beta, int depth, int ply) {
 }
 
 
-void orderMoves( int ply )
+// scores of the moves of ply, without making them
+void orderMoves( int ply, Move hashmove )
 {
-    unsigned k, i, n;
+    unsigned k;
+    int score;
+    Move move;
 
-    for (i = 0, n = 0, k = board.ply_moves[ply]; k < board.ply_moves[ply + 1]; k++, i++) {
-        moveOrder[i].move = board.moves[k];
-        n++;
-        make_move(board.moves[k]);
-        moveOrder[i].score = eval();
-        unmake_move();
-    }
-    quick_sort( 0, n-1);
-    for (i = 0, k = board.ply_moves[ply]; i < n; k++, i++) {
-         board.moves[k] = moveOrder[i].move;
+    for (k = board.ply_moves[ply]; k < board.ply_moves[ply + 1]; k++) {
+        move = board.moves[k];
+        if (!NO_MOVE(hashmove) && SAME_MOVE(move, hashmove)) {
+            score = ORDER_HASH;
+        } else if (move.capture || move.promotion) {
+            score = ORDER_CAPTURE + MVV_LVA_VALUE[move.capture & 7] * 16 - MVV_LVA_VALUE[move.piece & 7];
+            if (move.promotion) score += MVV_LVA_VALUE[move.promotion & 7] * 16;
+        } else if (SAME_MOVE(move, killers[ply][0])) {
+            score = ORDER_KILLER1;
+        } else if (SAME_MOVE(move, killers[ply][1])) {
+            score = ORDER_KILLER2;
+        } else {
+            score = history[move.piece][move.to];
+        }
+        moveScore[k] = score;
     }
 }
 
-
-void quick_sort(int low, int high)
+void ageHistory( void )
 {
-    int pivot,j,i;
-    MoveOrder temp;
-
-    if( low < high ) {
-        pivot = low;
-        i = low;
-        j = high;
+    int i, j;
 
-        while( i < j ) {
-            while( (moveOrder[i].score <= moveOrder[pivot].score) && (i<high) ) i++;
-
-            while(moveOrder[j].score>moveOrder[pivot].score) j--;
+    for (i = 0; i < 16; i++) {
+        for (j = 0; j < 64; j++) history[i][j] /= 2;
+    }
+}
 
-            if(i<j) {
-                temp=moveOrder[i];
-                moveOrder[i]=moveOrder[j];
-                moveOrder[j]=temp;
-            }
-        }
+// best of the moves k..hasta-1 is moved to k, most nodes are cut after the first moves
+Move pickMove( unsigned k, unsigned hasta )
+{
+    unsigned i, best;
+    int score;
+    Move move;
 
-        temp=moveOrder[pivot];
-        moveOrder[pivot]=moveOrder[j];
-        moveOrder[j]=temp;
-        quick_sort(low,j-1);
-        quick_sort(j+1,high);
+    best = k;
+    for (i = k + 1; i < hasta; i++) {
+        if (moveScore[i] > moveScore[best]) best = i;
+    }
+    if (best != k) {
+        move = board.moves[k];
+        board.moves[k] = board.moves[best];
+        board.moves[best] = move;
+        score = moveScore[k];
+        moveScore[k] = moveScore[best];
+        moveScore[best] = score;
     }
+    return board.moves[k];
 }
@@ -0,0 +1,410 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "defs.h"
+#include "protos.h"
+#include "globals.h"
+
+/*
+ * Position statistics: W/B/D/O counters of each (position, move), the position given by its
+ * zobrist key before the move, the move in the LCEngine4.move2num encoding.
+ * Open addressing with linear probing, move 0 (a1a1) marks an empty slot.
+ */
+
+
+static unsigned stats_slot(Bitmap key, unsigned move, unsigned mask)
+{
+    Bitmap h = key ^ ((Bitmap) move * 0x9e3779b97f4a7c15ULL);
+    h ^= h >> 29;
+    return (unsigned) h & mask;
+}
+
+StatsMap * stats_new(void)
+{
+    StatsMap *map;
+
+    map = (StatsMap *) malloc(sizeof(StatsMap));
+    if( !map ) return NULL;
+    map->size = 1 << 16;
+    map->count = 0;
+    map->entries = (StatsEntry *) calloc(map->size, sizeof(StatsEntry));
+    if( !map->entries )
+    {
+        free(map);
+        return NULL;
+    }
+    return map;
+}
+
+void stats_free(StatsMap *map)
+{
+    if( !map ) return;
+    free(map->entries);
+    free(map);
+}
+
+static StatsEntry * stats_find(StatsEntry *entries, unsigned size, Bitmap key, unsigned move)
+{
+    unsigned pos, mask;
+    StatsEntry *e;
+
+    mask = size - 1;
+    for( pos = stats_slot(key, move, mask); ; pos = (pos + 1) & mask )
+    {
+        e = &entries[pos];
+        if( !e->move || (e->key == key && e->move == move) ) return e;
+    }
+}
+
+static void stats_grow(StatsMap *map)
+{
+    StatsEntry *entries, *e;
+    unsigned i, size;
+
+    size = map->size * 2;
+    entries = (StatsEntry *) calloc(size, sizeof(StatsEntry));
+    if( !entries ) return;
+    for( i = 0; i < map->size; i++ )
+    {
+        e = &map->entries[i];
+        if( e->move ) *stats_find(entries, size, e->key, e->move) = *e;
+    }
+    free(map->entries);
+    map->entries = entries;
+    map->size = size;
+}
+
+// NULL if the entry doesn't exist and create is false
+StatsEntry * stats_entry(StatsMap *map, Bitmap key, unsigned move, bool create)
+{
+    StatsEntry *e;
+
+    if( create && (map->count + 1) * 4 >= map->size * 3 ) stats_grow(map);
+    e = stats_find(map->entries, map->size, key, move);
+    if( !e->move )
+    {
+        if( !create ) return NULL;
+        e->key = key;
+        e->move = move;
+        map->count++;
+    }
+    return e;
+}
+
+void stats_add(StatsMap *map, Bitmap key, unsigned move, int result, int r)
+{
+    StatsEntry *e;
+
+    e = stats_entry(map, key, move, true);
+    switch( result )
+    {
+    case RESULT_WHITE: e->w += r; break;
+    case RESULT_BLACK: e->b += r; break;
+    case RESULT_DRAW:  e->d += r; break;
+    default:           e->o += r; break;
+    }
+}
+
+void stats_add_line(StatsMap *map, Bitmap *keys, unsigned short *moves, int num, int result, int r)
+{
+    int i;
+    for( i = 0; i < num; i++ ) stats_add(map, keys[i], moves[i], result, r);
+}
+
+void stats_merge(StatsMap *dst, StatsMap *src)
+{
+    StatsEntry *e, *d;
+    unsigned i;
+
+    for( i = 0; i < src->size; i++ )
+    {
+        e = &src->entries[i];
+        if( !e->move ) continue;
+        d = stats_entry(dst, e->key, e->move, true);
+        d->w += e->w;
+        d->b += e->b;
+        d->d += e->d;
+        d->o += e->o;
+    }
+}
+
+int stats_count(StatsMap *map)
+{
+    return (int) map->count;
+}
+
+unsigned stats_move(Move move)
+{
+    unsigned num;
+
+    num = move.from + move.to * 64;
+    switch( move.promotion )
+    {
+    case WHITE_QUEEN:  case BLACK_QUEEN:  num += 1 * 64 * 64; break;
+    case WHITE_ROOK:   case BLACK_ROOK:   num += 2 * 64 * 64; break;
+    case WHITE_BISHOP: case BLACK_BISHOP: num += 3 * 64 * 64; break;
+    case WHITE_KNIGHT: case BLACK_KNIGHT: num += 4 * 64 * 64; break;
+    }
+    return num;
+}
+
+int stats_result(char *result)
+{
+    if( !strcmp(result, "1-0") ) return RESULT_WHITE;
+    if( !strcmp(result, "0-1") ) return RESULT_BLACK;
+    if( !strcmp(result, "1/2-1/2") ) return RESULT_DRAW;
+    return RESULT_OTHER;
+}
+
+/*
+ * Adds the first depth moves of pv (a1h8 format, from the initial position) to the stats.
+ * Returns the number of moves added.
+ */
+int stats_add_pv(StatsMap *map, char *pv, int result, int r, int depth)
+{
+    int num, k;
+    Move move;
+
+    init_board();
+    movegen();
+    num = 0;
+    while( num < depth && (k = pv_nummove(&pv)) >= 0 )
+    {
+        move = board.moves[k];
+        stats_add(map, board.hashkey, stats_move(move), result, r);
+        make_move(move);
+        movegen();
+        num++;
+    }
+    return num;
+}
+
+/*
+ * Stats of every legal move of the current board, in movegen order, 0 counters when absent.
+ * children must have room for 256 entries. Returns the number of moves.
+ */
+int stats_children(StatsMap *map, StatsEntry *children)
+{
+    StatsEntry *e;
+    unsigned k;
+    int n;
+    Move move;
+
+    board.idx_moves = board.ply_moves[board.ply - 1];
+    movegen();
+    n = 0;
+    for( k = board.ply_moves[board.ply - 1]; k < board.ply_moves[board.ply]; k++ )
+    {
+        move = board.moves[k];
+        e = stats_entry(map, board.hashkey, stats_move(move), false);
+        if( e ) children[n] = *e;
+        else
+        {
+            memset(&children[n], 0, sizeof(StatsEntry));
+            children[n].key = board.hashkey;
+            children[n].move = stats_move(move);
+        }
+        n++;
+    }
+    return n;
+}
+
+void stats_add_counts(StatsMap *map, Bitmap key, unsigned move, int w, int b, int d, int o)
+{
+    StatsEntry *e;
+
+    e = stats_entry(map, key, move, true);
+    e->w += w;
+    e->b += b;
+    e->d += d;
+    e->o += o;
+}
+
+void stats_clear(StatsMap *map)
+{
+    memset(map->entries, 0, map->size * sizeof(StatsEntry));
+    map->count = 0;
+}
+
+
+// ---------------------------------------------------------------------------------------------
+// File
+//
+// "LCSTATS1", depth, number of positions, then for each position, sorted by key:
+//      key (8 bytes little endian), number of moves, and for each move: move, w, b, d, o
+// every number but the keys is a varint, the counters zigzag encoded.
+// ---------------------------------------------------------------------------------------------
+
+#define STATS_MAGIC     "LCSTATS1"
+
+static int cmp_entries(const void *a, const void *b)
+{
+    const StatsEntry *ea = (const StatsEntry *) a;
+    const StatsEntry *eb = (const StatsEntry *) b;
+
+    if( ea->key != eb->key ) return ea->key < eb->key ? -1 : 1;
+    return (int) ea->move - (int) eb->move;
+}
+
+static void put_varint(FILE *f, unsigned v)
+{
+    while( v >= 0x80 )
+    {
+        fputc((int) (v & 0x7f) | 0x80, f);
+        v >>= 7;
+    }
+    fputc((int) v, f);
+}
+
+static void put_counter(FILE *f, int v)
+{
+    put_varint(f, ((unsigned) v << 1) ^ (unsigned) (v >> 31));
+}
+
+static bool get_varint(unsigned char **c, unsigned char *end, unsigned *v)
+{
+    int shift = 0;
+
+    *v = 0;
+    while( *c < end && shift < 35 )
+    {
+        *v |= (unsigned) (**c & 0x7f) << shift;
+        if( !(*(*c)++ & 0x80) ) return true;
+        shift += 7;
+    }
+    return false;
+}
+
+static bool get_counter(unsigned char **c, unsigned char *end, int *v)
+{
+    unsigned u;
+
+    if( !get_varint(c, end, &u) ) return false;
+    *v = (int) (u >> 1) ^ -(int) (u & 1);
+    return true;
+}
+
+/*
+ * Saves the stats, entries without games are dropped.
+ * The file is written aside and renamed, a crash doesn't leave a broken file.
+ */
+bool stats_save(StatsMap *map, char *fich, int depth)
+{
+    StatsEntry *li, *e;
+    unsigned i, n, j, nkeys;
+    char *tmp;
+    FILE *f;
+    int k;
+
+    li = (StatsEntry *) malloc((map->count + 1) * sizeof(StatsEntry));
+    tmp = (char *) malloc(strlen(fich) + 5);
+    if( !li || !tmp )
+    {
+        free(li);
+        free(tmp);
+        return false;
+    }
+    n = 0;
+    for( i = 0; i < map->size; i++ )
+    {
+        e = &map->entries[i];
+        if( e->move && (e->w || e->b || e->d || e->o) ) li[n++] = *e;
+    }
+    qsort(li, n, sizeof(StatsEntry), cmp_entries);
+
+    nkeys = 0;
+    for( i = 0; i < n; i++ )
+    {
+        if( !i || li[i].key != li[i-1].key ) nkeys++;
+    }
+
+    sprintf(tmp, "%s.tmp", fich);
+    f = fopen(tmp, "wb");
+    if( !f )
+    {
+        free(li);
+        free(tmp);
+        return false;
+    }
+    fwrite(STATS_MAGIC, 1, 8, f);
+    put_varint(f, (unsigned) depth);
+    put_varint(f, nkeys);
+    for( i = 0; i < n; i = j )
+    {
+        for( j = i; j < n && li[j].key == li[i].key; j++ );
+        for( k = 0; k < 8; k++ ) fputc((int) ((li[i].key >> (8*k)) & 0xff), f);
+        put_varint(f, j - i);
+        for( e = &li[i]; e < &li[j]; e++ )
+        {
+            put_varint(f, e->move);
+            put_counter(f, e->w);
+            put_counter(f, e->b);
+            put_counter(f, e->d);
+            put_counter(f, e->o);
+        }
+    }
+    free(li);
+    if( fclose(f) )
+    {
+        remove(tmp);
+        free(tmp);
+        return false;
+    }
+    i = replace_file(tmp, fich);
+    if( !i ) remove(tmp);
+    free(tmp);
+    return i;
+}
+
+/*
+ * Adds the stats of fich to map.
+ * Returns the depth of the file, -1 if it can't be read or it isn't a stats file.
+ */
+int stats_load(StatsMap *map, char *fich)
+{
+    FILE *f;
+    long size;
+    unsigned char *buf, *c, *end;
+    unsigned depth, nkeys, nmoves, move, i, j;
+    int w, b, d, o, k;
+    Bitmap key;
+    bool ok;
+
+    f = fopen(fich, "rb");
+    if( !f ) return -1;
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    rewind(f);
+    buf = (unsigned char *) malloc(size > 0 ? size : 1);
+    if( !buf || size < 8 || fread(buf, 1, size, f) != (size_t) size || memcmp(buf, STATS_MAGIC, 8) )
+    {
+        fclose(f);
+        free(buf);
+        return -1;
+    }
+    fclose(f);
+
+    c = buf + 8;
+    end = buf + size;
+    ok = get_varint(&c, end, &depth) && get_varint(&c, end, &nkeys);
+    for( i = 0; ok && i < nkeys; i++ )
+    {
+        if( end - c < 8 )
+        {
+            ok = false;
+            break;
+        }
+        key = 0;
+        for( k = 0; k < 8; k++ ) key |= (Bitmap) *c++ << (8*k);
+        ok = get_varint(&c, end, &nmoves);
+        for( j = 0; ok && j < nmoves; j++ )
+        {
+            ok = get_varint(&c, end, &move) && move &&
+                 get_counter(&c, end, &w) && get_counter(&c, end, &b) &&
+                 get_counter(&c, end, &d) && get_counter(&c, end, &o);
+            if( ok ) stats_add_counts(map, key, move, w, b, d, o);
+        }
+    }
+    free(buf);
+    return ok ? (int) depth : -1;
+}
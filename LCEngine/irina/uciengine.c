@@ -0,0 +1,810 @@
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#if defined(__linux__)
+#include <sys/epoll.h>
+#endif
+#endif
+
+#include "defs.h"
+#include "protos.h"
+
+/*
+ * UCI engines driven by the GUI.
+ *
+ * Each engine is a child process with its stdin/stdout connected to pipes owned here. The output
+ * of the engines is read without blocking, split in lines, and the "info" lines are parsed into
+ * UCIinfo records: the GUI gets the records, and as text only the other lines (id, option,
+ * readyok, bestmove, info string...). An info that only updates the last record of the same
+ * multipv and depth replaces it, the GUI sees the last state of each depth instead of every line.
+ *
+ * uci_engines_wait sleeps until any engine has something to read (epoll on Linux, poll on other
+ * posix systems, pipe peeking on Windows) and reads it.
+ *
+ * In raw mode (engine logs) every line is passed as text, without parsing. The lines saved for the
+ * brilliancies don't need it, the GUI rebuilds them from the records.
+ */
+
+#define UCI_MAX_ENGINES     256
+#define UCI_READ            65536
+
+#if defined(_WIN32)
+typedef CRITICAL_SECTION    UCImutex;
+#define mutex_lock(m)       EnterCriticalSection(m)
+#define mutex_unlock(m)     LeaveCriticalSection(m)
+#else
+typedef pthread_mutex_t     UCImutex;
+#define mutex_lock(m)       pthread_mutex_lock(m)
+#define mutex_unlock(m)     pthread_mutex_unlock(m)
+#endif
+
+struct UCIengine
+{
+    int         id;         // slot in engines[]
+#if defined(_WIN32)
+    HANDLE      process;
+    HANDLE      hread;      // engine stdout
+    HANDLE      hwrite;     // engine stdin
+    DWORD       pid;
+#else
+    pid_t       pid;
+    int         fdread;
+    int         fdwrite;
+#endif
+    bool        eof;
+    bool        raw;
+
+    char        *buf;       // last line, incomplete
+    int         buflen;
+    int         bufsize;
+
+    char        *lines;     // text lines for the GUI, '\n' terminated
+    int         lineslen;
+    int         linessize;
+
+    UCIinfo     *infos;
+    int         ninfos;
+    int         sizeinfos;
+};
+
+static UCIengine *engines[UCI_MAX_ENGINES];
+static int nengines = 0;
+static bool engines_init = false;
+static UCImutex engines_mutex;
+#if defined(__linux__)
+static int epoll_fd = -1;
+#endif
+
+static void init_engines(void)
+{
+    // first call comes from the GUI thread, before any wait
+    if( engines_init ) return;
+#if defined(_WIN32)
+    InitializeCriticalSection(&engines_mutex);
+#else
+    pthread_mutex_init(&engines_mutex, NULL);
+#endif
+#if defined(__linux__)
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+#endif
+    engines_init = true;
+}
+
+static bool grow(void **ptr, int *size, int need, int item)
+{
+    void *p;
+    int n;
+
+    if( need <= *size ) return true;
+    n = *size ? *size : 16;
+    while( n < need ) n *= 2;
+    p = realloc(*ptr, (size_t) n * item);
+    if( !p ) return false;
+    *ptr = p;
+    *size = n;
+    return true;
+}
+
+static void add_line(UCIengine *e, char *line, int len)
+{
+    if( !grow((void **) &e->lines, &e->linessize, e->lineslen + len + 1, 1) ) return;
+    memcpy(e->lines + e->lineslen, line, len);
+    e->lineslen += len;
+    e->lines[e->lineslen++] = '\n';
+}
+
+static void add_info(UCIengine *e, UCIinfo *info)
+{
+    int i;
+    UCIinfo *last;
+
+    // the last record of the same multipv, replaced if it is the same depth and kind
+    for( i = e->ninfos - 1; i >= 0; i-- )
+    {
+        last = &e->infos[i];
+        if( ((last->fields ^ info->fields) & UCI_MULTIPV) == 0 && last->multipv == info->multipv )
+        {
+            if( last->depth == info->depth && ((last->fields ^ info->fields) & (UCI_DEPTH | UCI_PV)) == 0 )
+            {
+                *last = *info;
+                return;
+            }
+            break;
+        }
+    }
+    if( !grow((void **) &e->infos, &e->sizeinfos, e->ninfos + 1, sizeof(UCIinfo)) ) return;
+    e->infos[e->ninfos++] = *info;
+}
+
+static bool is_keyword(char *word)
+{
+    static const char *keywords[] = { "multipv", "depth", "seldepth", "score", "time", "nodes", "pv",
+                                      "hashfull", "tbhits", "nps", "currmove", "currmovenumber",
+                                      "cpuload", "string", "refutation", "currline", NULL };
+    int i;
+
+    for( i = 0; keywords[i]; i++ )
+    {
+        if( strcmp(word, keywords[i]) == 0 ) return true;
+    }
+    return false;
+}
+
+// false: the line goes to the GUI as text
+static bool parse_info(UCIengine *e, char *line)
+{
+    UCIinfo info;
+    char *words[512];
+    int nwords, i, len;
+    char *p;
+
+    nwords = 0;
+    for( p = strtok(line + 5, " \t"); p && nwords < 512; p = strtok(NULL, " \t") ) words[nwords++] = p;
+    if( nwords == 512 ) return false;
+
+    memset(&info, 0, sizeof(info));
+    for( i = 0; i < nwords; i++ )
+    {
+        p = words[i];
+        if( strcmp(p, "string") == 0 ) return false;
+        if( strcmp(p, "lowerbound") == 0 || strcmp(p, "upperbound") == 0 ) return true;  // ignored
+        if( i + 1 >= nwords ) break;
+
+        if( strcmp(p, "depth") == 0 )
+        {
+            info.depth = atoi(words[++i]);
+            info.fields |= UCI_DEPTH;
+        }
+        else if( strcmp(p, "seldepth") == 0 )
+        {
+            info.seldepth = atoi(words[++i]);
+            info.fields |= UCI_SELDEPTH;
+        }
+        else if( strcmp(p, "multipv") == 0 )
+        {
+            info.multipv = atoi(words[++i]);
+            info.fields |= UCI_MULTIPV;
+        }
+        else if( strcmp(p, "time") == 0 )
+        {
+            info.time = atoi(words[++i]);
+            info.fields |= UCI_TIME;
+        }
+        else if( strcmp(p, "nodes") == 0 )
+        {
+            info.nodes = strtoull(words[++i], NULL, 10);
+            info.fields |= UCI_NODES;
+        }
+        else if( strcmp(p, "nps") == 0 )
+        {
+            info.nps = strtoull(words[++i], NULL, 10);
+            info.fields |= UCI_NPS;
+        }
+        else if( strcmp(p, "score") == 0 )
+        {
+            if( i + 2 >= nwords ) break;
+            if( strcmp(words[i + 1], "mate") == 0 ) info.fields |= UCI_MATE;
+            else if( strcmp(words[i + 1], "cp") != 0 ) continue;
+            info.score = atoi(words[i + 2]);
+            info.fields |= UCI_SCORE;
+            i += 2;
+        }
+        else if( strcmp(p, "pv") == 0 )
+        {
+            // moves up to the next keyword
+            len = 0;
+            while( i + 1 < nwords && !is_keyword(words[i + 1]) )
+            {
+                p = words[++i];
+                if( len + (int) strlen(p) + 2 > UCI_PV_SIZE ) continue;
+                if( len ) info.pv[len++] = ' ';
+                strcpy(info.pv + len, p);
+                len += (int) strlen(p);
+            }
+            if( len ) info.fields |= UCI_PV;
+        }
+    }
+
+    if( info.fields & UCI_PV )
+    {
+        // the GUI drops these pvs (XMotorRespuesta.miraPV)
+        if( (info.fields & UCI_NODES) && info.nodes == 0 && !(info.fields & UCI_MATE) ) return true;
+        if( (info.fields & UCI_MATE) && info.score == 0 ) return true;
+    }
+    else if( !(info.fields & UCI_SCORE) ) return true;  // currmove, hashfull...
+
+    add_info(e, &info);
+    return true;
+}
+
+static void parse_line(UCIengine *e, char *line, int len)
+{
+    if( len && line[len - 1] == '\r' ) len--;
+    line[len] = '\0';
+    if( !e->raw && strncmp(line, "info ", 5) == 0 )
+    {
+        char copy[UCI_READ];
+
+        // strtok writes in the line, the original is needed as text
+        memcpy(copy, line, len + 1);
+        if( parse_info(e, copy) ) return;
+    }
+    add_line(e, line, len);
+}
+
+static void parse_buffer(UCIengine *e)
+{
+    char *p, *nl;
+    int rest;
+
+    p = e->buf;
+    rest = e->buflen;
+    while( rest > 0 && (nl = memchr(p, '\n', rest)) != NULL )
+    {
+        parse_line(e, p, (int) (nl - p));
+        rest -= (int) (nl - p) + 1;
+        p = nl + 1;
+    }
+    if( rest && p != e->buf ) memmove(e->buf, p, rest);
+    e->buflen = rest;
+    if( e->buflen >= UCI_READ - 1 )
+    {
+        // a line that doesn't fit, passed in pieces
+        add_line(e, e->buf, e->buflen);
+        e->buflen = 0;
+    }
+}
+
+static void set_eof(UCIengine *e)
+{
+    e->eof = true;
+#if defined(__linux__)
+    // a closed pipe would wake every epoll_wait
+    if( epoll_fd >= 0 ) epoll_ctl(epoll_fd, EPOLL_CTL_DEL, e->fdread, NULL);
+#endif
+}
+
+// reads all what the engine has sent, without waiting; with the mutex locked
+static int read_engine(UCIengine *e)
+{
+    int total, n;
+
+    total = 0;
+    while( !e->eof )
+    {
+        if( !grow((void **) &e->buf, &e->bufsize, UCI_READ + 1, 1) ) break;
+#if defined(_WIN32)
+        {
+            DWORD avail, nread;
+
+            if( !PeekNamedPipe(e->hread, NULL, 0, NULL, &avail, NULL) )
+            {
+                set_eof(e);
+                break;
+            }
+            if( avail == 0 ) break;
+            if( avail > (DWORD) (UCI_READ - e->buflen) ) avail = UCI_READ - e->buflen;
+            if( !ReadFile(e->hread, e->buf + e->buflen, avail, &nread, NULL) || nread == 0 )
+            {
+                set_eof(e);
+                break;
+            }
+            n = (int) nread;
+        }
+#else
+        n = (int) read(e->fdread, e->buf + e->buflen, UCI_READ - e->buflen);
+        if( n < 0 )
+        {
+            if( errno == EINTR ) continue;
+            if( errno != EAGAIN && errno != EWOULDBLOCK ) set_eof(e);
+            break;
+        }
+        if( n == 0 )
+        {
+            set_eof(e);
+            break;
+        }
+#endif
+        e->buflen += n;
+        total += n;
+        parse_buffer(e);
+    }
+    return total;
+}
+
+#if !defined(_WIN32)
+/*
+ * Path of the program name as execvp finds it, searched here because execvp is not async-signal-safe
+ * in the child of fork. A name with '/' and the relative directories of PATH are from dir, as the
+ * engine starts there. Allocated, name itself if it isn't found, NULL without memory.
+ */
+static char * find_program(char *dir, char *name)
+{
+    char *path, *sep, *prog, *test;
+    size_t len;
+
+    if( strchr(name, '/') ) return strdup(name);
+    path = getenv("PATH");
+    if( !path ) path = "/bin:/usr/bin";
+    prog = (char *) malloc(strlen(path) + strlen(name) + 2);
+    test = (char *) malloc((dir ? strlen(dir) : 0) + strlen(path) + strlen(name) + 3);
+    if( !prog || !test )
+    {
+        free(prog);
+        free(test);
+        return NULL;
+    }
+    for( ; ; path = sep + 1 )
+    {
+        sep = strchr(path, ':');
+        len = sep ? (size_t)(sep - path) : strlen(path);
+        // an empty entry is the current directory
+        if( len ) memcpy(prog, path, len);
+        else prog[len++] = '.';
+        prog[len] = '/';
+        strcpy(prog + len + 1, name);
+
+        test[0] = '\0';
+        if( dir && dir[0] && prog[0] != '/' )
+        {
+            strcpy(test, dir);
+            strcat(test, "/");
+        }
+        strcat(test, prog);
+        if( access(test, X_OK) == 0 )
+        {
+            free(test);
+            return prog;
+        }
+        if( !sep ) break;
+    }
+    free(test);
+    strcpy(prog, name);
+    return prog;
+}
+#endif
+
+/*
+ * args[0] is the program, dir the working directory of the engine (NULL: the current one).
+ * NULL if the process can't be started.
+ */
+UCIengine * uci_engine_open(char *dir, char **args, int nargs)
+{
+    UCIengine *e;
+    int id;
+
+    if( nargs < 1 ) return NULL;
+    init_engines();
+
+    e = (UCIengine *) calloc(1, sizeof(UCIengine));
+    if( !e ) return NULL;
+
+#if defined(_WIN32)
+    {
+        SECURITY_ATTRIBUTES sa;
+        STARTUPINFOA si;
+        PROCESS_INFORMATION pi;
+        HANDLE child_in, child_out;
+        char *cmd;
+        size_t size;
+        int i;
+
+        sa.nLength = sizeof(sa);
+        sa.bInheritHandle = TRUE;
+        sa.lpSecurityDescriptor = NULL;
+        if( !CreatePipe(&e->hread, &child_out, &sa, 0) )
+        {
+            free(e);
+            return NULL;
+        }
+        if( !CreatePipe(&child_in, &e->hwrite, &sa, 0) )
+        {
+            CloseHandle(e->hread);
+            CloseHandle(child_out);
+            free(e);
+            return NULL;
+        }
+        SetHandleInformation(e->hread, HANDLE_FLAG_INHERIT, 0);
+        SetHandleInformation(e->hwrite, HANDLE_FLAG_INHERIT, 0);
+
+        // command line, every argument quoted
+        size = 1;
+        for( i = 0; i < nargs; i++ ) size += strlen(args[i]) + 3;
+        cmd = (char *) malloc(size);
+        cmd[0] = '\0';
+        for( i = 0; i < nargs; i++ )
+        {
+            if( i ) strcat(cmd, " ");
+            strcat(cmd, "\"");
+            strcat(cmd, args[i]);
+            strcat(cmd, "\"");
+        }
+
+        memset(&si, 0, sizeof(si));
+        si.cb = sizeof(si);
+        si.dwFlags = STARTF_USESTDHANDLES | STARTF_USESHOWWINDOW;
+        si.wShowWindow = SW_HIDE;
+        si.hStdInput = child_in;
+        si.hStdOutput = child_out;
+        si.hStdError = GetStdHandle(STD_ERROR_HANDLE);
+        if( !CreateProcessA(NULL, cmd, NULL, NULL, TRUE, CREATE_NO_WINDOW, NULL, dir, &si, &pi) )
+        {
+            free(cmd);
+            CloseHandle(child_in);
+            CloseHandle(child_out);
+            CloseHandle(e->hread);
+            CloseHandle(e->hwrite);
+            free(e);
+            return NULL;
+        }
+        free(cmd);
+        CloseHandle(child_in);
+        CloseHandle(child_out);
+        CloseHandle(pi.hThread);
+        e->process = pi.hProcess;
+        e->pid = pi.dwProcessId;
+    }
+#else
+    {
+        int to_engine[2], from_engine[2];
+        char **argv, *prog;
+        int i;
+
+        prog = find_program(dir, args[0]);
+        if( !prog )
+        {
+            free(e);
+            return NULL;
+        }
+        if( pipe(to_engine) == -1 )
+        {
+            free(prog);
+            free(e);
+            return NULL;
+        }
+        if( pipe(from_engine) == -1 )
+        {
+            close(to_engine[0]);
+            close(to_engine[1]);
+            free(prog);
+            free(e);
+            return NULL;
+        }
+        for( i = 0; i < 2; i++ )
+        {
+            fcntl(to_engine[i], F_SETFD, FD_CLOEXEC);
+            fcntl(from_engine[i], F_SETFD, FD_CLOEXEC);
+        }
+        argv = (char **) malloc((nargs + 1) * sizeof(char *));
+        for( i = 0; i < nargs; i++ ) argv[i] = args[i];
+        argv[nargs] = NULL;
+
+        e->pid = fork();
+        if( e->pid == 0 )
+        {
+            // engine: only async-signal-safe calls until exec
+            dup2(to_engine[0], 0);
+            dup2(from_engine[1], 1);
+            if( dir && dir[0] && chdir(dir) == -1 ) _exit(127);
+            execv(prog, argv);
+            _exit(127);
+        }
+        free(argv);
+        free(prog);
+        close(to_engine[0]);
+        close(from_engine[1]);
+        if( e->pid < 0 )
+        {
+            close(to_engine[1]);
+            close(from_engine[0]);
+            free(e);
+            return NULL;
+        }
+        e->fdwrite = to_engine[1];
+        e->fdread = from_engine[0];
+        fcntl(e->fdread, F_SETFL, fcntl(e->fdread, F_GETFL) | O_NONBLOCK);
+    }
+#endif
+
+    mutex_lock(&engines_mutex);
+    for( id = 0; id < UCI_MAX_ENGINES && engines[id]; id++ );
+    if( id < UCI_MAX_ENGINES )
+    {
+        e->id = id;
+        engines[id] = e;
+        if( id >= nengines ) nengines = id + 1;
+#if defined(__linux__)
+        if( epoll_fd >= 0 )
+        {
+            struct epoll_event ev;
+
+            ev.events = EPOLLIN;
+            ev.data.u32 = id;
+            epoll_ctl(epoll_fd, EPOLL_CTL_ADD, e->fdread, &ev);
+        }
+#endif
+    }
+    mutex_unlock(&engines_mutex);
+    if( id == UCI_MAX_ENGINES )
+    {
+        uci_engine_close(e);
+        return NULL;
+    }
+    return e;
+}
+
+/*
+ * The engine should have been told to quit, after a short grace it is killed.
+ */
+void uci_engine_close(UCIengine *e)
+{
+    int i;
+
+    if( !e ) return;
+
+    mutex_lock(&engines_mutex);
+    if( engines[e->id] == e )
+    {
+        engines[e->id] = NULL;
+        while( nengines > 0 && !engines[nengines - 1] ) nengines--;
+    }
+    mutex_unlock(&engines_mutex);
+
+#if defined(_WIN32)
+    CloseHandle(e->hwrite);
+    if( WaitForSingleObject(e->process, 200) != WAIT_OBJECT_0 ) TerminateProcess(e->process, 0);
+    CloseHandle(e->process);
+    CloseHandle(e->hread);
+#else
+#if defined(__linux__)
+    if( epoll_fd >= 0 && !e->eof ) epoll_ctl(epoll_fd, EPOLL_CTL_DEL, e->fdread, NULL);
+#endif
+    close(e->fdwrite);
+    close(e->fdread);
+    for( i = 0; i < 20; i++ )
+    {
+        struct timespec ts = { 0, 10 * 1000 * 1000 };
+
+        if( waitpid(e->pid, NULL, WNOHANG) != 0 ) break;
+        nanosleep(&ts, NULL);
+    }
+    if( i == 20 )
+    {
+        kill(e->pid, SIGKILL);
+        waitpid(e->pid, NULL, 0);
+    }
+#endif
+    (void) i;
+    free(e->buf);
+    free(e->lines);
+    free(e->infos);
+    free(e);
+}
+
+int uci_engine_pid(UCIengine *e)
+{
+    return (int) e->pid;
+}
+
+// line without '\n'; false if the engine is gone
+bool uci_engine_put(UCIengine *e, char *line)
+{
+    char *p;
+    int len, n;
+    bool ok;
+
+    len = (int) strlen(line);
+    p = (char *) malloc(len + 1);
+    if( !p ) return false;
+    memcpy(p, line, len);
+    p[len++] = '\n';
+
+    ok = true;
+    n = 0;
+    while( n < len )
+    {
+#if defined(_WIN32)
+        DWORD written;
+
+        if( !WriteFile(e->hwrite, p + n, len - n, &written, NULL) )
+        {
+            ok = false;
+            break;
+        }
+        n += (int) written;
+#else
+        int w = (int) write(e->fdwrite, p + n, len - n);
+
+        if( w < 0 )
+        {
+            if( errno == EINTR ) continue;
+            ok = false;
+            break;
+        }
+        n += w;
+#endif
+    }
+    free(p);
+    return ok;
+}
+
+void uci_engine_set_raw(UCIengine *e, bool raw)
+{
+    mutex_lock(&engines_mutex);
+    e->raw = raw;
+    mutex_unlock(&engines_mutex);
+}
+
+// reads the pipe; bytes read, -1 once the engine has closed its output and everything was taken
+int uci_engine_read(UCIengine *e)
+{
+    int n;
+
+    mutex_lock(&engines_mutex);
+    n = read_engine(e);
+    if( n == 0 && e->eof && e->lineslen == 0 && e->ninfos == 0 ) n = -1;
+    mutex_unlock(&engines_mutex);
+    return n;
+}
+
+bool uci_engine_pending(UCIengine *e)
+{
+    bool pending;
+
+    mutex_lock(&engines_mutex);
+    pending = e->lineslen > 0 || e->ninfos > 0;
+    mutex_unlock(&engines_mutex);
+    return pending;
+}
+
+// moves whole lines (up to size bytes, at least one line if it fits) to dst; bytes copied
+int uci_engine_lines(UCIengine *e, char *dst, int size)
+{
+    int len;
+    char *nl;
+
+    mutex_lock(&engines_mutex);
+    len = e->lineslen;
+    if( len > size )
+    {
+        for( len = size; len > 0 && e->lines[len - 1] != '\n'; len-- );
+        if( len == 0 && (nl = memchr(e->lines, '\n', size)) == NULL ) len = size;
+    }
+    memcpy(dst, e->lines, len);
+    e->lineslen -= len;
+    if( e->lineslen ) memmove(e->lines, e->lines + len, e->lineslen);
+    mutex_unlock(&engines_mutex);
+    return len;
+}
+
+// moves up to max records to dst, in arrival order
+int uci_engine_infos(UCIengine *e, UCIinfo *dst, int max)
+{
+    int n;
+
+    mutex_lock(&engines_mutex);
+    n = e->ninfos < max ? e->ninfos : max;
+    memcpy(dst, e->infos, n * sizeof(UCIinfo));
+    e->ninfos -= n;
+    if( e->ninfos ) memmove(e->infos, e->infos + n, e->ninfos * sizeof(UCIinfo));
+    mutex_unlock(&engines_mutex);
+    return n;
+}
+
+void uci_engine_clear(UCIengine *e)
+{
+    mutex_lock(&engines_mutex);
+    read_engine(e);
+    e->lineslen = 0;
+    e->ninfos = 0;
+    mutex_unlock(&engines_mutex);
+}
+
+/*
+ * Waits up to ms milliseconds until an engine sends something, and reads every engine with data.
+ * Number of engines read.
+ */
+int uci_engines_wait(int ms)
+{
+    int i, n;
+
+    init_engines();
+    n = 0;
+#if defined(__linux__)
+    if( epoll_fd >= 0 )
+    {
+        struct epoll_event ev[UCI_MAX_ENGINES];
+        int nev;
+
+        nev = epoll_wait(epoll_fd, ev, UCI_MAX_ENGINES, ms);
+        mutex_lock(&engines_mutex);
+        for( i = 0; i < nev; i++ )
+        {
+            UCIengine *e = engines[ev[i].data.u32];
+
+            if( e && read_engine(e) ) n++;
+        }
+        mutex_unlock(&engines_mutex);
+        return n;
+    }
+#endif
+#if defined(_WIN32)
+    {
+        DWORD start = GetTickCount();
+
+        while( 1 )
+        {
+            mutex_lock(&engines_mutex);
+            for( i = 0; i < nengines; i++ )
+            {
+                if( engines[i] && !engines[i]->eof && read_engine(engines[i]) ) n++;
+            }
+            mutex_unlock(&engines_mutex);
+            if( n || (int) (GetTickCount() - start) >= ms ) break;
+            Sleep(1);
+        }
+    }
+#else
+    {
+        struct pollfd fds[UCI_MAX_ENGINES];
+        int ids[UCI_MAX_ENGINES];
+        int nfds;
+
+        mutex_lock(&engines_mutex);
+        nfds = 0;
+        for( i = 0; i < nengines; i++ )
+        {
+            if( engines[i] && !engines[i]->eof )
+            {
+                fds[nfds].fd = engines[i]->fdread;
+                fds[nfds].events = POLLIN;
+                ids[nfds++] = i;
+            }
+        }
+        mutex_unlock(&engines_mutex);
+
+        if( poll(fds, nfds, ms) > 0 )
+        {
+            mutex_lock(&engines_mutex);
+            for( i = 0; i < nfds; i++ )
+            {
+                if( fds[i].revents && engines[ids[i]] && read_engine(engines[ids[i]]) ) n++;
+            }
+            mutex_unlock(&engines_mutex);
+        }
+    }
+#endif
+    return n;
+}
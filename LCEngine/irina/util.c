@@ -109,3 +109,14 @@ bool bioskey() {
     return _kbhit();
 }
 #endif
+
+/*
+ * Renames from to to, replacing to if it exists. The old file stays until the new one takes its place.
+ */
+bool replace_file(char *from, char *to) {
+#ifdef _WIN32
+    return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return rename(from, to) == 0;
+#endif
+}
@@ -8,7 +8,7 @@ set INCLUDE=%VCINSTALLDIR%\Include;%WindowsSdkDir%\Include;%INCLUDE%
 set LIB=%VCINSTALLDIR%\Lib;%WindowsSdkDir%\Lib;%LIB%
 set LIBPATH=%VCINSTALLDIR%\Lib;%WindowsSdkDir%\Lib;%LIBPATH%
 
-cl /c /nologo /Ox /MD /GS- /DNDEBUG lc.c board.c data.c eval.c hash.c loop.c makemove.c movegen.c movegen_piece_to.c search.c test.c util.c pgn.c
-lib /OUT:..\irina.lib lc.obj board.obj data.obj eval.obj hash.obj loop.obj makemove.obj movegen.obj movegen_piece_to.obj search.obj test.obj util.obj pgn.obj
+cl /c /nologo /Ox /MD /GS- /DNDEBUG /DIRINA_NO_TLS lc.c board.c data.c eval.c hash.c loop.c makemove.c movegen.c movegen_piece_to.c search.c test.c util.c pgn.c pgnscan.c pgnbatch.c stats.c polyglot.c uciengine.c ancache.c xpv.c posindex.c gamequery.c pgnimport.c ctx.c
+lib /OUT:..\irina.lib lc.obj board.obj data.obj eval.obj hash.obj loop.obj makemove.obj movegen.obj movegen_piece_to.obj search.obj test.obj util.obj pgn.obj pgnscan.obj pgnbatch.obj stats.obj polyglot.obj uciengine.obj ancache.obj xpv.obj posindex.obj gamequery.obj pgnimport.obj ctx.obj
 del *.obj
 
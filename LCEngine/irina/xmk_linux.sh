@@ -1,6 +1,6 @@
 #!/usr/bin/env bash
-gcc -Wall -fPIC -O3 -c lc.c board.c data.c eval.c hash.c loop.c makemove.c movegen.c movegen_piece_to.c search.c test.c util.c pgn.c -DNDEBUG
-gcc -shared -o ../libirina.so lc.o board.o data.o eval.o hash.o loop.o makemove.o movegen.o movegen_piece_to.o search.o test.o util.o pgn.o
+gcc -Wall -fPIC -O3 -pthread -c lc.c board.c data.c eval.c hash.c loop.c makemove.c movegen.c movegen_piece_to.c search.c test.c util.c pgn.c pgnscan.c pgnbatch.c stats.c polyglot.c uciengine.c ancache.c xpv.c posindex.c gamequery.c pgnimport.c ctx.c -DNDEBUG
+gcc -shared -pthread -o ../libirina.so lc.o board.o data.o eval.o hash.o loop.o makemove.o movegen.o movegen_piece_to.o search.o test.o util.o pgn.o pgnscan.o pgnbatch.o stats.o polyglot.o uciengine.o ancache.o xpv.o posindex.o gamequery.o pgnimport.o ctx.o
 rm *.o
 
 #i686-linux-gnu-gcc -pthread -shared -Wl,-O1 -Wl,-Bsymbolic-functions -Wl,-Bsymbolic-functions -Wl,-z,relro -fno-strict-aliasing -DNDEBUG -g -fwrapv -O2 -Wall -Wstrict-prototypes -Wdate-time -D_FORTIFY_SOURCE=2 -g -fstack-protector-strong -Wformat -Werror=format-security -Wl,-Bsymbolic-functions -Wl,-z,relro -Wdate-time -D_FORTIFY_SOURCE=2 -g -fstack-protector-strong -Wformat -Werror=format-security  -o /home/xqt2/pyDBgames/LCEngine/libirina.so
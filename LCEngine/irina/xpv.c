@@ -0,0 +1,322 @@
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "defs.h"
+#include "protos.h"
+#include "globals.h"
+
+/*
+ * Encodings of a line of moves (pv "e2e4 e7e5 g1f3").
+ *
+ * xpv: 2 chars per move, from and to squares + 58, and a third one for the promotion (q=50 r=51 b=52 n=53).
+ *      The format of the XPV columns of the opening lines and of the game databases created before mvx,
+ *      the same as pgn.c writes.
+ *
+ * mvx: each move is its index in the legal moves of the position, ordered by from, to and promotion,
+ *      so it doesn't depend on the order of movegen. Indexes 0-63 take 1 char, the rest 2 chars
+ *      (a prefix char with the 64s and the rest). All the chars are printable and none is special
+ *      in GLOB/LIKE, a line that begins with another has an mvx that begins with its mvx.
+ *      The format of the XPV column of the new game databases (DBgames), about 1 char per move.
+ *      Decoding has to replay the moves, encoding and decoding use the board of the thread.
+ */
+
+static const char MVX_DIGITS[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz+/";
+static const char MVX_PREFIX[] = "!#$%";
+
+static char xpv_promotion(char promotion)
+{
+    switch( tolower(promotion) )
+    {
+    case 'q': return 50;
+    case 'r': return 51;
+    case 'b': return 52;
+    case 'n': return 53;
+    default:  return 0;
+    }
+}
+
+/*
+ * xpv of pv, at most size-1 chars. Returns the length.
+ */
+int pv_to_xpv(char *pv, char *xpv, int size)
+{
+    char *c = pv, *x = xpv, prom;
+
+    while( 1 )
+    {
+        while( *c == ' ' ) c++;
+        if( !c[0] || !c[1] || !c[2] || !c[3] || x - xpv + 4 > size ) break;
+        *x++ = (char) (ah_pos(c) + 58);
+        *x++ = (char) (ah_pos(c + 2) + 58);
+        c += 4;
+        if( *c && *c != ' ' )
+        {
+            prom = xpv_promotion(*c++);
+            if( prom ) *x++ = prom;
+        }
+        while( *c && *c != ' ' ) c++;
+    }
+    *x = 0;
+    return (int) (x - xpv);
+}
+
+/*
+ * pv of xpv, at most size-1 chars. Returns the number of moves.
+ */
+int xpv_to_pv(char *xpv, char *pv, int size)
+{
+    unsigned char *c = (unsigned char *) xpv;
+    char *p = pv;
+    int num = 0, pos;
+
+    while( *c )
+    {
+        if( *c < 58 )
+        {
+            // promotion of the last move
+            if( num && *c >= 50 && *c <= 53 && p - pv + 2 <= size ) *p++ = "qrbn"[*c - 50];
+            c++;
+            continue;
+        }
+        if( !c[1] || c[1] < 58 || p - pv + 7 > size ) break;
+        if( num++ ) *p++ = ' ';
+        pos = c[0] - 58;
+        *p++ = (char) ('a' + pos % 8);
+        *p++ = (char) ('1' + pos / 8);
+        pos = c[1] - 58;
+        *p++ = (char) ('a' + pos % 8);
+        *p++ = (char) ('1' + pos / 8);
+        c += 2;
+    }
+    *p = 0;
+    return num;
+}
+
+/*
+ * Plays on the board the next move of *xpv and advances it, the move played in *move.
+ * False at the end of xpv or with a move that is not legal.
+ */
+bool xpv_make_move(char **xpv, Move *move)
+{
+    unsigned char *c = (unsigned char *) *xpv;
+    int from, to, n, k;
+    char promotion = 0;
+
+    while( *c && *c < 58 ) c++;
+    if( !c[0] || !c[1] || c[1] < 58 ) return false;
+    from = c[0] - 58;
+    to = c[1] - 58;
+    c += 2;
+    if( *c >= 50 && *c <= 53 ) promotion = "qrbn"[*c++ - 50];
+    *xpv = (char *) c;
+
+    // one ply stored, games can be longer than the game line of the board
+    board_reset();
+    if( !board.pz[from] ) return false;
+    n = movegen_piece_to((int) board.pz[from], (unsigned) to);
+    for( k = 0; k < n; k++ )
+    {
+        *move = board.moves[k];
+        if( move->from != from || move->to != to ) continue;
+        if( move->promotion && tolower(NAMEPZ[move->promotion]) != promotion ) continue;
+        make_move(*move);
+        return true;
+    }
+    return false;
+}
+
+static unsigned mvx_key(Move move)
+{
+    unsigned prom = 0;
+
+    if( move.promotion )
+    {
+        switch( tolower(NAMEPZ[move.promotion]) )
+        {
+        case 'n': prom = 1; break;
+        case 'b': prom = 2; break;
+        case 'r': prom = 3; break;
+        default:  prom = 4;
+        }
+    }
+    return move.from | move.to << 6 | prom << 12;
+}
+
+// legal moves of the board after fen (NULL initial position) or after the last move
+static void mvx_start(char *fen)
+{
+    if( fen && *fen ) fen_board(fen);
+    else init_board();
+}
+
+static int mvx_movegen(void)
+{
+    // one ply stored, lines can be longer than the game line of the board
+    board_reset();
+    return movegen();
+}
+
+/*
+ * mvx of pv played from fen (NULL initial position), at most size-1 chars.
+ * Returns the number of moves encoded, less than the moves of pv if one is not legal.
+ */
+int mvx_encode(char *fen, char *pv, char *mvx, int size)
+{
+    char *c = pv, *x = mvx;
+    int num = 0, k, found, idx, n;
+    unsigned key;
+
+    mvx_start(fen);
+    while( x - mvx + 3 <= size )
+    {
+        n = mvx_movegen();
+        found = pv_nummove(&c);
+        if( found < 0 ) break;
+
+        // index = moves with a lower key
+        key = mvx_key(board.moves[found]);
+        idx = 0;
+        for( k = 0; k < n; k++ )
+        {
+            if( mvx_key(board.moves[k]) < key ) idx++;
+        }
+        if( idx >= 64 ) *x++ = MVX_PREFIX[idx / 64 - 1];
+        *x++ = MVX_DIGITS[idx % 64];
+        make_move(board.moves[found]);
+        num++;
+    }
+    *x = 0;
+    return num;
+}
+
+/*
+ * Reads the next index of *mvx, *mvx is left after it, and generates the legal moves of the board.
+ * Returns the index in board.moves of the move, -1 at the end of mvx or with an index out of range.
+ */
+static int mvx_nummove(char **mvx)
+{
+    char *c = *mvx, *d;
+    int idx = 0, n, k, j;
+    unsigned keys[256], key;
+
+    d = *c ? strchr(MVX_PREFIX, *c) : NULL;
+    if( d )
+    {
+        idx = 64 * (int) (d - MVX_PREFIX + 1);
+        c++;
+    }
+    d = *c ? strchr(MVX_DIGITS, *c) : NULL;
+    if( !d ) return -1;
+    idx += (int) (d - MVX_DIGITS);
+    *mvx = c + 1;
+
+    n = mvx_movegen();
+    if( idx >= n || n > 256 ) return -1;
+
+    // the idx-th key, insertion sort of the few keys of a position
+    for( k = 0; k < n; k++ )
+    {
+        key = mvx_key(board.moves[k]);
+        for( j = k; j > 0 && keys[j - 1] > key; j-- ) keys[j] = keys[j - 1];
+        keys[j] = key;
+    }
+    for( k = 0; k < n && mvx_key(board.moves[k]) != keys[idx]; k++ );
+    return k;
+}
+
+/*
+ * pv of mvx played from fen (NULL initial position), at most size-1 chars.
+ * Returns the number of moves decoded, it stops at the first index out of range.
+ */
+int mvx_decode(char *fen, char *mvx, char *pv, int size)
+{
+    char *c = mvx, *p = pv;
+    int num = 0, k;
+    Move move;
+
+    mvx_start(fen);
+    while( *c && p - pv + 7 <= size )
+    {
+        k = mvx_nummove(&c);
+        if( k < 0 ) break;
+        move = board.moves[k];
+
+        if( num++ ) *p++ = ' ';
+        strcpy(p, POS_AH[move.from]);
+        strcpy(p + 2, POS_AH[move.to]);
+        p += 4;
+        if( move.promotion ) *p++ = (char) tolower(NAMEPZ[move.promotion]);
+        make_move(move);
+    }
+    *p = 0;
+    return num;
+}
+
+/*
+ * Plays on the board the next move of *mvx and advances it, the move played in *move, as xpv_make_move.
+ * False at the end of mvx or with an index out of range.
+ */
+bool mvx_make_move(char **mvx, Move *move)
+{
+    int k = mvx_nummove(mvx);
+
+    if( k < 0 ) return false;
+    *move = board.moves[k];
+    make_move(*move);
+    return true;
+}
+
+/*
+ * Bulk form for whole tables of games, src[i] coded with codec (CODEC_*) into dst[i], that has room
+ * for sizes[i] chars. The mvx codecs play the games from the initial position on their own context,
+ * so the function can run in any thread. Returns the number of lines coded.
+ */
+int pv_codec_list(int codec, char **src, char **dst, int *sizes, int num)
+{
+    LCContext *ctx = NULL;
+    char *pv = NULL;
+    int i, size = 0, len;
+
+    if( codec >= CODEC_PV_MVX )
+    {
+        ctx = lc_ctx_new();
+        if( !ctx ) return 0;
+    }
+    for( i = 0; i < num; i++ )
+    {
+        // the conversions between xpv and mvx go through the pv
+        if( codec == CODEC_XPV_MVX || codec == CODEC_MVX_XPV )
+        {
+            len = (int) strlen(src[i]) * 6 + 1;
+            if( len > size )
+            {
+                free(pv);
+                size = len;
+                pv = (char *) malloc(size);
+                if( !pv ) break;
+            }
+        }
+        switch( codec )
+        {
+        case CODEC_PV_XPV: pv_to_xpv(src[i], dst[i], sizes[i]); break;
+        case CODEC_XPV_PV: xpv_to_pv(src[i], dst[i], sizes[i]); break;
+        case CODEC_PV_MVX: lc_mvx_encode(ctx, NULL, src[i], dst[i], sizes[i]); break;
+        case CODEC_MVX_PV: lc_mvx_decode(ctx, NULL, src[i], dst[i], sizes[i]); break;
+        case CODEC_XPV_MVX:
+            xpv_to_pv(src[i], pv, size);
+            lc_mvx_encode(ctx, NULL, pv, dst[i], sizes[i]);
+            break;
+        case CODEC_MVX_XPV:
+            lc_mvx_decode(ctx, NULL, src[i], pv, size);
+            pv_to_xpv(pv, dst[i], sizes[i]);
+            break;
+        default:
+            lc_ctx_free(ctx);
+            return i;
+        }
+    }
+    free(pv);
+    lc_ctx_free(ctx);
+    return i;
+}